@@ -27,12 +27,41 @@
  */
 
 #include "gdev_api.h"
+#include "gdev_copy.h"
 #include "gdev_device.h"
+#include "gdev_iotune.h"
 #include "gdev_sched.h"
+#include "gdev_slice.h"
+#include "gdev_zswap.h"
+
+#ifndef __KERNEL__
+#include <pthread.h>
+#endif
 
 #define gdev_max(x, y) (x) > (y) ? (x) : (y)
 #define gdev_min(x, y) (x) < (y) ? (x) : (y)
 
+#define GDEV_ACCESS_SET_COUNT 8 /* ranges declared per launch */
+
+/**
+ * ranges of device memory declared to be accessed by the next launch.
+ */
+struct gdev_access_set {
+	uint64_t addr[GDEV_ACCESS_SET_COUNT];
+	uint64_t size[GDEV_ACCESS_SET_COUNT];
+	int count; /* # of the ranges, -1 if undeclared, more if overflowed. */
+};
+
+/**
+ * ranges declared for a launch, taken from the handle when launched so that
+ * other threads can declare theirs for the next one.
+ */
+struct gdev_launch_sets {
+	struct gdev_handle *h;
+	struct gdev_access_set write_set;
+	struct gdev_access_set use_set;
+};
+
 /**
  * Gdev handle struct: not visible to outside.
  */
@@ -41,9 +70,18 @@ struct gdev_handle {
 	struct gdev_sched_entity *se; /* scheduling entity. */
 	gdev_vas_t *vas; /* virtual address space object. */
 	gdev_ctx_t *ctx; /* device context object. */
-	gdev_mem_t **dma_mem; /* host-side DMA memory object (bounce buffer). */
+	gdev_mem_t **dma_mem[GDEV_MEMCPY_BOUNCE_COUNT]; /* host-side DMA memory objects (bounce buffers), a set per copying thread. */
+	unsigned long dma_busy; /* bitmap of the sets of bounce buffers in use. */
+	gdev_mem_t **swap_dma; /* host-side DMA memory objects (bounce buffers) for swap. */
+	gdev_mutex_t swap_mutex; /* serializes swap_dma. */
+	gdev_mutex_t sched_mutex; /* serializes the threads waiting for the scheduler. */
 	uint32_t chunk_size; /* configurable memcpy chunk size. */
 	int pipeline_count; /* configurable memcpy pipeline count. */
+	uint32_t slice_size; /* CTAs per slice of launches, 0 if not sliced. */
+	struct gdev_access_set write_set; /* ranges the next launch writes. */
+	struct gdev_access_set use_set; /* ranges the next launch accesses. */
+	gdev_lock_t lock; /* protects the tunables and the access sets. */
+	struct gdev_list list_entry_pool; /* entry to the context pool. */
 	int dev_id; /* device ID. */
 };
 
@@ -79,6 +117,151 @@ static void __free_dma(gdev_mem_t **dma_mem, int p_count)
 	FREE(dma_mem);
 }
 
+/**
+ * get a set of bounce buffers of @h for a copy of @size bytes, so that 
+ * threads sharing @h copy data at the same time. @ch_size and @p_count are
+ * given the chunk size and the pipeline count of the set. if all the sets
+ * are busy, temporary bounce buffers are allocated instead. this must be
+ * called before the memory object is locked, since the allocation locks 
+ * the shared memory list of the device.
+ */
+static gdev_mem_t **__get_dma(struct gdev_handle *h, uint64_t size, int *slot, uint32_t *ch_size, int *p_count)
+{
+	unsigned long bit;
+	int i;
+
+	for (i = 0; i < GDEV_MEMCPY_BOUNCE_COUNT; i++) {
+		bit = 1UL << i;
+		if (__sync_fetch_and_or(&h->dma_busy, bit) & bit)
+			continue;
+		/* gtune() changes them only while holding all the sets. */
+		*ch_size = h->chunk_size;
+		*p_count = h->pipeline_count;
+		if (!h->dma_mem[i])
+			h->dma_mem[i] = __malloc_dma(h->vas, *ch_size, *p_count);
+		if (h->dma_mem[i]) {
+			*slot = i;
+			return h->dma_mem[i];
+		}
+		__sync_fetch_and_and(&h->dma_busy, ~bit);
+		break;
+	}
+
+	gdev_lock(&h->lock);
+	*ch_size = h->chunk_size;
+	*p_count = h->pipeline_count;
+	gdev_unlock(&h->lock);
+
+	*slot = -1;
+	return __malloc_dma(h->vas, gdev_min(size, *ch_size), *p_count);
+}
+
+/**
+ * put the set of bounce buffers got by __get_dma(). this must be called
+ * after the memory object is unlocked.
+ */
+static void __put_dma(struct gdev_handle *h, gdev_mem_t **dma_mem, int slot, int p_count)
+{
+	if (slot < 0)
+		__free_dma(dma_mem, p_count);
+	else
+		__sync_fetch_and_and(&h->dma_busy, ~(1UL << slot));
+}
+
+/**
+ * allocate the bounce buffers of @h for swap, which hold a swap page at 
+ * least so that the compressed host swap can use them.
+ */
+static gdev_mem_t **__malloc_swap_dma(gdev_vas_t *vas, uint32_t ch_size, int p_count)
+{
+	return __malloc_dma(vas, gdev_max(ch_size, GDEV_SWAP_PAGE_SIZE), p_count);
+}
+
+/**
+ * get the bounce buffers of @h for swap. the swap callbacks are called with
+ * the shared memory locked, so they must not allocate bounce buffers but 
+ * wait for the static ones. NULL is returned if they failed to allocate.
+ */
+static gdev_mem_t **__get_swap_dma(struct gdev_handle *h, uint32_t *ch_size, int *p_count)
+{
+	gdev_mutex_lock(&h->swap_mutex);
+	*ch_size = h->chunk_size;
+	*p_count = h->pipeline_count;
+
+	return h->swap_dma;
+}
+
+static void __put_swap_dma(struct gdev_handle *h)
+{
+	gdev_mutex_unlock(&h->swap_mutex);
+}
+
+/**
+ * free all the sets of bounce buffers of @h. they must not be in use.
+ */
+static void __free_dma_all(struct gdev_handle *h)
+{
+	int i;
+
+	for (i = 0; i < GDEV_MEMCPY_BOUNCE_COUNT; i++) {
+		if (h->dma_mem[i]) {
+			__free_dma(h->dma_mem[i], h->pipeline_count);
+			h->dma_mem[i] = NULL;
+		}
+	}
+}
+
+#ifndef GDEV_SCHED_DISABLED
+/**
+ * the threads sharing @h schedule its entity in turn, since it waits in a
+ * queue as one. the entity is given to the thread, so that the wakeup goes
+ * to the task that sleeps. the entity is left running with the others,
+ * e.g., the memcpy instances of other threads.
+ */
+static void __schedule_compute(struct gdev_handle *h, void (*wait)(void *), void *arg)
+{
+	gdev_mutex_lock(&h->sched_mutex);
+	h->se->task = gdev_sched_get_current_task();
+	gdev_schedule_compute_wait(h->se, wait, arg);
+	gdev_mutex_unlock(&h->sched_mutex);
+}
+
+static void __schedule_memory(struct gdev_handle *h)
+{
+	gdev_mutex_lock(&h->sched_mutex);
+	h->se->task = gdev_sched_get_current_task();
+	gdev_schedule_memory(h->se);
+	gdev_mutex_unlock(&h->sched_mutex);
+}
+
+/* the copy engine is let go while @h is throttled, and taken again. */
+static void __throttle_release(void *arg)
+{
+	struct gdev_handle *h = (struct gdev_handle *)arg;
+
+	gdev_select_next_memory(h->gdev);
+}
+
+static void __throttle_acquire(void *arg)
+{
+	__schedule_memory((struct gdev_handle *)arg);
+}
+#endif
+
+/**
+ * throttle a memcpy chunk of @size bytes on the virtual device of @h, which
+ * holds the copy engine. the engine is given to others while @h waits, so
+ * that a throttled virtual device does not keep it idle. @h is NULL if the
+ * runtime copies data by itself, e.g., for swap.
+ */
+static void __throttle_memcpy(struct gdev_handle *h, uint64_t size)
+{
+#ifndef GDEV_SCHED_DISABLED
+	if (h)
+		gdev_throttle_memory_wait(h->gdev, size, __throttle_release, __throttle_acquire, h);
+#endif
+}
+
 /**
  * a wrapper of memcpy().
  */
@@ -109,10 +292,107 @@ static int __f_ctu(void *dst, const void *src, uint32_t size)
 }
 
 /**
- * copy host buffer to device memory with pipelining.
- * @host_copy is either memcpy() or copy_from_user().
+ * a host buffer, and host_copy() which is either memcpy(), or
+ * copy_from_user() or copy_to_user(). the memcpy pipelines move the data
+ * between the bounce buffers and the host by copy(@arg, @offset, @buf,
+ * @size), where @offset is that of the chunk in the whole copy, @buf is the
+ * bounce buffer, and @arg is either this or struct gdev_zswap_range.
+ */
+struct gdev_host_buf {
+	void *buf;
+	int (*host_copy)(void*, const void*, uint32_t);
+};
+
+/* copy @size bytes at @src into the host buffer @arg at @offset. */
+static int __host_copy_to(void *arg, uint64_t offset, void *src, uint32_t size)
+{
+	struct gdev_host_buf *b = arg;
+
+	/* split large copies across cores. */
+	if (b->host_copy == __f_memcpy) {
+		gdev_copy(b->buf + offset, src, size, 0);
+		return 0;
+	}
+
+	return b->host_copy(b->buf + offset, src, size);
+}
+
+/* copy @size bytes of the host buffer @arg at @offset into @dst. */
+static int __host_copy_from(void *arg, uint64_t offset, void *dst, uint32_t size)
+{
+	struct gdev_host_buf *b = arg;
+
+	/* split large copies across cores. @dst is a bounce buffer which the 
+	   host does not read back, so it is written around the caches. */
+	if (b->host_copy == __f_memcpy) {
+		gdev_copy(dst, b->buf + offset, size, GDEV_COPY_NT);
+		return 0;
+	}
+
+	return b->host_copy(dst, b->buf + offset, size);
+}
+
+/* a range of the compressed host swap. the pages are compressed and 
+   decompressed in the bounce buffers while the next chunks are copied. */
+struct gdev_zswap_range {
+	struct gdev_zswap *z;
+	uint64_t offset;
+};
+
+/* store @size bytes at @src into the swap range @arg at @offset. */
+static int __zswap_copy_to(void *arg, uint64_t offset, void *src, uint32_t size)
+{
+	struct gdev_zswap_range *r = arg;
+
+	return gdev_zswap_store(r->z, r->offset + offset, src, size);
+}
+
+/* fetch @size bytes of the swap range @arg at @offset into @dst. */
+static int __zswap_copy_from(void *arg, uint64_t offset, void *dst, uint32_t size)
+{
+	struct gdev_zswap_range *r = arg;
+
+	return gdev_zswap_fetch(r->z, r->offset + offset, dst, size);
+}
+
+/* the device whose direct I/O limits apply to @mem. */
+static struct gdev_device *__iotune_device(gdev_mem_t *mem)
+{
+	struct gdev_device *gdev = mem->vas->gdev;
+	struct gdev_device *phys = gdev_phys_get(gdev);
+
+	return phys ? phys : gdev;
+}
+
+/* return true if @size bytes should be copied by direct I/O. */
+static int __iotune_direct(struct gdev_device *gdev, struct gdev_iotune *t, uint64_t size, int *timed)
+{
+	int direct;
+
+	gdev_lock(&gdev->global_lock);
+	direct = gdev_iotune_direct(t, size, timed);
+	gdev_unlock(&gdev->global_lock);
+
+	return direct;
+}
+
+/* account the copy of @size bytes started at @start. */
+static void __iotune_update(struct gdev_device *gdev, struct gdev_iotune *t, int direct, uint64_t size, struct gdev_time *start)
+{
+	struct gdev_time now, elapse;
+
+	gdev_time_stamp(&now);
+	gdev_time_sub(&elapse, &now, start);
+	gdev_lock(&gdev->global_lock);
+	gdev_iotune_update(t, direct, size, gdev_time_to_ns(&elapse));
+	gdev_unlock(&gdev->global_lock);
+}
+
+/**
+ * copy host data to device memory with pipelining. copy(@arg, ...) reads
+ * the host data into the bounce buffers.
  */
-static int __gmemcpy_to_device_p(gdev_ctx_t *ctx, uint64_t dst_addr, const void *src_buf, uint64_t size, uint32_t ch_size, int p_count, gdev_mem_t **bmem, int (*host_copy)(void*, const void*, uint32_t))
+static int __gmemcpy_to_device_p(struct gdev_handle *h, gdev_ctx_t *ctx, uint64_t dst_addr, uint64_t size, uint32_t ch_size, int p_count, gdev_mem_t **bmem, int (*copy)(void*, uint64_t, void*, uint32_t), void *arg)
 {
 	uint64_t rest_size = size;
 	uint64_t offset;
@@ -133,10 +413,12 @@ static int __gmemcpy_to_device_p(gdev_ctx_t *ctx, uint64_t dst_addr, const void
 	for (;;) {
 		for (i = 0; i < p_count; i++) {
 			dma_size = gdev_min(rest_size, ch_size);
+			/* throttle while the previous chunks are in flight. */
+			__throttle_memcpy(h, dma_size);
 			/* HtoH */
 			if (fence[i])
 				gdev_poll(ctx, fence[i], NULL);
-			ret = host_copy(dma_buf[i], src_buf+offset, dma_size);
+			ret = copy(arg, offset, dma_buf[i], dma_size);
 			if (ret)
 				goto end;
 			/* HtoD */
@@ -156,10 +438,10 @@ end:
 }
 
 /**
- * copy host buffer to device memory without pipelining.
- * @host_copy is either memcpy() or copy_from_user().
+ * copy host data to device memory without pipelining. copy(@arg, ...)
+ * reads the host data into the bounce buffer.
  */
-static int __gmemcpy_to_device_np(gdev_ctx_t *ctx, uint64_t dst_addr, const void *src_buf, uint64_t size, uint32_t ch_size, gdev_mem_t **bmem, int (*host_copy)(void*, const void*, uint32_t))
+static int __gmemcpy_to_device_np(struct gdev_handle *h, gdev_ctx_t *ctx, uint64_t dst_addr, uint64_t size, uint32_t ch_size, gdev_mem_t **bmem, int (*copy)(void*, uint64_t, void*, uint32_t), void *arg)
 {
 	uint64_t rest_size = size;
 	uint64_t offset;
@@ -176,7 +458,8 @@ static int __gmemcpy_to_device_np(gdev_ctx_t *ctx, uint64_t dst_addr, const void
 	offset = 0;
 	while (rest_size) {
 		dma_size = gdev_min(rest_size, ch_size);
-		ret = host_copy(dma_buf[0], src_buf + offset, dma_size);
+		__throttle_memcpy(h, dma_size);
+		ret = copy(arg, offset, dma_buf[0], dma_size);
 		if (ret)
 			goto end;
 		fence = gdev_memcpy(ctx, dst_addr + offset, dma_addr[0], dma_size);
@@ -192,10 +475,12 @@ end:
 /**
  * copy host DMA buffer to device memory.
  */
-static int __gmemcpy_dma_to_device(gdev_ctx_t *ctx, uint64_t dst_addr, uint64_t src_addr, uint64_t size, uint32_t *id)
+static int __gmemcpy_dma_to_device(struct gdev_handle *h, gdev_ctx_t *ctx, uint64_t dst_addr, uint64_t src_addr, uint64_t size, uint32_t *id)
 {
 	uint32_t fence;
 
+	__throttle_memcpy(h, size);
+
 	/* we don't break data into chunks if copying directly from dma memory. 
 	   if @id == NULL, it means memcpy is synchronous. */
 	if (!id) {
@@ -213,12 +498,21 @@ static int __gmemcpy_dma_to_device(gdev_ctx_t *ctx, uint64_t dst_addr, uint64_t
 /**
  * a wrapper function of __gmemcpy_to_device().
  */
-static int __gmemcpy_to_device_locked(gdev_ctx_t *ctx, uint64_t dst_addr, const void *src_buf, uint64_t size, uint32_t *id, uint32_t ch_size, int p_count, gdev_vas_t *vas, gdev_mem_t *mem, gdev_mem_t **dma_mem, int (*host_copy)(void*, const void*, uint32_t))
+static int __gmemcpy_to_device_locked(struct gdev_handle *h, gdev_ctx_t *ctx, uint64_t dst_addr, const void *src_buf, uint64_t size, uint32_t *id, uint32_t ch_size, int p_count, gdev_vas_t *vas, gdev_mem_t *mem, gdev_mem_t **dma_mem, int (*host_copy)(void*, const void*, uint32_t))
 {
+	struct gdev_host_buf b = {(void *)src_buf, host_copy};
 	gdev_mem_t *hmem;
 	gdev_mem_t **bmem;
+	struct gdev_device *phys = __iotune_device(mem);
+	struct gdev_time start;
+	int direct = 0, timed = 0;
 	int ret;
 
+	if (mem->map)
+		direct = __iotune_direct(phys, &phys->iowrite, size, &timed);
+	if (timed)
+		gdev_time_stamp(&start);
+
 	if (size <= 4 && mem->map) {
 		gdev_write32(mem, dst_addr, ((uint32_t*)src_buf)[0]);
 		ret = 0;
@@ -226,14 +520,16 @@ static int __gmemcpy_to_device_locked(gdev_ctx_t *ctx, uint64_t dst_addr, const
 		if (id)
 			*id = 0;
 	}
-	else if (size <= GDEV_MEMCPY_IOWRITE_LIMIT && mem->map) {
+	else if (direct) {
 		ret = gdev_write(mem, dst_addr, src_buf, size);
 		/* if @id is give while not asynchronous, give it zero. */
 		if (id)
 			*id = 0;
 	}
 	else if ((hmem = gdev_mem_lookup_by_buf(vas, src_buf, GDEV_MEM_DMA))) {
-		ret = __gmemcpy_dma_to_device(ctx, dst_addr, hmem->addr, size, id);
+		/* asynchronous, or no host copy to compare. */
+		timed = 0;
+		ret = __gmemcpy_dma_to_device(h, ctx, dst_addr, hmem->addr, size, id);
 	}
 	else {
 		/* prepare bounce buffer memory. */
@@ -247,9 +543,9 @@ static int __gmemcpy_to_device_locked(gdev_ctx_t *ctx, uint64_t dst_addr, const
 
 		/* copy memory to device. */
 		if (p_count > 1 && size > ch_size)
-			ret = __gmemcpy_to_device_p(ctx, dst_addr, src_buf, size, ch_size, p_count, bmem, host_copy);
+			ret = __gmemcpy_to_device_p(h, ctx, dst_addr, size, ch_size, p_count, bmem, __host_copy_from, &b);
 		else
-			ret = __gmemcpy_to_device_np(ctx, dst_addr, src_buf, size, ch_size, bmem, host_copy);
+			ret = __gmemcpy_to_device_np(h, ctx, dst_addr, size, ch_size, bmem, __host_copy_from, &b);
 
 		/* free bounce buffer memory, if necessary. */
 		if (!dma_mem)
@@ -260,6 +556,9 @@ static int __gmemcpy_to_device_locked(gdev_ctx_t *ctx, uint64_t dst_addr, const
 			*id = 0;
 	}
 
+	if (timed && !ret)
+		__iotune_update(phys, &phys->iowrite, direct, size, &start);
+
 	return ret;
 }
 
@@ -269,33 +568,42 @@ static int __gmemcpy_to_device_locked(gdev_ctx_t *ctx, uint64_t dst_addr, const
 static int __gmemcpy_to_device(struct gdev_handle *h, uint64_t dst_addr, const void *src_buf, uint64_t size, uint32_t *id, int (*host_copy)(void*, const void*, uint32_t))
 {
 #ifndef GDEV_SCHED_DISABLED
-	struct gdev_sched_entity *se = h->se;
 	struct gdev_device *gdev = h->gdev;
 #endif
 	gdev_vas_t *vas = h->vas;
 	gdev_ctx_t *ctx = h->ctx;
-	gdev_mem_t **dma_mem = h->dma_mem;
+	gdev_mem_t **dma_mem;
 	gdev_mem_t *mem;
-	uint32_t ch_size = h->chunk_size;
-	int p_count = h->pipeline_count;
+	uint32_t ch_size;
+	int p_count;
+	int slot;
 	int ret;
 
 	mem = gdev_mem_lookup_by_addr(vas, dst_addr, GDEV_MEM_DEVICE);
 	if (!mem)
 		return -ENOENT;
 
+	/* taken before the copy engine, which would be left reserved if the 
+	   bounce buffers failed to be allocated. */
+	dma_mem = __get_dma(h, size, &slot, &ch_size, &p_count);
+	if (!dma_mem)
+		return -ENOMEM;
+
 #ifndef GDEV_SCHED_DISABLED
 	/* decide if the context needs to stall or not. */
-	gdev_schedule_memory(se);
+	__schedule_memory(h);
 #endif
 
 	gdev_mem_lock(mem);
 
-	gdev_shm_evict_conflict(ctx, mem); /* evict conflicting data. */
-	ret = __gmemcpy_to_device_locked(ctx, dst_addr, src_buf, size, id, ch_size, p_count, vas, mem, dma_mem, host_copy);
+	gdev_shm_index_touch(mem); /* the least recently used is evicted first. */
+	gdev_shm_evict_conflict(ctx, mem, dst_addr, size); /* evict conflicting data. */
+	ret = __gmemcpy_to_device_locked(h, ctx, dst_addr, src_buf, size, id, ch_size, p_count, vas, mem, dma_mem, host_copy);
 
 	gdev_mem_unlock(mem);
 
+	__put_dma(h, dma_mem, slot, p_count);
+
 #ifndef GDEV_SCHED_DISABLED
 	/* select the next context by itself, since memcpy is sychronous. */
 	gdev_select_next_memory(gdev);
@@ -305,10 +613,10 @@ static int __gmemcpy_to_device(struct gdev_handle *h, uint64_t dst_addr, const v
 }
 
 /**
- * copy device memory to host buffer with pipelining.
- * host_copy() is either memcpy() or copy_to_user().
+ * copy device memory to host data with pipelining. copy(@arg, ...) writes
+ * the bounce buffers to the host data.
  */
-static int __gmemcpy_from_device_p(gdev_ctx_t *ctx, void *dst_buf, uint64_t src_addr, uint64_t size, uint32_t ch_size, int p_count, gdev_mem_t **bmem, int (*host_copy)(void*, const void*, uint32_t))
+static int __gmemcpy_from_device_p(struct gdev_handle *h, gdev_ctx_t *ctx, uint64_t src_addr, uint64_t size, uint32_t ch_size, int p_count, gdev_mem_t **bmem, int (*copy)(void*, uint64_t, void*, uint32_t), void *arg)
 {
 	uint64_t rest_size = size;
 	uint64_t offset;
@@ -329,6 +637,7 @@ static int __gmemcpy_from_device_p(gdev_ctx_t *ctx, void *dst_buf, uint64_t src_
 	offset = 0;
 	for (i = 0; i < p_count; i++) {
 		dma_size = gdev_min(rest_size, ch_size);
+		__throttle_memcpy(h, dma_size);
 		fence[i] = gdev_memcpy(ctx, dma_addr[i], src_addr + offset, dma_size);
 		if (rest_size == dma_size)
 			break;
@@ -345,7 +654,7 @@ static int __gmemcpy_from_device_p(gdev_ctx_t *ctx, void *dst_buf, uint64_t src_
 			dma_size = gdev_min(rest_size, ch_size);
 			/* HtoH */
 			gdev_poll(ctx, fence[i], NULL);
-			ret = host_copy(dst_buf + offset, dma_buf[i], dma_size);
+			ret = copy(arg, offset, dma_buf[i], dma_size);
 			if (ret)
 				goto end;
 			/* DtoH for the next round if necessary. */
@@ -353,6 +662,7 @@ static int __gmemcpy_from_device_p(gdev_ctx_t *ctx, void *dst_buf, uint64_t src_
 				uint64_t rest_size_n = rest_size - p_count * ch_size;
 				uint32_t dma_size_n = gdev_min(rest_size_n, ch_size);
 				uint64_t offset_n = offset + p_count * ch_size;
+				__throttle_memcpy(h, dma_size_n);
 				fence[i] = gdev_memcpy(ctx, dma_addr[i], src_addr + offset_n, dma_size_n);
 			}
 			else if (rest_size == dma_size)
@@ -367,10 +677,10 @@ end:
 }
 
 /**
- * copy device memory to host buffer without pipelining.
- * host_copy() is either memcpy() or copy_to_user().
+ * copy device memory to host data without pipelining. copy(@arg, ...)
+ * writes the bounce buffer to the host data.
  */
-static int __gmemcpy_from_device_np(gdev_ctx_t *ctx, void *dst_buf, uint64_t src_addr, uint64_t size, uint32_t ch_size, gdev_mem_t **bmem, int (*host_copy)(void*, const void*, uint32_t))
+static int __gmemcpy_from_device_np(struct gdev_handle *h, gdev_ctx_t *ctx, uint64_t src_addr, uint64_t size, uint32_t ch_size, gdev_mem_t **bmem, int (*copy)(void*, uint64_t, void*, uint32_t), void *arg)
 {
 	uint64_t rest_size = size;
 	uint64_t offset;
@@ -387,9 +697,10 @@ static int __gmemcpy_from_device_np(gdev_ctx_t *ctx, void *dst_buf, uint64_t src
 	offset = 0;
 	while (rest_size) {
 		dma_size = gdev_min(rest_size, ch_size);
+		__throttle_memcpy(h, dma_size);
 		fence = gdev_memcpy(ctx, dma_addr[0], src_addr + offset, dma_size);
 		gdev_poll(ctx, fence, NULL);
-		ret = host_copy(dst_buf + offset, dma_buf[0], dma_size);
+		ret = copy(arg, offset, dma_buf[0], dma_size);
 		if (ret)
 			goto end;
 		rest_size -= dma_size;
@@ -403,10 +714,12 @@ end:
 /**
  * copy device memory to host DMA buffer.
  */
-static int __gmemcpy_dma_from_device(gdev_ctx_t *ctx, uint64_t dst_addr, uint64_t src_addr, uint64_t size, uint32_t *id)
+static int __gmemcpy_dma_from_device(struct gdev_handle *h, gdev_ctx_t *ctx, uint64_t dst_addr, uint64_t src_addr, uint64_t size, uint32_t *id)
 {
 	uint32_t fence;
 
+	__throttle_memcpy(h, size);
+
 	/* we don't break data into chunks if copying directly from dma memory. 
 	   if @id == NULL, it means memcpy is synchronous. */
 	if (!id) {
@@ -424,12 +737,21 @@ static int __gmemcpy_dma_from_device(gdev_ctx_t *ctx, uint64_t dst_addr, uint64_
 /**
  * a wrapper function of __gmemcpy_from_device().
  */
-static int __gmemcpy_from_device_locked(gdev_ctx_t *ctx, void *dst_buf, uint64_t src_addr, uint64_t size, uint32_t *id, uint32_t ch_size, int p_count, gdev_vas_t *vas, gdev_mem_t *mem, gdev_mem_t **dma_mem, int (*host_copy)(void*, const void*, uint32_t))
+static int __gmemcpy_from_device_locked(struct gdev_handle *h, gdev_ctx_t *ctx, void *dst_buf, uint64_t src_addr, uint64_t size, uint32_t *id, uint32_t ch_size, int p_count, gdev_vas_t *vas, gdev_mem_t *mem, gdev_mem_t **dma_mem, int (*host_copy)(void*, const void*, uint32_t))
 {
+	struct gdev_host_buf b = {dst_buf, host_copy};
 	gdev_mem_t *hmem;
 	gdev_mem_t **bmem;
+	struct gdev_device *phys = __iotune_device(mem);
+	struct gdev_time start;
+	int direct = 0, timed = 0;
 	int ret;
 
+	if (mem->map)
+		direct = __iotune_direct(phys, &phys->ioread, size, &timed);
+	if (timed)
+		gdev_time_stamp(&start);
+
 	if (size <= 4 && mem->map) {
 		((uint32_t*)dst_buf)[0] = gdev_read32(mem, src_addr);
 		ret = 0;
@@ -437,14 +759,16 @@ static int __gmemcpy_from_device_locked(gdev_ctx_t *ctx, void *dst_buf, uint64_t
 		if (id)
 			*id = 0;
 	}
-	else if (size <= GDEV_MEMCPY_IOREAD_LIMIT && mem->map) {
+	else if (direct) {
 		ret = gdev_read(mem, dst_buf, src_addr, size);
 		/* if @id is given despite not asynchronous, give it zero. */
 		if (id)
 			*id = 0;
 	}
 	else if ((hmem = gdev_mem_lookup_by_buf(vas, dst_buf, GDEV_MEM_DMA))) {
-		ret = __gmemcpy_dma_from_device(ctx, hmem->addr, src_addr, size, id);
+		/* asynchronous, or no host copy to compare. */
+		timed = 0;
+		ret = __gmemcpy_dma_from_device(h, ctx, hmem->addr, src_addr, size, id);
 	}
 	else {
 		/* prepare bounce buffer memory. */
@@ -457,9 +781,9 @@ static int __gmemcpy_from_device_locked(gdev_ctx_t *ctx, void *dst_buf, uint64_t
 			bmem = dma_mem;
 
 		if (p_count > 1 && size > ch_size)
-			ret = __gmemcpy_from_device_p(ctx, dst_buf, src_addr, size, ch_size, p_count, bmem, host_copy);
+			ret = __gmemcpy_from_device_p(h, ctx, src_addr, size, ch_size, p_count, bmem, __host_copy_to, &b);
 		else
-			ret = __gmemcpy_from_device_np(ctx, dst_buf, src_addr, size, ch_size, bmem, host_copy);
+			ret = __gmemcpy_from_device_np(h, ctx, src_addr, size, ch_size, bmem, __host_copy_to, &b);
 
 		/* free bounce buffer memory, if necessary. */
 		if (!dma_mem)
@@ -470,6 +794,9 @@ static int __gmemcpy_from_device_locked(gdev_ctx_t *ctx, void *dst_buf, uint64_t
 			*id = 0;
 	}
 
+	if (timed && !ret)
+		__iotune_update(phys, &phys->ioread, direct, size, &start);
+
 	return ret;
 }
 
@@ -479,34 +806,43 @@ static int __gmemcpy_from_device_locked(gdev_ctx_t *ctx, void *dst_buf, uint64_t
 static int __gmemcpy_from_device(struct gdev_handle *h, void *dst_buf, uint64_t src_addr, uint64_t size, uint32_t *id, int (*host_copy)(void*, const void*, uint32_t))
 {
 #ifndef GDEV_SCHED_DISABLED
-	struct gdev_sched_entity *se = h->se;
 	struct gdev_device *gdev = h->gdev;
 #endif
 	gdev_vas_t *vas = h->vas;
 	gdev_ctx_t *ctx = h->ctx;
-	gdev_mem_t **dma_mem = h->dma_mem;
+	gdev_mem_t **dma_mem;
 	gdev_mem_t *mem;
-	uint32_t ch_size = h->chunk_size;
-	int p_count = h->pipeline_count;
+	uint32_t ch_size;
+	int p_count;
+	int slot;
 	int ret;
 
 	mem = gdev_mem_lookup_by_addr(vas, src_addr, GDEV_MEM_DEVICE);
 	if (!mem)
 		return -ENOENT;
 
+	/* taken before the copy engine, which would be left reserved if the 
+	   bounce buffers failed to be allocated. */
+	dma_mem = __get_dma(h, size, &slot, &ch_size, &p_count);
+	if (!dma_mem)
+		return -ENOMEM;
+
 #ifndef GDEV_SCHED_DISABLED
 	/* decide if the context needs to stall or not. */
-	gdev_schedule_memory(se);
+	__schedule_memory(h);
 #endif
 
 	gdev_mem_lock(mem);
 
+	gdev_shm_index_touch(mem); /* the least recently used is evicted first. */
 	gdev_shm_retrieve_swap(ctx, mem); /* retrieve data swapped. */
-	ret = __gmemcpy_from_device_locked(ctx, dst_buf, src_addr, size, id, 
+	ret = __gmemcpy_from_device_locked(h, ctx, dst_buf, src_addr, size, id, 
 									   ch_size, p_count, vas, mem, dma_mem,
 									   host_copy);
 	gdev_mem_unlock(mem);
 
+	__put_dma(h, dma_mem, slot, p_count);
+
 #ifndef GDEV_SCHED_DISABLED
 	/* select the next context by itself, since memcpy is synchronous. */
 	gdev_select_next_memory(gdev);
@@ -522,16 +858,21 @@ int gdev_callback_save_to_host(void *h, void* dst_buf, uint64_t src_addr, uint64
 {
 	gdev_vas_t *vas = ((struct gdev_handle*)h)->vas;
 	gdev_ctx_t *ctx = ((struct gdev_handle*)h)->ctx;
-	gdev_mem_t **dma_mem = ((struct gdev_handle*)h)->dma_mem;
+	gdev_mem_t **dma_mem;
 	gdev_mem_t *mem;
-	uint32_t ch_size = ((struct gdev_handle*)h)->chunk_size;
-	int p_count = ((struct gdev_handle*)h)->pipeline_count;
+	uint32_t ch_size;
+	int p_count;
+	int ret;
 
 	mem = gdev_mem_lookup_by_addr(vas, src_addr, GDEV_MEM_DEVICE);
 	if (!mem)
 		return -ENOENT;
 
-	return __gmemcpy_from_device_locked(ctx, dst_buf, src_addr, size, NULL, ch_size, p_count, vas, mem, dma_mem, __f_memcpy);
+	dma_mem = __get_swap_dma(h, &ch_size, &p_count);
+	ret = __gmemcpy_from_device_locked(NULL, ctx, dst_buf, src_addr, size, NULL, ch_size, p_count, vas, mem, dma_mem, __f_memcpy);
+	__put_swap_dma(h);
+
+	return ret;
 }
 
 /**
@@ -555,16 +896,111 @@ int gdev_callback_load_from_host(void *h, uint64_t dst_addr, void *src_buf, uint
 {
 	gdev_vas_t *vas = ((struct gdev_handle*)h)->vas;
 	gdev_ctx_t *ctx = ((struct gdev_handle*)h)->ctx;
-	gdev_mem_t **dma_mem = ((struct gdev_handle*)h)->dma_mem;
+	gdev_mem_t **dma_mem;
 	gdev_mem_t *mem;
-	uint32_t ch_size = ((struct gdev_handle*)h)->chunk_size;
-	int p_count = ((struct gdev_handle*)h)->pipeline_count;
+	uint32_t ch_size;
+	int p_count;
+	int ret;
 
 	mem = gdev_mem_lookup_by_addr(vas, dst_addr, GDEV_MEM_DEVICE);
 	if (!mem)
 		return -ENOENT;
 
-	return __gmemcpy_to_device_locked(ctx, dst_addr, src_buf, size, NULL, ch_size, p_count, vas, mem, dma_mem, __f_memcpy);
+	dma_mem = __get_swap_dma(h, &ch_size, &p_count);
+	ret = __gmemcpy_to_device_locked(NULL, ctx, dst_addr, src_buf, size, NULL, ch_size, p_count, vas, mem, dma_mem, __f_memcpy);
+	__put_swap_dma(h);
+
+	return ret;
+}
+
+/* chunk size of copies with the compressed host swap, which are aligned to
+   the swap pages. */
+static uint32_t __zswap_chunk_size(uint32_t chunk_size)
+{
+	uint32_t ch_size = chunk_size / GDEV_SWAP_PAGE_SIZE * GDEV_SWAP_PAGE_SIZE;
+
+	return ch_size ? ch_size : GDEV_SWAP_PAGE_SIZE;
+}
+
+/**
+ * this function must be used when saving data to compressed host swap.
+ * the pages are compressed in the pipeline of bounce buffers.
+ */
+int gdev_callback_save_to_zswap(void *h, struct gdev_zswap *z, uint64_t offset, uint64_t src_addr, uint64_t size)
+{
+	gdev_ctx_t *ctx = ((struct gdev_handle*)h)->ctx;
+	gdev_vas_t *vas = ((struct gdev_handle*)h)->vas;
+	gdev_mem_t **dma_mem;
+	gdev_mem_t **bmem;
+	uint32_t ch_size;
+	int p_count;
+	struct gdev_zswap_range r = {z, offset};
+	int ret;
+
+	dma_mem = __get_swap_dma(h, &ch_size, &p_count);
+	ch_size = __zswap_chunk_size(ch_size);
+
+	/* the bounce buffers for swap hold a page at least. */
+	if (!dma_mem) {
+		bmem = __malloc_dma(vas, gdev_min(size, ch_size), p_count);
+		if (!bmem) {
+			__put_swap_dma(h);
+			return -ENOMEM;
+		}
+	}
+	else
+		bmem = dma_mem;
+
+	if (p_count > 1 && size > ch_size)
+		ret = __gmemcpy_from_device_p(NULL, ctx, src_addr, size, ch_size, p_count, bmem, __zswap_copy_to, &r);
+	else
+		ret = __gmemcpy_from_device_np(NULL, ctx, src_addr, size, ch_size, bmem, __zswap_copy_to, &r);
+
+	if (bmem != dma_mem)
+		__free_dma(bmem, p_count);
+	__put_swap_dma(h);
+
+	return ret;
+}
+
+/**
+ * this function must be used when loading data from compressed host swap.
+ * the pages are decompressed in the pipeline of bounce buffers.
+ */
+int gdev_callback_load_from_zswap(void *h, uint64_t dst_addr, struct gdev_zswap *z, uint64_t offset, uint64_t size)
+{
+	gdev_ctx_t *ctx = ((struct gdev_handle*)h)->ctx;
+	gdev_vas_t *vas = ((struct gdev_handle*)h)->vas;
+	gdev_mem_t **dma_mem;
+	gdev_mem_t **bmem;
+	uint32_t ch_size;
+	int p_count;
+	struct gdev_zswap_range r = {z, offset};
+	int ret;
+
+	dma_mem = __get_swap_dma(h, &ch_size, &p_count);
+	ch_size = __zswap_chunk_size(ch_size);
+
+	if (!dma_mem) {
+		bmem = __malloc_dma(vas, gdev_min(size, ch_size), p_count);
+		if (!bmem) {
+			__put_swap_dma(h);
+			return -ENOMEM;
+		}
+	}
+	else
+		bmem = dma_mem;
+
+	if (p_count > 1 && size > ch_size)
+		ret = __gmemcpy_to_device_p(NULL, ctx, dst_addr, size, ch_size, p_count, bmem, __zswap_copy_from, &r);
+	else
+		ret = __gmemcpy_to_device_np(NULL, ctx, dst_addr, size, ch_size, bmem, __zswap_copy_from, &r);
+
+	if (bmem != dma_mem)
+		__free_dma(bmem, p_count);
+	__put_swap_dma(h);
+
+	return ret;
 }
 
 /**
@@ -581,20 +1017,13 @@ int gdev_callback_load_from_device(void *h, uint64_t dst_addr, uint64_t src_addr
 	return 0;
 }
 
-/******************************************************************************
- ******************************************************************************
- * Gdev API functions
- ******************************************************************************
- ******************************************************************************/
-
 /**
- * gopen():
- * create a new GPU context on the given device #@devnum.
+ * create a new GPU context on @gdev, which is opened for it: the VAS, the 
+ * context, the bounce buffers and the scheduling entity.
  */
-struct gdev_handle *gopen(int minor)
+static struct gdev_handle *__handle_new(struct gdev_device *gdev)
 {
 	struct gdev_handle *h = NULL;
-	struct gdev_device *gdev = NULL;
 	struct gdev_sched_entity *se = NULL;
 	gdev_vas_t *vas = NULL;
 	gdev_ctx_t *ctx = NULL;
@@ -606,15 +1035,15 @@ struct gdev_handle *gopen(int minor)
 	}
 	memset(h, 0, sizeof(*h));
 
+	gdev_lock_init(&h->lock);
+	gdev_mutex_init(&h->swap_mutex);
+	gdev_mutex_init(&h->sched_mutex);
+	gdev_list_init(&h->list_entry_pool, (void*)h);
 	h->pipeline_count = GDEV_PIPELINE_DEFAULT_COUNT;
 	h->chunk_size = GDEV_CHUNK_DEFAULT_SIZE;
-
-	/* open the specified device. */
-	gdev = gdev_dev_open(minor);
-	if (!gdev) {
-		GDEV_PRINT("Failed to open gdev%d\n", minor);
-		goto fail_open;
-	}
+	h->slice_size = 0;
+	h->write_set.count = -1;
+	h->use_set.count = -1;
 
 	/* none can access GPU while someone is opening device. */
 	gdev_block_start(gdev);
@@ -633,8 +1062,8 @@ struct gdev_handle *gopen(int minor)
 		goto fail_ctx;
 	}
 
-	/* allocate static bounce bound buffer objects. */
-	dma_mem = __malloc_dma(vas, GDEV_CHUNK_DEFAULT_SIZE, h->pipeline_count);
+	/* allocate static bounce bound buffer objects for swap. */
+	dma_mem = __malloc_swap_dma(vas, h->chunk_size, h->pipeline_count);
 	if (!dma_mem) {
 		GDEV_PRINT("Failed to allocate static DMA buffer object\n");
 		goto fail_dma;
@@ -654,13 +1083,10 @@ struct gdev_handle *gopen(int minor)
 
 	/* save the objects to the handle. */
 	h->se = se;
-	h->dma_mem = dma_mem;
+	h->swap_dma = dma_mem;
 	h->vas = vas;
 	h->ctx = ctx;
 	h->gdev = gdev;
-	h->dev_id = minor;
-
-	GDEV_PRINT("Opened gdev%d\n", minor);
 
 	return h;
 
@@ -674,37 +1100,29 @@ fail_ctx:
 	gdev_vas_free(vas);
 fail_vas:
 	gdev_block_end(gdev);
-	gdev_dev_close(gdev);
-fail_open:
+	FREE(h);
 	return NULL;
 }
 
 /**
- * gclose():
- * destroy the GPU context associated with @handle.
+ * destroy the GPU context of @h, and free @h. the device is left opened.
  */
-int gclose(struct gdev_handle *h)
+static void __handle_free(struct gdev_handle *h)
 {
-	struct gdev_device *gdev=h->gdev;
+	struct gdev_device *gdev = h->gdev;
 
-	if (!h)
-		return -ENOENT;
-	if (!h->gdev || !h->ctx || !h->vas)
-		return -ENOENT;
-	
 	/* none can access GPU while someone is closing device. */
 	gdev_block_start(gdev);
 
 #ifndef GDEV_SCHED_DISABLED
-	if (!h->se)
-		return -ENOENT;
 	/* free the scheduling entity. */
 	gdev_sched_entity_destroy(h->se);
 #endif
 	
-	/* free the bounce buffer. */
-	if (h->dma_mem)
-		__free_dma(h->dma_mem, h->pipeline_count);
+	/* free the bounce buffers. */
+	__free_dma_all(h);
+	if (h->swap_dma)
+		__free_dma(h->swap_dma, h->pipeline_count);
 
 	/* garbage collection: free all memory left in heap. */
 	gdev_mem_gc(h->vas);
@@ -714,47 +1132,359 @@ int gclose(struct gdev_handle *h)
 	gdev_vas_free(h->vas);
 	
 	gdev_block_end(gdev);
-	
-	gdev_dev_close(h->gdev);
-
-	GDEV_PRINT("Closed gdev%d\n", h->dev_id);
 
 	FREE(h);
-
-	return 0;
 }
 
 /**
- * gmalloc():
- * allocate new device memory space.
+ * the context pool of a device: gopen() takes a context kept initialized
+ * instead of creating one, and gclose() scrubs the context and returns it.
+ * the handles in the pool keep the device opened. in user space, a thread 
+ * refills the pool in the background once half of it is taken, so that the
+ * contexts returned by gclose() are used first. the thread keeps the device
+ * opened as well.
+ * the device object is shared among processes in user space if scheduled,
+ * while the contexts are not, so the pool is not used then.
  */
-uint64_t gmalloc(struct gdev_handle *h, uint64_t size)
-{
-	struct gdev_device *gdev = h->gdev;
-	gdev_vas_t *vas = h->vas;
-	gdev_mem_t *mem;
+#if defined(__KERNEL__) || defined(GDEV_SCHED_DISABLED)
+#define GDEV_CTX_POOL_ENABLED
+#endif
 
-	if (gdev->mem_used + size > gdev->mem_size) {
-		/* try to share memory with someone (only for device memory). 
-		   the shared memory must be freed in gdev_mem_free() when 
-		   unreferenced by all users. */
-		if (!(mem = gdev_mem_share(vas, size))) {
-			GDEV_PRINT("Failed to share memory with victims\n");
-			goto fail;
-		}
-	}
-	else if (!(mem = gdev_mem_alloc(vas, size, GDEV_MEM_DEVICE))) {
-		if (!(mem = gdev_mem_share(vas, size))) {
-			GDEV_PRINT("Failed to share memory with victims\n");
-			goto fail;
-		}
-	}
+#define GDEV_CTX_POOL_WAIT_US 1000000 /* 1 sec, to wait for a shortage. */
 
-	return gdev_mem_getaddr(mem);
+#ifdef GDEV_CTX_POOL_ENABLED
+static int __pool_short(struct gdev_device *gdev)
+{
+	int ret;
 
-fail:
-	return 0;
-}
+	gdev_lock(&gdev->ctx_pool_lock);
+	ret = gdev->ctx_pool_count < gdev->ctx_pool_size;
+	gdev_unlock(&gdev->ctx_pool_lock);
+
+	return ret;
+}
+
+static int __pool_low(struct gdev_device *gdev)
+{
+	int ret;
+
+	gdev_lock(&gdev->ctx_pool_lock);
+	ret = gdev->ctx_pool_count < gdev->ctx_pool_size &&
+		gdev->ctx_pool_count * 2 <= gdev->ctx_pool_size;
+	gdev_unlock(&gdev->ctx_pool_lock);
+
+	return ret;
+}
+
+/**
+ * take a context out of the pool of @gdev, if it has more than @n.
+ */
+static struct gdev_handle *__pool_pop(struct gdev_device *gdev, int n)
+{
+	struct gdev_handle *h = NULL;
+
+	gdev_lock(&gdev->ctx_pool_lock);
+	if (gdev->ctx_pool_count > n) {
+		h = gdev_list_container(gdev_list_head(&gdev->ctx_pool));
+		gdev_list_del(&h->list_entry_pool);
+		gdev->ctx_pool_count--;
+	}
+	gdev_unlock(&gdev->ctx_pool_lock);
+
+	return h;
+}
+
+/**
+ * add @h to the pool of its device, unless the pool is full.
+ */
+static int __pool_add(struct gdev_handle *h)
+{
+	struct gdev_device *gdev = h->gdev;
+	int ret = 0;
+
+	gdev_lock(&gdev->ctx_pool_lock);
+	if (gdev->ctx_pool_count < gdev->ctx_pool_size) {
+		gdev_list_add_tail(&h->list_entry_pool, &gdev->ctx_pool);
+		gdev->ctx_pool_count++;
+		ret = 1;
+	}
+	gdev_unlock(&gdev->ctx_pool_lock);
+
+	return ret;
+}
+
+#ifndef __KERNEL__
+static void *__pool_refill_thread(void *arg)
+{
+	int minor = (int)(long)arg;
+	struct gdev_device *gdev = gdev_dev_open(minor);
+	struct gdev_handle *h;
+	unsigned int seq;
+
+	if (!gdev)
+		return NULL;
+
+	for (;;) {
+		seq = gdev_event_seq(&gdev->ctx_pool_event);
+		/* once low, the pool is filled up. */
+		if (__pool_low(gdev)) {
+			while (__pool_short(gdev)) {
+				/* every handle in the pool has the device opened. */
+				if (!gdev_dev_open(minor))
+					break;
+				if (!(h = __handle_new(gdev))) {
+					gdev_dev_close(gdev);
+					break;
+				}
+				h->dev_id = minor;
+				if (!__pool_add(h)) {
+					__handle_free(h);
+					gdev_dev_close(gdev);
+				}
+			}
+		}
+		gdev_event_wait(&gdev->ctx_pool_event, seq, GDEV_CTX_POOL_WAIT_US);
+	}
+
+	return NULL;
+}
+#endif
+
+/**
+ * start refilling the pool of @gdev opened as #@minor, if not yet.
+ */
+static void __pool_start(struct gdev_device *gdev, int minor)
+{
+#ifndef __KERNEL__
+	pthread_t thread;
+
+	if (!__atomic_load_n(&gdev->ctx_pool_size, __ATOMIC_RELAXED) ||
+		!__sync_bool_compare_and_swap(&gdev->ctx_pool_refilling, 0, 1))
+		return;
+
+	if (pthread_create(&thread, NULL, __pool_refill_thread, (void*)(long)minor))
+		__atomic_store_n(&gdev->ctx_pool_refilling, 0, __ATOMIC_RELAXED);
+	else
+		pthread_detach(thread);
+#endif
+}
+#endif
+
+/**
+ * take a context from the pool of @gdev opened as #@minor, if any. 
+ */
+static struct gdev_handle *__pool_take(struct gdev_device *gdev, int minor)
+{
+#ifdef GDEV_CTX_POOL_ENABLED
+	struct gdev_handle *h;
+
+	__pool_start(gdev, minor);
+
+	if ((h = __pool_pop(gdev, 0))) {
+		gdev_event_signal(&gdev->ctx_pool_event);
+#ifndef GDEV_SCHED_DISABLED
+		gdev_sched_entity_reset(h->se);
+#endif
+	}
+
+	return h;
+#else
+	return NULL;
+#endif
+}
+
+/**
+ * scrub @h of what its user left, and return it to the pool of its device.
+ * false is returned if the pool is full or @h has its bounce buffers tuned,
+ * and then the caller destroys @h.
+ */
+static int __pool_put(struct gdev_handle *h)
+{
+#ifdef GDEV_CTX_POOL_ENABLED
+	gdev_mem_t *keep[(GDEV_MEMCPY_BOUNCE_COUNT + 1) * GDEV_PIPELINE_MAX_COUNT];
+	int i, j, n = 0;
+
+	if (!__pool_short(h->gdev) || !h->swap_dma || 
+		h->chunk_size != GDEV_CHUNK_DEFAULT_SIZE ||
+		h->pipeline_count != GDEV_PIPELINE_DEFAULT_COUNT)
+		return 0;
+
+	/* the bounce buffers are kept for the next user. */
+	for (j = 0; j < h->pipeline_count; j++)
+		keep[n++] = h->swap_dma[j];
+	for (i = 0; i < GDEV_MEMCPY_BOUNCE_COUNT; i++) {
+		for (j = 0; h->dma_mem[i] && j < h->pipeline_count; j++)
+			keep[n++] = h->dma_mem[i][j];
+	}
+
+	gdev_block_start(h->gdev);
+	/* the device must be done with the work of the user before its memory
+	   is freed, or the next user may see the memory written. */
+	gdev_barrier(h->ctx);
+	gdev_mem_gc_keep(h->vas, keep, n);
+	gdev_block_end(h->gdev);
+
+	/* forget what the user tuned. */
+	h->slice_size = 0;
+	h->write_set.count = -1;
+	h->use_set.count = -1;
+#ifndef GDEV_SCHED_DISABLED
+	gdev_sched_entity_set_deadline(h->se, 0, 0);
+#endif
+
+	return __pool_add(h);
+#else
+	return 0;
+#endif
+}
+
+/**
+ * free all the contexts in the pool of @gdev, e.g., when the device exits.
+ */
+void gdev_ctx_pool_drain(struct gdev_device *gdev)
+{
+#ifdef GDEV_CTX_POOL_ENABLED
+	struct gdev_handle *h;
+
+	while ((h = __pool_pop(gdev, 0))) {
+		__handle_free(h);
+		gdev_dev_close(gdev);
+	}
+#endif
+}
+
+/**
+ * keep @size contexts in the pool of @gdev opened as #@minor. the contexts
+ * over it are freed.
+ */
+static int __pool_resize(struct gdev_device *gdev, int minor, uint32_t size)
+{
+#ifdef GDEV_CTX_POOL_ENABLED
+	struct gdev_handle *h;
+
+	if (size > GDEV_CONTEXT_MAX_COUNT)
+		return -EINVAL;
+
+	gdev_lock(&gdev->ctx_pool_lock);
+	__atomic_store_n(&gdev->ctx_pool_size, size, __ATOMIC_RELAXED);
+	gdev_unlock(&gdev->ctx_pool_lock);
+
+	while ((h = __pool_pop(gdev, size))) {
+		__handle_free(h);
+		gdev_dev_close(gdev);
+	}
+
+	__pool_start(gdev, minor);
+	gdev_event_signal(&gdev->ctx_pool_event);
+
+	return 0;
+#else
+	return -EINVAL;
+#endif
+}
+
+/******************************************************************************
+ ******************************************************************************
+ * Gdev API functions
+ ******************************************************************************
+ ******************************************************************************/
+
+/**
+ * gopen():
+ * create a new GPU context on the given device #@devnum.
+ */
+struct gdev_handle *gopen(int minor)
+{
+	struct gdev_handle *h;
+	struct gdev_device *gdev;
+
+	/* open the specified device. */
+	gdev = gdev_dev_open(minor);
+	if (!gdev) {
+		GDEV_PRINT("Failed to open gdev%d\n", minor);
+		return NULL;
+	}
+
+	/* a context taken from the pool has the device opened by itself. */
+	if ((h = __pool_take(gdev, minor)))
+		gdev_dev_close(gdev);
+	else if (!(h = __handle_new(gdev))) {
+		gdev_dev_close(gdev);
+		return NULL;
+	}
+	h->dev_id = minor;
+
+	GDEV_PRINT("Opened gdev%d\n", minor);
+
+	return h;
+}
+
+/**
+ * gclose():
+ * destroy the GPU context associated with @handle.
+ */
+int gclose(struct gdev_handle *h)
+{
+	struct gdev_device *gdev;
+
+	if (!h)
+		return -ENOENT;
+	if (!h->gdev || !h->ctx || !h->vas)
+		return -ENOENT;
+#ifndef GDEV_SCHED_DISABLED
+	if (!h->se)
+		return -ENOENT;
+#endif
+
+	GDEV_PRINT("Closed gdev%d\n", h->dev_id);
+
+	/* the context returned to the pool keeps the device opened. */
+	gdev = h->gdev;
+	if (__pool_put(h))
+		return 0;
+
+	__handle_free(h);
+	gdev_dev_close(gdev);
+
+	return 0;
+}
+
+/**
+ * gmalloc():
+ * allocate new device memory space.
+ */
+uint64_t gmalloc(struct gdev_handle *h, uint64_t size)
+{
+	struct gdev_device *gdev = h->gdev;
+	gdev_vas_t *vas = h->vas;
+	gdev_mem_t *mem;
+	uint64_t mem_used;
+
+	gdev_mutex_lock(&gdev->shm_mutex);
+	mem_used = gdev->mem_used;
+	gdev_mutex_unlock(&gdev->shm_mutex);
+
+	if (mem_used + size > gdev->mem_size) {
+		/* try to share memory with someone (only for device memory). 
+		   the shared memory must be freed in gdev_mem_free() when 
+		   unreferenced by all users. */
+		if (!(mem = gdev_mem_share(vas, size))) {
+			GDEV_PRINT("Failed to share memory with victims\n");
+			goto fail;
+		}
+	}
+	else if (!(mem = gdev_mem_alloc(vas, size, GDEV_MEM_DEVICE))) {
+		if (!(mem = gdev_mem_share(vas, size))) {
+			GDEV_PRINT("Failed to share memory with victims\n");
+			goto fail;
+		}
+	}
+
+	return gdev_mem_getaddr(mem);
+
+fail:
+	return 0;
+}
 
 /**
  * gfree():
@@ -786,8 +1516,13 @@ void *gmalloc_dma(struct gdev_handle *h, uint64_t size)
 	struct gdev_device *gdev = h->gdev;
 	gdev_vas_t *vas = h->vas;
 	gdev_mem_t *mem;
+	uint64_t dma_mem_used;
 
-	if (gdev->dma_mem_used + size > gdev->dma_mem_size)
+	gdev_mutex_lock(&gdev->shm_mutex);
+	dma_mem_used = gdev->dma_mem_used;
+	gdev_mutex_unlock(&gdev->shm_mutex);
+
+	if (dma_mem_used + size > gdev->dma_mem_size)
 		goto fail;
 	else if (!(mem = gdev_mem_alloc(vas, size, GDEV_MEM_DMA)))
 		goto fail;
@@ -851,9 +1586,7 @@ int gunmap(struct gdev_handle *h, void *buf)
 	if (!(mem = gdev_mem_lookup_by_buf(vas, buf, GDEV_MEM_DEVICE)))
 		goto fail;
 
-	gdev_mem_unmap(mem);
-
-	return 0;
+	return gdev_mem_unmap(mem);
 
 fail:
 	return -ENOENT;
@@ -940,7 +1673,6 @@ int gmemcpy_user_from_device_async(struct gdev_handle *h, void *dst_buf, uint64_
 int gmemcpy(struct gdev_handle *h, uint64_t dst_addr, uint64_t src_addr, uint64_t size)
 {
 #ifndef GDEV_SCHED_DISABLED
-	struct gdev_sched_entity *se = h->se;
 	struct gdev_device *gdev = h->gdev;
 #endif
 	gdev_ctx_t *ctx = h->ctx;
@@ -965,12 +1697,18 @@ int gmemcpy(struct gdev_handle *h, uint64_t dst_addr, uint64_t src_addr, uint64_
 
 #ifndef GDEV_SCHED_DISABLED
 	/* decide if the context needs to stall or not. */
-	gdev_schedule_memory(se);
+	__schedule_memory(h);
 #endif
 
+	__throttle_memcpy(h, size);
+
 	gdev_mem_lock(dst);
 	gdev_mem_lock(src);
 
+	gdev_shm_index_touch(src);
+	gdev_shm_index_touch(dst);
+	gdev_shm_retrieve_swap(ctx, src);
+	gdev_shm_evict_conflict(ctx, dst, dst_addr, size);
 	fence = gdev_memcpy(ctx, dst_addr, src_addr, size); 
 	gdev_poll(ctx, fence, NULL);
 
@@ -993,7 +1731,6 @@ int gmemcpy(struct gdev_handle *h, uint64_t dst_addr, uint64_t src_addr, uint64_
 int gmemcpy_async(struct gdev_handle *h, uint64_t dst_addr, uint64_t src_addr, uint64_t size, uint32_t *id)
 {
 #ifndef GDEV_SCHED_DISABLED
-	struct gdev_sched_entity *se = h->se;
 	struct gdev_device *gdev = h->gdev;
 #endif
 	gdev_ctx_t *ctx = h->ctx;
@@ -1018,12 +1755,18 @@ int gmemcpy_async(struct gdev_handle *h, uint64_t dst_addr, uint64_t src_addr, u
 
 #ifndef GDEV_SCHED_DISABLED
 	/* decide if the context needs to stall or not. */
-	gdev_schedule_memory(se);
+	__schedule_memory(h);
 #endif
 
+	__throttle_memcpy(h, size);
+
 	gdev_mem_lock(dst);
 	gdev_mem_lock(src);
 
+	gdev_shm_index_touch(src);
+	gdev_shm_index_touch(dst);
+	gdev_shm_retrieve_swap(ctx, src);
+	gdev_shm_evict_conflict(ctx, dst, dst_addr, size);
 	fence = gdev_memcpy_async(ctx, dst_addr, src_addr, size); 
 
 	gdev_mem_unlock(src);
@@ -1039,33 +1782,318 @@ int gmemcpy_async(struct gdev_handle *h, uint64_t dst_addr, uint64_t src_addr, u
 	return 0;
 }
 
+static int __access_set_declared(struct gdev_access_set *set)
+{
+	return set->count >= 0 && set->count <= GDEV_ACCESS_SET_COUNT;
+}
+
+static int __access_set_add(struct gdev_handle *h, struct gdev_access_set *set, uint64_t addr, uint64_t size)
+{
+	gdev_mem_t *mem;
+	int ret;
+
+	mem = gdev_mem_lookup_by_addr(h->vas, addr, GDEV_MEM_DEVICE);
+	if (!mem)
+		return -ENOENT;
+	if (size > mem->addr + mem->size - addr)
+		return -EINVAL;
+
+	gdev_lock(&h->lock);
+	if (set->count > GDEV_ACCESS_SET_COUNT)
+		ret = -ENOSPC;
+	else if (set->count == GDEV_ACCESS_SET_COUNT) {
+		/* the launch is assumed to access everything, like undeclared. */
+		set->count++;
+		ret = -ENOSPC;
+	}
+	else {
+		if (set->count < 0)
+			set->count = 0;
+		set->addr[set->count] = addr;
+		set->size[set->count] = size;
+		set->count++;
+		ret = 0;
+	}
+	gdev_unlock(&h->lock);
+
+	return ret;
+}
+
 /**
- * glaunch():
- * launch the GPU kernel code.
+ * get the device memory used by the launch swapped back. unless declared by
+ * guseset(), all the memory objects are assumed to be used. all of them 
+ * must be locked.
  */
-int glaunch(struct gdev_handle *h, struct gdev_kernel *kernel, uint32_t *id)
+static void __retrieve_used(struct gdev_launch_sets *ls)
+{
+	struct gdev_access_set *set = &ls->use_set;
+	gdev_vas_t *vas = ls->h->vas;
+	gdev_ctx_t *ctx = ls->h->ctx;
+	gdev_mem_t *mem;
+	int i;
+
+	if (!__access_set_declared(set)) {
+		gdev_shm_index_touch_all(vas);
+		gdev_shm_retrieve_swap_all(ctx, vas); /* get all data swapped back! */
+		return;
+	}
+
+	for (i = 0; i < set->count; i++) {
+		mem = gdev_mem_lookup_by_addr(vas, set->addr[i], GDEV_MEM_DEVICE);
+		if (mem) {
+			gdev_shm_index_touch(mem);
+			gdev_shm_retrieve_range(ctx, mem, set->addr[i], set->size[i]);
+		}
+	}
+}
+
+/**
+ * mark the device memory written by the launch dirty, so that it is saved
+ * when evicted. unless declared by gwriteset(), the memory used by the 
+ * launch is assumed to be written. all of them must be locked.
+ */
+static void __mark_written(struct gdev_launch_sets *ls)
+{
+	struct gdev_access_set *set = &ls->write_set;
+	gdev_vas_t *vas = ls->h->vas;
+	gdev_mem_t *mem;
+	int i;
+
+	if (!__access_set_declared(set))
+		set = &ls->use_set;
+	if (!__access_set_declared(set)) {
+		gdev_shm_mark_dirty_all(vas);
+		return;
+	}
+
+	for (i = 0; i < set->count; i++) {
+		mem = gdev_mem_lookup_by_addr(vas, set->addr[i], GDEV_MEM_DEVICE);
+		if (mem)
+			gdev_shm_mark_dirty(mem, set->addr[i], set->size[i]);
+	}
+}
+
+/**
+ * take the ranges declared for the launch into @ls, and forget them.
+ */
+static void __take_sets(struct gdev_handle *h, struct gdev_launch_sets *ls)
 {
+	ls->h = h;
+	gdev_lock(&h->lock);
+	ls->write_set = h->write_set;
+	ls->use_set = h->use_set;
+	h->write_set.count = -1;
+	h->use_set.count = -1;
+	gdev_unlock(&h->lock);
+}
+
 #ifndef GDEV_SCHED_DISABLED
+/**
+ * get the device memory used by the next launch swapped back while it waits
+ * in the compute queue, so that the data transfer overlaps the launches of
+ * others instead of delaying its own. copies hold the compute queue under 
+ * SDQ, so they cannot overlap there.
+ */
+static void __prefetch(void *arg)
+{
+	struct gdev_launch_sets *ls = arg;
+	struct gdev_handle *h = ls->h;
 	struct gdev_sched_entity *se = h->se;
+	gdev_vas_t *vas = h->vas;
+
+	if (gdev_sched_queueing_get(h->gdev) == GDEV_SCHED_SDQ ||
+		!gdev_shm_swapped_out(vas))
+		return;
+
+	/* the caller holds h->sched_mutex. */
+	gdev_schedule_memory(se);
+
+	gdev_mem_lock_all(vas);
+	__retrieve_used(ls);
+	gdev_mem_unlock_all(vas);
+
+	gdev_select_next_memory(h->gdev);
+}
 #endif
+
+#ifndef GDEV_SCHED_DISABLED
+/**
+ * launch the GPU kernel code by slices of h->slice_size CTAs. each slice
+ * waits for the preceding one, and is scheduled as a launch by itself, so
+ * that higher-priority contexts can run in between. hence the caller is
+ * blocked until the last slice is launched, which is left running, and
+ * @id is its fence. the slices take a copy of the parameters, so that
+ * @kernel is left untouched.
+ */
+static int __glaunch_sliced(struct gdev_handle *h, struct gdev_kernel *kernel, uint32_t *id)
+{
 	gdev_vas_t *vas = h->vas;
 	gdev_ctx_t *ctx = h->ctx;
+	struct gdev_kernel slice;
+	struct gdev_slice s;
+	struct gdev_launch_sets ls;
+	uint32_t *param_buf;
+
+	if (!(param_buf = MALLOC(kernel->param_size)))
+		return -ENOMEM;
+	memcpy(param_buf, kernel->param_buf, kernel->param_size);
+
+	*id = 0;
+	__take_sets(h, &ls);
+	gdev_slice_init(&s);
+	while (gdev_slice_next(kernel, &slice, h->slice_size, &s)) {
+		if (*id) {
+			gdev_poll(ctx, *id, NULL);
+#ifndef __KERNEL__
+			/* in the kernel, the completion interrupt does it. */
+			gdev_next_compute(h->gdev);
+#endif
+		}
+
+		__schedule_compute(h, __prefetch, &ls);
+
+		gdev_mem_lock_all(vas);
+
+		__retrieve_used(&ls);
+		gdev_slice_param(kernel, &s, param_buf);
+		slice.param_buf = param_buf;
+		*id = gdev_launch(ctx, &slice);
+		__mark_written(&ls);
+
+		gdev_mem_unlock_all(vas);
+	}
+
+	FREE(param_buf);
+
+	return 0;
+}
+#endif
+
+/**
+ * glaunch():
+ * launch the GPU kernel code.
+ */
+int glaunch(struct gdev_handle *h, struct gdev_kernel *kernel, uint32_t *id)
+{
+	gdev_vas_t *vas = h->vas;
+	gdev_ctx_t *ctx = h->ctx;
+	struct gdev_launch_sets ls;
+
+#ifndef GDEV_SCHED_DISABLED
+	if (gdev_slice_enabled(kernel, h->slice_size))
+		return __glaunch_sliced(h, kernel, id);
+#endif
+
+	__take_sets(h, &ls);
 
 #ifndef GDEV_SCHED_DISABLED
 	/* decide if the context needs to stall or not. */
-	gdev_schedule_compute(se);
+	__schedule_compute(h, __prefetch, &ls);
 #endif
 
 	gdev_mem_lock_all(vas);
 
-	gdev_shm_retrieve_swap_all(ctx, vas); /* get all data swapped back! */
+	__retrieve_used(&ls);
 	*id = gdev_launch(ctx, kernel);
+	__mark_written(&ls);
 
 	gdev_mem_unlock_all(vas); /* this should be called when compute done... */
 
 	return 0;
 }
 
+/**
+ * gcmdbuf_alloc():
+ * allocate a command buffer, into which kernel launches and memory copies
+ * are encoded once so that they can be submitted many times.
+ */
+struct gdev_cmdbuf *gcmdbuf_alloc(struct gdev_handle *h)
+{
+	return gdev_cmdbuf_new(h->ctx);
+}
+
+/**
+ * gcmdbuf_free():
+ * free the command buffer.
+ */
+int gcmdbuf_free(struct gdev_handle *h, struct gdev_cmdbuf *cb)
+{
+	gdev_cmdbuf_free(cb);
+
+	return 0;
+}
+
+/**
+ * gcmdbuf_launch():
+ * append the launch of the GPU kernel code to the command buffer.
+ * the index of the command is returned, which is used to update it.
+ */
+int gcmdbuf_launch(struct gdev_handle *h, struct gdev_cmdbuf *cb, struct gdev_kernel *kernel)
+{
+	return gdev_cmdbuf_launch(h->ctx, cb, kernel);
+}
+
+/**
+ * gcmdbuf_memcpy():
+ * append the copy of data within the global address space to the command 
+ * buffer. the index of the command is returned.
+ */
+int gcmdbuf_memcpy(struct gdev_handle *h, struct gdev_cmdbuf *cb, uint64_t dst_addr, uint64_t src_addr, uint64_t size)
+{
+	gdev_vas_t *vas = h->vas;
+
+	if (size > 0xffffffff)
+		return -EINVAL;
+
+	if (!gdev_mem_lookup_by_addr(vas, dst_addr, GDEV_MEM_DEVICE) &&
+		!gdev_mem_lookup_by_addr(vas, dst_addr, GDEV_MEM_DMA))
+		return -ENOENT;
+	if (!gdev_mem_lookup_by_addr(vas, src_addr, GDEV_MEM_DEVICE) &&
+		!gdev_mem_lookup_by_addr(vas, src_addr, GDEV_MEM_DMA))
+		return -ENOENT;
+
+	return gdev_cmdbuf_memcpy(h->ctx, cb, dst_addr, src_addr, size);
+}
+
+/**
+ * gcmdbuf_update():
+ * replace the kernel launched by the @index-th command of the command 
+ * buffer, e.g., to change its parameters.
+ */
+int gcmdbuf_update(struct gdev_handle *h, struct gdev_cmdbuf *cb, int index, struct gdev_kernel *kernel)
+{
+	return gdev_cmdbuf_update(h->ctx, cb, index, kernel);
+}
+
+/**
+ * gcmdbuf_submit():
+ * submit all the commands in the command buffer at once. they are 
+ * scheduled as one compute job.
+ */
+int gcmdbuf_submit(struct gdev_handle *h, struct gdev_cmdbuf *cb, uint32_t *id)
+{
+	gdev_vas_t *vas = h->vas;
+	gdev_ctx_t *ctx = h->ctx;
+	struct gdev_launch_sets ls;
+
+	__take_sets(h, &ls);
+
+#ifndef GDEV_SCHED_DISABLED
+	/* decide if the context needs to stall or not. */
+	__schedule_compute(h, __prefetch, &ls);
+#endif
+
+	gdev_mem_lock_all(vas);
+
+	__retrieve_used(&ls);
+	*id = gdev_cmdbuf_submit(ctx, cb);
+	__mark_written(&ls);
+
+	gdev_mem_unlock_all(vas);
+
+	return 0;
+}
+
 /**
  * gsync():
  * poll until the GPU becomes available.
@@ -1103,9 +2131,67 @@ int gbarrier(struct gdev_handle *h)
  */
 int gquery(struct gdev_handle *h, uint32_t type, uint64_t *result)
 {
+	switch (type) {
+	case GDEV_QUERY_DEADLINE_JOBS:
+		if (!h->se)
+			return -EINVAL;
+		*result = h->se->deadline_jobs;
+		return 0;
+	case GDEV_QUERY_DEADLINE_MISSES:
+		if (!h->se)
+			return -EINVAL;
+		*result = h->se->deadline_misses;
+		return 0;
+	}
+
 	return gdev_query(h->gdev, type, result);
 }
 
+/**
+ * change the memcpy parameter @type of @h to @value, and reallocate the 
+ * bounce buffers. all the sets of them are held in the meantime, so it 
+ * fails if someone is copying data. the bounce buffers for swap are 
+ * replaced while swap waits for them.
+ */
+static int __tune_dma(struct gdev_handle *h, uint32_t type, uint32_t value)
+{
+	unsigned long all = (1UL << GDEV_MEMCPY_BOUNCE_COUNT) - 1;
+	uint32_t ch_size = h->chunk_size;
+	int p_count = h->pipeline_count;
+	int old_p_count = p_count;
+	gdev_mem_t **swap_dma, **old_swap_dma;
+
+	if (!__sync_bool_compare_and_swap(&h->dma_busy, 0, all))
+		return -EBUSY;
+
+	__free_dma_all(h);
+
+	if (type == GDEV_TUNE_MEMCPY_PIPELINE_COUNT)
+		p_count = value;
+	else
+		ch_size = value;
+
+	/* reallocate host DMA memory. it is allocated and freed without 
+	   swap_mutex, since the swap waiting for it holds the shared memory. */
+	swap_dma = __malloc_swap_dma(h->vas, ch_size, p_count);
+
+	gdev_mutex_lock(&h->swap_mutex);
+	old_swap_dma = h->swap_dma;
+	h->swap_dma = swap_dma;
+	gdev_lock(&h->lock);
+	h->chunk_size = ch_size;
+	h->pipeline_count = p_count;
+	gdev_unlock(&h->lock);
+	gdev_mutex_unlock(&h->swap_mutex);
+
+	if (old_swap_dma)
+		__free_dma(old_swap_dma, old_p_count);
+
+	__sync_fetch_and_and(&h->dma_busy, ~all);
+
+	return swap_dma ? 0 : -ENOMEM;
+}
+
 /**
  * gtune():
  * tune resource management parameters.
@@ -1117,40 +2203,63 @@ int gtune(struct gdev_handle *h, uint32_t type, uint32_t value)
 		if (value > GDEV_PIPELINE_MAX_COUNT || value < GDEV_PIPELINE_MIN_COUNT)
 			return -EINVAL;
 
-		if (h->dma_mem)
-			__free_dma(h->dma_mem, h->pipeline_count);
-
-		/* change the pipeline count here. */
-		h->pipeline_count = value;
-
-		/* reallocate host DMA memory. */
-		h->dma_mem = __malloc_dma(h->vas, h->chunk_size, h->pipeline_count);
-		if (!h->dma_mem)
-			return -ENOMEM;
-
-		break;
+		return __tune_dma(h, type, value);
 	case GDEV_TUNE_MEMCPY_CHUNK_SIZE:
 		if (value > GDEV_CHUNK_MAX_SIZE)
 			return -EINVAL;
 
-		if (h->dma_mem)
-			__free_dma(h->dma_mem, h->pipeline_count);
-
-		/* change the chunk size here. */
-		h->chunk_size = value;
+		return __tune_dma(h, type, value);
+	case GDEV_TUNE_DEADLINE:
+		if (!h->se)
+			return -EINVAL;
 
-		/* reallocate host DMA memory. */
-		h->dma_mem = __malloc_dma(h->vas, h->chunk_size, h->pipeline_count);
-		if (!h->dma_mem)
-			return -ENOMEM;
+		/* the budget must not exceed the new deadline. */
+		return gdev_sched_entity_set_deadline(h->se, value, value ? (gdev_min(h->se->budget, value)) : 0);
+	case GDEV_TUNE_BUDGET:
+		if (!h->se || !h->se->deadline)
+			return -EINVAL;
 
+		return gdev_sched_entity_set_deadline(h->se, h->se->deadline, value);
+	case GDEV_TUNE_SLICE_SIZE:
+#ifdef GDEV_SCHED_DISABLED
+		/* launches are sliced only to be scheduled in between. */
+		return -EINVAL;
+#else
+		h->slice_size = value;
 		break;
+#endif
+	case GDEV_TUNE_CTX_POOL_SIZE:
+		return __pool_resize(h->gdev, h->dev_id, value);
 	default:
 		return -EINVAL;
 	}
 	return 0;
 }
 
+/**
+ * gwriteset():
+ * declare that the next launch writes [@addr, @addr + @size) of device 
+ * memory, so that only these ranges need saving when evicted. if no range
+ * is declared, or too many, the launch is assumed to write everything.
+ */
+int gwriteset(struct gdev_handle *h, uint64_t addr, uint64_t size)
+{
+	return __access_set_add(h, &h->write_set, addr, size);
+}
+
+/**
+ * guseset():
+ * declare that the next launch accesses [@addr, @addr + @size) of device 
+ * memory, so that only these ranges need swapping back before it runs. if
+ * no range is declared, or too many, the launch is assumed to access 
+ * everything. unless declared by gwriteset(), these ranges are also 
+ * assumed to be written.
+ */
+int guseset(struct gdev_handle *h, uint64_t addr, uint64_t size)
+{
+	return __access_set_add(h, &h->use_set, addr, size);
+}
+
 int gshmget(Ghandle h, int key, uint64_t size, int flags)
 {
 	struct gdev_device *gdev = h->gdev;
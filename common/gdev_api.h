@@ -39,6 +39,9 @@
 /* Gdev handle members are not exposed to users. */
 typedef struct gdev_handle* Ghandle;
 
+/* neither are command buffer members. */
+struct gdev_cmdbuf;
+
 /**
  * Gdev APIs:
  */
@@ -61,10 +64,18 @@ int gmemcpy_user_from_device_async(Ghandle h, void *dst_buf, uint64_t src_addr,
 int gmemcpy(Ghandle h, uint64_t dst_addr, uint64_t src_addr, uint64_t size);
 int gmemcpy_async(Ghandle h, uint64_t dst_addr, uint64_t src_addr, uint64_t size, uint32_t *id);
 int glaunch(Ghandle h, struct gdev_kernel *kernel, uint32_t *id);
+struct gdev_cmdbuf *gcmdbuf_alloc(Ghandle h);
+int gcmdbuf_free(Ghandle h, struct gdev_cmdbuf *cb);
+int gcmdbuf_launch(Ghandle h, struct gdev_cmdbuf *cb, struct gdev_kernel *kernel);
+int gcmdbuf_memcpy(Ghandle h, struct gdev_cmdbuf *cb, uint64_t dst_addr, uint64_t src_addr, uint64_t size);
+int gcmdbuf_update(Ghandle h, struct gdev_cmdbuf *cb, int index, struct gdev_kernel *kernel);
+int gcmdbuf_submit(Ghandle h, struct gdev_cmdbuf *cb, uint32_t *id);
 int gsync(Ghandle h, uint32_t id, struct gdev_time *timeout);
 int gbarrier(Ghandle h);
 int gquery(Ghandle h, uint32_t type, uint64_t *result);
 int gtune(Ghandle h, uint32_t type, uint32_t value);
+int gwriteset(Ghandle h, uint64_t addr, uint64_t size);
+int guseset(Ghandle h, uint64_t addr, uint64_t size);
 int gshmget(Ghandle h, int key, uint64_t size, int flags);
 uint64_t gshmat(Ghandle h, int id, uint64_t addr, int flags);
 int gshmdt(Ghandle h, uint64_t addr);
@@ -81,6 +92,10 @@ int gdevice_count(int* result);
  */
 #define GDEV_TUNE_MEMCPY_PIPELINE_COUNT 1
 #define GDEV_TUNE_MEMCPY_CHUNK_SIZE 2
+#define GDEV_TUNE_DEADLINE 3 /* relative deadline of launches (us) */
+#define GDEV_TUNE_BUDGET 4 /* execution budget per deadline (us) */
+#define GDEV_TUNE_SLICE_SIZE 5 /* CTAs per slice of launches, 0 if unsliced */
+#define GDEV_TUNE_CTX_POOL_SIZE 6 /* contexts kept initialized on the device for gopen() */
 
 /**
  * common queries:
@@ -93,6 +108,12 @@ int gdevice_count(int* result);
 #define GDEV_QUERY_PCI_VENDOR 6
 #define GDEV_QUERY_PCI_DEVICE 7
 
+/**
+ * context queries:
+ */
+#define GDEV_QUERY_DEADLINE_JOBS 0x200 /* launches with deadlines */
+#define GDEV_QUERY_DEADLINE_MISSES 0x201 /* launches missing deadlines */
+
 /**
  * IPC commands:
  */
@@ -37,6 +37,7 @@
  */
 struct gdev_device; 
 struct gdev_kernel;
+struct gdev_cmdbuf;
 
 /**
  * Gdev types: they are not exposed to end users.
@@ -52,6 +53,12 @@ int gdev_compute_setup(struct gdev_device *gdev);
 uint32_t gdev_launch(gdev_ctx_t *ctx, struct gdev_kernel *kern);
 uint32_t gdev_memcpy(gdev_ctx_t *ctx, uint64_t dst_addr, uint64_t src_addr, uint32_t size);
 uint32_t gdev_memcpy_async(gdev_ctx_t *ctx, uint64_t dst_addr, uint64_t src_addr, uint32_t size);
+struct gdev_cmdbuf *gdev_cmdbuf_new(gdev_ctx_t *ctx);
+void gdev_cmdbuf_free(struct gdev_cmdbuf *cb);
+int gdev_cmdbuf_launch(gdev_ctx_t *ctx, struct gdev_cmdbuf *cb, struct gdev_kernel *kern);
+int gdev_cmdbuf_memcpy(gdev_ctx_t *ctx, struct gdev_cmdbuf *cb, uint64_t dst_addr, uint64_t src_addr, uint32_t size);
+int gdev_cmdbuf_update(gdev_ctx_t *ctx, struct gdev_cmdbuf *cb, int index, struct gdev_kernel *kern);
+uint32_t gdev_cmdbuf_submit(gdev_ctx_t *ctx, struct gdev_cmdbuf *cb);
 uint32_t gdev_read32(gdev_mem_t *mem, uint64_t addr);
 void gdev_write32(gdev_mem_t *mem, uint64_t addr, uint32_t val);
 int gdev_read(gdev_mem_t *mem, void *buf, uint64_t addr, uint32_t size);
@@ -82,8 +89,9 @@ gdev_mem_t *gdev_mem_alloc(gdev_vas_t *vas, uint64_t size, int type);
 gdev_mem_t *gdev_mem_share(gdev_vas_t *vas, uint64_t size);
 void gdev_mem_free(gdev_mem_t *mem);
 void gdev_mem_gc(gdev_vas_t *vas);
+void gdev_mem_gc_keep(gdev_vas_t *vas, gdev_mem_t **keep, int n);
 void *gdev_mem_map(gdev_mem_t *mem, uint64_t offset, uint64_t size);
-void gdev_mem_unmap(gdev_mem_t *mem);
+int gdev_mem_unmap(gdev_mem_t *mem);
 gdev_mem_t *gdev_mem_lookup_by_addr(gdev_vas_t *vas, uint64_t addr, int type);
 gdev_mem_t *gdev_mem_lookup_by_buf(gdev_vas_t *vas, const void *buf, int type);
 void *gdev_mem_getbuf(gdev_mem_t *mem);
@@ -95,9 +103,17 @@ int gdev_shm_destroy_mark(struct gdev_device *gdev, gdev_mem_t *owner);
 gdev_mem_t *gdev_shm_attach(gdev_vas_t *vas, gdev_mem_t *mem, uint64_t size);
 void gdev_shm_detach(gdev_mem_t *mem);
 gdev_mem_t *gdev_shm_lookup(struct gdev_device *gdev, int id);
-int gdev_shm_evict_conflict(gdev_ctx_t *ctx, gdev_mem_t *mem);
+int gdev_shm_evict_conflict(gdev_ctx_t *ctx, gdev_mem_t *mem, uint64_t addr, uint64_t size);
 int gdev_shm_retrieve_swap(gdev_ctx_t *ctx, gdev_mem_t *mem);
 int gdev_shm_retrieve_swap_all(gdev_ctx_t *ctx, gdev_vas_t *vas);
+int gdev_shm_retrieve_range(gdev_ctx_t *ctx, gdev_mem_t *mem, uint64_t addr, uint64_t size);
+int gdev_shm_swapped_out(gdev_vas_t *vas);
+void gdev_shm_mark_dirty(gdev_mem_t *mem, uint64_t addr, uint64_t size);
+void gdev_shm_mark_dirty_all(gdev_vas_t *vas);
+void gdev_shm_index_add(gdev_mem_t *mem);
+void gdev_shm_index_del(gdev_mem_t *mem);
+void gdev_shm_index_touch(gdev_mem_t *mem);
+void gdev_shm_index_touch_all(gdev_vas_t *vas);
 int gdev_swap_create(struct gdev_device *gdev, uint32_t size);
 void gdev_swap_destroy(struct gdev_device *gdev);
 
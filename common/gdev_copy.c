@@ -0,0 +1,311 @@
+/*
+ * Copyright (C) Shinpei Kato
+ *
+ * University of California, Santa Cruz
+ * Systems Research Lab.
+ *
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "gdev_conf.h"
+#include "gdev_copy.h"
+#include "gdev_system.h"
+
+#ifndef __KERNEL__
+#include <pthread.h>
+#include <unistd.h>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#endif
+
+#define GDEV_COPY_NT_MIN_SIZE 0x10000 /* 64KB, cached below. */
+
+#ifndef __KERNEL__
+/**
+ * copy with non-temporal stores: the destination is not read back by the 
+ * host, so it should neither be read for ownership nor pollute the caches.
+ */
+static void __gdev_copy_nt(void *dst, const void *src, uint64_t size)
+{
+#if defined(__SSE2__)
+	char *d = dst;
+	const char *s = src;
+	uint64_t head = (16 - ((unsigned long)d & 15)) & 15;
+	__m128i x0, x1, x2, x3;
+
+	if (size < GDEV_COPY_NT_MIN_SIZE) {
+		memcpy(dst, src, size);
+		return;
+	}
+
+	/* align the destination to 16 bytes. */
+	memcpy(d, s, head);
+	d += head;
+	s += head;
+	size -= head;
+
+	for (; size >= 64; size -= 64, d += 64, s += 64) {
+		x0 = _mm_loadu_si128((const __m128i *)s);
+		x1 = _mm_loadu_si128((const __m128i *)(s + 16));
+		x2 = _mm_loadu_si128((const __m128i *)(s + 32));
+		x3 = _mm_loadu_si128((const __m128i *)(s + 48));
+		_mm_stream_si128((__m128i *)d, x0);
+		_mm_stream_si128((__m128i *)(d + 16), x1);
+		_mm_stream_si128((__m128i *)(d + 32), x2);
+		_mm_stream_si128((__m128i *)(d + 48), x3);
+	}
+	/* the streaming stores are weakly ordered. */
+	_mm_sfence();
+	memcpy(d, s, size);
+#else
+	memcpy(dst, src, size);
+#endif
+}
+
+static void __gdev_copy_one(void *dst, const void *src, uint64_t size, int flags)
+{
+	if (flags & GDEV_COPY_NT)
+		__gdev_copy_nt(dst, src, size);
+	else
+		memcpy(dst, src, size);
+}
+
+/**
+ * a piece of the copy given to a worker.
+ */
+struct gdev_copy_job {
+	void *dst;
+	const void *src;
+	uint64_t size;
+	int flags;
+};
+
+/**
+ * the pool is shared by the process. only one copy uses it at a time; the 
+ * others copy on their callers rather than wait for it.
+ */
+static struct gdev_copy_pool {
+	pthread_mutex_t lock;
+	pthread_cond_t work; /* signaled when jobs are given. */
+	pthread_cond_t done; /* signaled when all the jobs are done. */
+	pthread_mutex_t busy; /* held by the copy using the pool. */
+	pthread_t thread[GDEV_MEMCPY_THREADS];
+	struct gdev_copy_job job[GDEV_MEMCPY_THREADS];
+	int threads; /* # of the workers running. */
+	int started; /* the pool has been started, maybe with no workers. */
+	int stopping;
+	int pending; /* # of the jobs not done yet. */
+	uint64_t round; /* incremented every time jobs are given. */
+} pool = {
+	.lock = PTHREAD_MUTEX_INITIALIZER,
+	.work = PTHREAD_COND_INITIALIZER,
+	.done = PTHREAD_COND_INITIALIZER,
+	.busy = PTHREAD_MUTEX_INITIALIZER,
+};
+
+static void *__gdev_copy_worker(void *arg)
+{
+	int id = (int)(long)arg;
+	struct gdev_copy_job *job = &pool.job[id];
+	uint64_t round = 0;
+
+	pthread_mutex_lock(&pool.lock);
+	for (;;) {
+		while (!pool.stopping && pool.round == round)
+			pthread_cond_wait(&pool.work, &pool.lock);
+		if (pool.stopping)
+			break;
+		round = pool.round;
+		if (!job->size)
+			continue;
+		pthread_mutex_unlock(&pool.lock);
+
+		__gdev_copy_one(job->dst, job->src, job->size, job->flags);
+
+		pthread_mutex_lock(&pool.lock);
+		job->size = 0;
+		if (--pool.pending == 0)
+			pthread_cond_signal(&pool.done);
+	}
+	pthread_mutex_unlock(&pool.lock);
+
+	return NULL;
+}
+
+/* the child of fork() inherits no workers. */
+static void __gdev_copy_atfork_child(void)
+{
+	pthread_mutex_init(&pool.lock, NULL);
+	pthread_cond_init(&pool.work, NULL);
+	pthread_cond_init(&pool.done, NULL);
+	pthread_mutex_init(&pool.busy, NULL);
+	pool.threads = 0;
+	pool.started = 0;
+	pool.stopping = 0;
+	pool.pending = 0;
+}
+
+static void __gdev_copy_atfork_register(void)
+{
+	pthread_atfork(NULL, NULL, __gdev_copy_atfork_child);
+}
+
+/**
+ * start @threads workers, or as many as the other cores if @threads < 0. 
+ * the pool is started at the first copy otherwise. the number of workers 
+ * running is returned.
+ */
+int gdev_copy_start(int threads)
+{
+	static pthread_once_t once = PTHREAD_ONCE_INIT;
+	long cpus;
+	int i;
+
+	pthread_once(&once, __gdev_copy_atfork_register);
+
+	pthread_mutex_lock(&pool.lock);
+	if (pool.started)
+		goto end;
+
+	if (threads < 0) {
+		/* the caller copies too. */
+		cpus = sysconf(_SC_NPROCESSORS_ONLN);
+		threads = cpus > 1 ? cpus - 1 : 0;
+	}
+	if (threads > GDEV_MEMCPY_THREADS)
+		threads = GDEV_MEMCPY_THREADS;
+
+	pool.stopping = 0;
+	for (i = 0; i < threads; i++) {
+		pool.job[i].size = 0;
+		if (pthread_create(&pool.thread[i], NULL, __gdev_copy_worker, (void *)(long)i)) {
+			GDEV_PRINT("Failed to start memcpy workers\n");
+			break;
+		}
+	}
+	pool.threads = i;
+	pool.started = 1;
+
+end:
+	threads = pool.threads;
+	pthread_mutex_unlock(&pool.lock);
+
+	return threads;
+}
+
+/**
+ * stop the workers. copies made after this start the pool again.
+ */
+void gdev_copy_stop(void)
+{
+	int i;
+
+	pthread_mutex_lock(&pool.busy);
+	pthread_mutex_lock(&pool.lock);
+	pool.stopping = 1;
+	pthread_cond_broadcast(&pool.work);
+	pthread_mutex_unlock(&pool.lock);
+
+	for (i = 0; i < pool.threads; i++)
+		pthread_join(pool.thread[i], NULL);
+
+	pthread_mutex_lock(&pool.lock);
+	pool.threads = 0;
+	pool.started = 0;
+	pool.stopping = 0;
+	pthread_mutex_unlock(&pool.lock);
+	pthread_mutex_unlock(&pool.busy);
+}
+
+/**
+ * copy @size bytes at @src to @dst, by the pool if the copy is worth 
+ * splitting. every piece but the last is a multiple of 64 bytes, so that 
+ * non-temporal stores stay aligned across the pieces.
+ */
+void gdev_copy(void *dst, const void *src, uint64_t size, int flags)
+{
+	uint64_t piece, offset;
+	int threads, n, i;
+
+	if (size < 2 * GDEV_MEMCPY_THREAD_SIZE)
+		goto single;
+
+	/* someone else is using the pool. */
+	if (pthread_mutex_trylock(&pool.busy))
+		goto single;
+	/* the pool is started at the first copy, and cannot be stopped while
+	   it is busy. */
+	if (!(threads = gdev_copy_start(-1))) {
+		pthread_mutex_unlock(&pool.busy);
+		goto single;
+	}
+
+	n = size / GDEV_MEMCPY_THREAD_SIZE;
+	if (n > threads + 1)
+		n = threads + 1;
+	piece = (size / n) & ~63ULL;
+
+	pthread_mutex_lock(&pool.lock);
+	for (i = 0, offset = 0; i < n - 1; i++, offset += piece) {
+		pool.job[i].dst = dst + offset;
+		pool.job[i].src = src + offset;
+		pool.job[i].size = piece;
+		pool.job[i].flags = flags;
+	}
+	pool.pending = n - 1;
+	pool.round++;
+	pthread_cond_broadcast(&pool.work);
+	pthread_mutex_unlock(&pool.lock);
+
+	/* the last piece is copied by the caller. */
+	__gdev_copy_one(dst + offset, src + offset, size - offset, flags);
+
+	pthread_mutex_lock(&pool.lock);
+	while (pool.pending)
+		pthread_cond_wait(&pool.done, &pool.lock);
+	pthread_mutex_unlock(&pool.lock);
+	pthread_mutex_unlock(&pool.busy);
+
+	return;
+
+single:
+	__gdev_copy_one(dst, src, size, flags);
+}
+
+#else /* __KERNEL__ */
+
+int gdev_copy_start(int threads)
+{
+	return 0;
+}
+
+void gdev_copy_stop(void)
+{
+}
+
+void gdev_copy(void *dst, const void *src, uint64_t size, int flags)
+{
+	memcpy(dst, src, size);
+}
+
+#endif
@@ -0,0 +1,48 @@
+/*
+ * Copyright (C) Shinpei Kato
+ *
+ * University of California, Santa Cruz
+ * Systems Research Lab.
+ *
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef __GDEV_COPY_H__
+#define __GDEV_COPY_H__
+
+#ifndef __KERNEL__
+#include <stdint.h>
+#endif
+
+/**
+ * host copies of the memcpy pipelines: a large copy is split across a pool 
+ * of worker threads and the caller, so that more than one core drives the 
+ * memory bandwidth while the DMA of the previous chunk proceeds. the pool 
+ * is available only in user-space; the kernel copies on the caller.
+ */
+#define GDEV_COPY_NT 0x1 /* non-temporal stores, e.g., into DMA memory. */
+
+int gdev_copy_start(int threads);
+void gdev_copy_stop(void);
+void gdev_copy(void *dst, const void *src, uint64_t size, int flags);
+
+#endif
@@ -49,6 +49,8 @@ int VCOUNT_LIST[GDEV_PHYSICAL_DEVICE_MAX_COUNT] = {
 
 void __gdev_init_device(struct gdev_device *gdev, int id)
 {
+	int i;
+
 	gdev->id = id;
 	gdev->users = 0;
 	gdev->accessed = 0;
@@ -64,9 +66,23 @@ void __gdev_init_device(struct gdev_device *gdev, int id)
 	gdev->com_bw_used = 0;
 	gdev->mem_bw_used = 0;
 	gdev->period = 0;
+	gdev->vsched_policy = GDEV_VSCHED_DEFAULT;
+	gdev->sched_queueing = GDEV_SCHED_QUEUEING_DEFAULT;
+	gdev->deadline_util = 0;
 	gdev->com_time = 0;
 	gdev->mem_time = 0;
+	gdev->com_time_rem = 0;
+	gdev->mem_time_rem = 0;
+	gdev->com_time_uncharged = 0;
+	gdev->mem_time_uncharged = 0;
+	gdev->vtime_com = 0;
+	gdev->vtime_mem = 0;
 	gdev->swap = NULL;
+	gdev->swap_compress = GDEV_SWAP_COMPRESS;
+	gdev_list_init(&gdev->ctx_pool, NULL);
+	gdev->ctx_pool_count = 0;
+	gdev->ctx_pool_size = GDEV_CTX_POOL_SIZE;
+	gdev->ctx_pool_refilling = 0;
 	gdev->sched_com_thread = NULL;
 	gdev->sched_mem_thread = NULL;
 	gdev->credit_com_thread = NULL;
@@ -77,15 +93,37 @@ void __gdev_init_device(struct gdev_device *gdev, int id)
 	gdev->priv = NULL;
 	gdev_time_us(&gdev->credit_com, 0);
 	gdev_time_us(&gdev->credit_mem, 0);
+	gdev_time_us(&gdev->arrival_com, 0);
+	gdev_time_us(&gdev->arrival_mem, 0);
+	gdev->interarrival_com = 0;
+	gdev->interarrival_mem = 0;
+	gdev->mem_rate = 0;
+	gdev->mem_tokens = 0;
+	gdev_time_stamp(&gdev->mem_tokens_stamp);
 	gdev_list_init(&gdev->sched_com_list, NULL);
 	gdev_list_init(&gdev->sched_mem_list, NULL);
+	gdev_queue_init(&gdev->sched_com_queue);
+	gdev_queue_init(&gdev->sched_mem_queue);
 	gdev_list_init(&gdev->vas_list, NULL);
 	gdev_list_init(&gdev->shm_list, NULL);
+	gdev_list_init(&gdev->map_cache, NULL);
+	gdev->map_cache_size = 0;
+	gdev_iotune_init(&gdev->iowrite, GDEV_MEMCPY_IOWRITE_LIMIT);
+	gdev_iotune_init(&gdev->ioread, GDEV_MEMCPY_IOREAD_LIMIT);
+	for (i = 0; i < GDEV_EVICT_CLASSES; i++)
+		gdev_queue_init(&gdev->evict_index[i]);
 	gdev_lock_init(&gdev->sched_com_lock);
 	gdev_lock_init(&gdev->sched_mem_lock);
 	gdev_lock_init(&gdev->vas_lock);
 	gdev_lock_init(&gdev->global_lock);
 	gdev_mutex_init(&gdev->shm_mutex);
+	gdev_mutex_init(&gdev->map_mutex);
+	gdev_lock_init(&gdev->ctx_pool_lock);
+	gdev_event_init(&gdev->ctx_pool_event);
+	gdev_event_init(&gdev->sched_com_event);
+	gdev_event_init(&gdev->sched_mem_event);
+	gdev_event_init(&gdev->throttle_mem_event);
+	gdev_trace_init(&gdev->trace);
 }
 
 /* initialize the physical device information. */
@@ -116,6 +154,7 @@ int gdev_init_device(struct gdev_device *gdev, int id, void *priv)
 /* finalize the physical device. */
 void gdev_exit_device(struct gdev_device *gdev)
 {
+	gdev_ctx_pool_drain(gdev);
 }
 
 /* initialize the virtual device information. */
@@ -144,6 +183,8 @@ int gdev_init_virtual_device(struct gdev_device *gdev, int id, uint32_t weight,
 /* finalize the virtual device. */
 void gdev_exit_virtual_device(struct gdev_device *gdev)
 {
+	gdev_ctx_pool_drain(gdev);
+
 	if (GDEV_SWAP_MEM_SIZE > 0) {
 		gdev_swap_destroy(gdev);
 	}
@@ -30,8 +30,11 @@
 #define __GDEV_DEVICE_H__
 
 #include "gdev_arch.h"
+#include "gdev_iotune.h"
 #include "gdev_list.h"
+#include "gdev_queue.h"
 #include "gdev_system.h"
+#include "gdev_trace.h"
 
 /**
  * maximum number of physical devices that Gdev supports
@@ -45,6 +48,14 @@
 #define GDEV_OP_MEMCPY 2
 #define GDEV_OP_MEMCPY_ASYNC 3
 
+/**
+ * eviction index: device memory objects are queued per size class, at the
+ * level of their priority in least-recently-used order.
+ */
+#define GDEV_EVICT_SHIFT 16 /* the smallest size class holds up to 64KB */
+#define GDEV_EVICT_CLASSES 32
+#define GDEV_EVICT_SCAN 64 /* objects looked at per class and level */
+
 /**
  * Gdev device struct:
  */
@@ -62,12 +73,28 @@ struct gdev_device {
 	uint32_t mem_bw; /* available memory bandwidth */
 	uint32_t mem_sh; /* available memory space share */
 	uint32_t period; /* minimum inter-arrival time (us) of replenishment. */
+	int vsched_policy; /* virtual device scheduling policy (GDEV_VSCHED_*) */
+	int sched_queueing; /* queueing method (GDEV_SCHED_SDQ or MRQ) */
+	uint32_t deadline_util; /* utilization (permille) reserved by deadlines */
 	uint32_t com_bw_used; /* used compute bandwidth */
 	uint32_t mem_bw_used; /* used memory bandwidth */
 	uint32_t com_time; /* cumulative computation time. */
 	uint32_t mem_time; /* cumulative memory transfer time. */
+	uint32_t com_time_rem; /* nanoseconds of com_time below a microsecond. */
+	uint32_t mem_time_rem; /* nanoseconds of mem_time below a microsecond. */
+	uint64_t com_time_uncharged; /* computation time (ns) not yet in vtime_com. */
+	uint64_t mem_time_uncharged; /* memory transfer time (ns) not yet in vtime_mem. */
+	uint64_t vtime_com; /* virtual time of compute (fair queueing) */
+	uint64_t vtime_mem; /* virtual time of memory transfer (fair queueing) */
 	struct gdev_time credit_com; /* credit of compute execution */
 	struct gdev_time credit_mem; /* credit of memory transfer */
+	struct gdev_time arrival_com; /* last arrival of a compute entity */
+	struct gdev_time arrival_mem; /* last arrival of a memory entity */
+	uint32_t interarrival_com; /* average inter-arrival time (us) of compute */
+	uint32_t interarrival_mem; /* average inter-arrival time (us) of memory */
+	uint64_t mem_rate; /* memcpy rate (bytes/s) to be shared, 0 if unlimited */
+	int64_t mem_tokens; /* bytes that can be copied without throttling */
+	struct gdev_time mem_tokens_stamp; /* last refill of mem_tokens */
 	void *priv; /* private device object */
 	void *compute; /* private set of compute functions */
 	void *sched_com_thread; /* compute scheduler thread */
@@ -79,16 +106,35 @@ struct gdev_device {
 	struct gdev_device *parent; /* only for virtual devices */
 	struct gdev_list list_entry_com; /* entry to active compute list */
 	struct gdev_list list_entry_mem; /* entry to active memory list */
-	struct gdev_list sched_com_list; /* wait list for compute scheduling */
-	struct gdev_list sched_mem_list; /* wait list for memory scheduling */
+	struct gdev_list sched_com_list; /* virtual devices for compute scheduling */
+	struct gdev_list sched_mem_list; /* virtual devices for memory scheduling */
+	struct gdev_queue sched_com_queue; /* wait queue for compute scheduling */
+	struct gdev_queue sched_mem_queue; /* wait queue for memory scheduling */
 	struct gdev_list vas_list; /* list of VASes allocated to this device */
 	struct gdev_list shm_list; /* list of shm users allocated to this device */
+	struct gdev_queue evict_index[GDEV_EVICT_CLASSES]; /* eviction candidates */
+	struct gdev_list map_cache; /* mappings no one uses, least recent first */
+	uint64_t map_cache_size; /* bytes of mappings of large buffers */
+	struct gdev_iotune iowrite; /* direct I/O limit of writes, if physical */
+	struct gdev_iotune ioread; /* direct I/O limit of reads, if physical */
 	gdev_lock_t sched_com_lock;
 	gdev_lock_t sched_mem_lock;
 	gdev_lock_t vas_lock;
 	gdev_lock_t global_lock;
 	gdev_mutex_t shm_mutex;
+	gdev_mutex_t map_mutex;
+	gdev_event_t sched_com_event; /* arrivals for compute scheduling */
+	gdev_event_t sched_mem_event; /* arrivals for memory scheduling */
+	gdev_event_t throttle_mem_event; /* changes of mem_rate */
 	gdev_mem_t *swap; /* reserved swap memory space */
+	int swap_compress; /* compress the host swap of new memory */
+	struct gdev_list ctx_pool; /* contexts kept initialized for gopen() */
+	int ctx_pool_count; /* # of the contexts in ctx_pool */
+	int ctx_pool_size; /* # of the contexts to keep, 0 if no pool */
+	int ctx_pool_refilling; /* the thread refilling ctx_pool is running */
+	gdev_lock_t ctx_pool_lock;
+	gdev_event_t ctx_pool_event; /* shortages of ctx_pool */
+	struct gdev_trace trace; /* scheduler events, only for physical devices */
 };
 
 int gdev_init_device(struct gdev_device *gdev, int id, void *priv);
@@ -96,6 +142,7 @@ void gdev_exit_device(struct gdev_device *gdev);
 
 int gdev_init_virtual_device(struct gdev_device *gdev, int id, uint32_t weight, struct gdev_device *parent);
 void gdev_exit_virtual_device(struct gdev_device*);
+void gdev_ctx_pool_drain(struct gdev_device *gdev);
 int gdev_getinfo_device_count(void);
 
 extern int gdev_count;
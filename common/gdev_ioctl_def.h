@@ -62,6 +62,8 @@
 #define GDEV_IOCTL_GUNREF 0x122
 #define GDEV_IOCTL_GPHYSGET 0x123
 #define GDEV_IOCTL_GVIRTGET 0x124
+#define GDEV_IOCTL_GWRITESET 0x125
+#define GDEV_IOCTL_GUSESET 0x126
 
 struct gdev_ioctl_handle {
 	uint64_t handle;
@@ -0,0 +1,121 @@
+/*
+ * Copyright (C) Shinpei Kato
+ *
+ * University of California, Santa Cruz
+ * Systems Research Lab.
+ *
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef __GDEV_IOTUNE_H__
+#define __GDEV_IOTUNE_H__
+
+#ifndef __KERNEL__
+#include <stdint.h>
+#endif
+
+/**
+ * direct I/O threshold tuning: copies no larger than the limit access the 
+ * BAR directly, and the others go through DMA. copies around the limit 
+ * are timed, one in GDEV_IOTUNE_EXPLORE of them by the other path, and 
+ * the limit moves toward the path that costs less per byte, staying within
+ * GDEV_IOTUNE_RANGE times of where it started.
+ */
+#define GDEV_IOTUNE_EXPLORE 8
+#define GDEV_IOTUNE_SAMPLES 32 /* copies timed before the limit moves */
+#define GDEV_IOTUNE_RANGE 16
+
+struct gdev_iotune {
+	uint32_t limit; /* copies up to this size are by direct I/O */
+	uint32_t min, max; /* the range of the limit */
+	uint32_t count; /* copies around the limit */
+	uint32_t samples; /* copies timed */
+	uint64_t io_ns, io_bytes; /* time and bytes by direct I/O */
+	uint64_t dma_ns, dma_bytes; /* time and bytes by DMA */
+};
+
+static inline void gdev_iotune_init(struct gdev_iotune *t, uint32_t limit)
+{
+	t->limit = limit;
+	t->min = limit / GDEV_IOTUNE_RANGE;
+	t->max = limit * GDEV_IOTUNE_RANGE;
+	t->count = 0;
+	t->samples = 0;
+	t->io_ns = t->io_bytes = 0;
+	t->dma_ns = t->dma_bytes = 0;
+}
+
+/**
+ * return true if @size bytes should be copied by direct I/O. @timed is set 
+ * if the copy is around the limit and to be given to gdev_iotune_update().
+ */
+static inline int gdev_iotune_direct(struct gdev_iotune *t, uint64_t size, int *timed)
+{
+	int direct = size <= t->limit;
+
+	*timed = 0;
+	if (size < t->limit / 2 || size > (uint64_t)t->limit * 2)
+		return direct;
+
+	*timed = 1;
+	/* explore the other path once in a while. */
+	if (++t->count % GDEV_IOTUNE_EXPLORE == 0)
+		direct = !direct;
+
+	return direct;
+}
+
+/**
+ * account @ns nanoseconds taken to copy @size bytes by direct I/O if 
+ * @direct is true, or by DMA otherwise, and move the limit if enough 
+ * copies have been timed by both the paths.
+ */
+static inline void gdev_iotune_update(struct gdev_iotune *t, int direct, uint64_t size, uint64_t ns)
+{
+	if (direct) {
+		t->io_ns += ns;
+		t->io_bytes += size;
+	}
+	else {
+		t->dma_ns += ns;
+		t->dma_bytes += size;
+	}
+
+	if (++t->samples < GDEV_IOTUNE_SAMPLES || !t->io_bytes || !t->dma_bytes)
+		return;
+
+	/* io_ns / io_bytes vs. dma_ns / dma_bytes. */
+	if (t->io_ns * t->dma_bytes < t->dma_ns * t->io_bytes)
+		t->limit += t->limit / 4;
+	else
+		t->limit -= t->limit / 5;
+	if (t->limit > t->max)
+		t->limit = t->max;
+	if (t->limit < t->min)
+		t->limit = t->min;
+
+	t->samples = 0;
+	t->io_ns = t->io_bytes = 0;
+	t->dma_ns = t->dma_bytes = 0;
+}
+
+#endif
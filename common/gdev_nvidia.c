@@ -81,7 +81,7 @@ struct gdev_vas *gdev_vas_new(struct gdev_device *gdev, uint64_t size, void *han
 	gdev_list_init(&vas->list_entry, (void *) vas); /* entry to VAS list. */
 	gdev_list_init(&vas->mem_list, NULL); /* device memory list. */
 	gdev_list_init(&vas->dma_mem_list, NULL); /* host dma memory list. */
-	gdev_lock_init(&vas->lock);
+	gdev_rwlock_init(&vas->lock);
 
 	__gdev_vas_list_add(vas);
 
@@ -107,6 +107,7 @@ struct gdev_ctx *gdev_ctx_new(struct gdev_device *gdev, struct gdev_vas *vas)
 
 	/* save the paraent object. */
 	ctx->vas = vas;
+	gdev_mutex_init(&ctx->submit_mutex);
 
 	/* initialize the compute-related objects. this must follow ctx_new(). */
 	compute->init(ctx);
@@ -80,7 +80,8 @@
  * Gdev shared memory information:
  */
 struct gdev_shm {
-	struct gdev_mem *holder; /* current memory holder */
+	struct gdev_mem *holder; /* object holding all the pages, if any */
+	struct gdev_mem **page_owner; /* object holding each swap page */
 	struct gdev_list mem_list; /* list of memory objects attached */
 	struct gdev_list list_entry; /* entry to the list of shared memory */
 	gdev_mutex_t mutex;
@@ -124,7 +125,7 @@ struct gdev_vas {
 	struct gdev_list mem_list; /* list of device memory spaces. */
 	struct gdev_list dma_mem_list; /* list of host dma memory spaces. */
 	struct gdev_list list_entry; /* entry to the vas list. */
-	gdev_lock_t lock;
+	gdev_rwlock_t lock; /* written only when the memory lists change. */
 	int prio;
 };
 
@@ -169,6 +170,7 @@ struct gdev_ctx {
 		uint64_t addr;
 	} notify;
 	uint32_t dummy;
+	gdev_mutex_t submit_mutex; /* serializes the FIFO among threads. */
 	void *pdata; /* arch-specific private data object. */
 	struct gdev_desc {
 	    void *bo;
@@ -185,18 +187,49 @@ struct gdev_mem {
 	struct gdev_vas *vas; /* mem is associated with a specific vas object */
 	struct gdev_list list_entry_heap; /* entry to heap list */
 	struct gdev_list list_entry_shm; /* entry to shared memory list */
+	struct gdev_list list_entry_evict; /* entry to eviction index */
+	int evict_level; /* level in the eviction index, -1 if not indexed */
 	struct gdev_shm *shm; /* shared memory information */
 	struct gdev_mem *swap_mem; /* device memory for temporal swap */
 	void *swap_buf; /* host buffer for swap */
+	struct gdev_zswap *swap_zbuf; /* compressed host buffer instead */
+	unsigned long *swap_dirty; /* pages newer on the device than in swap */
+	unsigned long *swap_saved; /* pages whose data is in swap */
+	unsigned long *swap_dev; /* saved pages in the device swap */
 	int evicted; /* 1 if evicted, 0 otherwise */
 	uint64_t size; /* memory size */
 	uint64_t addr; /* virtual memory address */
 	int type; /* device or host dma? */
 	void *map; /* memory-mapped buffer */
 	int map_users; /* # of users referencing the map */
+	struct gdev_list list_entry_map; /* entry to cached mappings */
 	void *pdata; /* arch-specific private data object. */
 };
 
+/**
+ * command buffer struct: launches and copies encoded once, and submitted 
+ * to the FIFO as many times as requested.
+ */
+#define GDEV_CMD_LAUNCH 1
+#define GDEV_CMD_MEMCPY 2
+#define GDEV_CMDBUF_CAPTURE_SIZE 0x10000 /* bytes: enough for any command. */
+struct gdev_cmdbuf {
+	struct gdev_cmd {
+		int type; /* GDEV_CMD_LAUNCH or GDEV_CMD_MEMCPY */
+		struct gdev_kernel kernel; /* own copy, incl. param_buf */
+		uint64_t dst_addr;
+		uint64_t src_addr;
+		uint32_t size;
+		uint32_t pos; /* first word in the encoded words */
+		uint32_t len; /* number of the encoded words */
+	} *cmd;
+	int count; /* number of commands */
+	int max_count; /* capacity of @cmd */
+	uint32_t *words; /* encoded words, NULL if not encodable */
+	uint32_t len; /* number of the encoded words */
+	uint32_t size; /* capacity of @words in words */
+};
+
 /**
  * private compute functions. 
  */
@@ -288,6 +321,34 @@ static inline void __gdev_out_ring(struct gdev_ctx *ctx, uint32_t word)
 	ctx->fifo.pb_pos &= ctx->fifo.pb_mask;
 }
 
+/* copy @count words encoded in advance to the ring. the words are fired
+   whenever the ring gets full, as the GPU never consumes unfired words. */
+static inline void __gdev_out_ring_words(struct gdev_ctx *ctx, const uint32_t *words, uint32_t count)
+{
+	while (count) {
+		uint32_t pos = ctx->fifo.pb_pos;
+		uint32_t room = (ctx->fifo.pb_get - pos - 4) & ctx->fifo.pb_mask;
+		uint32_t n;
+
+		if (room == 0) {
+			uint32_t old = ctx->fifo.pb_get;
+			__gdev_fire_ring(ctx);
+			ctx->fifo.update_get(ctx);
+			if (old == ctx->fifo.pb_get) {
+				SCHED_YIELD();
+			}
+			continue;
+		}
+		if (room > ctx->fifo.pb_size - pos)
+			room = ctx->fifo.pb_size - pos; /* up to the end of the ring. */
+		n = room / 4 < count ? room / 4 : count;
+		memcpy(&ctx->fifo.pb_map[pos/4], words, n * 4);
+		ctx->fifo.pb_pos = (pos + n * 4) & ctx->fifo.pb_mask;
+		words += n;
+		count -= n;
+	}
+}
+
 static inline void __gdev_ring_space(struct gdev_ctx *ctx, uint32_t word)
 {
 	if (ctx->fifo.space)
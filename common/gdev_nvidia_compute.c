@@ -63,26 +63,31 @@ int gdev_compute_setup(struct gdev_device *gdev)
 	return 0;
 }
 
+/* allocate the next fence sequence of @ctx, which is never 0. threads of a
+   process may allocate sequences at the same time. */
+static uint32_t __gdev_fence_next(struct gdev_ctx *ctx)
+{
+	uint32_t old, seq;
+
+	do {
+		old = __atomic_load_n(&ctx->fence.seq, __ATOMIC_RELAXED);
+		seq = old + 1 == GDEV_FENCE_COUNT ? 1 : old + 1;
+	} while (!__sync_bool_compare_and_swap(&ctx->fence.seq, old, seq));
+
+	return seq;
+}
+
 /* launch the kernel onto the GPU. */
 uint32_t gdev_launch(struct gdev_ctx *ctx, struct gdev_kernel *kern)
 {
 	struct gdev_vas *vas = ctx->vas;
 	struct gdev_device *gdev = vas->gdev;
-	struct gdev_mem *dev_swap = gdev_swap_get(gdev);
 	struct gdev_compute *compute = gdev_compute_get(gdev);
 	uint32_t seq;
 
-	/* evict data saved in device swap memory space to host memory. */
-	if (dev_swap && dev_swap->shm->holder) {
-		struct gdev_mem *mem = dev_swap->shm->holder;
-		gdev_shm_evict_conflict(ctx, mem->swap_mem); /* don't use gdev->swap */
-		dev_swap->shm->holder = NULL;
-	}
-
-	if (++ctx->fence.seq == GDEV_FENCE_COUNT)
-		ctx->fence.seq = 1;
-	seq = ctx->fence.seq;
+	seq = __gdev_fence_next(ctx);
 
+	gdev_mutex_lock(&ctx->submit_mutex);
 	compute->membar(ctx);
 	/* it's important to emit a fence *after* launch():
 	   the LAUNCH method of the PGRAPH engine is not associated with
@@ -96,6 +101,7 @@ uint32_t gdev_launch(struct gdev_ctx *ctx, struct gdev_kernel *kern)
 	/* set an interrupt to be caused when compute done. */
 	compute->notify_intr(ctx);
 #endif
+	gdev_mutex_unlock(&ctx->submit_mutex);
 	
 	return seq;
 }
@@ -108,10 +114,9 @@ uint32_t gdev_memcpy(struct gdev_ctx *ctx, uint64_t dst_addr, uint64_t src_addr,
 	struct gdev_compute *compute = gdev_compute_get(gdev);
 	uint32_t seq;
 
-	if (++ctx->fence.seq == GDEV_FENCE_COUNT)
-		ctx->fence.seq = 1;
-	seq = ctx->fence.seq;
+	seq = __gdev_fence_next(ctx);
 
+	gdev_mutex_lock(&ctx->submit_mutex);
 	compute->membar(ctx);
 	/* it's important to emit a fence *before* memcpy():
 	   the EXEC method of the PCOPY and M2MF engines is associated with
@@ -126,6 +131,7 @@ uint32_t gdev_memcpy(struct gdev_ctx *ctx, uint64_t dst_addr, uint64_t src_addr,
 	    compute->fence_write(ctx, GDEV_OP_MEMCPY /* == M2MF */, seq);
 	    compute->memcpy(ctx, dst_addr, src_addr, size);
 	}
+	gdev_mutex_unlock(&ctx->submit_mutex);
 
 	return seq;
 }
@@ -138,10 +144,9 @@ uint32_t gdev_memcpy_async(struct gdev_ctx *ctx, uint64_t dst_addr, uint64_t src
 	struct gdev_compute *compute = gdev_compute_get(gdev);
 	uint32_t seq;
 
-	if (++ctx->fence.seq == GDEV_FENCE_COUNT)
-		ctx->fence.seq = 1;
-	seq = ctx->fence.seq;
+	seq = __gdev_fence_next(ctx);
 
+	gdev_mutex_lock(&ctx->submit_mutex);
 	compute->membar(ctx);
 	/* it's important to emit a fence *before* memcpy():
 	   the EXEC method of the PCOPY and M2MF engines is associated with
@@ -156,6 +161,324 @@ uint32_t gdev_memcpy_async(struct gdev_ctx *ctx, uint64_t dst_addr, uint64_t src
 	    compute->fence_write(ctx, GDEV_OP_MEMCPY_ASYNC /* == PCOPY0 */, seq);
 	    compute->memcpy_async(ctx, dst_addr, src_addr, size);
 	}
+	gdev_mutex_unlock(&ctx->submit_mutex);
+
+	return seq;
+}
+
+/* launches on some chipsets depend on memory written by the host at the 
+   time of launch, e.g., the compute descriptor of NVE4, and some backends
+   have no FIFO at all. commands are then emitted one by one on submit. */
+static int __gdev_cmdbuf_encodable(struct gdev_ctx *ctx)
+{
+	return ctx->fifo.pb_map && !ctx->desc.map;
+}
+
+/* emit the methods of @cmd. nothing is fenced in between commands, but 
+   M2MF always writes a query with its last line, which is directed to 
+   sequence 0 so that it never completes a pending sequence. */
+static void __gdev_cmdbuf_emit(struct gdev_ctx *ctx, struct gdev_cmd *cmd)
+{
+	struct gdev_device *gdev = ctx->vas->gdev;
+	struct gdev_compute *compute = gdev_compute_get(gdev);
+
+	compute->membar(ctx);
+	switch (cmd->type) {
+	case GDEV_CMD_LAUNCH:
+		compute->launch(ctx, &cmd->kernel);
+		break;
+	case GDEV_CMD_MEMCPY:
+		if (!((gdev->chipset & 0xf0) >= 0xe0 || (gdev->chipset & 0xf000)))
+			compute->fence_write(ctx, GDEV_OP_MEMCPY, 0);
+		compute->memcpy(ctx, cmd->dst_addr, cmd->src_addr, cmd->size);
+		break;
+	}
+}
+
+/* nothing is submitted while capturing: words just stay in the buffer. */
+static void __gdev_cmdbuf_push(struct gdev_ctx *ctx, uint64_t base, uint32_t len, int flags)
+{
+}
+
+/* encode @cmd into @words by redirecting the FIFO of @ctx to @words for a 
+   moment. @words must have GDEV_CMDBUF_CAPTURE_SIZE bytes of room. others
+   must not submit in the meantime. */
+static uint32_t __gdev_cmdbuf_capture(struct gdev_ctx *ctx, struct gdev_cmd *cmd, uint32_t *words)
+{
+	struct gdev_fifo fifo;
+	uint32_t len;
+
+	gdev_mutex_lock(&ctx->submit_mutex);
+	fifo = ctx->fifo;
+	ctx->fifo.pb_map = words;
+	ctx->fifo.pb_base = 0;
+	ctx->fifo.pb_size = GDEV_CMDBUF_CAPTURE_SIZE;
+	ctx->fifo.pb_mask = GDEV_CMDBUF_CAPTURE_SIZE - 1;
+	ctx->fifo.pb_pos = 0;
+	ctx->fifo.pb_put = 0;
+	ctx->fifo.pb_get = 1; /* never reached, as positions are word-aligned. */
+	ctx->fifo.space = NULL;
+	ctx->fifo.push = __gdev_cmdbuf_push;
+	ctx->fifo.kick = NULL;
+
+	__gdev_cmdbuf_emit(ctx, cmd);
+	len = ctx->fifo.pb_pos / 4;
+
+	ctx->fifo = fifo;
+	gdev_mutex_unlock(&ctx->submit_mutex);
+
+	return len;
+}
+
+/* make sure there is room for one more capture at the end of the words. */
+static int __gdev_cmdbuf_reserve(struct gdev_cmdbuf *cb)
+{
+	uint32_t size = cb->len + GDEV_CMDBUF_CAPTURE_SIZE / 4;
+	uint32_t *words;
+
+	if (size <= cb->size)
+		return 0;
+
+	size = size > cb->size * 2 ? size : cb->size * 2;
+	if (!(words = MALLOC(size * 4)))
+		return -ENOMEM;
+	if (cb->words) {
+		memcpy(words, cb->words, cb->len * 4);
+		FREE(cb->words);
+	}
+	cb->words = words;
+	cb->size = size;
+
+	return 0;
+}
+
+static int __gdev_cmdbuf_encode(struct gdev_ctx *ctx, struct gdev_cmdbuf *cb, struct gdev_cmd *cmd)
+{
+	if (__gdev_cmdbuf_reserve(cb))
+		return -ENOMEM;
+
+	cmd->pos = cb->len;
+	cmd->len = __gdev_cmdbuf_capture(ctx, cmd, &cb->words[cb->len]);
+	cb->len += cmd->len;
+
+	return 0;
+}
+
+static struct gdev_cmd *__gdev_cmdbuf_add(struct gdev_cmdbuf *cb)
+{
+	struct gdev_cmd *cmd;
+
+	if (cb->count == cb->max_count) {
+		int max_count = cb->max_count ? cb->max_count * 2 : 16;
+		if (!(cmd = MALLOC(sizeof(*cmd) * max_count)))
+			return NULL;
+		if (cb->cmd) {
+			memcpy(cmd, cb->cmd, sizeof(*cmd) * cb->count);
+			FREE(cb->cmd);
+		}
+		cb->cmd = cmd;
+		cb->max_count = max_count;
+	}
+
+	cmd = &cb->cmd[cb->count];
+	memset(cmd, 0, sizeof(*cmd));
+
+	return cmd;
+}
+
+/* copy @kern into @cmd. the parameter buffer is copied as well, as it is
+   referenced every time the command is encoded. */
+static int __gdev_cmdbuf_set_kernel(struct gdev_cmd *cmd, struct gdev_kernel *kern)
+{
+	uint32_t *param_buf = cmd->kernel.param_buf;
+
+	if (param_buf && cmd->kernel.param_size != kern->param_size) {
+		FREE(param_buf);
+		param_buf = NULL;
+	}
+	if (!param_buf && kern->param_size) {
+		if (!(param_buf = MALLOC(kern->param_size)))
+			return -ENOMEM;
+	}
+	if (param_buf)
+		memcpy(param_buf, kern->param_buf, kern->param_size);
+
+	cmd->kernel = *kern;
+	cmd->kernel.param_buf = param_buf;
+
+	return 0;
+}
+
+/* allocate a new command buffer for @ctx. */
+struct gdev_cmdbuf *gdev_cmdbuf_new(struct gdev_ctx *ctx)
+{
+	struct gdev_cmdbuf *cb;
+
+	if (!(cb = MALLOC(sizeof(*cb))))
+		return NULL;
+	memset(cb, 0, sizeof(*cb));
+
+	if (__gdev_cmdbuf_encodable(ctx) && __gdev_cmdbuf_reserve(cb)) {
+		FREE(cb);
+		return NULL;
+	}
+
+	return cb;
+}
+
+/* free the command buffer. */
+void gdev_cmdbuf_free(struct gdev_cmdbuf *cb)
+{
+	int i;
+
+	for (i = 0; i < cb->count; i++) {
+		if (cb->cmd[i].kernel.param_buf)
+			FREE(cb->cmd[i].kernel.param_buf);
+	}
+	if (cb->cmd)
+		FREE(cb->cmd);
+	if (cb->words)
+		FREE(cb->words);
+	FREE(cb);
+}
+
+/* append the launch of @kern to the command buffer. the index of the new 
+   command is returned. */
+int gdev_cmdbuf_launch(struct gdev_ctx *ctx, struct gdev_cmdbuf *cb, struct gdev_kernel *kern)
+{
+	struct gdev_cmd *cmd;
+
+	if (!(cmd = __gdev_cmdbuf_add(cb)))
+		return -ENOMEM;
+
+	cmd->type = GDEV_CMD_LAUNCH;
+	if (__gdev_cmdbuf_set_kernel(cmd, kern))
+		return -ENOMEM;
+
+	if (cb->words && __gdev_cmdbuf_encode(ctx, cb, cmd)) {
+		if (cmd->kernel.param_buf)
+			FREE(cmd->kernel.param_buf);
+		return -ENOMEM;
+	}
+
+	return cb->count++;
+}
+
+/* append the copy of data of @size from @src_addr to @dst_addr to the 
+   command buffer. the index of the new command is returned. */
+int gdev_cmdbuf_memcpy(struct gdev_ctx *ctx, struct gdev_cmdbuf *cb, uint64_t dst_addr, uint64_t src_addr, uint32_t size)
+{
+	struct gdev_cmd *cmd;
+
+	if (!(cmd = __gdev_cmdbuf_add(cb)))
+		return -ENOMEM;
+
+	cmd->type = GDEV_CMD_MEMCPY;
+	cmd->dst_addr = dst_addr;
+	cmd->src_addr = src_addr;
+	cmd->size = size;
+
+	if (cb->words && __gdev_cmdbuf_encode(ctx, cb, cmd))
+		return -ENOMEM;
+
+	return cb->count++;
+}
+
+/* replace the kernel launched by the @index-th command with @kern. only
+   that command is encoded again if it keeps the same number of words, 
+   which is the case when just parameters are changed. the command buffer
+   is left as it was if it fails. */
+int gdev_cmdbuf_update(struct gdev_ctx *ctx, struct gdev_cmdbuf *cb, int index, struct gdev_kernel *kern)
+{
+	struct gdev_cmd *cmd, new;
+	uint32_t *words, size, len;
+	int i;
+
+	if (index < 0 || index >= cb->count)
+		return -EINVAL;
+	cmd = &cb->cmd[index];
+	if (cmd->type != GDEV_CMD_LAUNCH)
+		return -EINVAL;
+
+	new = *cmd;
+	new.kernel.param_buf = NULL;
+	if (__gdev_cmdbuf_set_kernel(&new, kern))
+		return -ENOMEM;
+
+	if (!cb->words)
+		goto commit;
+
+	/* encode it at the end of the words first. */
+	if (__gdev_cmdbuf_reserve(cb))
+		goto fail;
+	len = __gdev_cmdbuf_capture(ctx, &new, &cb->words[cb->len]);
+	if (len == cmd->len) {
+		memcpy(&cb->words[cmd->pos], &cb->words[cb->len], len * 4);
+		goto commit;
+	}
+
+	/* the layout has been changed: encode all over again into new words,
+	   leaving room for one more capture as __gdev_cmdbuf_reserve() does. */
+	size = cb->len - cmd->len + len + GDEV_CMDBUF_CAPTURE_SIZE / 4;
+	if (!(words = MALLOC(size * 4)))
+		goto fail;
+	if (cmd->kernel.param_buf)
+		FREE(cmd->kernel.param_buf);
+	*cmd = new;
+	len = 0;
+	for (i = 0; i < cb->count; i++) {
+		cb->cmd[i].pos = len;
+		cb->cmd[i].len = __gdev_cmdbuf_capture(ctx, &cb->cmd[i], &words[len]);
+		len += cb->cmd[i].len;
+	}
+	FREE(cb->words);
+	cb->words = words;
+	cb->size = size;
+	cb->len = len;
+
+	return 0;
+
+commit:
+	if (cmd->kernel.param_buf)
+		FREE(cmd->kernel.param_buf);
+	*cmd = new;
+	return 0;
+
+fail:
+	if (new.kernel.param_buf)
+		FREE(new.kernel.param_buf);
+	return -ENOMEM;
+}
+
+/* submit all the commands in the command buffer at once. only the last
+   command is fenced, so the returned sequence means all of them done. */
+uint32_t gdev_cmdbuf_submit(struct gdev_ctx *ctx, struct gdev_cmdbuf *cb)
+{
+	struct gdev_vas *vas = ctx->vas;
+	struct gdev_device *gdev = vas->gdev;
+	struct gdev_compute *compute = gdev_compute_get(gdev);
+	uint32_t seq;
+	int i;
+
+	seq = __gdev_fence_next(ctx);
+
+	gdev_mutex_lock(&ctx->submit_mutex);
+	if (cb->words)
+		__gdev_out_ring_words(ctx, cb->words, cb->len);
+	else {
+		for (i = 0; i < cb->count; i++)
+			__gdev_cmdbuf_emit(ctx, &cb->cmd[i]);
+	}
+
+	compute->membar(ctx);
+	compute->fence_reset(ctx, seq);
+	compute->fence_write(ctx, GDEV_OP_COMPUTE, seq);
+
+#ifndef GDEV_SCHED_DISABLED
+	/* set an interrupt to be caused when compute done. */
+	compute->notify_intr(ctx);
+#endif
+	gdev_mutex_unlock(&ctx->submit_mutex);
 
 	return seq;
 }
@@ -212,19 +535,28 @@ int gdev_poll(struct gdev_ctx *ctx, uint32_t seq, struct gdev_time *timeout)
 	return 0;
 }
 
-/* barrier memory by blocking. */
+/* barrier memory by blocking, i.e., wait for all the work submitted to 
+   @ctx so far, including the copies on the copy engine. */
 int gdev_barrier(struct gdev_ctx *ctx)
 {
 	struct gdev_vas *vas = ctx->vas;
 	struct gdev_device *gdev = vas->gdev;
 	struct gdev_compute *compute = gdev_compute_get(gdev);
-	uint32_t seq = 0; /* 0 is a special sequence for barrier. */
+	uint32_t seq, seq_async;
 
+	/* the copy engine is fenced only with a copy, hence fence slot 0, 
+	   which is never allocated to a sequence, is copied onto itself. */
+	seq_async = gdev_memcpy_async(ctx, ctx->fence.addr, ctx->fence.addr, 4);
+
+	seq = __gdev_fence_next(ctx);
+	gdev_mutex_lock(&ctx->submit_mutex);
 	compute->membar(ctx);
+	compute->fence_reset(ctx, seq);
 	compute->fence_write(ctx, GDEV_OP_COMPUTE, seq);
-	while (seq != compute->fence_read(ctx, seq));
+	gdev_mutex_unlock(&ctx->submit_mutex);
 
-	return 0;
+	gdev_poll(ctx, seq_async, NULL);
+	return gdev_poll(ctx, seq, NULL);
 }
 
 /* query device-specific information. */
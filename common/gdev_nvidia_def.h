@@ -47,6 +47,12 @@
  */
 #define GDEV_NVIDIA_QUERY_MP_COUNT 0x100
 
+/**
+ * hidden parameter words of grid slicing (see gdev_slice.h).
+ */
+#define GDEV_SLICE_PARAM_MIN 16 /* param_buf[0-15] are taken by the launch. */
+#define GDEV_SLICE_PARAM_COUNT 4 /* offset X, Y and grid width, height */
+
 /**
  * GPGPU kernel object struct:
  * we use the same kernel struct between user-space and kernel-space.
@@ -86,6 +92,7 @@ struct gdev_kernel {
 	uint32_t block_x; /* block dimension X */
 	uint32_t block_y; /* block dimension Y */
 	uint32_t block_z; /* block dimension Z */
+	uint32_t slice_param; /* param_buf index of the slicing words, 0 if none */
 	/* symbol of kernel, for debugging and profiling (Barra back-end) */
 	char* name;
 };
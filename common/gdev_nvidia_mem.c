@@ -36,30 +36,38 @@ void gdev_nvidia_mem_setup(struct gdev_mem *mem, struct gdev_vas *vas, int type)
 	mem->evicted = 0;
 	mem->swap_mem = NULL;
 	mem->swap_buf = NULL;
+	mem->swap_zbuf = NULL;
+	mem->swap_dirty = NULL;
+	mem->swap_saved = NULL;
+	mem->swap_dev = NULL;
 	mem->shm = NULL;
 	mem->map_users = 0;
 	
 	gdev_list_init(&mem->list_entry_heap, (void *)mem);
 	gdev_list_init(&mem->list_entry_shm, (void *)mem);
+	gdev_list_init(&mem->list_entry_evict, (void *)mem);
+	gdev_list_init(&mem->list_entry_map, (void *)mem);
+	mem->evict_level = -1;
 }
 
-/* add a new memory object to the memory list. */
+/* add a new memory object to the memory list. the lists are changed under
+   gdev->shm_mutex as well, so that either lock keeps them stable. */
 void gdev_nvidia_mem_list_add(struct gdev_mem *mem)
 {
 	struct gdev_vas *vas = mem->vas;
 	int type = mem->type;
-	unsigned long flags;
 
 	switch (type) {
 	case GDEV_MEM_DEVICE:
-		gdev_lock_save(&vas->lock, &flags);
+		gdev_write_lock(&vas->lock);
 		gdev_list_add(&mem->list_entry_heap, &vas->mem_list);
-		gdev_unlock_restore(&vas->lock, &flags);
+		gdev_write_unlock(&vas->lock);
+		gdev_shm_index_add(mem);
 		break;
 	case GDEV_MEM_DMA:
-		gdev_lock_save(&vas->lock, &flags);
+		gdev_write_lock(&vas->lock);
 		gdev_list_add(&mem->list_entry_heap, &vas->dma_mem_list);
-		gdev_unlock_restore(&vas->lock, &flags);
+		gdev_write_unlock(&vas->lock);
 		break;
 	default:
 		GDEV_PRINT("Memory type not supported\n");
@@ -70,19 +78,19 @@ void gdev_nvidia_mem_list_add(struct gdev_mem *mem)
 void gdev_nvidia_mem_list_del(struct gdev_mem *mem)
 {
 	struct gdev_vas *vas = mem->vas;
-	unsigned long flags;
 	int type = mem->type;
 
 	switch (type) {
 	case GDEV_MEM_DEVICE:
-		gdev_lock_save(&vas->lock, &flags);
+		gdev_shm_index_del(mem);
+		gdev_write_lock(&vas->lock);
 		gdev_list_del(&mem->list_entry_heap);
-		gdev_unlock_restore(&vas->lock, &flags);
+		gdev_write_unlock(&vas->lock);
 		break;
 	case GDEV_MEM_DMA:
-		gdev_lock_save(&vas->lock, &flags);
+		gdev_write_lock(&vas->lock);
 		gdev_list_del(&mem->list_entry_heap);
-		gdev_unlock_restore(&vas->lock, &flags);
+		gdev_write_unlock(&vas->lock);
 		break;
 	default:
 		GDEV_PRINT("Memory type not supported\n");
@@ -107,7 +115,8 @@ void gdev_mem_unlock(struct gdev_mem *mem)
 	}
 }
 
-/* lock all the memory objects associated with @vas. */
+/* lock all the memory objects associated with @vas. gdev->shm_mutex keeps
+   the memory list stable. */
 void gdev_mem_lock_all(struct gdev_vas *vas)
 {
 	struct gdev_device *gdev = vas->gdev;
@@ -154,11 +163,11 @@ struct gdev_mem *gdev_mem_alloc(struct gdev_vas *vas, uint64_t size, int type)
 	}
 
 	gdev_nvidia_mem_setup(mem, vas, type);
-	gdev_nvidia_mem_list_add(mem);
 
 	/* update the size of memory used on the gdev device; mem->size
 	 * could have been rounded up */
 	gdev_mutex_lock(&gdev->shm_mutex);
+	gdev_nvidia_mem_list_add(mem);
 	if (type == GDEV_MEM_DEVICE) {
 		gdev->mem_used += mem->size;
 	}
@@ -195,6 +204,37 @@ fail:
 	return NULL;
 }
 
+/* unmap the cached mapping of @mem. gdev->map_mutex must be locked. */
+static void __gdev_mem_map_evict(struct gdev_device *gdev, struct gdev_mem *mem)
+{
+	gdev_list_del(&mem->list_entry_map);
+	gdev_raw_mem_unmap(mem, mem->map);
+	mem->map = NULL;
+	gdev->map_cache_size -= mem->size;
+}
+
+/* drop the mapping of @mem cached, if any, before it is freed. */
+static void __gdev_mem_map_drop(struct gdev_mem *mem)
+{
+	struct gdev_device *gdev = mem->vas->gdev;
+
+	if (mem->size <= GDEV_MEM_MAPPABLE_LIMIT)
+		return;
+
+	gdev_mutex_lock(&gdev->map_mutex);
+	if (mem->map) {
+		if (mem->map_users == 0)
+			__gdev_mem_map_evict(gdev, mem);
+		else {
+			/* still mapped by someone who forgot to unmap it. */
+			gdev_raw_mem_unmap(mem, mem->map);
+			mem->map = NULL;
+			gdev->map_cache_size -= mem->size;
+		}
+	}
+	gdev_mutex_unlock(&gdev->map_mutex);
+}
+
 /* free the specified memory object. */
 void gdev_mem_free(struct gdev_mem *mem)
 {
@@ -203,6 +243,9 @@ void gdev_mem_free(struct gdev_mem *mem)
 	int mem_size_freed = mem->size;
 	int mem_type = mem->type;
 
+	if (mem_type == GDEV_MEM_DEVICE)
+		__gdev_mem_map_drop(mem);
+
 	/* if the memory object is associated with shared memory, detach the 
 	   shared memory. note that the memory object will be freed if users
 	   become zero.
@@ -230,7 +273,15 @@ void gdev_mem_free(struct gdev_mem *mem)
 /* garbage collection: free all memory left in heap. */
 void gdev_mem_gc(struct gdev_vas *vas)
 {
-	struct gdev_mem *mem;
+	gdev_mem_gc_keep(vas, NULL, 0);
+}
+
+/* garbage collection as gdev_mem_gc(), but @n host DMA memory objects of 
+   @keep are left, e.g., the bounce buffers kept for the next user of @vas. */
+void gdev_mem_gc_keep(struct gdev_vas *vas, struct gdev_mem **keep, int n)
+{
+	struct gdev_mem *mem, *next;
+	int i;
 
 	/* device memory. */
 	while((mem = gdev_list_container(gdev_list_head(&vas->mem_list)))) {
@@ -238,60 +289,112 @@ void gdev_mem_gc(struct gdev_vas *vas)
 	}
 
 	/* host DMA memory. */
-	while((mem = gdev_list_container(gdev_list_head(&vas->dma_mem_list)))) {
-		gdev_mem_free(mem);
+	mem = gdev_list_container(gdev_list_head(&vas->dma_mem_list));
+	while (mem) {
+		next = gdev_list_container(mem->list_entry_heap.next);
+		for (i = 0; i < n && keep[i] != mem; i++)
+			;
+		if (i == n)
+			gdev_mem_free(mem);
+		mem = next;
+	}
+}
+
+/* unmap the least recently used mappings no one is using, until @size more 
+   bytes fit in the budget. gdev->map_mutex must be locked. */
+static void __gdev_mem_map_reclaim(struct gdev_device *gdev, uint64_t size)
+{
+	struct gdev_mem *mem;
+
+	while (gdev->map_cache_size + size > GDEV_MEM_MAP_CACHE_SIZE) {
+		mem = gdev_list_container(gdev_list_head(&gdev->map_cache));
+		if (!mem)
+			break;
+		__gdev_mem_map_evict(gdev, mem);
 	}
 }
 
-/* map device memory to host DMA memory. */
+/* map device memory to host DMA memory. large buffers keep their mappings 
+   cached after unmapped, as long as the BAR space budget allows. */
 void *gdev_mem_map(struct gdev_mem *mem, uint64_t offset, uint64_t size)
 {
+	struct gdev_device *gdev = mem->vas->gdev;
+
 	if (offset + size > mem->size)
 		return NULL;
 
+	gdev_mutex_lock(&gdev->map_mutex);
 	/* @size is not really used here... */
 	if (mem->map_users == 0 && mem->size > GDEV_MEM_MAPPABLE_LIMIT) {
-		mem->map = gdev_raw_mem_map(mem);
-		if (!mem->map)
-			return NULL;
+		if (mem->map) {
+			/* reuse the cached mapping. */
+			gdev_list_del(&mem->list_entry_map);
+		}
+		else {
+			__gdev_mem_map_reclaim(gdev, mem->size);
+			mem->map = gdev_raw_mem_map(mem);
+			if (!mem->map) {
+				/* the BAR space may be taken by cached mappings. */
+				__gdev_mem_map_reclaim(gdev, GDEV_MEM_MAP_CACHE_SIZE + 1);
+				mem->map = gdev_raw_mem_map(mem);
+			}
+			if (!mem->map) {
+				gdev_mutex_unlock(&gdev->map_mutex);
+				return NULL;
+			}
+			gdev->map_cache_size += mem->size;
+		}
 	}
 
 	mem->map_users++;
+	gdev_mutex_unlock(&gdev->map_mutex);
+
 	return mem->map + offset;
 }
 
 /* unmap device memory from host DMA memory. */
-void gdev_mem_unmap(struct gdev_mem *mem)
+int gdev_mem_unmap(struct gdev_mem *mem)
 {
+	struct gdev_device *gdev = mem->vas->gdev;
+
+	gdev_mutex_lock(&gdev->map_mutex);
+	/* the mapping may be left cached after unmapped. */
+	if (mem->map_users == 0) {
+		gdev_mutex_unlock(&gdev->map_mutex);
+		return -ENOENT;
+	}
 	mem->map_users--;
 	if (mem->map_users == 0 && mem->size > GDEV_MEM_MAPPABLE_LIMIT) {
-		gdev_raw_mem_unmap(mem, mem->map);
-		mem->map = NULL;
+		/* the most recently used at the tail. */
+		gdev_list_add_tail(&mem->list_entry_map, &gdev->map_cache);
+		__gdev_mem_map_reclaim(gdev, 0);
 	}
+	gdev_mutex_unlock(&gdev->map_mutex);
+
+	return 0;
 }
 
 /* look up a memory object associated with device virtual memory address. */
 struct gdev_mem *gdev_mem_lookup_by_addr(struct gdev_vas *vas, uint64_t addr, int type)
 {
 	struct gdev_mem *mem = NULL;
-	unsigned long flags;
 
 	switch (type) {
 	case GDEV_MEM_DEVICE:
-		gdev_lock_save(&vas->lock, &flags);
+		gdev_read_lock(&vas->lock);
 		gdev_list_for_each (mem, &vas->mem_list, list_entry_heap) {
 			if ((addr >= mem->addr) && (addr < mem->addr + mem->size))
 				break;
 		}
-		gdev_unlock_restore(&vas->lock, &flags);
+		gdev_read_unlock(&vas->lock);
 		break;
 	case GDEV_MEM_DMA:
-		gdev_lock_save(&vas->lock, &flags);
+		gdev_read_lock(&vas->lock);
 		gdev_list_for_each (mem, &vas->dma_mem_list, list_entry_heap) {
 			if ((addr >= mem->addr) && (addr < mem->addr + mem->size))
 				break;
 		}
-		gdev_unlock_restore(&vas->lock, &flags);
+		gdev_read_unlock(&vas->lock);
 		break;
 	default:
 		GDEV_PRINT("Memory type not supported\n");
@@ -305,26 +408,25 @@ struct gdev_mem *gdev_mem_lookup_by_buf(struct gdev_vas *vas, const void *buf, i
 {
 	struct gdev_mem *mem = NULL;
 	uint64_t addr = (uint64_t)buf;
-	unsigned long flags;
 
 	switch (type) {
 	case GDEV_MEM_DEVICE:
-		gdev_lock_save(&vas->lock, &flags);
+		gdev_read_lock(&vas->lock);
 		gdev_list_for_each (mem, &vas->mem_list, list_entry_heap) {
 			uint64_t map_addr = (uint64_t)mem->map;
 			if ((addr >= map_addr) && (addr < map_addr + mem->size))
 				break;
 		}
-		gdev_unlock_restore(&vas->lock, &flags);
+		gdev_read_unlock(&vas->lock);
 		break;
 	case GDEV_MEM_DMA:
-		gdev_lock_save(&vas->lock, &flags);
+		gdev_read_lock(&vas->lock);
 		gdev_list_for_each (mem, &vas->dma_mem_list, list_entry_heap) {
 			uint64_t map_addr = (uint64_t)mem->map;
 			if ((addr >= map_addr) && (addr < map_addr + mem->size))
 				break;
 		}
-		gdev_unlock_restore(&vas->lock, &flags);
+		gdev_read_unlock(&vas->lock);
 		break;
 	default:
 		GDEV_PRINT("Memory type not supported\n");
@@ -167,7 +167,9 @@ static int nvc0_launch(struct gdev_ctx *ctx, struct gdev_kernel *k)
 				__gdev_out_ring(ctx, k->param_buf[i]); /* CB_DATA#0 */
 			}
 		}
-		/* nvcc uses c1[], but what is this? */
+		/* nvcc uses c1[], but what is this? the CUDA driver puts the same
+		   words in the host image of the segment, which it may share among
+		   kernels, while direct users of glaunch() rely on them here. */
 		else if (x == 1) {
 			int i;
 			__gdev_begin_ring_nvc0(ctx, GDEV_SUBCH_NV_COMPUTE, 0x238c, 1);
@@ -28,6 +28,7 @@
 
 #include "gdev_device.h"
 #include "gdev_sched.h"
+#include "gdev_zswap.h"
 
 #define GDEV_SHM_SEGMENT_COUNT 512 /* hardcoded */
 static struct gdev_mem *gdev_shm_owners[GDEV_SHM_SEGMENT_COUNT] = {
@@ -42,6 +43,31 @@ int gdev_callback_save_to_host(void*, void*, uint64_t, uint64_t);
 int gdev_callback_save_to_device(void*, uint64_t, uint64_t, uint64_t);
 int gdev_callback_load_from_host(void*, uint64_t, void*, uint64_t);
 int gdev_callback_load_from_device(void*, uint64_t, uint64_t, uint64_t);
+int gdev_callback_save_to_zswap(void*, struct gdev_zswap*, uint64_t, uint64_t, uint64_t);
+int gdev_callback_load_from_zswap(void*, uint64_t, struct gdev_zswap*, uint64_t, uint64_t);
+
+#define GDEV_SWAP_BITS (sizeof(unsigned long) * 8)
+
+/* number of swap pages covering @size bytes. */
+static inline int __gdev_swap_pages(uint64_t size)
+{
+	return (size + GDEV_SWAP_PAGE_SIZE - 1) / GDEV_SWAP_PAGE_SIZE;
+}
+
+static inline int __gdev_swap_test(unsigned long *map, int page)
+{
+	return (map[page / GDEV_SWAP_BITS] >> (page % GDEV_SWAP_BITS)) & 1;
+}
+
+static inline void __gdev_swap_set(unsigned long *map, int page, int val)
+{
+	unsigned long bit = 1UL << (page % GDEV_SWAP_BITS);
+
+	if (val)
+		map[page / GDEV_SWAP_BITS] |= bit;
+	else
+		map[page / GDEV_SWAP_BITS] &= ~bit;
+}
 
 /* attach device memory and allocate host buffer for swap */
 static int __gdev_swap_attach(struct gdev_mem *mem)
@@ -49,14 +75,29 @@ static int __gdev_swap_attach(struct gdev_mem *mem)
 	struct gdev_vas *vas = mem->vas;
 	struct gdev_device *gdev = vas->gdev;
 	struct gdev_mem *swap_mem;
-	void *swap_buf;
-
-	/* host buffer for swap. */
-	swap_buf = MALLOC(mem->size);
-	if (!swap_buf)
-		goto fail_swap_buf;
-	/* device memory for temporal swap (shared by others). */
-	if (GDEV_SWAP_MEM_SIZE > 0) {
+	struct gdev_zswap *swap_zbuf = NULL;
+	unsigned long *map;
+	void *swap_buf = NULL;
+	int words = (__gdev_swap_pages(mem->size) + GDEV_SWAP_BITS - 1) / GDEV_SWAP_BITS;
+
+	/* host buffer for swap, which only takes what is saved if compressed. */
+	if (gdev->swap_compress) {
+		swap_zbuf = gdev_zswap_alloc(mem->size, GDEV_SWAP_PAGE_SIZE);
+		if (!swap_zbuf)
+			goto fail_swap_buf;
+	}
+	else {
+		swap_buf = MALLOC(mem->size);
+		if (!swap_buf)
+			goto fail_swap_buf;
+	}
+	/* dirty, saved, and device bitmaps of swap pages. */
+	map = MALLOC(sizeof(*map) * words * 3);
+	if (!map)
+		goto fail_map;
+	memset(map, 0, sizeof(*map) * words * 3);
+	/* device memory for temporal swap (shared by others), if reserved. */
+	if (GDEV_SWAP_MEM_SIZE > 0 && gdev->swap) {
 		swap_mem = gdev_raw_mem_share(vas, gdev->swap);
 		if (!swap_mem)
 			goto fail_swap_mem;
@@ -66,12 +107,21 @@ static int __gdev_swap_attach(struct gdev_mem *mem)
 		swap_mem = NULL;
 	}
 	mem->swap_buf = swap_buf;
+	mem->swap_zbuf = swap_zbuf;
 	mem->swap_mem = swap_mem;
+	mem->swap_dirty = map;
+	mem->swap_saved = map + words;
+	mem->swap_dev = map + words * 2;
 
 	return 0;
 
 fail_swap_mem:
-	FREE(swap_buf);
+	FREE(map);
+fail_map:
+	if (swap_zbuf)
+		gdev_zswap_free(swap_zbuf);
+	else
+		FREE(swap_buf);
 fail_swap_buf:
 	return -ENOMEM;
 }
@@ -79,9 +129,40 @@ fail_swap_buf:
 /* detach device memory and free host buffer for swap */
 static void __gdev_swap_detach(struct gdev_mem *mem)
 {
-	if (GDEV_SWAP_MEM_SIZE > 0)
+	struct gdev_mem *dev_swap = mem->vas->gdev->swap;
+
+	if (dev_swap && dev_swap->shm->holder == mem)
+		dev_swap->shm->holder = NULL;
+	if (mem->swap_mem)
 		gdev_raw_mem_unshare(mem->swap_mem);
-	FREE(mem->swap_buf);
+	FREE(mem->swap_dirty);
+	if (mem->swap_zbuf)
+		gdev_zswap_free(mem->swap_zbuf);
+	else
+		FREE(mem->swap_buf);
+	mem->swap_mem = NULL;
+	mem->swap_buf = NULL;
+	mem->swap_zbuf = NULL;
+	mem->swap_dirty = mem->swap_saved = mem->swap_dev = NULL;
+}
+
+/* hand all the pages of the implicit shared memory @shm to @holder. its
+   data is only on the device so far, i.e., all the pages are dirty. */
+static int __gdev_swap_setup(struct gdev_shm *shm, struct gdev_mem *holder)
+{
+	int pages = __gdev_swap_pages(shm->size);
+	int words = (pages + GDEV_SWAP_BITS - 1) / GDEV_SWAP_BITS;
+	int i;
+
+	shm->page_owner = MALLOC(sizeof(*shm->page_owner) * pages);
+	if (!shm->page_owner)
+		return -ENOMEM;
+	for (i = 0; i < pages; i++)
+		shm->page_owner[i] = holder;
+	memset(holder->swap_dirty, 0xff, sizeof(unsigned long) * words);
+	shm->holder = holder;
+
+	return 0;
 }
 
 static void __gdev_shm_init(struct gdev_mem *mem, struct gdev_shm *shm)
@@ -92,6 +173,7 @@ static void __gdev_shm_init(struct gdev_mem *mem, struct gdev_shm *shm)
 	shm->prio = GDEV_PRIO_MIN;
 	shm->users = 1; /* count itself. */
 	shm->holder = NULL;
+	shm->page_owner = NULL;
 	shm->bo = mem->bo;
 	shm->size = mem->size;
 	shm->key = 0;
@@ -175,40 +257,158 @@ int gdev_shm_destroy_mark(struct gdev_device *gdev, struct gdev_mem *owner)
 	return 0;
 }
 
+/* the level of @mem in the eviction index. lower priorities are put at 
+   higher levels, which are looked up first. */
+static int __gdev_index_level(struct gdev_mem *mem)
+{
+	int prio = mem->shm ? mem->shm->prio : mem->vas->prio;
+
+	if (prio > GDEV_PRIO_MAX)
+		prio = GDEV_PRIO_MAX;
+	else if (prio < GDEV_PRIO_MIN)
+		prio = GDEV_PRIO_MIN;
+
+	return GDEV_PRIO_MAX - prio;
+}
+
+/* the size class of @size. the class n holds objects larger than half the 
+   size of the class n + 1, so any object in a class above that of @size is
+   large enough. */
+static int __gdev_index_class(uint64_t size)
+{
+	int class;
+
+	if (size <= (1ULL << GDEV_EVICT_SHIFT))
+		return 0;
+	class = 64 - __builtin_clzll((size - 1) >> GDEV_EVICT_SHIFT);
+
+	return class < GDEV_EVICT_CLASSES ? class : GDEV_EVICT_CLASSES - 1;
+}
+
+/* gdev->vas_lock must be held. */
+static void __gdev_index_insert(struct gdev_device *gdev, struct gdev_mem *mem)
+{
+	struct gdev_queue *q = &gdev->evict_index[__gdev_index_class(mem->size)];
+
+	mem->evict_level = __gdev_index_level(mem);
+	gdev_queue_add_tail(q, &mem->list_entry_evict, mem->evict_level);
+}
+
+/* gdev->vas_lock must be held. */
+static void __gdev_index_remove(struct gdev_device *gdev, struct gdev_mem *mem)
+{
+	struct gdev_queue *q = &gdev->evict_index[__gdev_index_class(mem->size)];
+
+	gdev_queue_del(q, &mem->list_entry_evict, mem->evict_level);
+	mem->evict_level = -1;
+}
+
+/* add the device memory object @mem to the eviction index. */
+void gdev_shm_index_add(struct gdev_mem *mem)
+{
+	struct gdev_device *gdev = mem->vas->gdev;
+	unsigned long flags;
+
+	gdev_lock_save(&gdev->vas_lock, &flags);
+	__gdev_index_insert(gdev, mem);
+	gdev_unlock_restore(&gdev->vas_lock, &flags);
+}
+
+/* remove @mem from the eviction index. */
+void gdev_shm_index_del(struct gdev_mem *mem)
+{
+	struct gdev_device *gdev = mem->vas->gdev;
+	unsigned long flags;
+
+	gdev_lock_save(&gdev->vas_lock, &flags);
+	if (mem->evict_level >= 0)
+		__gdev_index_remove(gdev, mem);
+	gdev_unlock_restore(&gdev->vas_lock, &flags);
+}
+
+/* make @mem the most recently used at its priority, which may have changed
+   since it was indexed. */
+void gdev_shm_index_touch(struct gdev_mem *mem)
+{
+	struct gdev_device *gdev = mem->vas->gdev;
+	unsigned long flags;
+
+	gdev_lock_save(&gdev->vas_lock, &flags);
+	if (mem->evict_level >= 0) {
+		__gdev_index_remove(gdev, mem);
+		__gdev_index_insert(gdev, mem);
+	}
+	gdev_unlock_restore(&gdev->vas_lock, &flags);
+}
+
+/* touch all the device memory objects associated to @vas, e.g., when they
+   are all available to a launch. vas->lock may sleep, so it is taken 
+   before gdev->vas_lock. */
+void gdev_shm_index_touch_all(struct gdev_vas *vas)
+{
+	struct gdev_device *gdev = vas->gdev;
+	struct gdev_mem *mem;
+	unsigned long flags;
+
+	gdev_read_lock(&vas->lock);
+	gdev_lock_save(&gdev->vas_lock, &flags);
+	gdev_list_for_each (mem, &vas->mem_list, list_entry_heap) {
+		if (mem->evict_level >= 0) {
+			__gdev_index_remove(gdev, mem);
+			__gdev_index_insert(gdev, mem);
+		}
+	}
+	gdev_unlock_restore(&gdev->vas_lock, &flags);
+	gdev_read_unlock(&vas->lock);
+}
+
+/* requeue the objects sharing @shm at its new priority. */
+static void __gdev_shm_index_update(struct gdev_shm *shm)
+{
+	struct gdev_mem *m;
+
+	gdev_list_for_each (m, &shm->mem_list, list_entry_shm) {
+		gdev_shm_index_touch(m);
+	}
+}
+
 /* find a memory object that we can borrow some memory space from. */
 static struct gdev_mem *__gdev_shm_find_victim(struct gdev_vas *vas, uint64_t size)
 {
 	struct gdev_device *gdev = vas->gdev;
-	struct gdev_vas *v;
 	struct gdev_mem *m, *victim = NULL;
 	struct gdev_shm *shm;
 	unsigned long flags;
-
-	/* select the lowest-priority object. */
+	uint64_t levels = 0;
+	int first = __gdev_index_class(size);
+	int class, level, scan;
+
+	/* select the lowest-priority object, and the least recently used one 
+	   in the smallest size class at that priority. the classes below that
+	   of @size are never looked up. the objects of @vas and those smaller
+	   than @size are skipped, but only GDEV_EVICT_SCAN objects are looked
+	   at per class and level, so the lookup is bounded by the number of
+	   classes and levels. an object behind more than that is passed over
+	   for one of a larger class or a higher priority. */
 	gdev_lock_save(&gdev->vas_lock, &flags);
-	gdev_list_for_each (v, &gdev->vas_list, list_entry) {
-		gdev_lock_nested(&v->lock);
-		gdev_list_for_each (m, &v->mem_list, list_entry_heap) {
-			/* don't select from the save VAS object! */
-			if (m->size >= size && m->vas != vas) {
-				if (!victim)
+	for (class = first; class < GDEV_EVICT_CLASSES; class++)
+		levels |= gdev->evict_index[class].bitmap;
+	while (levels && !victim) {
+		level = 63 - __builtin_clzll(levels);
+		for (class = first; class < GDEV_EVICT_CLASSES && !victim; class++) {
+			struct gdev_list *list = gdev_queue_level(&gdev->evict_index[class], level);
+			scan = 0;
+			gdev_list_for_each (m, list, list_entry_evict) {
+				/* don't select from the save VAS object! */
+				if (m->size >= size && m->vas != vas) {
 					victim = m;
-				else {
-					int victim_prio, m_prio;
-					if (victim->shm)
-						victim_prio = victim->shm->prio;
-					else
-						victim_prio = victim->vas->prio;
-					if (m->shm)
-						m_prio = m->shm->prio;
-					else
-						m_prio = m->vas->prio;
-					if (victim_prio > m_prio)
-						victim = m;
+					break;
 				}
+				if (++scan >= GDEV_EVICT_SCAN)
+					break;
 			}
 		}
-		gdev_unlock_nested(&v->lock);
+		levels &= ~(1ULL << level);
 	}
 	gdev_unlock_restore(&gdev->vas_lock, &flags);
 
@@ -225,6 +425,12 @@ static struct gdev_mem *__gdev_shm_find_victim(struct gdev_vas *vas, uint64_t si
 			return NULL;
 		}
 		__gdev_shm_init(victim, shm);
+		if (__gdev_swap_setup(shm, victim)) {
+			victim->shm = NULL;
+			__gdev_swap_detach(victim);
+			FREE(shm);
+			return NULL;
+		}
 		gdev_list_add(&shm->list_entry, &gdev->shm_list);
 		shm->implicit = 1; /* shared memory is created implicitly */
 	}
@@ -233,16 +439,13 @@ static struct gdev_mem *__gdev_shm_find_victim(struct gdev_vas *vas, uint64_t si
 		if (!shm->implicit) {
 			gdev_mutex_lock(&shm->mutex);
 			gdev_list_for_each(m, &shm->mem_list, list_entry_shm) {
-				if (__gdev_swap_attach(m)) {
-					/* if someone fails, detach all. */
-					gdev_list_for_each(m, &shm->mem_list, list_entry_shm) {
-						if (m->swap_mem)
-							__gdev_swap_detach(m);
-					}
-					gdev_mutex_unlock(&shm->mutex);
-					return NULL;
-				}
+				if (__gdev_swap_attach(m))
+					goto fail_swap;
 			}
+			/* the data seen by all the users so far is given to the 
+			   victim, which is to be evicted first. */
+			if (__gdev_swap_setup(shm, victim))
+				goto fail_swap;
 			/* now turns into an implicit shared memory object. */
 			shm->implicit = 1; 
 			gdev_mutex_unlock(&shm->mutex);
@@ -250,6 +453,15 @@ static struct gdev_mem *__gdev_shm_find_victim(struct gdev_vas *vas, uint64_t si
 	}
 
 	return victim;
+
+fail_swap:
+	/* if someone fails, detach all. */
+	gdev_list_for_each(m, &shm->mem_list, list_entry_shm) {
+		if (m->swap_dirty)
+			__gdev_swap_detach(m);
+	}
+	gdev_mutex_unlock(&shm->mutex);
+	return NULL;
 }
 
 /* share memory space with @mem. if @mem is null, find victim instead. 
@@ -289,6 +501,8 @@ struct gdev_mem *gdev_shm_attach(struct gdev_vas *vas, struct gdev_mem *mem, uin
 		/* attach swap for evicting data from shared memory space. */
 		if (__gdev_swap_attach(new))
 			goto fail_swap;
+		/* none of the pages are held yet. */
+		new->evicted = 1;
 	}
 
 	gdev_mutex_lock(&mem->shm->mutex);
@@ -298,6 +512,7 @@ struct gdev_mem *gdev_shm_attach(struct gdev_vas *vas, struct gdev_mem *mem, uin
 		new->shm->prio = vas->prio;
 	/* insert the new memory object into the shared memory list. */
 	gdev_list_add(&new->list_entry_shm, &new->shm->mem_list);
+	__gdev_shm_index_update(new->shm);
 	gdev_mutex_unlock(&mem->shm->mutex);
 
 	/* this increment is protected by gdev->shm_mutex. */
@@ -333,8 +548,19 @@ void gdev_shm_detach(struct gdev_mem *mem)
 	gdev_mutex_lock(&shm->mutex);
 	mem->shm = NULL;
 	gdev_list_del(&mem->list_entry_shm);
-	if (shm->implicit)
-		__gdev_swap_detach(mem);
+	if (shm->implicit) {
+		/* the pages held by @mem are now free to anyone. */
+		if (shm->page_owner) {
+			int pages = __gdev_swap_pages(shm->size);
+			int i;
+			for (i = 0; i < pages; i++) {
+				if (shm->page_owner[i] == mem)
+					shm->page_owner[i] = NULL;
+			}
+		}
+		if (mem->swap_dirty)
+			__gdev_swap_detach(mem);
+	}
 
 	/* if the memory object is shared but no users, free it. 
 	   since users == 0, no one else will use mem->shm. */
@@ -343,6 +569,8 @@ void gdev_shm_detach(struct gdev_mem *mem)
 		gdev_raw_mem_free(mem); 
 		gdev_mutex_unlock(&shm->mutex);
 		gdev_list_del(&shm->list_entry); /* remove from the device shm list. */
+		if (shm->page_owner)
+			FREE(shm->page_owner);
 		FREE(shm);
 	}
 	/* otherwise, just unshare the memory object. */
@@ -356,6 +584,7 @@ void gdev_shm_detach(struct gdev_mem *mem)
 					prio = m->vas->prio;
 			}
 			shm->prio = prio;
+			__gdev_shm_index_update(shm);
 		}
 		if (shm->holder == mem)
 			shm->holder = NULL;
@@ -373,101 +602,309 @@ struct gdev_mem *gdev_shm_lookup(struct gdev_device *gdev, int id)
 	return gdev_shm_owners[id];
 }
 
-/* evict the conflicting shared memory object data.
-   the shared memory object associated with @mem must be locked. */
-int gdev_shm_evict_conflict(struct gdev_ctx *ctx, struct gdev_mem *mem)
+/* true if @mem shares memory space implicitly, i.e., needs swap. */
+static inline int __gdev_swap_enabled(struct gdev_mem *mem)
+{
+	return mem->shm && mem->shm->implicit && mem->swap_dirty;
+}
+
+/* bytes of @n pages from @page, clipped at the end of @shm. */
+static inline uint64_t __gdev_swap_size(struct gdev_shm *shm, int page, int n)
+{
+	uint64_t offset = (uint64_t)page * GDEV_SWAP_PAGE_SIZE;
+	uint64_t size = (uint64_t)n * GDEV_SWAP_PAGE_SIZE;
+
+	if (offset + size > shm->size)
+		size = shm->size - offset;
+
+	return size;
+}
+
+/* save the dirty pages [@page, @page + @n) of @owner, which @mem is going 
+   to take over. the device swap is used if no one else is using it. */
+static int __gdev_swap_save(struct gdev_ctx *ctx, struct gdev_mem *mem, struct gdev_mem *owner, int page, int n)
+{
+	struct gdev_device *gdev = mem->vas->gdev;
+	struct gdev_mem *dev_swap = gdev->swap;
+	void *h = ctx->vas->handle;
+	uint64_t offset = (uint64_t)page * GDEV_SWAP_PAGE_SIZE;
+	uint64_t size = __gdev_swap_size(mem->shm, page, n);
+	int dev = 0;
+	int ret, i;
+
+	if (dev_swap && mem->swap_mem && offset + size <= dev_swap->size &&
+		(!dev_swap->shm->holder || dev_swap->shm->holder == owner)) {
+		/* @mem has its own mapping of the device swap. */
+		uint64_t dst_addr = mem->swap_mem->addr + offset;
+		ret = gdev_callback_save_to_device(h, dst_addr, mem->addr + offset, size);
+		if (ret)
+			return ret;
+		dev_swap->shm->holder = owner;
+		dev = 1;
+	}
+	else if (owner->swap_zbuf) {
+		ret = gdev_callback_save_to_zswap(h, owner->swap_zbuf, offset, mem->addr + offset, size);
+		if (ret)
+			return ret;
+	}
+	else {
+		void *dst_buf = owner->swap_buf + offset;
+		ret = gdev_callback_save_to_host(h, dst_buf, mem->addr + offset, size);
+		if (ret)
+			return ret;
+	}
+
+	for (i = page; i < page + n; i++) {
+		__gdev_swap_set(owner->swap_dirty, i, 0);
+		__gdev_swap_set(owner->swap_saved, i, 1);
+		__gdev_swap_set(owner->swap_dev, i, dev);
+	}
+	gdev_trace(gdev, GDEV_TRACE_EVICT, GDEV_TRACE_MEMORY, ctx->cid, size);
+
+	return 0;
+}
+
+/* load the saved pages [@page, @page + @n) of @mem from the device swap if 
+   @dev is true, or from the host otherwise. */
+static int __gdev_swap_load(struct gdev_ctx *ctx, struct gdev_mem *mem, int page, int n, int dev)
+{
+	void *h = ctx->vas->handle;
+	uint64_t offset = (uint64_t)page * GDEV_SWAP_PAGE_SIZE;
+	uint64_t size = __gdev_swap_size(mem->shm, page, n);
+	int ret, i;
+
+	if (dev) {
+		uint64_t src_addr = mem->swap_mem->addr + offset;
+		ret = gdev_callback_load_from_device(h, mem->addr + offset, src_addr, size);
+	}
+	else if (mem->swap_zbuf) {
+		ret = gdev_callback_load_from_zswap(h, mem->addr + offset, mem->swap_zbuf, offset, size);
+	}
+	else {
+		void *src_buf = mem->swap_buf + offset;
+		ret = gdev_callback_load_from_host(h, mem->addr + offset, src_buf, size);
+	}
+	if (ret)
+		return ret;
+
+	/* the device swap is given up to others, so the pages loaded from it 
+	   have no copy but on the device any longer. */
+	for (i = page; i < page + n; i++)
+		__gdev_swap_set(mem->swap_dirty, i, dev);
+
+	return 0;
+}
+
+/* take over the pages [@first, @last] for @mem. the dirty pages of their 
+   owners are saved first, and the saved pages of @mem are loaded if @load 
+   is true. the pages are processed in runs, so that contiguous ranges are 
+   copied at once. */
+static int __gdev_swap_claim(struct gdev_ctx *ctx, struct gdev_mem *mem, int first, int last, int load)
 {
-	struct gdev_vas *vas = mem->vas;
 	struct gdev_shm *shm = mem->shm;
-	struct gdev_device *gdev = vas->gdev;
-	struct gdev_mem *holder;
-	uint64_t src_addr;
-	uint64_t size;
+	struct gdev_mem *dev_swap = mem->vas->gdev->swap;
+	struct gdev_mem *owner;
+	int page, n, dev, i;
 	int ret;
 
-	if (shm && shm->implicit) {
-		void *h = ctx->vas->handle;
-		if (shm->holder && shm->holder != mem) {
-			struct gdev_mem *dev_swap = gdev->swap;
-			holder = shm->holder;
-			src_addr = mem->addr;
-			size = shm->size;
-			if (dev_swap && !dev_swap->shm->holder) {
-				uint64_t dst_addr = holder->swap_mem->addr;
-				ret = gdev_callback_save_to_device(h, dst_addr, src_addr, size);
-				if (ret)
-					goto fail_evict;
-				dev_swap->shm->holder = mem;
-			}
-			else {
-				void *dst_buf = holder->swap_buf;
-				ret = gdev_callback_save_to_host(h, dst_buf, src_addr, size);
-				if (ret)
-					goto fail_evict;
-			}
-			holder->evicted = 1;
+	for (page = first; page <= last; page += n) {
+		owner = shm->page_owner[page];
+		n = 1;
+		if (!owner || owner == mem || !__gdev_swap_test(owner->swap_dirty, page))
+			continue;
+		while (page + n <= last && shm->page_owner[page + n] == owner &&
+			   __gdev_swap_test(owner->swap_dirty, page + n))
+			n++;
+		ret = __gdev_swap_save(ctx, mem, owner, page, n);
+		if (ret)
+			return ret;
+	}
+
+	for (page = first; page <= last; page += n) {
+		n = 1;
+		if (shm->page_owner[page] == mem)
+			continue;
+		if (load && __gdev_swap_test(mem->swap_saved, page)) {
+			dev = __gdev_swap_test(mem->swap_dev, page);
+			while (page + n <= last && shm->page_owner[page + n] != mem &&
+				   __gdev_swap_test(mem->swap_saved, page + n) &&
+				   __gdev_swap_test(mem->swap_dev, page + n) == dev)
+				n++;
+			ret = __gdev_swap_load(ctx, mem, page, n, dev);
+			if (ret)
+				return ret;
 		}
-		shm->holder = mem;
+		for (i = page; i < page + n; i++) {
+			owner = shm->page_owner[i];
+			if (owner)
+				owner->evicted = 1;
+			shm->page_owner[i] = mem;
+			__gdev_swap_set(mem->swap_dev, i, 0);
+		}
+	}
+
+	/* release the device swap if @mem no longer has data in it. */
+	if (dev_swap && dev_swap->shm->holder == mem) {
+		int pages = __gdev_swap_pages(shm->size);
+		for (i = 0; i < pages; i++) {
+			if (__gdev_swap_test(mem->swap_dev, i))
+				break;
+		}
+		if (i == pages)
+			dev_swap->shm->holder = NULL;
 	}
 
+	if (shm->holder != mem)
+		shm->holder = NULL;
+
 	return 0;
-	
-fail_evict:
-	return ret;
 }
 
-/* retrieve data evicted in swap space.
+/* evict the conflicting shared memory object data in [@addr, @addr + 
+   @size), which @mem is going to overwrite. the pages partially overwritten
+   are retrieved, and the range is then marked dirty.
    the shared memory object associated with @mem must be locked. */
-int gdev_shm_retrieve_swap(struct gdev_ctx *ctx, struct gdev_mem *mem)
+int gdev_shm_evict_conflict(struct gdev_ctx *ctx, struct gdev_mem *mem, uint64_t addr, uint64_t size)
 {
-	struct gdev_vas *vas = ctx->vas;
-	struct gdev_device *gdev = vas->gdev;
-	struct gdev_mem *dev_swap;
-	uint64_t dst_addr;
-	uint64_t size;
+	struct gdev_shm *shm = mem->shm;
+	uint64_t offset = addr - mem->addr;
+	uint64_t end = offset + size;
+	int first, last;
 	int ret;
 
-	if (mem->evicted) {
-		void *h = vas->handle;
-		/* evict the corresponding memory space first. */
-		gdev_shm_evict_conflict(ctx, mem);
-		/* load data regardless whether eviction succeeded or failed. */
-		dev_swap = gdev->swap;
-		dst_addr = mem->addr;
-		size = mem->size;
-		if (dev_swap && dev_swap->shm->holder == mem) {
-			uint64_t src_addr = mem->swap_mem->addr;
-			ret = gdev_callback_load_from_device(h, dst_addr, src_addr, size);
+	if (!__gdev_swap_enabled(mem) || size == 0)
+		return 0;
+
+	first = offset / GDEV_SWAP_PAGE_SIZE;
+	last = (end - 1) / GDEV_SWAP_PAGE_SIZE;
+
+	if (shm->holder != mem) {
+		if (offset % GDEV_SWAP_PAGE_SIZE) {
+			ret = __gdev_swap_claim(ctx, mem, first, first, 1);
 			if (ret)
-				goto fail_retrieve;
+				return ret;
 		}
-		else {
-			void *src_buf = mem->swap_buf;
-			ret = gdev_callback_load_from_host(h, dst_addr, src_buf, size);
+		if (end % GDEV_SWAP_PAGE_SIZE && end < shm->size) {
+			ret = __gdev_swap_claim(ctx, mem, last, last, 1);
 			if (ret)
-				goto fail_retrieve;
+				return ret;
 		}
-		mem->evicted = 0;
-		mem->shm->holder = mem;
+		ret = __gdev_swap_claim(ctx, mem, first, last, 0);
+		if (ret)
+			return ret;
 	}
 
+	gdev_shm_mark_dirty(mem, addr, size);
+
 	return 0;
+}
 
-fail_retrieve:
-	return ret;
+/* retrieve data evicted in swap space.
+   the shared memory object associated with @mem must be locked. */
+int gdev_shm_retrieve_swap(struct gdev_ctx *ctx, struct gdev_mem *mem)
+{
+	struct gdev_shm *shm = mem->shm;
+	int ret;
+
+	if (!__gdev_swap_enabled(mem) || shm->holder == mem)
+		return 0;
+
+	ret = __gdev_swap_claim(ctx, mem, 0, __gdev_swap_pages(shm->size) - 1, 1);
+	if (ret)
+		return ret;
+	mem->evicted = 0;
+	shm->holder = mem;
+
+	return 0;
 }
 
-/* retrieve all data evicted in swap space associated to @vas.
+/* mark [@addr, @addr + @size) of @mem as written on the device, so that it 
+   is saved when evicted. @mem must hold the pages, e.g., by retrieval.
+   the shared memory object associated with @mem must be locked. */
+void gdev_shm_mark_dirty(struct gdev_mem *mem, uint64_t addr, uint64_t size)
+{
+	uint64_t offset = addr - mem->addr;
+	int page, last;
+
+	if (!__gdev_swap_enabled(mem) || size == 0)
+		return;
+
+	last = (offset + size - 1) / GDEV_SWAP_PAGE_SIZE;
+	for (page = offset / GDEV_SWAP_PAGE_SIZE; page <= last; page++)
+		__gdev_swap_set(mem->swap_dirty, page, 1);
+}
+
+/* mark all the memory objects associated to @vas as written.
    all the shared memory objects associated to @vas must be locked. */
-int gdev_shm_retrieve_swap_all(struct gdev_ctx *ctx, struct gdev_vas *vas)
+void gdev_shm_mark_dirty_all(struct gdev_vas *vas)
 {
 	struct gdev_mem *mem;
 
+	gdev_read_lock(&vas->lock);
 	gdev_list_for_each (mem, &vas->mem_list, list_entry_heap) {
-		gdev_shm_retrieve_swap(ctx, mem);
+		gdev_shm_mark_dirty(mem, mem->addr, mem->size);
 	}
+	gdev_read_unlock(&vas->lock);
+}
 
-	return 0;
+/* retrieve data evicted in swap space in [@addr, @addr + @size) only, e.g.,
+   the range a launch is known to use.
+   the shared memory object associated with @mem must be locked. */
+int gdev_shm_retrieve_range(struct gdev_ctx *ctx, struct gdev_mem *mem, uint64_t addr, uint64_t size)
+{
+	struct gdev_shm *shm = mem->shm;
+	uint64_t offset = addr - mem->addr;
+
+	if (!__gdev_swap_enabled(mem) || shm->holder == mem || size == 0)
+		return 0;
+
+	return __gdev_swap_claim(ctx, mem, offset / GDEV_SWAP_PAGE_SIZE,
+							 (offset + size - 1) / GDEV_SWAP_PAGE_SIZE, 1);
+}
+
+/* see if any data associated to @vas may be evicted. this is only a hint, 
+   since the shared memory objects are not locked. */
+int gdev_shm_swapped_out(struct gdev_vas *vas)
+{
+	struct gdev_mem *mem;
+	int ret = 0;
+
+	gdev_read_lock(&vas->lock);
+	gdev_list_for_each (mem, &vas->mem_list, list_entry_heap) {
+		if (mem->evicted) {
+			ret = 1;
+			break;
+		}
+	}
+	gdev_read_unlock(&vas->lock);
+
+	return ret;
+}
+
+/* retrieve all data evicted in swap space associated to @vas.
+   all the shared memory objects associated to @vas must be locked.
+   the memory list is not locked while retrieving, since the swap callbacks
+   look up the list, and other threads may wait for the swap meanwhile. the
+   objects retrieved are not freed, since they are locked. */
+int gdev_shm_retrieve_swap_all(struct gdev_ctx *ctx, struct gdev_vas *vas)
+{
+	struct gdev_mem *mem;
+	int ret;
+
+	for (;;) {
+		gdev_read_lock(&vas->lock);
+		gdev_list_for_each (mem, &vas->mem_list, list_entry_heap) {
+			if (__gdev_swap_enabled(mem) && mem->shm->holder != mem)
+				break;
+		}
+		gdev_read_unlock(&vas->lock);
+
+		if (!mem)
+			return 0;
+		ret = gdev_shm_retrieve_swap(ctx, mem);
+		if (ret)
+			return ret;
+	}
 }
 
 /* create swap memory object for the device. */
@@ -0,0 +1,96 @@
+/*
+ * Copyright (C) Shinpei Kato
+ *
+ * University of California, Santa Cruz
+ * Systems Research Lab.
+ *
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef __GDEV_QUEUE_H__
+#define __GDEV_QUEUE_H__
+
+#ifdef __KERNEL__
+#include <linux/types.h>
+#else
+#include <stdint.h>
+#endif
+#include "gdev_list.h"
+
+#define GDEV_QUEUE_LEVELS 64
+
+/* a priority queue: entries are kept in FIFO order per level, and the
+   highest non-empty level is found from the bitmap in constant time. */
+struct gdev_queue {
+	uint64_t bitmap;
+	struct gdev_list level[GDEV_QUEUE_LEVELS];
+};
+
+static inline void gdev_queue_init(struct gdev_queue *q)
+{
+	int i;
+
+	q->bitmap = 0;
+	for (i = 0; i < GDEV_QUEUE_LEVELS; i++)
+		gdev_list_init(&q->level[i], NULL);
+}
+
+static inline int gdev_queue_empty(struct gdev_queue *q)
+{
+	return !q->bitmap;
+}
+
+/* the list of @level, e.g., to insert entries other than at the tail. */
+static inline struct gdev_list *gdev_queue_level(struct gdev_queue *q, int level)
+{
+	return &q->level[level];
+}
+
+static inline void gdev_queue_add_tail(struct gdev_queue *q, struct gdev_list *entry, int level)
+{
+	gdev_list_add_tail(entry, &q->level[level]);
+	q->bitmap |= 1ULL << level;
+}
+
+/* insert @entry in front of @pos, which must be on the list of @level. */
+static inline void gdev_queue_add_prev(struct gdev_queue *q, struct gdev_list *entry, struct gdev_list *pos, int level)
+{
+	gdev_list_add_prev(entry, pos);
+	q->bitmap |= 1ULL << level;
+}
+
+static inline void gdev_queue_del(struct gdev_queue *q, struct gdev_list *entry, int level)
+{
+	gdev_list_del(entry);
+	if (gdev_list_empty(&q->level[level]))
+		q->bitmap &= ~(1ULL << level);
+}
+
+/* the first entry of the highest non-empty level. */
+static inline struct gdev_list *gdev_queue_head(struct gdev_queue *q)
+{
+	if (!q->bitmap)
+		return NULL;
+	return gdev_list_head(&q->level[63 - __builtin_clzll(q->bitmap)]);
+}
+
+#endif
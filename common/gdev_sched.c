@@ -103,10 +103,19 @@ struct gdev_sched_entity *gdev_sched_entity_create(struct gdev_device *gdev, gde
 	se->rt_prio = GDEV_PRIO_DEFAULT;
 	se->launch_instances = 0;
 	se->memcpy_instances = 0;
+	se->deadline = 0;
+	se->budget = 0;
+	se->deadline_jobs = 0;
+	se->deadline_misses = 0;
+	se->level_com = 0;
+	se->level_mem = 0;
 	gdev_list_init(&se->list_entry_com, (void*)se);
 	gdev_list_init(&se->list_entry_mem, (void*)se);
 	gdev_time_us(&se->last_tick_com, 0);
 	gdev_time_us(&se->last_tick_mem, 0);
+	gdev_time_us(&se->abs_deadline, 0);
+	gdev_time_us(&se->job_deadline, 0);
+	gdev_time_us(&se->budget_left, 0);
 	sched_entity_ptr[gdev_ctx_get_cid(ctx)] = se;
 
 	return se;
@@ -117,61 +126,257 @@ struct gdev_sched_entity *gdev_sched_entity_create(struct gdev_device *gdev, gde
  */
 void gdev_sched_entity_destroy(struct gdev_sched_entity *se)
 {
+	/* release the utilization reserved for the deadline. */
+	gdev_sched_entity_set_deadline(se, 0, 0);
 	FREE(se);
 }
 
 /**
- * insert the scheduling entity to the priority-ordered compute list.
+ * give the scheduling entity @se of a context kept initialized to the 
+ * current task, as if it were created again.
+ */
+void gdev_sched_entity_reset(struct gdev_sched_entity *se)
+{
+	gdev_sched_entity_set_deadline(se, 0, 0);
+	se->task = gdev_sched_get_current_task();
+	se->prio = gdev_sched_get_static_prio(se->task);
+	se->rt_prio = GDEV_PRIO_DEFAULT;
+	se->launch_instances = 0;
+	se->memcpy_instances = 0;
+	se->deadline_jobs = 0;
+	se->deadline_misses = 0;
+}
+
+/**
+ * set the relative deadline @deadline and the execution budget @budget
+ * per deadline of the scheduling entity, both in microseconds.
+ * the budget is reserved out of the physical device, and the request is
+ * rejected with -EBUSY if the reservations exceed the utilization bound.
+ * @deadline = 0 clears both.
+ */
+int gdev_sched_entity_set_deadline(struct gdev_sched_entity *se, uint32_t deadline, uint32_t budget)
+{
+	struct gdev_device *phys = gdev_phys_get(se->gdev);
+	uint32_t util, old_util;
+	int ret = 0;
+
+	if (!deadline)
+		budget = 0;
+	if (budget > deadline)
+		return -EINVAL;
+
+	if (!phys)
+		phys = se->gdev;
+
+	/* round up so that reservations never add up over the bound. */
+	util = budget ? ((uint64_t)budget * 1000 + deadline - 1) / deadline : 0;
+	old_util = se->budget ? ((uint64_t)se->budget * 1000 + se->deadline - 1) / se->deadline : 0;
+
+	gdev_lock(&phys->sched_com_lock);
+	if (phys->deadline_util - old_util + util > GDEV_DEADLINE_UTIL_BOUND)
+		ret = -EBUSY;
+	else {
+		phys->deadline_util = phys->deadline_util - old_util + util;
+		se->deadline = deadline;
+		se->budget = budget;
+		gdev_time_us(&se->abs_deadline, 0);
+		gdev_time_us(&se->budget_left, 0);
+	}
+	gdev_unlock(&phys->sched_com_lock);
+
+	return ret;
+}
+
+/**
+ * record a scheduler event of the virtual device @gdev in the trace ring
+ * of its physical device.
+ */
+void gdev_trace(struct gdev_device *gdev, int type, int res, int cid, int64_t val)
+{
+	struct gdev_device *phys = gdev_phys_get(gdev);
+
+	if (!phys)
+		phys = gdev;
+	gdev_trace_record(&phys->trace, type, res, gdev->id, cid, val);
+}
+
+static int __gdev_sched_cid(struct gdev_sched_entity *se)
+{
+	return se->ctx ? gdev_ctx_get_cid(se->ctx) : -1;
+}
+
+/**
+ * give a deadline to a new launch. if the budget has been used up, the
+ * deadline is postponed, so that overrunning contexts cannot make others
+ * miss their deadlines.
+ */
+static void __gdev_sched_release(struct gdev_sched_entity *se)
+{
+	struct gdev_time now, deadline, budget;
+
+	if (!se->deadline)
+		return;
+
+	gdev_time_stamp(&now);
+	gdev_time_us(&deadline, se->deadline);
+	gdev_time_add(&se->job_deadline, &now, &deadline);
+
+	if (!se->budget) {
+		se->abs_deadline = se->job_deadline;
+		return;
+	}
+
+	gdev_time_us(&budget, se->budget);
+	if (gdev_time_ge(&now, &se->abs_deadline)) {
+		/* a new window: the debt of the overrun is carried over. */
+		se->abs_deadline = se->job_deadline;
+		gdev_time_add(&se->budget_left, &se->budget_left, &budget);
+		if (gdev_time_gt(&se->budget_left, &budget))
+			se->budget_left = budget;
+	}
+	while (gdev_time_lez(&se->budget_left)) {
+		gdev_time_add(&se->abs_deadline, &se->abs_deadline, &deadline);
+		gdev_time_add(&se->budget_left, &se->budget_left, &budget);
+	}
+}
+
+/**
+ * account for the completion of a launch with a deadline.
+ */
+static void __gdev_sched_complete(struct gdev_sched_entity *se, struct gdev_time *now, struct gdev_time *exec)
+{
+	if (!se->deadline)
+		return;
+
+	if (se->budget)
+		gdev_time_sub(&se->budget_left, &se->budget_left, exec);
+	se->deadline_jobs++;
+	if (gdev_time_gt(now, &se->job_deadline))
+		se->deadline_misses++;
+}
+
+/**
+ * return true if @se should be dispatched before @p. entities with
+ * deadlines come first in order of the deadlines, and the others follow
+ * in order of the priorities.
+ */
+static int __gdev_sched_before(struct gdev_sched_entity *se, struct gdev_sched_entity *p)
+{
+	if (se->deadline && p->deadline)
+		return gdev_time_lt(&se->abs_deadline, &p->abs_deadline);
+	if (se->deadline || p->deadline)
+		return se->deadline != 0;
+	return se->prio > p->prio;
+}
+
+/**
+ * return the level of the scheduling entity in the wait queues. entities
+ * with deadlines share the highest level, ordered by the deadlines.
+ */
+static int __gdev_sched_level(struct gdev_sched_entity *se)
+{
+	if (se->deadline)
+		return GDEV_QUEUE_LEVELS - 1;
+	if (se->prio < GDEV_PRIO_MIN)
+		return GDEV_PRIO_MIN;
+	if (se->prio > GDEV_PRIO_MAX)
+		return GDEV_PRIO_MAX;
+	return se->prio;
+}
+
+/**
+ * insert the scheduling entity to the deadline/priority-ordered compute queue.
  * gdev->sched_com_lock must be locked.
  */
 static void __gdev_enqueue_compute(struct gdev_device *gdev, struct gdev_sched_entity *se)
 {
+	struct gdev_queue *q = &gdev->sched_com_queue;
 	struct gdev_sched_entity *p;
+	int level = __gdev_sched_level(se);
 
-	gdev_list_for_each (p, &gdev->sched_com_list, list_entry_com) {
-		if (se->prio > p->prio) {
-			gdev_list_add_prev(&se->list_entry_com, &p->list_entry_com);
-			break;
+	/* only entities with deadlines are sorted, otherwise FIFO. */
+	if (se->deadline) {
+		gdev_list_for_each (p, gdev_queue_level(q, level), list_entry_com) {
+			if (__gdev_sched_before(se, p)) {
+				gdev_queue_add_prev(q, &se->list_entry_com, &p->list_entry_com, level);
+				break;
+			}
 		}
 	}
 	if (gdev_list_empty(&se->list_entry_com))
-		gdev_list_add_tail(&se->list_entry_com, &gdev->sched_com_list);
+		gdev_queue_add_tail(q, &se->list_entry_com, level);
+	se->level_com = level;
+	gdev_trace(gdev, GDEV_TRACE_ENQUEUE, GDEV_TRACE_COMPUTE, __gdev_sched_cid(se), se->prio);
+
+	/* the entity woken up with the device reserved has been put back to
+	   sleep before running, so release the reservation. */
+	if (se->launch_instances == 0 && gdev_current_com_get(gdev) == se)
+		gdev_current_com_set(gdev, NULL);
 }
 
 /**
- * delete the scheduling entity from the priority-ordered compute list.
+ * delete the scheduling entity from the deadline/priority-ordered compute queue.
  * gdev->sched_com_lock must be locked.
  */
 static void __gdev_dequeue_compute(struct gdev_sched_entity *se)
 {
-	gdev_list_del(&se->list_entry_com);
+	gdev_queue_del(&se->gdev->sched_com_queue, &se->list_entry_com, se->level_com);
 }
 
 /**
- * insert the scheduling entity to the priority-ordered memory list.
+ * insert the scheduling entity to the deadline/priority-ordered memory queue.
  * gdev->sched_mem_lock must be locked.
  */
 static void __gdev_enqueue_memory(struct gdev_device *gdev, struct gdev_sched_entity *se)
 {
+	struct gdev_queue *q = &gdev->sched_mem_queue;
 	struct gdev_sched_entity *p;
+	int level = __gdev_sched_level(se);
 
-	gdev_list_for_each (p, &gdev->sched_mem_list, list_entry_mem) {
-		if (se->prio > p->prio) {
-			gdev_list_add_prev(&se->list_entry_mem, &p->list_entry_mem);
-			break;
+	if (se->deadline) {
+		gdev_list_for_each (p, gdev_queue_level(q, level), list_entry_mem) {
+			if (__gdev_sched_before(se, p)) {
+				gdev_queue_add_prev(q, &se->list_entry_mem, &p->list_entry_mem, level);
+				break;
+			}
 		}
 	}
 	if (gdev_list_empty(&se->list_entry_mem))
-		gdev_list_add_tail(&se->list_entry_mem, &gdev->sched_mem_list);
+		gdev_queue_add_tail(q, &se->list_entry_mem, level);
+	se->level_mem = level;
+	gdev_trace(gdev, GDEV_TRACE_ENQUEUE, GDEV_TRACE_MEMORY, __gdev_sched_cid(se), se->prio);
+
+	/* release the reservation, as for compute. */
+	if (se->memcpy_instances == 0 && gdev->current_mem == se)
+		gdev->current_mem = NULL;
 }
 
 /**
- * delete the scheduling entity from the priority-ordered memory list.
+ * delete the scheduling entity from the deadline/priority-ordered memory queue.
  * gdev->sched_mem_lock must be locked.
  */
 static void __gdev_dequeue_memory(struct gdev_sched_entity *se)
 {
-	gdev_list_del(&se->list_entry_mem);
+	gdev_queue_del(&se->gdev->sched_mem_queue, &se->list_entry_mem, se->level_mem);
+}
+
+/**
+ * sleep until the scheduling entity is dequeued from the memory queue. the
+ * task may be woken for compute meanwhile, if it waits in both queues, e.g.,
+ * in the callback of gdev_schedule_compute_wait(), which then sees that the
+ * entity has been dequeued from the compute queue.
+ */
+static void __gdev_sched_sleep_memory(struct gdev_sched_entity *se)
+{
+	struct gdev_device *gdev = se->gdev;
+	int queued;
+
+	do {
+		gdev_sched_sleep();
+		gdev_lock(&gdev->sched_mem_lock);
+		queued = !gdev_list_empty(&se->list_entry_mem);
+		gdev_unlock(&gdev->sched_mem_lock);
+	} while (queued);
 }
 
 /**
@@ -181,32 +386,199 @@ static void __gdev_dequeue_memory(struct gdev_sched_entity *se)
 #include "gdev_vsched_credit.c"
 #include "gdev_vsched_fifo.c"
 #include "gdev_vsched_null.c"
+#include "gdev_vsched_edf.c"
+#include "gdev_vsched_sfq.c"
+
+/* indexed by GDEV_VSCHED_*. */
+struct gdev_vsched_policy *gdev_vsched_policies[GDEV_VSCHED_POLICY_COUNT] = {
+	[GDEV_VSCHED_BAND] = &gdev_vsched_band,
+	[GDEV_VSCHED_CREDIT] = &gdev_vsched_credit,
+	[GDEV_VSCHED_FIFO] = &gdev_vsched_fifo,
+	[GDEV_VSCHED_NULL] = &gdev_vsched_null,
+	[GDEV_VSCHED_EDF] = &gdev_vsched_edf,
+	[GDEV_VSCHED_SFQ] = &gdev_vsched_sfq,
+};
+
+/**
+ * return the index of the policy named @name, or -EINVAL if unknown.
+ */
+int gdev_vsched_lookup(const char *name)
+{
+	int i;
+
+	for (i = 0; i < GDEV_VSCHED_POLICY_COUNT; i++) {
+		if (!strcmp(gdev_vsched_policies[i]->name, name))
+			return i;
+	}
+
+	return -EINVAL;
+}
+
+/**
+ * the policy is chosen by the physical device, and shared among all its
+ * virtual devices. only the index is kept in the device structure, since
+ * the structure may be shared among processes in the user-space mode.
+ */
+struct gdev_vsched_policy *gdev_vsched_get(struct gdev_device *gdev)
+{
+	struct gdev_device *phys = gdev_phys_get(gdev);
+	int policy = phys ? phys->vsched_policy : gdev->vsched_policy;
+
+	if (policy < 0 || policy >= GDEV_VSCHED_POLICY_COUNT)
+		policy = GDEV_VSCHED_DEFAULT;
+
+	return gdev_vsched_policies[policy];
+}
+
+/**
+ * return -EBUSY if any context is running on or waiting for the physical
+ * device @phys. phys->global_lock and phys->sched_com_lock must be locked.
+ * gdev_access_start() takes the global lock, so nothing can start
+ * accessing the device while they are held.
+ */
+static int __gdev_sched_busy(struct gdev_device *phys)
+{
+	struct gdev_device *p;
+	int ret = 0;
+
+	gdev_lock_nested(&phys->sched_mem_lock);
+	if (phys->accessed || phys->blocked ||
+		gdev_current_com_get(phys) || phys->current_mem)
+		ret = -EBUSY;
+	else {
+		gdev_list_for_each(p, &phys->sched_com_list, list_entry_com) {
+			if (!gdev_queue_empty(&p->sched_com_queue)) {
+				ret = -EBUSY;
+				break;
+			}
+		}
+		gdev_list_for_each(p, &phys->sched_mem_list, list_entry_mem) {
+			if (!gdev_queue_empty(&p->sched_mem_queue)) {
+				ret = -EBUSY;
+				break;
+			}
+		}
+	}
+	gdev_unlock_nested(&phys->sched_mem_lock);
+
+	return ret;
+}
+
+/**
+ * switch the policy of the physical device to which @gdev belongs.
+ * the policies keep their own state in the device structures, so they are
+ * switched only while no context is running on or waiting for the device.
+ * return -EBUSY otherwise.
+ */
+int gdev_vsched_set(struct gdev_device *gdev, int policy)
+{
+	struct gdev_device *phys = gdev_phys_get(gdev);
+	int ret;
+
+	if (policy < 0 || policy >= GDEV_VSCHED_POLICY_COUNT)
+		return -EINVAL;
+
+	if (!phys)
+		phys = gdev;
+
+	gdev_lock(&phys->global_lock);
+	gdev_lock_nested(&phys->sched_com_lock);
+	ret = __gdev_sched_busy(phys);
+	if (!ret)
+		phys->vsched_policy = policy;
+	gdev_unlock_nested(&phys->sched_com_lock);
+	gdev_unlock(&phys->global_lock);
 
-#define GDEV_VSCHED_POLICY_BAND
-//#define GDEV_VSCHED_POLICY_CREDIT
-//#define GDEV_VSCHED_POLICY_FIFO
-//#define GDEV_VSCHED_POLICY_NULL
+	return ret;
+}
 
-#if defined(GDEV_VSCHED_POLICY_BAND)
-struct gdev_vsched_policy *gdev_vsched = &gdev_vsched_band;
-#elif defined(GDEV_VSCHED_POLICY_CREDIT)
-struct gdev_vsched_policy *gdev_vsched = &gdev_vsched_credit;
-#elif defined(GDEV_VSCHED_POLICY_FIFO)
-struct gdev_vsched_policy *gdev_vsched = &gdev_vsched_fifo;
-#elif defined(GDEV_VSCHED_POLICY_NULL)
-struct gdev_vsched_policy *gdev_vsched = &gdev_vsched_null;
-#endif
+/* indexed by GDEV_SCHED_SDQ and MRQ. */
+const char *gdev_sched_queueing_names[GDEV_SCHED_QUEUEING_COUNT] = {
+	[GDEV_SCHED_SDQ] = "sdq",
+	[GDEV_SCHED_MRQ] = "mrq",
+};
+
+/**
+ * return the queueing method named @name, or -EINVAL if unknown.
+ */
+int gdev_sched_queueing_lookup(const char *name)
+{
+	int i;
+
+	for (i = 0; i < GDEV_SCHED_QUEUEING_COUNT; i++) {
+		if (!strcmp(gdev_sched_queueing_names[i], name))
+			return i;
+	}
+
+	return -EINVAL;
+}
+
+/**
+ * the queueing method is chosen by the physical device, as the policy is.
+ */
+int gdev_sched_queueing_get(struct gdev_device *gdev)
+{
+	struct gdev_device *phys = gdev_phys_get(gdev);
+	int queueing = phys ? phys->sched_queueing : gdev->sched_queueing;
+
+	if (queueing < 0 || queueing >= GDEV_SCHED_QUEUEING_COUNT)
+		queueing = GDEV_SCHED_QUEUEING_DEFAULT;
+
+	return queueing;
+}
+
+/**
+ * switch the queueing method of the physical device to which @gdev belongs.
+ * a memory copy scheduled by one method cannot complete by the other, so
+ * this is also done only while the device is idle. return -EBUSY otherwise.
+ */
+int gdev_sched_queueing_set(struct gdev_device *gdev, int queueing)
+{
+	struct gdev_device *phys = gdev_phys_get(gdev);
+	int ret;
+
+	if (queueing < 0 || queueing >= GDEV_SCHED_QUEUEING_COUNT)
+		return -EINVAL;
+
+	if (!phys)
+		phys = gdev;
+
+	gdev_lock(&phys->global_lock);
+	gdev_lock_nested(&phys->sched_com_lock);
+	ret = __gdev_sched_busy(phys);
+	if (!ret)
+		phys->sched_queueing = queueing;
+	gdev_unlock_nested(&phys->sched_com_lock);
+	gdev_unlock(&phys->global_lock);
+
+	return ret;
+}
 
 /**
  * schedule compute calls.
  */
 void gdev_schedule_compute(struct gdev_sched_entity *se)
+{
+	gdev_schedule_compute_wait(se, NULL, NULL);
+}
+
+/**
+ * schedule compute calls, and call @wait(@arg) once if the entity has to
+ * wait in the compute queue, so that the task can do something else for
+ * the launch meanwhile, e.g., swap its data back.
+ */
+void gdev_schedule_compute_wait(struct gdev_sched_entity *se, void (*wait)(void *), void *arg)
 {
 	struct gdev_device *gdev = se->gdev;
+	int woken, first;
+
+	/* a new launch, rather than one more instance of the running launch. */
+	if (se->launch_instances == 0)
+		__gdev_sched_release(se);
 
 resched:
 	/* algorithm-specific virtual device scheduler. */
-	gdev_vsched->schedule_compute(se);
+	gdev_vsched_get(gdev)->schedule_compute(se);
 
 	/* local compute scheduler. */
 	gdev_lock(&gdev->sched_com_lock);
@@ -215,6 +587,18 @@ resched:
 		__gdev_enqueue_compute(gdev, se);
 		gdev_unlock(&gdev->sched_com_lock);
 
+		if (wait) {
+			wait(arg);
+			wait = NULL;
+			/* the wakeup may have been taken by a sleep in @wait(), while
+			   an extra one is harmless, so see if it has been dequeued. */
+			gdev_lock(&gdev->sched_com_lock);
+			woken = gdev_list_empty(&se->list_entry_com);
+			gdev_unlock(&gdev->sched_com_lock);
+			if (woken)
+				goto resched;
+		}
+
 		/* now the corresponding task will be suspended until some other tasks
 		   will awaken it upon completions of their compute launches. */
 		gdev_sched_sleep();
@@ -223,10 +607,9 @@ resched:
 	}
 	else {
 		/* now, let's get offloaded to the device! */
-		if (se->launch_instances == 0) {
-			/* record the start time. */
-			gdev_time_stamp(&se->last_tick_com);
-		}
+		first = (se->launch_instances == 0);
+		if (first)
+			gdev_trace(gdev, GDEV_TRACE_DISPATCH, GDEV_TRACE_COMPUTE, __gdev_sched_cid(se), se->prio);
 		se->launch_instances++;
 		gdev_current_com_set(gdev, (void*)se);
 		gdev_unlock(&gdev->sched_com_lock);
@@ -235,6 +618,11 @@ resched:
 	/* this function call will block any new contexts to be created during
 	   the busy period on the GPU. */
 	gdev_access_start(gdev);
+
+	/* record the start time, once the launch can go to the device, so
+	   that the overhead of scheduling is not charged as its execution. */
+	if (first)
+		gdev_time_stamp(&se->last_tick_com);
 }
 
 /**
@@ -247,6 +635,10 @@ void gdev_select_next_compute(struct gdev_device *gdev)
 	struct gdev_device *next;
 	struct gdev_time now, exec;
 
+	/* record the end time (update on multiple launches too) before the
+	   overhead of scheduling, as the start time is after it. */
+	gdev_time_stamp(&now);
+
 	/* now new contexts are allowed to be created as the GPU is idling. */
 	gdev_access_end(gdev);
 
@@ -258,8 +650,6 @@ void gdev_select_next_compute(struct gdev_device *gdev)
 		return;
 	}
 
-	/* record the end time (update on multiple launches too). */
-	gdev_time_stamp(&now);
 	/* aquire the execution time. */
 	gdev_time_sub(&exec, &now, &se->last_tick_com);
 
@@ -268,11 +658,15 @@ void gdev_select_next_compute(struct gdev_device *gdev)
 		/* account for the credit. */
 		gdev_time_sub(&gdev->credit_com, &gdev->credit_com, &exec);
 		/* accumulate the computation time. */
-		gdev->com_time += gdev_time_to_us(&exec);
+		gdev->com_time += gdev_time_to_us_carry(&exec, &gdev->com_time_rem);
+		gdev->com_time_uncharged += gdev_time_to_ns(&exec);
+		/* account for the deadline. */
+		__gdev_sched_complete(se, &now, &exec);
+		gdev_trace(gdev, GDEV_TRACE_COMPLETE, GDEV_TRACE_COMPUTE, __gdev_sched_cid(se), gdev_time_to_us(&exec));
 
 		/* select the next context to be scheduled.
 		   now don't reference the previous entity by se. */
-		se = gdev_list_container(gdev_list_head(&gdev->sched_com_list));
+		se = gdev_list_container(gdev_queue_head(&gdev->sched_com_queue));
 		/* setting the next entity here prevents lower-priority contexts 
 		   arriving in gdev_schedule_compute() from being dispatched onto
 		   the device. note that se = NULL could happen. */
@@ -280,16 +674,31 @@ void gdev_select_next_compute(struct gdev_device *gdev)
 		gdev_unlock(&gdev->sched_com_lock);
 
 		/* select the next device to be scheduled. */
-		next = gdev_vsched->select_next_compute(gdev);
+		next = gdev_vsched_get(gdev)->select_next_compute(gdev);
 		if (!next)
 			return;
 
+		/* if the virtual device is switched, cancel the reservation for
+		   the next entity, unless a context has been dispatched already. */
+		if (next != gdev) {
+			struct gdev_sched_entity *cur;
+			gdev_lock(&gdev->sched_com_lock);
+			cur = (struct gdev_sched_entity *)gdev_current_com_get(gdev);
+			if (cur && cur->launch_instances == 0)
+				gdev_current_com_set(gdev, NULL);
+			gdev_unlock(&gdev->sched_com_lock);
+		}
+
 		gdev_lock(&next->sched_com_lock);
 		/* if the virtual device needs to be switched, change the next
 		   scheduling entity to be scheduled also needs to be changed. */
 		if (next != gdev) {
-		    	gdev_current_com_set( gdev, NULL);
-			se = gdev_list_container(gdev_list_head(&next->sched_com_list));
+			se = gdev_list_container(gdev_queue_head(&next->sched_com_queue));
+			/* reserve the device for the woken entity, otherwise another
+			   context arriving in the meantime could be dispatched
+			   together with it. */
+			if (se && !gdev_current_com_get(next))
+				gdev_current_com_set(next, (void*)se);
 		}
 
 		/* now remove the scheduling entity from the waiting list, and wake 
@@ -310,12 +719,19 @@ void gdev_select_next_compute(struct gdev_device *gdev)
 		gdev_unlock(&gdev->sched_com_lock);
 }
 
+/* signed microseconds of @credit. */
+static int64_t __gdev_trace_credit(struct gdev_time *credit)
+{
+	return gdev_time_to_ns(credit) / NSEC_1USEC;
+}
+
 /**
  * automatically replenish the credit of compute launches.
  */
 void gdev_replenish_credit_compute(struct gdev_device *gdev)
 {
-	gdev_vsched->replenish_compute(gdev);
+	gdev_vsched_get(gdev)->replenish_compute(gdev);
+	gdev_trace(gdev, GDEV_TRACE_REPLENISH, GDEV_TRACE_COMPUTE, -1, __gdev_trace_credit(&gdev->credit_com));
 }
 
 /**
@@ -324,15 +740,17 @@ void gdev_replenish_credit_compute(struct gdev_device *gdev)
 void gdev_schedule_memory(struct gdev_sched_entity *se)
 {
 	struct gdev_device *gdev = se->gdev;
+	int first;
 
-#ifndef GDEV_SCHED_MRQ
-	gdev_schedule_compute(se);
-	return;
-#endif
+	/* copies hold the compute queue under SDQ. */
+	if (gdev_sched_queueing_get(gdev) == GDEV_SCHED_SDQ) {
+		gdev_schedule_compute(se);
+		return;
+	}
 
 resched:
 	/* algorithm-specific virtual device scheduler. */
-	gdev_vsched->schedule_memory(se);
+	gdev_vsched_get(gdev)->schedule_memory(se);
 
 	/* local memory scheduler. */
 	gdev_lock(&gdev->sched_mem_lock);
@@ -343,22 +761,25 @@ resched:
 
 		/* now the corresponding task will be suspended until some other tasks
 		   will awaken it upon completions of their memory transfers. */
-		gdev_sched_sleep();
+		__gdev_sched_sleep_memory(se);
 
 		goto resched;
 	}
 	else {
 		/* now, let's get offloaded to the device! */
-		if (se->memcpy_instances == 0) {
-			/* record the start time. */
-			gdev_time_stamp(&se->last_tick_mem);
-		}
+		first = (se->memcpy_instances == 0);
+		if (first)
+			gdev_trace(gdev, GDEV_TRACE_DISPATCH, GDEV_TRACE_MEMORY, __gdev_sched_cid(se), se->prio);
 		se->memcpy_instances++;
 		gdev->current_mem = (void*)se;
 		gdev_unlock(&gdev->sched_mem_lock);
 	}
 
 	gdev_access_start(gdev);
+
+	/* record the start time, as for compute launches. */
+	if (first)
+		gdev_time_stamp(&se->last_tick_mem);
 }
 
 /**
@@ -371,10 +792,13 @@ void gdev_select_next_memory(struct gdev_device *gdev)
 	struct gdev_device *next;
 	struct gdev_time now, exec;
 
-#ifndef GDEV_SCHED_MRQ
-	gdev_select_next_compute(gdev);
-	return;
-#endif
+	if (gdev_sched_queueing_get(gdev) == GDEV_SCHED_SDQ) {
+		gdev_select_next_compute(gdev);
+		return;
+	}
+
+	/* record the end time (update on multiple launches too). */
+	gdev_time_stamp(&now);
 
 	gdev_access_end(gdev);
 
@@ -386,8 +810,6 @@ void gdev_select_next_memory(struct gdev_device *gdev)
 		return;
 	}
 
-	/* record the end time (update on multiple launches too). */
-	gdev_time_stamp(&now);
 	/* aquire the execution time. */
 	gdev_time_sub(&exec, &now, &se->last_tick_mem);
 
@@ -396,11 +818,13 @@ void gdev_select_next_memory(struct gdev_device *gdev)
 		/* account for the credit. */
 		gdev_time_sub(&gdev->credit_mem, &gdev->credit_mem, &exec);
 		/* accumulate the memory transfer time. */
-		gdev->mem_time += gdev_time_to_us(&exec);
+		gdev->mem_time += gdev_time_to_us_carry(&exec, &gdev->mem_time_rem);
+		gdev->mem_time_uncharged += gdev_time_to_ns(&exec);
+		gdev_trace(gdev, GDEV_TRACE_COMPLETE, GDEV_TRACE_MEMORY, __gdev_sched_cid(se), gdev_time_to_us(&exec));
 
 		/* select the next context to be scheduled.
 		   now don't reference the previous entity by se. */
-		se = gdev_list_container(gdev_list_head(&gdev->sched_mem_list));
+		se = gdev_list_container(gdev_queue_head(&gdev->sched_mem_queue));
 		/* setting the next entity here prevents lower-priority contexts 
 		   arriving in gdev_schedule_memory() from being dispatched onto
 		   the device. note that se = NULL could happen. */
@@ -408,15 +832,30 @@ void gdev_select_next_memory(struct gdev_device *gdev)
 		gdev_unlock(&gdev->sched_mem_lock);
 
 		/* select the next device to be scheduled. */
-		next = gdev_vsched->select_next_memory(gdev);
+		next = gdev_vsched_get(gdev)->select_next_memory(gdev);
 		if (!next)
 			return;
 
+		/* if the virtual device is switched, cancel the reservation for
+		   the next entity, unless a context has been dispatched already. */
+		if (next != gdev) {
+			struct gdev_sched_entity *cur;
+			gdev_lock(&gdev->sched_mem_lock);
+			cur = (struct gdev_sched_entity *)gdev->current_mem;
+			if (cur && cur->memcpy_instances == 0)
+				gdev->current_mem = NULL;
+			gdev_unlock(&gdev->sched_mem_lock);
+		}
+
 		gdev_lock(&next->sched_mem_lock);
 		/* if the virtual device needs to be switched, change the next
 		   scheduling entity to be scheduled also needs to be changed. */
-		if (next != gdev)
-			se = gdev_list_container(gdev_list_head(&next->sched_mem_list));
+		if (next != gdev) {
+			se = gdev_list_container(gdev_queue_head(&next->sched_mem_queue));
+			/* reserve the engine for the woken entity. */
+			if (se && !next->current_mem)
+				next->current_mem = (void*)se;
+		}
 
 		/* now remove the scheduling entity from the waiting list, and wake 
 		   up the corresponding task. */
@@ -424,8 +863,9 @@ void gdev_select_next_memory(struct gdev_device *gdev)
 			__gdev_dequeue_memory(se);
 			gdev_unlock(&next->sched_mem_lock);
 
-			while (gdev_sched_wakeup(se->task) < 0) {
+			if (gdev_sched_wakeup(se->task) < 0) {
 				GDEV_PRINT("Failed to wake up context %d\n", se->ctx->cid);
+				GDEV_PRINT("Perhaps context %d is already up\n", se->ctx->cid);
 			}
 		}
 		else
@@ -440,8 +880,156 @@ void gdev_select_next_memory(struct gdev_device *gdev)
  */
 void gdev_replenish_credit_memory(struct gdev_device *gdev)
 {
-#ifdef GDEV_SCHED_MRQ
-	gdev_vsched->replenish_memory(gdev);
-#endif
+	/* kept up under SDQ too, so that MRQ can be switched to at any time. */
+	gdev_vsched_get(gdev)->replenish_memory(gdev);
+	gdev_trace(gdev, GDEV_TRACE_REPLENISH, GDEV_TRACE_MEMORY, -1, __gdev_trace_credit(&gdev->credit_mem));
+}
+
+
+/**
+ * add the tokens that @gdev has earned at @rate bytes/s by @now.
+ * at most GDEV_THROTTLE_BURST worth of them are saved up, and a debt of
+ * at most a second is paid off.
+ */
+static void __gdev_throttle_refill(struct gdev_device *gdev, uint64_t rate, struct gdev_time *now)
+{
+	struct gdev_time elapse, keep;
+	int64_t burst = rate * GDEV_THROTTLE_BURST / USEC_1SEC;
+	uint64_t ns, rem;
+
+	gdev_time_sub(&elapse, now, &gdev->mem_tokens_stamp);
+	gdev->mem_tokens_stamp = *now;
+	if (gdev_time_ltz(&elapse))
+		return;
+
+	ns = gdev_time_to_ns(&elapse);
+	if (ns > NSEC_1SEC)
+		ns = NSEC_1SEC;
+	/* rate * ns / NSEC_1SEC without overflowing. the time worth the
+	   fraction of a token left over is kept, so that refills in quick
+	   succession add up rather than round down to nothing. */
+	rem = rate % NSEC_1SEC * ns;
+	gdev->mem_tokens += rate / NSEC_1SEC * ns + rem / NSEC_1SEC;
+	if (gdev->mem_tokens > burst)
+		gdev->mem_tokens = burst;
+	else if (rate) {
+		gdev_time_ns(&keep, rem % NSEC_1SEC / rate);
+		gdev_time_sub(&gdev->mem_tokens_stamp, now, &keep);
+	}
+}
+
+/**
+ * throttle a memcpy chunk of @size bytes on the virtual device @gdev.
+ * the virtual device spends its own tokens first, which guarantee it
+ * mem_bw percent of mem_rate. the physical device keeps the tokens of
+ * the whole rate, which everyone spends, so what is left there is the
+ * capacity unused by others, and it is lent to whoever asks first.
+ * a bucket may run into debt by one chunk, so that chunks larger than
+ * the burst still go through at the right rate.
+ */
+void gdev_throttle_memory(struct gdev_device *gdev, uint64_t size)
+{
+	gdev_throttle_memory_wait(gdev, size, NULL, NULL, NULL);
+}
+
+/**
+ * throttle as above, and call @release(@arg) before waiting for the first
+ * time and @acquire(@arg) once the chunk is let through, so that the copy
+ * engine held by the caller serves others in the meantime.
+ */
+void gdev_throttle_memory_wait(struct gdev_device *gdev, uint64_t size, void (*release)(void *), void (*acquire)(void *), void *arg)
+{
+	struct gdev_device *phys = gdev_phys_get(gdev);
+	struct gdev_time now;
+	uint64_t rate, wait, wait_own;
+	int64_t debt;
+	unsigned int seq;
+	int released = 0;
+
+	if (!phys)
+		phys = gdev;
+
+	for (;;) {
+		gdev_lock(&phys->sched_mem_lock);
+		if (!phys->mem_rate) {
+			gdev_unlock(&phys->sched_mem_lock);
+			goto out;
+		}
+		seq = gdev_event_seq(&phys->throttle_mem_event);
+		rate = phys->mem_rate * gdev->mem_bw / 100;
+		gdev_time_stamp(&now);
+		__gdev_throttle_refill(phys, phys->mem_rate, &now);
+		if (gdev != phys)
+			__gdev_throttle_refill(gdev, rate, &now);
+
+		/* within the guaranteed rate. the physical device is charged in
+		   full, so that nothing is lent beyond the rate. its debt stays
+		   within the bursts unless mem_bw is overcommitted, in which
+		   case it is bounded by a second of the rate. */
+		if (gdev != phys && rate && gdev->mem_tokens >= 0) {
+			gdev->mem_tokens -= size;
+			phys->mem_tokens -= size;
+			debt = phys->mem_rate;
+			if (phys->mem_tokens < -debt)
+				phys->mem_tokens = -debt;
+			gdev_unlock(&phys->sched_mem_lock);
+			goto out;
+		}
+
+		/* borrow the capacity left unused. */
+		if (phys->mem_tokens >= 0) {
+			phys->mem_tokens -= size;
+			gdev_unlock(&phys->sched_mem_lock);
+			goto out;
+		}
+
+		/* sleep until either bucket gets out of debt. */
+		wait = -phys->mem_tokens * USEC_1SEC / phys->mem_rate + 1;
+		if (gdev != phys && rate) {
+			wait_own = -gdev->mem_tokens * USEC_1SEC / rate + 1;
+			if (wait_own < wait)
+				wait = wait_own;
+		}
+		gdev_unlock(&phys->sched_mem_lock);
+
+		if (release && !released) {
+			release(arg);
+			released = 1;
+		}
+		gdev_event_wait(&phys->throttle_mem_event, seq, wait);
+	}
+
+out:
+	if (released)
+		acquire(arg);
+}
+
+/**
+ * the memcpy rate is given to the physical device, and shared among its
+ * virtual devices by mem_bw.
+ */
+uint64_t gdev_throttle_rate_get(struct gdev_device *gdev)
+{
+	struct gdev_device *phys = gdev_phys_get(gdev);
+
+	return phys ? phys->mem_rate : gdev->mem_rate;
 }
 
+/**
+ * set the memcpy rate (bytes/s) of the physical device to which @gdev
+ * belongs. zero stops throttling. throttled contexts are woken up, so
+ * that they go by the new rate.
+ */
+void gdev_throttle_rate_set(struct gdev_device *gdev, uint64_t rate)
+{
+	struct gdev_device *phys = gdev_phys_get(gdev);
+
+	if (!phys)
+		phys = gdev;
+
+	gdev_lock(&phys->sched_mem_lock);
+	phys->mem_rate = rate;
+	gdev_unlock(&phys->sched_mem_lock);
+
+	gdev_event_signal(&phys->throttle_mem_event);
+}
@@ -33,11 +33,15 @@
 #include "gdev_time.h"
 
 /**
- * Queueing methods:
- * SDQ: Single Device Queue
- * MRQ: Multiple Resource Queues
+ * Queueing methods, selectable per physical device:
+ * SDQ: Single Device Queue, memory copies are scheduled as compute.
+ * MRQ: Multiple Resource Queues, compute and memory copies are scheduled
+ *      separately so that they overlap on their own engines.
  */
-#define GDEV_SCHED_SDQ /*GDEV_SCHED_MRQ */
+#define GDEV_SCHED_SDQ 0
+#define GDEV_SCHED_MRQ 1
+#define GDEV_SCHED_QUEUEING_COUNT 2
+#define GDEV_SCHED_QUEUEING_DEFAULT GDEV_SCHED_MRQ
 
 /**
  * priority levels.
@@ -46,6 +50,19 @@
 #define GDEV_PRIO_MIN 0
 #define GDEV_PRIO_DEFAULT 20
 
+/**
+ * map @prio of the OS, in @min..@max, onto GDEV_PRIO_MIN..GDEV_PRIO_MAX
+ * keeping the order, so that the wait queues tell every value apart.
+ */
+static inline int gdev_sched_prio_map(int prio, int min, int max)
+{
+	if (prio < min)
+		prio = min;
+	if (prio > max)
+		prio = max;
+	return GDEV_PRIO_MIN + (prio - min) * (GDEV_PRIO_MAX - GDEV_PRIO_MIN) / (max - min);
+}
+
 /**
  * virtual device period/threshold.
  */
@@ -57,6 +74,14 @@
  * scheduling properties.
  */
 #define GDEV_INSTANCES_LIMIT 32
+#define GDEV_DEADLINE_UTIL_BOUND 1000 /* admissible utilization (permille) */
+
+/**
+ * memcpy throttling: each virtual device may copy at mem_bw percent of
+ * mem_rate of the physical device, and save up to GDEV_THROTTLE_BURST
+ * worth of the rate for bursts.
+ */
+#define GDEV_THROTTLE_BURST 10000 /* microseconds */
 
 struct gdev_sched_entity {
 	struct gdev_device *gdev; /* associated Gdev (virtual) device */
@@ -64,15 +89,37 @@ struct gdev_sched_entity {
 	gdev_ctx_t *ctx; /* holder context */
 	int prio; /* general priority */
 	int rt_prio; /* real-time priority */
-	struct gdev_list list_entry_com; /* entry to compute scheduler list */
-	struct gdev_list list_entry_mem; /* entry to memory scheduler list */
+	struct gdev_list list_entry_com; /* entry to compute scheduler queue */
+	struct gdev_list list_entry_mem; /* entry to memory scheduler queue */
+	int level_com; /* level in the compute scheduler queue */
+	int level_mem; /* level in the memory scheduler queue */
 	struct gdev_time last_tick_com; /* last tick of compute execution */
 	struct gdev_time last_tick_mem; /* last tick of memory transfer */
 	int launch_instances;
 	int memcpy_instances;
+	uint32_t deadline; /* relative deadline (us) of launches, 0 if none */
+	uint32_t budget; /* execution budget (us) per deadline, 0 if none */
+	struct gdev_time abs_deadline; /* deadline used for scheduling */
+	struct gdev_time job_deadline; /* deadline of the current launch */
+	struct gdev_time budget_left; /* budget left for abs_deadline */
+	uint32_t deadline_jobs; /* number of launches with deadlines */
+	uint32_t deadline_misses; /* number of launches missing deadlines */
 };
 
+/**
+ * virtual device scheduling policies, selectable per physical device.
+ */
+#define GDEV_VSCHED_BAND 0
+#define GDEV_VSCHED_CREDIT 1
+#define GDEV_VSCHED_FIFO 2
+#define GDEV_VSCHED_NULL 3
+#define GDEV_VSCHED_EDF 4
+#define GDEV_VSCHED_SFQ 5
+#define GDEV_VSCHED_POLICY_COUNT 6
+#define GDEV_VSCHED_DEFAULT GDEV_VSCHED_BAND
+
 struct gdev_vsched_policy {
+	const char *name;
 	void (*schedule_compute)(struct gdev_sched_entity *se);
 	struct gdev_device *(*select_next_compute)(struct gdev_device *gdev);
 	void (*replenish_compute)(struct gdev_device *gdev);
@@ -86,14 +133,35 @@ void gdev_exit_scheduler(struct gdev_device *gdev);
 
 struct gdev_sched_entity *gdev_sched_entity_create(struct gdev_device *gdev, gdev_ctx_t *ctx);
 void gdev_sched_entity_destroy(struct gdev_sched_entity *se);
+void gdev_sched_entity_reset(struct gdev_sched_entity *se);
+int gdev_sched_entity_set_deadline(struct gdev_sched_entity *se, uint32_t deadline, uint32_t budget);
 
 void gdev_schedule_compute(struct gdev_sched_entity *se);
+void gdev_schedule_compute_wait(struct gdev_sched_entity *se, void (*wait)(void *), void *arg);
 void gdev_select_next_compute(struct gdev_device *gdev);
 void gdev_schedule_memory(struct gdev_sched_entity *se);
 void gdev_select_next_memory(struct gdev_device *gdev);
 void gdev_replenish_credit_compute(struct gdev_device *gdev);
 void gdev_replenish_credit_memory(struct gdev_device *gdev);
 
+int gdev_vsched_lookup(const char *name);
+struct gdev_vsched_policy *gdev_vsched_get(struct gdev_device *gdev);
+int gdev_vsched_set(struct gdev_device *gdev, int policy);
+
+int gdev_sched_queueing_lookup(const char *name);
+int gdev_sched_queueing_get(struct gdev_device *gdev);
+int gdev_sched_queueing_set(struct gdev_device *gdev, int queueing);
+
+void gdev_trace(struct gdev_device *gdev, int type, int res, int cid, int64_t val);
+
+void gdev_throttle_memory(struct gdev_device *gdev, uint64_t size);
+void gdev_throttle_memory_wait(struct gdev_device *gdev, uint64_t size, void (*release)(void *), void (*acquire)(void *), void *arg);
+uint64_t gdev_throttle_rate_get(struct gdev_device *gdev);
+void gdev_throttle_rate_set(struct gdev_device *gdev, uint64_t rate);
+
+extern struct gdev_vsched_policy *gdev_vsched_policies[GDEV_VSCHED_POLICY_COUNT];
+extern const char *gdev_sched_queueing_names[GDEV_SCHED_QUEUEING_COUNT];
+
 extern struct gdev_sched_entity *sched_entity_ptr[GDEV_CONTEXT_MAX_COUNT];
 extern gdev_lock_t global_sched_lock;
 
@@ -0,0 +1,114 @@
+/*
+ * Copyright (C) Shinpei Kato
+ *
+ * University of California, Santa Cruz
+ * Systems Research Lab.
+ *
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#ifndef __GDEV_SLICE_H__
+#define __GDEV_SLICE_H__
+
+#include "gdev_nvidia_def.h"
+
+/**
+ * grid slicing: a launch is split into slices of CTAs, so that the
+ * scheduler can dispatch other contexts in between. the kernel must be
+ * built to take the hidden parameter words from param_buf[slice_param]:
+ * the block offset X and Y of the slice, which it adds to its block
+ * index, and the grid width and height of the whole launch, which it
+ * uses instead of gridDim, since gridDim is that of the slice.
+ */
+struct gdev_slice {
+	uint32_t x; /* block offset X of the slice */
+	uint32_t y; /* block offset Y of the slice */
+	uint32_t next_x; /* block offset X of the next slice */
+	uint32_t next_y; /* block offset Y of the next slice */
+};
+
+/* return true if @k can be launched by slices of @blocks CTAs. the grid
+   is not sliced in depth, so a slice takes at least grid_z CTAs. */
+static inline int gdev_slice_enabled(struct gdev_kernel *k, uint32_t blocks)
+{
+	return blocks && k->slice_param >= GDEV_SLICE_PARAM_MIN &&
+		k->slice_param + GDEV_SLICE_PARAM_COUNT <= k->param_size / 4 &&
+		k->grid_z <= blocks &&
+		blocks < k->grid_x * k->grid_y * k->grid_z;
+}
+
+static inline void gdev_slice_init(struct gdev_slice *s)
+{
+	s->x = s->y = s->next_x = s->next_y = 0;
+}
+
+/**
+ * make @slice the next slice of @k, of @blocks CTAs at most. the grid is
+ * sliced by rows if a row fits in a slice, and each row by columns
+ * otherwise, so that every slice is a rectangle. @slice shares param_buf
+ * with @k. return 0 if no CTA is left.
+ */
+static inline int gdev_slice_next(struct gdev_kernel *k, struct gdev_kernel *slice, uint32_t blocks, struct gdev_slice *s)
+{
+	uint32_t n;
+
+	if (s->next_y >= k->grid_y)
+		return 0;
+
+	*slice = *k;
+	s->x = s->next_x;
+	s->y = s->next_y;
+	if (k->grid_x * k->grid_z <= blocks) {
+		n = blocks / (k->grid_x * k->grid_z);
+		if (n > k->grid_y - s->y)
+			n = k->grid_y - s->y;
+		slice->grid_y = n;
+		s->next_y += n;
+	}
+	else {
+		n = blocks / k->grid_z;
+		if (n > k->grid_x - s->x)
+			n = k->grid_x - s->x;
+		slice->grid_x = n;
+		slice->grid_y = 1;
+		s->next_x += n;
+		if (s->next_x == k->grid_x) {
+			s->next_x = 0;
+			s->next_y++;
+		}
+	}
+
+	return 1;
+}
+
+/* give the block offset of the slice and the grid of @k to the kernel
+   through @param_buf, which is a copy of the parameters of @k. */
+static inline void gdev_slice_param(struct gdev_kernel *k, struct gdev_slice *s, uint32_t *param_buf)
+{
+	param_buf[k->slice_param] = s->x;
+	param_buf[k->slice_param + 1] = s->y;
+	param_buf[k->slice_param + 2] = k->grid_x;
+	param_buf[k->slice_param + 3] = k->grid_y;
+}
+
+#endif
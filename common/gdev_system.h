@@ -43,6 +43,8 @@ struct gdev_device; /* prototype declaration */
  */
 typedef struct gdev_lock gdev_lock_t;
 typedef struct gdev_mutex gdev_mutex_t;
+typedef struct gdev_rwlock gdev_rwlock_t;
+typedef struct gdev_event gdev_event_t;
 
 /**
  * OS and user-space private functions.
@@ -63,6 +65,15 @@ void gdev_unlock_nested(gdev_lock_t *p);
 void gdev_mutex_init(gdev_mutex_t *p);
 void gdev_mutex_lock(gdev_mutex_t *p);
 void gdev_mutex_unlock(gdev_mutex_t *p);
+void gdev_rwlock_init(gdev_rwlock_t *p);
+void gdev_read_lock(gdev_rwlock_t *p);
+void gdev_read_unlock(gdev_rwlock_t *p);
+void gdev_write_lock(gdev_rwlock_t *p);
+void gdev_write_unlock(gdev_rwlock_t *p);
+void gdev_event_init(gdev_event_t *p);
+unsigned int gdev_event_seq(gdev_event_t *p);
+void gdev_event_wait(gdev_event_t *p, unsigned int seq, unsigned long timeout_us);
+void gdev_event_signal(gdev_event_t *p);
 void *gdev_current_com_get(struct gdev_device *gdev);
 void gdev_current_com_set(struct gdev_device *gdev, void* com);
 void *gdev_priv_get(struct gdev_device *gdev);
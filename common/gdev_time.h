@@ -38,6 +38,11 @@
 #else
 #include <sys/time.h>
 #include <stdint.h>
+#include <time.h>
+#if defined(GDEV_TIME_TSC) && defined(__x86_64__)
+#include <cpuid.h>
+#include <x86intrin.h>
+#endif
 #endif
 
 #ifndef true
@@ -50,277 +55,264 @@
 #define NULL 0
 #endif
 
+#define NSEC_1SEC	1000000000LL
+#define NSEC_1MSEC	1000000LL
+#define NSEC_1USEC	1000LL
 #define USEC_1SEC	1000000
 #define USEC_1MSEC	1000
 #define MSEC_1SEC	1000
 
-/* compatible with struct timeval. */
+/**
+ * time on the monotonic clock, or a span of it, in nanoseconds. it does 
+ * not jump with the wall-clock time, and spans may be negative.
+ */
 struct gdev_time {
-	uint64_t sec;
-	uint64_t usec;
-	int neg;
+	int64_t ns;
+};
+
+#if !defined(__KERNEL__) && defined(GDEV_TIME_TSC) && defined(__x86_64__)
+/**
+ * the TSC calibrated against the monotonic clock, if GDEV_TIME_TSC is 
+ * defined. the calibration is shared by the process, so it must not be 
+ * used for time stamps shared with other processes, e.g., by usched.
+ */
+#define GDEV_TIME_TSC_CALIBRATE_NS (10 * NSEC_1MSEC)
+
+struct gdev_time_tsc {
+	volatile int state; /* 0: not yet, 1: calibrating, 2: ready, -1: none */
+	uint64_t tsc0; /* TSC at ns0 */
+	int64_t ns0;
+	uint64_t mult; /* nanoseconds per cycle << 32 */
 };
 
+__attribute__((weak)) struct gdev_time_tsc gdev_time_tsc;
+
+static inline int64_t __gdev_time_mono_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * NSEC_1SEC + ts.tv_nsec;
+}
+
+static inline void __gdev_time_tsc_calibrate(struct gdev_time_tsc *t)
+{
+	unsigned int eax, ebx, ecx, edx;
+	uint64_t tsc0, tsc1;
+	int64_t ns0, ns1;
+
+	/* only the invariant TSC ticks at a constant rate. */
+	if (!__get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx) || !(edx & (1 << 8))) {
+		t->state = -1;
+		return;
+	}
+
+	ns0 = __gdev_time_mono_ns();
+	tsc0 = __rdtsc();
+	do {
+		ns1 = __gdev_time_mono_ns();
+		tsc1 = __rdtsc();
+	} while (ns1 - ns0 < GDEV_TIME_TSC_CALIBRATE_NS);
+
+	t->tsc0 = tsc0;
+	t->ns0 = ns0;
+	t->mult = ((uint64_t)(ns1 - ns0) << 32) / (tsc1 - tsc0);
+	__sync_synchronize();
+	t->state = 2;
+}
+
+static inline int64_t __gdev_time_now_ns(void)
+{
+	struct gdev_time_tsc *t = &gdev_time_tsc;
+
+	if (t->state == 2)
+		return t->ns0 + (int64_t)(((unsigned __int128)(__rdtsc() - t->tsc0) * t->mult) >> 32);
+	/* one thread calibrates, and the others read the clock meanwhile. */
+	if (t->state == 0 && __sync_bool_compare_and_swap(&t->state, 0, 1))
+		__gdev_time_tsc_calibrate(t);
+	return __gdev_time_mono_ns();
+}
+#endif
+
 /* ret = current time */
 static inline void gdev_time_stamp(struct gdev_time *ret)
 {
 #ifdef __KERNEL__
-#if LINUX_VERSION_CODE >= KERNEL_VERSION(4,9,0)
-	struct timespec ts;
-	getnstimeofday64(&ts);
-	ret->sec = ts.tv_sec;
-	ret->usec = ts.tv_nsec / 1000;
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(3,17,0)
+	ret->ns = ktime_get_ns();
 #else
-	struct timeval tv;
-	do_gettimeofday(&tv);
-	ret->sec = tv.tv_sec;
-	ret->usec = tv.tv_usec;
+	ret->ns = ktime_to_ns(ktime_get());
 #endif
+#elif defined(GDEV_TIME_TSC) && defined(__x86_64__)
+	ret->ns = __gdev_time_now_ns();
 #else
-	struct timeval tv;
-	gettimeofday(&tv, NULL);
-	ret->sec = tv.tv_sec;
-	ret->usec = tv.tv_usec;
+	/* served by the vDSO without entering the kernel. */
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	ret->ns = ts.tv_sec * NSEC_1SEC + ts.tv_nsec;
 #endif
-	ret->neg = 0;
+}
+
+/* generate struct gdev_time from nanoseconds. */
+static inline void gdev_time_ns(struct gdev_time *ret, int64_t ns)
+{
+	ret->ns = ns;
 }
 
 /* generate struct gdev_time from seconds. */
 static inline void gdev_time_sec(struct gdev_time *ret, unsigned long sec)
 {
-	ret->sec = sec;
-	ret->usec = 0;
+	ret->ns = sec * NSEC_1SEC;
 }
 
 /* generate struct gdev_time from milliseconds. */
 static inline void gdev_time_ms(struct gdev_time *ret, unsigned long ms)
 {
-	unsigned long carry = ms / MSEC_1SEC;
-	ret->sec = carry;
-	ret->usec = (ms - carry * MSEC_1SEC) * USEC_1MSEC;
-	ret->neg = 0;
+	ret->ns = ms * NSEC_1MSEC;
 }
 
 /* generate struct gdev_time from microseconds. */
 static inline void gdev_time_us(struct gdev_time *ret, unsigned long us)
 {
-	ret->sec = 0;
-	ret->usec = us;
-	ret->neg = 0;
+	ret->ns = us * NSEC_1USEC;
 }
 
-/* transform from struct gdev_time to seconds. */
+/* transform from struct gdev_time to signed nanoseconds. */
+static inline int64_t gdev_time_to_ns(struct gdev_time *p)
+{
+	return p->ns;
+}
+
+/* the absolute value of @p in nanoseconds. */
+static inline uint64_t __gdev_time_abs_ns(struct gdev_time *p)
+{
+	return p->ns < 0 ? -p->ns : p->ns;
+}
+
+/* transform from struct gdev_time to seconds, regardless of the sign. */
 static inline unsigned long gdev_time_to_sec(struct gdev_time *p)
 {
-	return (p->sec * USEC_1SEC + p->usec) / USEC_1SEC;
+	return __gdev_time_abs_ns(p) / NSEC_1SEC;
 }
 
-/* transform from struct gdev_time to milliseconds. */
+/* transform from struct gdev_time to milliseconds, regardless of the sign. */
 static inline unsigned long gdev_time_to_ms(struct gdev_time *p)
 {
-	return (p->sec * USEC_1SEC + p->usec) / USEC_1MSEC;
+	return __gdev_time_abs_ns(p) / NSEC_1MSEC;
 }
 
-/* transform from struct gdev_time to microseconds. */
+/* transform from struct gdev_time to microseconds, regardless of the sign. */
 static inline unsigned long gdev_time_to_us(struct gdev_time *p)
 {
-	return (p->sec * USEC_1SEC + p->usec);
+	return __gdev_time_abs_ns(p) / NSEC_1USEC;
 }
 
-/* clear the timeval values. */
-static inline void gdev_time_clear(struct gdev_time *t)
+/**
+ * transform from struct gdev_time to microseconds, regardless of the sign,
+ * adding up the nanoseconds left over in *@rem, so that a sum of short 
+ * spans is not cut short by a microsecond each.
+ */
+static inline unsigned long gdev_time_to_us_carry(struct gdev_time *p, uint32_t *rem)
 {
-	t->sec = t->usec = t->neg = 0;
+	uint64_t ns = __gdev_time_abs_ns(p) + *rem;
+
+	*rem = ns % NSEC_1USEC;
+	return ns / NSEC_1USEC;
 }
 
+/* clear the time value. */
+static inline void gdev_time_clear(struct gdev_time *t)
+{
+	t->ns = 0;
+}
 
 /* x == y */
 static inline int gdev_time_eq(struct gdev_time *x, struct gdev_time *y)
 {
-	return (x->sec == y->sec) && (x->usec == y->usec);
+	return x->ns == y->ns;
 }
 
 /* p == 0 */
 static inline int gdev_time_eqz(struct gdev_time *p)
 {
-	return (p->sec == 0) && (p->usec == 0);
+	return p->ns == 0;
 }
 
 /* x > y */
 static inline int gdev_time_gt(struct gdev_time *x, struct gdev_time *y)
 {
-	if (!x->neg && y->neg)
-		return true;
-	else if (x->neg && !y->neg)
-		return false;
-	else if (x->neg && y->neg)
-		return (x->sec == y->sec) ? (x->usec < y->usec) : (x->sec < y->sec);
-	else
-		return (x->sec == y->sec) ? (x->usec > y->usec) : (x->sec > y->sec);
+	return x->ns > y->ns;
 }
 
 /* p > 0 */
 static inline int gdev_time_gtz(struct gdev_time *p)
 {
-	return (!p->neg) && ((p->sec > 0) || (p->usec > 0));
+	return p->ns > 0;
 }
 
 /* x >= y */
 static inline int gdev_time_ge(struct gdev_time *x, struct gdev_time *y)
 {
-	if (gdev_time_eq(x, y))
-		return true;
-	else
-		return gdev_time_gt(x, y);
+	return x->ns >= y->ns;
 }
 
 /* p >= 0 */
 static inline int gdev_time_gez(struct gdev_time *p)
 {
-	return gdev_time_gtz(p) || gdev_time_eqz(p);
+	return p->ns >= 0;
 }
 
 /* x < y */
 static inline int gdev_time_lt(struct gdev_time *x, struct gdev_time *y)
 {
-	if (!x->neg && y->neg)
-		return false;
-	else if (x->neg && !y->neg)
-		return true;
-	else if (x->neg && y->neg)
-		return (x->sec == y->sec) ? (x->usec > y->usec) : (x->sec > y->sec);
-	else
-		return (x->sec == y->sec) ? (x->usec < y->usec) : (x->sec < y->sec);
+	return x->ns < y->ns;
 }
 
 /* p < 0 */
 static inline int gdev_time_ltz(struct gdev_time *p)
 {
-	return p->neg;
+	return p->ns < 0;
 }
 
 /* x <= y */
 static inline int gdev_time_le(struct gdev_time *x, struct gdev_time *y)
 {
-	if (gdev_time_eq(x, y))
-		return true;
-	else
-		return gdev_time_lt(x, y);
+	return x->ns <= y->ns;
 }
 
 /* p <= 0 */
 static inline int gdev_time_lez(struct gdev_time *p)
 {
-	return gdev_time_ltz(p) || gdev_time_eqz(p);
+	return p->ns <= 0;
 }
 
-/* ret = x + y (x and y must be positive) */
-static inline void __gdev_time_add_pos(struct gdev_time *ret, struct gdev_time *x, struct gdev_time *y)
-{
-	ret->sec = x->sec + y->sec;
-	ret->usec = x->usec + y->usec;
-	if (ret->usec >= USEC_1SEC) {
-		ret->sec++;
-		ret->usec -= USEC_1SEC;
-	}
-}
-
-/* ret = x - y (x and y must be positive) */
-static inline void __gdev_time_sub_pos(struct gdev_time *ret, struct gdev_time *x, struct gdev_time *y)
-{
-	if (gdev_time_lt(x, y)) {
-		struct gdev_time *tmp = x;
-		x = y;
-		y = tmp;
-		ret->neg = 1;
-	}
-	else
-		ret->neg = 0;
-	ret->sec = x->sec - y->sec;
-	ret->usec = x->usec - y->usec;
-	if (ret->usec < 0) {
-		ret->sec--;
-		ret->usec += USEC_1SEC;
-	}
-}
-
-/* ret = x + y. */
+/* ret = x + y. ret may be either x or y. */
 static inline void gdev_time_add(struct gdev_time *ret, struct gdev_time *x, struct gdev_time *y)
 {
-	if (ret != x && ret != y)
-		gdev_time_clear(ret);
-
-	if (!x->neg && y->neg) { /* x - y */
-		y->neg = 0;
-		__gdev_time_sub_pos(ret, x, y);
-		y->neg = 1;
-	}
-	else if (x->neg && !y->neg) { /* y - x */
-		x->neg = 0;
-		__gdev_time_sub_pos(ret, y, x);
-		x->neg = 1;
-	}
-	else if (x->neg && y->neg) { /* - (x + y) */
-		x->neg = y-> neg = 0;
-		__gdev_time_add_pos(ret, x, y);
-		ret->neg = 1;
-		x->neg = y-> neg = 1;
-	}
-	else { /* x + y */
-		__gdev_time_add_pos(ret, x, y);
-	}
+	ret->ns = x->ns + y->ns;
 }
 
-/* ret = x - y. */
+/* ret = x - y. ret may be either x or y. */
 static inline void gdev_time_sub(struct gdev_time *ret, struct gdev_time *x, struct gdev_time *y)
 {
-	if (ret != x && ret != y)
-		gdev_time_clear(ret);
+	ret->ns = x->ns - y->ns;
+}
 
-	if (!x->neg && y->neg) { /* x + y */
-		y->neg = 0;
-		__gdev_time_add_pos(ret, x, y);
-		y->neg = 1;
-	}
-	else if (x->neg && !y->neg) { /* - (x + y) */
-		x->neg = 0;
-		__gdev_time_add_pos(ret, y, x);
-		ret->neg = 1;
-		x->neg = 1;
-	}
-	else if (x->neg && y->neg) { /* y - x */
-		x->neg = y-> neg = 0;
-		__gdev_time_sub_pos(ret, y, x);
-		x->neg = y-> neg = 1;
-	}
-	else { /* x - y */
-		__gdev_time_sub_pos(ret, x, y);
-	}
+/* ret = -x. ret may be x. */
+static inline void gdev_time_neg(struct gdev_time *ret, struct gdev_time *x)
+{
+	ret->ns = -x->ns;
 }
 
 /* ret = x * I. */
 static inline void gdev_time_mul(struct gdev_time *ret, struct gdev_time *x, int I)
 {
-	if (ret != x)
-		gdev_time_clear(ret);
-
-	ret->sec = x->sec * I;
-	ret->usec = x->usec * I;
-	if (ret->usec >= USEC_1SEC) {
-		unsigned long carry = ret->usec / USEC_1SEC;
-		ret->sec += carry;
-		ret->usec -= carry * USEC_1SEC;
-	}
+	ret->ns = x->ns * I;
 }
 
 /* ret = x / I. */
 static inline void gdev_time_div(struct gdev_time *ret, struct gdev_time *x, int I)
 {
-	if (ret != x)
-		gdev_time_clear(ret);
-
-	ret->sec = x->sec / I;
-	ret->usec = x->usec / I;
+	ret->ns = x->ns / I;
 }
 
 #endif
@@ -0,0 +1,169 @@
+/*
+ * Copyright (C) Shinpei Kato
+ *
+ * University of California, Santa Cruz
+ * Systems Research Lab.
+ *
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef __GDEV_TRACE_H__
+#define __GDEV_TRACE_H__
+
+#include "gdev_time.h"
+
+/**
+ * scheduler event trace: each physical device has a ring of the latest
+ * GDEV_TRACE_COUNT events. writers never block: they claim a slot by
+ * incrementing head, and publish it by writing seq last. readers may lose
+ * events overwritten in the meantime, but never see broken ones.
+ */
+#define GDEV_TRACE_COUNT 1024 /* must be a power of two */
+
+/* event types. */
+#define GDEV_TRACE_ENQUEUE 0 /* val: priority */
+#define GDEV_TRACE_DISPATCH 1 /* val: priority */
+#define GDEV_TRACE_COMPLETE 2 /* val: execution time (us) */
+#define GDEV_TRACE_REPLENISH 3 /* val: credit (us) after replenishment */
+#define GDEV_TRACE_YIELD 4 /* val: yield window (us) */
+#define GDEV_TRACE_EVICT 5 /* val: evicted bytes */
+#define GDEV_TRACE_TYPE_COUNT 6
+
+/* resources. */
+#define GDEV_TRACE_COMPUTE 0
+#define GDEV_TRACE_MEMORY 1
+
+struct gdev_trace_event {
+	uint64_t ts; /* time stamp (us) */
+	uint32_t seq; /* 1 + position in the ring, 0 while being written */
+	uint16_t type; /* GDEV_TRACE_* event type */
+	uint16_t res; /* GDEV_TRACE_COMPUTE or GDEV_TRACE_MEMORY */
+	int32_t vid; /* virtual device ID */
+	int32_t cid; /* context ID, -1 if none */
+	int64_t val; /* type-specific value */
+};
+
+struct gdev_trace {
+	int enabled;
+	uint32_t head; /* position of the next event */
+	struct gdev_trace_event ev[GDEV_TRACE_COUNT];
+};
+
+static inline void gdev_trace_init(struct gdev_trace *t)
+{
+	int i;
+
+	t->enabled = 0;
+	t->head = 0;
+	for (i = 0; i < GDEV_TRACE_COUNT; i++)
+		t->ev[i].seq = 0;
+}
+
+static inline const char *gdev_trace_type_name(int type)
+{
+	static const char *names[GDEV_TRACE_TYPE_COUNT] = {
+		[GDEV_TRACE_ENQUEUE] = "enqueue",
+		[GDEV_TRACE_DISPATCH] = "dispatch",
+		[GDEV_TRACE_COMPLETE] = "complete",
+		[GDEV_TRACE_REPLENISH] = "replenish",
+		[GDEV_TRACE_YIELD] = "yield",
+		[GDEV_TRACE_EVICT] = "evict",
+	};
+
+	if (type < 0 || type >= GDEV_TRACE_TYPE_COUNT)
+		return "unknown";
+	return names[type];
+}
+
+static inline const char *gdev_trace_res_name(int res)
+{
+	return res == GDEV_TRACE_MEMORY ? "memory" : "compute";
+}
+
+/* record an event. this costs a load and a branch if disabled. */
+static inline void gdev_trace_record(struct gdev_trace *t, int type, int res, int vid, int cid, int64_t val)
+{
+	struct gdev_trace_event *ev;
+	struct gdev_time now;
+	uint32_t pos;
+
+	if (!t->enabled)
+		return;
+
+	pos = __sync_fetch_and_add(&t->head, 1);
+	ev = &t->ev[pos & (GDEV_TRACE_COUNT - 1)];
+	ev->seq = 0;
+	__sync_synchronize();
+
+	gdev_time_stamp(&now);
+	ev->ts = gdev_time_to_us(&now);
+	ev->type = type;
+	ev->res = res;
+	ev->vid = vid;
+	ev->cid = cid;
+	ev->val = val;
+
+	__sync_synchronize();
+	ev->seq = pos + 1;
+}
+
+/* position of the oldest event in the ring. */
+static inline uint32_t gdev_trace_tail(struct gdev_trace *t)
+{
+	uint32_t head = *(volatile uint32_t *)&t->head;
+
+	return head > GDEV_TRACE_COUNT ? head - GDEV_TRACE_COUNT : 0;
+}
+
+/* copy the event at *@pos to @ev, and advance *@pos. events overwritten
+   before being read are skipped. return 1 if @ev is filled, or 0 if no
+   more events have been published yet. */
+static inline int gdev_trace_read(struct gdev_trace *t, uint32_t *pos, struct gdev_trace_event *ev)
+{
+	struct gdev_trace_event *p;
+	uint32_t head, seq;
+
+	for (;;) {
+		head = *(volatile uint32_t *)&t->head;
+		if (*pos == head)
+			return 0;
+		if (head - *pos > GDEV_TRACE_COUNT)
+			*pos = head - GDEV_TRACE_COUNT;
+
+		p = &t->ev[*pos & (GDEV_TRACE_COUNT - 1)];
+		seq = *(volatile uint32_t *)&p->seq;
+		__sync_synchronize();
+		*ev = *p;
+		__sync_synchronize();
+		if (seq == *pos + 1 && *(volatile uint32_t *)&p->seq == seq) {
+			(*pos)++;
+			return 1;
+		}
+		/* the writer of *pos has not published it yet. */
+		if (!seq || (int32_t)(seq - (*pos + 1)) <= 0)
+			return 0;
+		/* overwritten by a newer event. */
+		(*pos)++;
+	}
+}
+
+#endif
@@ -27,6 +27,8 @@
  */
 
 #define GDEV_VSCHED_BAND_SELECT_CHANCES 1
+#define GDEV_VSCHED_BAND_YIELD_MAX 500 /* us */
+#define GDEV_VSCHED_BAND_YIELD_MIN 20 /* us */
 
 static int __gdev_is_alone(struct gdev_device *gdev)
 {
@@ -49,22 +51,57 @@ static int __gdev_is_alone(struct gdev_device *gdev)
 	return alone;
 }
 
-static void __gdev_vsched_band_yield_chance(void)
+/* record an arrival of an entity at the physical device, and let the
+   device yielding it know. this must be called with the scheduling lock. */
+static void __gdev_vsched_band_arrive(struct gdev_time *last, uint32_t *interarrival, gdev_event_t *event)
 {
-	struct gdev_time time_wait, time_now;
-	gdev_time_stamp(&time_now);
-	gdev_time_us(&time_wait, 500); /* 500 us */
-	gdev_time_add(&time_wait, &time_wait, &time_now);
-	while (gdev_time_lt(&time_now, &time_wait)) {
-		SCHED_YIELD();
-		gdev_time_stamp(&time_now);
-	}
+	struct gdev_time now, elapse;
+	uint32_t us;
+
+	gdev_time_stamp(&now);
+	gdev_time_sub(&elapse, &now, last);
+	*last = now;
+	/* idle gaps are cut down not to stretch the average too much. */
+	us = gdev_time_to_us(&elapse);
+	if (us > GDEV_VSCHED_BAND_YIELD_MAX * 2)
+		us = GDEV_VSCHED_BAND_YIELD_MAX * 2;
+	if (*interarrival)
+		*interarrival = (*interarrival * 7 + us) / 8;
+	else
+		*interarrival = us;
+
+	gdev_event_signal(event);
+}
+
+/* another device is likely to arrive within twice the average inter-arrival
+   time, if ever. */
+static unsigned long __gdev_vsched_band_yield_window(uint32_t interarrival)
+{
+	unsigned long window = interarrival * 2;
+
+	if (!interarrival || window > GDEV_VSCHED_BAND_YIELD_MAX)
+		return GDEV_VSCHED_BAND_YIELD_MAX;
+	if (window < GDEV_VSCHED_BAND_YIELD_MIN)
+		return GDEV_VSCHED_BAND_YIELD_MIN;
+	return window;
+}
+
+/* give the other devices a chance to take the physical device. @seq must be
+   read while the physical device is released under the scheduling lock. */
+static void __gdev_vsched_band_yield_chance(struct gdev_device *gdev, int res, gdev_event_t *event, unsigned int seq, uint32_t interarrival)
+{
+	unsigned long window = __gdev_vsched_band_yield_window(interarrival);
+
+	gdev_trace(gdev, GDEV_TRACE_YIELD, res, -1, window);
+	gdev_event_wait(event, seq, window);
 }
 
 static void gdev_vsched_band_schedule_compute(struct gdev_sched_entity *se)
 {
 	struct gdev_device *gdev = se->gdev;
 	struct gdev_device *phys = gdev_phys_get(gdev);
+	unsigned int seq;
+	int arrived = 0;
 
 	if (!phys)
 		return;
@@ -76,12 +113,13 @@ resched:
 		gdev_lock(&phys->sched_com_lock);
 		if (gdev_current_com_get(phys)== gdev) {
 			gdev_current_com_set(phys,NULL);
+			seq = gdev_event_seq(&phys->sched_com_event);
 			gdev_unlock(&phys->sched_com_lock);
 
-			__gdev_vsched_band_yield_chance();
+			__gdev_vsched_band_yield_chance(gdev, GDEV_TRACE_COMPUTE, &phys->sched_com_event, seq, phys->interarrival_com);
 
 			gdev_lock(&phys->sched_com_lock);
-			if (gdev_current_com_get(gdev)== NULL)
+			if (gdev_current_com_get(phys)== NULL)
 				gdev_current_com_set(phys,gdev);
 			gdev_unlock(&phys->sched_com_lock);
 		}
@@ -91,6 +129,12 @@ resched:
 
 	gdev_lock(&phys->sched_com_lock);
 
+	/* entities woken up to resched are not new arrivals. */
+	if (!arrived) {
+		__gdev_vsched_band_arrive(&phys->arrival_com, &phys->interarrival_com, &phys->sched_com_event);
+		arrived = 1;
+	}
+
 	if (gdev_current_com_get(phys)&& (gdev_current_com_get(phys)!= gdev)) {
 		/* insert the scheduling entity to its local priority-ordered list. */
 		gdev_lock_nested(&gdev->sched_com_lock);
@@ -119,6 +163,7 @@ static struct gdev_device *gdev_vsched_band_select_next_compute(struct gdev_devi
 	struct gdev_device *phys = gdev_phys_get(gdev);
 	struct gdev_device *next;
 	int chances = GDEV_VSCHED_BAND_SELECT_CHANCES;
+	unsigned int seq;
 
 	if (!phys)
 		return gdev;
@@ -135,7 +180,7 @@ retry:
 
 	gdev_list_for_each(next, &phys->sched_com_list, list_entry_com) {
 		gdev_lock_nested(&next->sched_com_lock);
-		if (!gdev_list_empty(&next->sched_com_list)) {
+		if (!gdev_queue_empty(&next->sched_com_queue)) {
 			gdev_unlock_nested(&next->sched_com_lock);
 			//printk("Gdev#%d Selected\n", next->id);
 			goto device_switched;
@@ -149,8 +194,9 @@ device_switched:
 		
 	if (next && (next != gdev) && (next->com_bw_used > next->com_bw)) {
 		gdev_current_com_set(phys,NULL);
+		seq = gdev_event_seq(&phys->sched_com_event);
 		gdev_unlock(&phys->sched_com_lock);
-		__gdev_vsched_band_yield_chance();
+		__gdev_vsched_band_yield_chance(gdev, GDEV_TRACE_COMPUTE, &phys->sched_com_event, seq, phys->interarrival_com);
 		gdev_lock(&phys->sched_com_lock);
 		if (gdev_current_com_get(phys) == NULL) {
 			gdev_current_com_set(phys,(void*)next);
@@ -183,7 +229,7 @@ static void gdev_vsched_band_replenish_compute(struct gdev_device *gdev)
 	if (gdev_time_gt(&gdev->credit_com, &threshold))
 		gdev_time_us(&gdev->credit_com, 0);
 	/* when the credit exceeds the threshold in negative, even it. */
-	threshold.neg = 1;
+	gdev_time_neg(&threshold, &threshold);
 	if (gdev_time_lt(&gdev->credit_com, &threshold))
 		gdev_time_us(&gdev->credit_com, 0);
 }
@@ -192,6 +238,8 @@ static void gdev_vsched_band_schedule_memory(struct gdev_sched_entity *se)
 {
 	struct gdev_device *gdev = se->gdev;
 	struct gdev_device *phys = gdev_phys_get(gdev);
+	unsigned int seq;
+	int arrived = 0;
 
 	if (!phys)
 		return;
@@ -202,9 +250,10 @@ resched:
 		gdev_lock(&phys->sched_mem_lock);
 		if (phys->current_mem == gdev) {
 			phys->current_mem = NULL;
+			seq = gdev_event_seq(&phys->sched_mem_event);
 			gdev_unlock(&phys->sched_mem_lock);
 
-			__gdev_vsched_band_yield_chance();
+			__gdev_vsched_band_yield_chance(gdev, GDEV_TRACE_MEMORY, &phys->sched_mem_event, seq, phys->interarrival_mem);
 
 			gdev_lock(&phys->sched_mem_lock);
 			if (phys->current_mem == NULL)
@@ -216,6 +265,13 @@ resched:
 	}
 
 	gdev_lock(&phys->sched_mem_lock);
+
+	/* entities woken up to resched are not new arrivals. */
+	if (!arrived) {
+		__gdev_vsched_band_arrive(&phys->arrival_mem, &phys->interarrival_mem, &phys->sched_mem_event);
+		arrived = 1;
+	}
+
 	if (phys->current_mem && phys->current_mem != gdev) {
 		/* insert the scheduling entity to its local priority-ordered list. */
 		gdev_lock_nested(&gdev->sched_mem_lock);
@@ -225,7 +281,7 @@ resched:
 
 		/* now the corresponding task will be suspended until some other tasks
 		   will awaken it upon completions of their memory transfers. */
-		gdev_sched_sleep();
+		__gdev_sched_sleep_memory(se);
 
 		goto resched;
 	}
@@ -240,6 +296,7 @@ static struct gdev_device *gdev_vsched_band_select_next_memory(struct gdev_devic
 	struct gdev_device *phys = gdev_phys_get(gdev);
 	struct gdev_device *next;
 	int chances = GDEV_VSCHED_BAND_SELECT_CHANCES;
+	unsigned int seq;
 
 	if (!phys)
 		return gdev;
@@ -255,7 +312,7 @@ retry:
 
 	gdev_list_for_each(next, &phys->sched_mem_list, list_entry_mem) {
 		gdev_lock_nested(&next->sched_mem_lock);
-		if (!gdev_list_empty(&next->sched_mem_list)) {
+		if (!gdev_queue_empty(&next->sched_mem_queue)) {
 			gdev_unlock_nested(&next->sched_mem_lock);
 			goto device_switched;
 		}
@@ -267,8 +324,9 @@ device_switched:
 
 	if (next && next != gdev && next->mem_bw_used > next->mem_bw) {
 		phys->current_mem = NULL;
+		seq = gdev_event_seq(&phys->sched_mem_event);
 		gdev_unlock(&phys->sched_mem_lock);
-		__gdev_vsched_band_yield_chance();
+		__gdev_vsched_band_yield_chance(gdev, GDEV_TRACE_MEMORY, &phys->sched_mem_event, seq, phys->interarrival_mem);
 		gdev_lock(&phys->sched_mem_lock);
 		if (phys->current_mem == NULL) {
 			phys->current_mem = (void*)next;
@@ -300,7 +358,7 @@ static void gdev_vsched_band_replenish_memory(struct gdev_device *gdev)
 	if (gdev_time_gt(&gdev->credit_mem, &threshold))
 		gdev_time_us(&gdev->credit_mem, 0);
 	/* when the credit exceeds the threshold in negative, even it. */
-	threshold.neg = 1;
+	gdev_time_neg(&threshold, &threshold);
 	if (gdev_time_lt(&gdev->credit_mem, &threshold))
 		gdev_time_us(&gdev->credit_mem, 0);
 }
@@ -309,6 +367,7 @@ static void gdev_vsched_band_replenish_memory(struct gdev_device *gdev)
  * Bandwidth-aware non-preemptive device (Band) scheduler implementation
  */
 struct gdev_vsched_policy gdev_vsched_band = {
+	.name = "band",
 	.schedule_compute = gdev_vsched_band_schedule_compute,
 	.select_next_compute = gdev_vsched_band_select_next_compute,
 	.replenish_compute = gdev_vsched_band_replenish_compute,
@@ -74,7 +74,7 @@ static struct gdev_device *gdev_vsched_credit_select_next_compute(struct gdev_de
 
 	gdev_list_for_each(next, &phys->sched_com_list, list_entry_com) {
 		gdev_lock_nested(&next->sched_com_lock);
-		if (!gdev_list_empty(&next->sched_com_list)) {
+		if (!gdev_queue_empty(&next->sched_com_queue)) {
 			gdev_unlock_nested(&next->sched_com_lock);
 			goto device_switched;
 		}
@@ -99,7 +99,7 @@ static void gdev_vsched_credit_replenish_compute(struct gdev_device *gdev)
 	if (gdev_time_gt(&gdev->credit_com, &threshold))
 		gdev_time_us(&gdev->credit_com, 0);
 	/* when the credit exceeds the threshold in negative, even it. */
-	threshold.neg = 1;
+	gdev_time_neg(&threshold, &threshold);
 	if (gdev_time_lt(&gdev->credit_com, &threshold))
 		gdev_time_us(&gdev->credit_com, 0);
 }
@@ -123,7 +123,7 @@ resched:
 
 		/* now the corresponding task will be suspended until some other tasks
 		   will awaken it upon completions of their memory transfers. */
-		gdev_sched_sleep();
+		__gdev_sched_sleep_memory(se);
 
 		goto resched;
 	}
@@ -151,7 +151,7 @@ static struct gdev_device *gdev_vsched_credit_select_next_memory(struct gdev_dev
 
 	gdev_list_for_each(next, &phys->sched_mem_list, list_entry_mem) {
 		gdev_lock_nested(&next->sched_mem_lock);
-		if (!gdev_list_empty(&next->sched_mem_list)) {
+		if (!gdev_queue_empty(&next->sched_mem_queue)) {
 			gdev_unlock_nested(&next->sched_mem_lock);
 			goto device_switched;
 		}
@@ -176,7 +176,7 @@ static void gdev_vsched_credit_replenish_memory(struct gdev_device *gdev)
 	if (gdev_time_gt(&gdev->credit_mem, &threshold))
 		gdev_time_us(&gdev->credit_mem, 0);
 	/* when the credit exceeds the threshold in negative, even it. */
-	threshold.neg = 1;
+	gdev_time_neg(&threshold, &threshold);
 	if (gdev_time_lt(&gdev->credit_mem, &threshold))
 		gdev_time_us(&gdev->credit_mem, 0);
 }
@@ -185,6 +185,7 @@ static void gdev_vsched_credit_replenish_memory(struct gdev_device *gdev)
  * the Xen Credit scheduler implementation.
  */
 struct gdev_vsched_policy gdev_vsched_credit = {
+	.name = "credit",
 	.schedule_compute = gdev_vsched_credit_schedule_compute,
 	.select_next_compute = gdev_vsched_credit_select_next_compute,
 	.replenish_compute = gdev_vsched_credit_replenish_compute,
@@ -0,0 +1,232 @@
+/*
+ * Copyright (C) Shinpei Kato
+ *
+ * University of California, Santa Cruz
+ * Systems Research Lab.
+ *
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * return the virtual device whose first entity has the earliest deadline,
+ * or NULL if no entities are waiting. phys->sched_com_lock must be locked.
+ */
+static struct gdev_device *__gdev_vsched_edf_select_compute(struct gdev_device *phys)
+{
+	struct gdev_device *p, *next = NULL;
+	struct gdev_sched_entity *se, *first = NULL;
+
+	gdev_list_for_each(p, &phys->sched_com_list, list_entry_com) {
+		gdev_lock_nested(&p->sched_com_lock);
+		se = gdev_list_container(gdev_queue_head(&p->sched_com_queue));
+		if (se && (!first || __gdev_sched_before(se, first))) {
+			first = se;
+			next = p;
+		}
+		gdev_unlock_nested(&p->sched_com_lock);
+	}
+
+	return next;
+}
+
+/**
+ * the memory version of the above. phys->sched_mem_lock must be locked.
+ */
+static struct gdev_device *__gdev_vsched_edf_select_memory(struct gdev_device *phys)
+{
+	struct gdev_device *p, *next = NULL;
+	struct gdev_sched_entity *se, *first = NULL;
+
+	gdev_list_for_each(p, &phys->sched_mem_list, list_entry_mem) {
+		gdev_lock_nested(&p->sched_mem_lock);
+		se = gdev_list_container(gdev_queue_head(&p->sched_mem_queue));
+		if (se && (!first || __gdev_sched_before(se, first))) {
+			first = se;
+			next = p;
+		}
+		gdev_unlock_nested(&p->sched_mem_lock);
+	}
+
+	return next;
+}
+
+/**
+ * return true if a new launch of @se on @gdev, to which the physical device
+ * is given, must wait for an entity of another virtual device with an
+ * earlier deadline. this is the case only while nothing of @gdev is
+ * reserved or running, i.e., the device is being handed over, so that the
+ * selection in progress takes @se into account once it is queued.
+ * phys->sched_com_lock must be locked.
+ */
+static int __gdev_vsched_edf_defer_compute(struct gdev_device *phys, struct gdev_sched_entity *se)
+{
+	struct gdev_device *gdev = se->gdev, *p;
+	struct gdev_sched_entity *first;
+	int idle, ret = 0;
+
+	if (se->launch_instances > 0)
+		return 0;
+
+	gdev_lock_nested(&gdev->sched_com_lock);
+	idle = !gdev_current_com_get(gdev);
+	gdev_unlock_nested(&gdev->sched_com_lock);
+	if (!idle)
+		return 0;
+
+	gdev_list_for_each(p, &phys->sched_com_list, list_entry_com) {
+		if (p == gdev)
+			continue;
+		gdev_lock_nested(&p->sched_com_lock);
+		first = gdev_list_container(gdev_queue_head(&p->sched_com_queue));
+		if (first && __gdev_sched_before(first, se))
+			ret = 1;
+		gdev_unlock_nested(&p->sched_com_lock);
+		if (ret)
+			break;
+	}
+
+	return ret;
+}
+
+static void gdev_vsched_edf_schedule_compute(struct gdev_sched_entity *se)
+{
+	struct gdev_device *gdev = se->gdev;
+	struct gdev_device *phys = gdev_phys_get(gdev);
+	struct gdev_device *cur;
+
+	if (!phys)
+		return;
+
+resched:
+	gdev_lock(&phys->sched_com_lock);
+	cur = gdev_current_com_get(phys);
+	if ((cur && cur != gdev) || (cur == gdev && __gdev_vsched_edf_defer_compute(phys, se))) {
+		/* insert the scheduling entity to its local deadline-ordered list. */
+		gdev_lock_nested(&gdev->sched_com_lock);
+		__gdev_enqueue_compute(gdev, se);
+		gdev_unlock_nested(&gdev->sched_com_lock);
+		gdev_unlock(&phys->sched_com_lock);
+
+		/* now the corresponding task will be suspended until some other tasks
+		   will awaken it upon completions of their compute launches. */
+		gdev_sched_sleep();
+
+		goto resched;
+	}
+	else {
+		gdev_current_com_set(phys, (void *)gdev);
+		gdev_unlock(&phys->sched_com_lock);
+	}
+}
+
+static struct gdev_device *gdev_vsched_edf_select_next_compute(struct gdev_device *gdev)
+{
+	struct gdev_device *phys = gdev_phys_get(gdev);
+	struct gdev_device *next;
+
+	if (!phys)
+		return gdev;
+
+	gdev_lock(&phys->sched_com_lock);
+
+	/* virtual devices having no deadlines are served round-robin. */
+	gdev_list_del(&gdev->list_entry_com);
+	gdev_list_add_tail(&gdev->list_entry_com, &phys->sched_com_list);
+
+	next = __gdev_vsched_edf_select_compute(phys);
+	gdev_current_com_set(phys, (void*)next); /* could be null */
+	gdev_unlock(&phys->sched_com_lock);
+
+	return next;
+}
+
+static void gdev_vsched_edf_replenish_compute(struct gdev_device *gdev)
+{
+}
+
+static void gdev_vsched_edf_schedule_memory(struct gdev_sched_entity *se)
+{
+	struct gdev_device *gdev = se->gdev;
+	struct gdev_device *phys = gdev_phys_get(gdev);
+
+	if (!phys)
+		return;
+
+resched:
+	gdev_lock(&phys->sched_mem_lock);
+	if (phys->current_mem && phys->current_mem != gdev) {
+		/* insert the scheduling entity to its local deadline-ordered list. */
+		gdev_lock_nested(&gdev->sched_mem_lock);
+		__gdev_enqueue_memory(gdev, se);
+		gdev_unlock_nested(&gdev->sched_mem_lock);
+		gdev_unlock(&phys->sched_mem_lock);
+
+		/* now the corresponding task will be suspended until some other tasks
+		   will awaken it upon completions of their memory transfers. */
+		__gdev_sched_sleep_memory(se);
+
+		goto resched;
+	}
+	else {
+		phys->current_mem = (void *)gdev;
+		gdev_unlock(&phys->sched_mem_lock);
+	}
+}
+
+static struct gdev_device *gdev_vsched_edf_select_next_memory(struct gdev_device *gdev)
+{
+	struct gdev_device *phys = gdev_phys_get(gdev);
+	struct gdev_device *next;
+
+	if (!phys)
+		return gdev;
+
+	gdev_lock(&phys->sched_mem_lock);
+
+	gdev_list_del(&gdev->list_entry_mem);
+	gdev_list_add_tail(&gdev->list_entry_mem, &phys->sched_mem_list);
+
+	next = __gdev_vsched_edf_select_memory(phys);
+	phys->current_mem = (void*)next; /* could be null */
+	gdev_unlock(&phys->sched_mem_lock);
+
+	return next;
+}
+
+static void gdev_vsched_edf_replenish_memory(struct gdev_device *gdev)
+{
+}
+
+/**
+ * the earliest deadline first scheduler implementation.
+ * the virtual device whose first entity has the earliest deadline is
+ * selected, and the entities are ordered by deadlines in the local lists.
+ */
+struct gdev_vsched_policy gdev_vsched_edf = {
+	.name = "edf",
+	.schedule_compute = gdev_vsched_edf_schedule_compute,
+	.select_next_compute = gdev_vsched_edf_select_next_compute,
+	.replenish_compute = gdev_vsched_edf_replenish_compute,
+	.schedule_memory = gdev_vsched_edf_schedule_memory,
+	.select_next_memory = gdev_vsched_edf_select_next_memory,
+	.replenish_memory = gdev_vsched_edf_replenish_memory,
+};
@@ -70,7 +70,7 @@ static struct gdev_device *gdev_vsched_fifo_select_next_compute(struct gdev_devi
 
 	gdev_list_for_each(next, &phys->sched_com_list, list_entry_com) {
 		gdev_lock_nested(&next->sched_com_lock);
-		if (!gdev_list_empty(&next->sched_com_list)) {
+		if (!gdev_queue_empty(&next->sched_com_queue)) {
 			gdev_unlock_nested(&next->sched_com_lock);
 			goto device_switched;
 		}
@@ -107,7 +107,7 @@ resched:
 
 		/* now the corresponding task will be suspended until some other tasks
 		   will awaken it upon completions of their memory transfers. */
-		gdev_sched_sleep();
+		__gdev_sched_sleep_memory(se);
 
 		goto resched;
 	}
@@ -132,7 +132,7 @@ static struct gdev_device *gdev_vsched_fifo_select_next_memory(struct gdev_devic
 
 	gdev_list_for_each(next, &phys->sched_mem_list, list_entry_mem) {
 		gdev_lock_nested(&next->sched_mem_lock);
-		if (!gdev_list_empty(&next->sched_mem_list)) {
+		if (!gdev_queue_empty(&next->sched_mem_queue)) {
 			gdev_unlock_nested(&next->sched_mem_lock);
 			goto device_switched;
 		}
@@ -154,6 +154,7 @@ static void gdev_vsched_fifo_replenish_memory(struct gdev_device *gdev)
  * the Xen Null scheduler implementation.
  */
 struct gdev_vsched_policy gdev_vsched_fifo = {
+	.name = "fifo",
 	.schedule_compute = gdev_vsched_fifo_schedule_compute,
 	.select_next_compute = gdev_vsched_fifo_select_next_compute,
 	.replenish_compute = gdev_vsched_fifo_replenish_compute,
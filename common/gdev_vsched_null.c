@@ -56,6 +56,7 @@ static void gdev_vsched_null_replenish_memory(struct gdev_device *gdev)
  * the Xen Null scheduler implementation.
  */
 struct gdev_vsched_policy gdev_vsched_null = {
+	.name = "null",
 	.schedule_compute = gdev_vsched_null_schedule_compute,
 	.select_next_compute = gdev_vsched_null_select_next_compute,
 	.replenish_compute = gdev_vsched_null_replenish_compute,
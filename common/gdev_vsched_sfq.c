@@ -0,0 +1,265 @@
+/*
+ * Copyright (C) Shinpei Kato
+ *
+ * University of California, Santa Cruz
+ * Systems Research Lab.
+ *
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * charge the computation time executed since the last charge to the virtual
+ * time of @gdev, scaled by its compute bandwidth share.
+ * phys->sched_com_lock must be locked.
+ */
+static void __gdev_vsched_sfq_charge_compute(struct gdev_device *gdev)
+{
+	uint32_t weight = gdev->com_bw ? gdev->com_bw : 1;
+	uint64_t exec;
+
+	gdev_lock_nested(&gdev->sched_com_lock);
+	exec = gdev->com_time_uncharged;
+	gdev->com_time_uncharged = 0;
+	gdev_unlock_nested(&gdev->sched_com_lock);
+	gdev->vtime_com += exec * 100 / weight;
+}
+
+/**
+ * the memory version of the above. phys->sched_mem_lock must be locked.
+ */
+static void __gdev_vsched_sfq_charge_memory(struct gdev_device *gdev)
+{
+	uint32_t weight = gdev->mem_bw ? gdev->mem_bw : 1;
+	uint64_t exec;
+
+	gdev_lock_nested(&gdev->sched_mem_lock);
+	exec = gdev->mem_time_uncharged;
+	gdev->mem_time_uncharged = 0;
+	gdev_unlock_nested(&gdev->sched_mem_lock);
+	gdev->vtime_mem += exec * 100 / weight;
+}
+
+/**
+ * start serving @gdev. its start tag is the later of its own finish tag and
+ * the system virtual time, so that idle devices cannot save up service.
+ * phys->sched_com_lock must be locked.
+ */
+static void __gdev_vsched_sfq_start_compute(struct gdev_device *phys, struct gdev_device *gdev)
+{
+	if (gdev->vtime_com < phys->vtime_com)
+		gdev->vtime_com = phys->vtime_com;
+	phys->vtime_com = gdev->vtime_com;
+}
+
+/**
+ * the memory version of the above. phys->sched_mem_lock must be locked.
+ */
+static void __gdev_vsched_sfq_start_memory(struct gdev_device *phys, struct gdev_device *gdev)
+{
+	if (gdev->vtime_mem < phys->vtime_mem)
+		gdev->vtime_mem = phys->vtime_mem;
+	phys->vtime_mem = gdev->vtime_mem;
+}
+
+/**
+ * return the waiting virtual device with the smallest start tag, or NULL if
+ * no entities are waiting. phys->sched_com_lock must be locked.
+ */
+static struct gdev_device *__gdev_vsched_sfq_select_compute(struct gdev_device *phys)
+{
+	struct gdev_device *p, *next = NULL;
+	uint64_t start, first = 0;
+
+	gdev_list_for_each(p, &phys->sched_com_list, list_entry_com) {
+		gdev_lock_nested(&p->sched_com_lock);
+		if (!gdev_queue_empty(&p->sched_com_queue)) {
+			start = p->vtime_com > phys->vtime_com ? p->vtime_com : phys->vtime_com;
+			if (!next || start < first) {
+				first = start;
+				next = p;
+			}
+		}
+		gdev_unlock_nested(&p->sched_com_lock);
+	}
+
+	return next;
+}
+
+/**
+ * the memory version of the above. phys->sched_mem_lock must be locked.
+ */
+static struct gdev_device *__gdev_vsched_sfq_select_memory(struct gdev_device *phys)
+{
+	struct gdev_device *p, *next = NULL;
+	uint64_t start, first = 0;
+
+	gdev_list_for_each(p, &phys->sched_mem_list, list_entry_mem) {
+		gdev_lock_nested(&p->sched_mem_lock);
+		if (!gdev_queue_empty(&p->sched_mem_queue)) {
+			start = p->vtime_mem > phys->vtime_mem ? p->vtime_mem : phys->vtime_mem;
+			if (!next || start < first) {
+				first = start;
+				next = p;
+			}
+		}
+		gdev_unlock_nested(&p->sched_mem_lock);
+	}
+
+	return next;
+}
+
+static void gdev_vsched_sfq_schedule_compute(struct gdev_sched_entity *se)
+{
+	struct gdev_device *gdev = se->gdev;
+	struct gdev_device *phys = gdev_phys_get(gdev);
+
+	if (!phys)
+		return;
+
+resched:
+	gdev_lock(&phys->sched_com_lock);
+	if (gdev_current_com_get(phys) && gdev_current_com_get(phys) != gdev) {
+		/* insert the scheduling entity to its local priority-ordered list. */
+		gdev_lock_nested(&gdev->sched_com_lock);
+		__gdev_enqueue_compute(gdev, se);
+		gdev_unlock_nested(&gdev->sched_com_lock);
+		gdev_unlock(&phys->sched_com_lock);
+
+		/* now the corresponding task will be suspended until some other tasks
+		   will awaken it upon completions of their compute launches. */
+		gdev_sched_sleep();
+
+		goto resched;
+	}
+	else {
+		/* the device was idle, so no one else could compete. */
+		if (!gdev_current_com_get(phys))
+			__gdev_vsched_sfq_start_compute(phys, gdev);
+		gdev_current_com_set(phys, (void *)gdev);
+		gdev_unlock(&phys->sched_com_lock);
+	}
+}
+
+static struct gdev_device *gdev_vsched_sfq_select_next_compute(struct gdev_device *gdev)
+{
+	struct gdev_device *phys = gdev_phys_get(gdev);
+	struct gdev_device *next;
+
+	if (!phys)
+		return gdev;
+
+	gdev_lock(&phys->sched_com_lock);
+
+	__gdev_vsched_sfq_charge_compute(gdev);
+
+	/* break ties of start tags in round-robin. */
+	gdev_list_del(&gdev->list_entry_com);
+	gdev_list_add_tail(&gdev->list_entry_com, &phys->sched_com_list);
+
+	next = __gdev_vsched_sfq_select_compute(phys);
+	if (next)
+		__gdev_vsched_sfq_start_compute(phys, next);
+	gdev_current_com_set(phys, (void*)next); /* could be null */
+	gdev_unlock(&phys->sched_com_lock);
+
+	return next;
+}
+
+static void gdev_vsched_sfq_replenish_compute(struct gdev_device *gdev)
+{
+}
+
+static void gdev_vsched_sfq_schedule_memory(struct gdev_sched_entity *se)
+{
+	struct gdev_device *gdev = se->gdev;
+	struct gdev_device *phys = gdev_phys_get(gdev);
+
+	if (!phys)
+		return;
+
+resched:
+	gdev_lock(&phys->sched_mem_lock);
+	if (phys->current_mem && phys->current_mem != gdev) {
+		/* insert the scheduling entity to its local priority-ordered list. */
+		gdev_lock_nested(&gdev->sched_mem_lock);
+		__gdev_enqueue_memory(gdev, se);
+		gdev_unlock_nested(&gdev->sched_mem_lock);
+		gdev_unlock(&phys->sched_mem_lock);
+
+		/* now the corresponding task will be suspended until some other tasks
+		   will awaken it upon completions of their memory transfers. */
+		__gdev_sched_sleep_memory(se);
+
+		goto resched;
+	}
+	else {
+		if (!phys->current_mem)
+			__gdev_vsched_sfq_start_memory(phys, gdev);
+		phys->current_mem = (void *)gdev;
+		gdev_unlock(&phys->sched_mem_lock);
+	}
+}
+
+static struct gdev_device *gdev_vsched_sfq_select_next_memory(struct gdev_device *gdev)
+{
+	struct gdev_device *phys = gdev_phys_get(gdev);
+	struct gdev_device *next;
+
+	if (!phys)
+		return gdev;
+
+	gdev_lock(&phys->sched_mem_lock);
+
+	__gdev_vsched_sfq_charge_memory(gdev);
+
+	gdev_list_del(&gdev->list_entry_mem);
+	gdev_list_add_tail(&gdev->list_entry_mem, &phys->sched_mem_list);
+
+	next = __gdev_vsched_sfq_select_memory(phys);
+	if (next)
+		__gdev_vsched_sfq_start_memory(phys, next);
+	phys->current_mem = (void*)next; /* could be null */
+	gdev_unlock(&phys->sched_mem_lock);
+
+	return next;
+}
+
+static void gdev_vsched_sfq_replenish_memory(struct gdev_device *gdev)
+{
+}
+
+/**
+ * the start-time fair queueing scheduler implementation.
+ * each virtual device advances its virtual time by the measured execution
+ * time divided by its bandwidth share, and the waiting virtual device with
+ * the smallest start tag is served next. no credits are replenished, so
+ * short launches need not wait for the next period.
+ */
+struct gdev_vsched_policy gdev_vsched_sfq = {
+	.name = "sfq",
+	.schedule_compute = gdev_vsched_sfq_schedule_compute,
+	.select_next_compute = gdev_vsched_sfq_select_next_compute,
+	.replenish_compute = gdev_vsched_sfq_replenish_compute,
+	.schedule_memory = gdev_vsched_sfq_schedule_memory,
+	.select_next_memory = gdev_vsched_sfq_select_next_memory,
+	.replenish_memory = gdev_vsched_sfq_replenish_memory,
+};
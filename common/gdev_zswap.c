@@ -0,0 +1,415 @@
+/*
+ * Copyright (C) Shinpei Kato
+ *
+ * University of California, Santa Cruz
+ * Systems Research Lab.
+ *
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "gdev_system.h"
+#include "gdev_zswap.h"
+
+#define GDEV_ZSWAP_HASH_BITS 12
+#define GDEV_ZSWAP_MIN_MATCH 4
+#define GDEV_ZSWAP_MAX_OFFSET 0xffff
+
+/**
+ * the coded data is a series of sequences, each of which is a token byte,
+ * literals, and a match. the token holds the number of literals in its high
+ * nibble and the match length minus 4 in its low nibble, either of which
+ * is continued by bytes added up to it if 15. the match is the offset back
+ * to copy from in 2 bytes (little endian) and the rest of its length. the
+ * last sequence has no match.
+ */
+
+static inline uint32_t __read32(const uint8_t *p)
+{
+	uint32_t v;
+	memcpy(&v, p, sizeof(v));
+	return v;
+}
+
+static inline uint64_t __read64(const uint8_t *p)
+{
+	uint64_t v;
+	memcpy(&v, p, sizeof(v));
+	return v;
+}
+
+/* length of the match at @m against @r, not beyond @end. */
+static inline const uint8_t *__match_end(const uint8_t *m, const uint8_t *r, const uint8_t *end)
+{
+	uint64_t diff;
+
+	while (m + 8 <= end) {
+		diff = __read64(m) ^ __read64(r);
+		if (diff)
+			return m + (__builtin_ctzll(diff) >> 3);
+		m += 8;
+		r += 8;
+	}
+	while (m < end && *m == *r) {
+		m++;
+		r++;
+	}
+
+	return m;
+}
+
+static inline uint8_t *__put_length(uint8_t *op, uint32_t len)
+{
+	while (len >= 255) {
+		*op++ = 255;
+		len -= 255;
+	}
+	*op++ = len;
+
+	return op;
+}
+
+/* put a sequence of @n literals at @lit and a match of @len bytes at @off
+   back, or no match if @len is zero. NULL is returned if not fitting. */
+static uint8_t *__put_sequence(uint8_t *op, uint8_t *oend, const uint8_t *lit, uint32_t n, uint32_t off, uint32_t len)
+{
+	uint8_t *token = op;
+	uint32_t ml = len ? len - GDEV_ZSWAP_MIN_MATCH : 0;
+
+	if (oend - op < n + n / 255 + ml / 255 + 5)
+		return NULL;
+
+	op++;
+	*token = (n < 15 ? n : 15) << 4;
+	if (n >= 15)
+		op = __put_length(op, n - 15);
+	memcpy(op, lit, n);
+	op += n;
+
+	if (len) {
+		*token |= ml < 15 ? ml : 15;
+		*op++ = off & 0xff;
+		*op++ = off >> 8;
+		if (ml >= 15)
+			op = __put_length(op, ml - 15);
+	}
+
+	return op;
+}
+
+/**
+ * compress @size bytes at @src into @dst of @max bytes, using @work of
+ * GDEV_ZSWAP_WORK_SIZE bytes. the compressed size is returned, or -1 if
+ * it does not fit in @max bytes.
+ */
+int gdev_zswap_compress(const void *src, int size, void *dst, int max, void *work)
+{
+	const uint8_t *base = src;
+	const uint8_t *ip = base, *anchor = base, *ref, *end;
+	const uint8_t *iend = base + size;
+	uint8_t *op = dst, *oend = op + max;
+	uint32_t *table = work;
+	uint32_t seq, h;
+
+	memset(table, 0, GDEV_ZSWAP_WORK_SIZE);
+
+	while (ip + GDEV_ZSWAP_MIN_MATCH <= iend) {
+		seq = __read32(ip);
+		h = (seq * 2654435761U) >> (32 - GDEV_ZSWAP_HASH_BITS);
+		ref = base + table[h];
+		table[h] = ip - base;
+		if (ref < ip && ip - ref <= GDEV_ZSWAP_MAX_OFFSET && __read32(ref) == seq) {
+			end = __match_end(ip + GDEV_ZSWAP_MIN_MATCH, ref + GDEV_ZSWAP_MIN_MATCH, iend);
+			op = __put_sequence(op, oend, anchor, ip - anchor, ip - ref, end - ip);
+			if (!op)
+				return -1;
+			ip = anchor = end;
+			continue;
+		}
+		/* skip faster while nothing matches, e.g., random data. */
+		ip += 1 + ((ip - anchor) >> 6);
+	}
+
+	op = __put_sequence(op, oend, anchor, iend - anchor, 0, 0);
+	if (!op)
+		return -1;
+
+	return op - (uint8_t *)dst;
+}
+
+static inline const uint8_t *__get_length(const uint8_t *ip, const uint8_t *iend, uint32_t *len)
+{
+	uint8_t c;
+
+	do {
+		if (ip >= iend)
+			return NULL;
+		c = *ip++;
+		*len += c;
+	} while (c == 255);
+
+	return ip;
+}
+
+/**
+ * decompress @size bytes at @src into @dst of @max bytes. the decompressed
+ * size is returned, or -1 if the data is broken.
+ */
+int gdev_zswap_decompress(const void *src, int size, void *dst, int max)
+{
+	const uint8_t *ip = src, *iend = ip + size;
+	uint8_t *op = dst, *oend = op + max, *ref;
+	uint32_t n, len, off;
+	uint8_t token;
+
+	while (ip < iend) {
+		token = *ip++;
+
+		n = token >> 4;
+		if (n == 15 && !(ip = __get_length(ip, iend, &n)))
+			return -1;
+		if (iend - ip < n || oend - op < n)
+			return -1;
+		memcpy(op, ip, n);
+		ip += n;
+		op += n;
+		if (ip == iend)
+			break;
+
+		if (iend - ip < 2)
+			return -1;
+		off = ip[0] | (ip[1] << 8);
+		ip += 2;
+		len = token & 15;
+		if (len == 15 && !(ip = __get_length(ip, iend, &len)))
+			return -1;
+		len += GDEV_ZSWAP_MIN_MATCH;
+		if (off == 0 || off > op - (uint8_t *)dst || oend - op < len)
+			return -1;
+		ref = op - off;
+		if (off >= len) {
+			memcpy(op, ref, len);
+			op += len;
+		}
+		else {
+			/* the match overlaps itself, i.e., repeats a pattern. */
+			while (len--)
+				*op++ = *ref++;
+		}
+	}
+
+	return op - (uint8_t *)dst;
+}
+
+struct gdev_zswap *gdev_zswap_alloc(uint64_t size, uint32_t page_size)
+{
+	struct gdev_zswap *z;
+	int pages = (size + page_size - 1) / page_size;
+	int i;
+
+	if (page_size > GDEV_ZSWAP_PAGE_MAX || page_size % sizeof(uint32_t))
+		return NULL;
+
+	z = MALLOC(sizeof(*z) + sizeof(z->page[0]) * pages);
+	if (!z)
+		return NULL;
+
+	z->size = size;
+	z->page_size = page_size;
+	z->pages = pages;
+	z->stored = 0;
+	z->kept = 0;
+	z->work = NULL;
+	for (i = 0; i < pages; i++) {
+		z->page[i].buf = NULL;
+		z->page[i].size = 0;
+		z->page[i].fill = 0;
+		z->page[i].type = GDEV_ZSWAP_NONE;
+	}
+
+	return z;
+}
+
+void gdev_zswap_free(struct gdev_zswap *z)
+{
+	int i;
+
+	for (i = 0; i < z->pages; i++) {
+		if (z->page[i].buf)
+			FREE(z->page[i].buf);
+	}
+	if (z->work)
+		FREE(z->work);
+	FREE(z);
+}
+
+/* bytes of the page @i, which is only short at the end of the data. */
+static inline uint32_t __gdev_zswap_page_size(struct gdev_zswap *z, int i)
+{
+	uint64_t offset = (uint64_t)i * z->page_size;
+
+	if (offset + z->page_size > z->size)
+		return z->size - offset;
+
+	return z->page_size;
+}
+
+/* see if @size bytes at @buf repeat a 32-bit word. */
+static int __gdev_zswap_filled(const void *buf, uint32_t size, uint32_t *fill)
+{
+	const uint32_t *p = buf;
+	uint32_t i;
+
+	if (size % sizeof(uint32_t))
+		return 0;
+
+	for (i = 1; i < size / sizeof(uint32_t); i++) {
+		if (p[i] != p[0])
+			return 0;
+	}
+	*fill = p[0];
+
+	return 1;
+}
+
+static int __gdev_zswap_store_page(struct gdev_zswap *z, int i, const void *buf, void *work)
+{
+	struct gdev_zswap_page *page = &z->page[i];
+	uint32_t size = __gdev_zswap_page_size(z, i);
+	void *out = work + GDEV_ZSWAP_WORK_SIZE;
+	void *p = NULL;
+	uint32_t fill = 0;
+	int n, type;
+
+	if (__gdev_zswap_filled(buf, size, &fill)) {
+		type = GDEV_ZSWAP_FILL;
+		n = 0;
+	}
+	else {
+		/* keep it as is, unless it shrinks by an eighth at least. */
+		n = gdev_zswap_compress(buf, size, out, size - size / 8, work);
+		if (n < 0) {
+			type = GDEV_ZSWAP_RAW;
+			n = size;
+			out = (void *)buf;
+		}
+		else
+			type = GDEV_ZSWAP_LZ;
+		/* reuse the buffer of the page, if it has the same size. */
+		if (page->buf && page->size == n)
+			p = page->buf;
+		else if (!(p = MALLOC(n)))
+			return -ENOMEM;
+		memcpy(p, out, n);
+	}
+
+	if (page->buf && page->buf != p)
+		FREE(page->buf);
+	page->buf = p;
+	page->size = n;
+	page->fill = fill;
+	page->type = type;
+	z->stored += size;
+	z->kept += n;
+
+	return 0;
+}
+
+/**
+ * store @size bytes at @buf into @z at @offset, which must be aligned to
+ * the page size. so must be @size, unless the data ends there. the stores
+ * into @z must be serialized, as they share the work of @z.
+ */
+int gdev_zswap_store(struct gdev_zswap *z, uint64_t offset, const void *buf, uint64_t size)
+{
+	uint64_t done;
+	int i, ret = 0;
+
+	if (offset % z->page_size || offset + size > z->size ||
+		(size % z->page_size && offset + size != z->size))
+		return -EINVAL;
+
+	/* kept for the following chunks, which are stored one by one. */
+	if (!z->work && !(z->work = MALLOC(GDEV_ZSWAP_WORK_SIZE + z->page_size)))
+		return -ENOMEM;
+
+	i = offset / z->page_size;
+	for (done = 0; done < size; done += z->page_size, i++) {
+		ret = __gdev_zswap_store_page(z, i, buf + done, z->work);
+		if (ret)
+			break;
+	}
+
+	return ret;
+}
+
+/**
+ * fetch @size bytes of @z at @offset into @buf. the alignment is the same
+ * as gdev_zswap_store().
+ */
+int gdev_zswap_fetch(struct gdev_zswap *z, uint64_t offset, void *buf, uint64_t size)
+{
+	struct gdev_zswap_page *page;
+	uint32_t *p, n;
+	uint64_t done;
+	int i, k;
+
+	if (offset % z->page_size || offset + size > z->size ||
+		(size % z->page_size && offset + size != z->size))
+		return -EINVAL;
+
+	i = offset / z->page_size;
+	for (done = 0; done < size; done += z->page_size, i++) {
+		page = &z->page[i];
+		n = __gdev_zswap_page_size(z, i);
+		switch (page->type) {
+		case GDEV_ZSWAP_FILL:
+			p = buf + done;
+			for (k = 0; k < n / sizeof(uint32_t); k++)
+				p[k] = page->fill;
+			break;
+		case GDEV_ZSWAP_LZ:
+			if (gdev_zswap_decompress(page->buf, page->size, buf + done, n) != n)
+				return -EIO;
+			break;
+		case GDEV_ZSWAP_RAW:
+			memcpy(buf + done, page->buf, n);
+			break;
+		default:
+			/* never stored, i.e., undefined. */
+			break;
+		}
+	}
+
+	return 0;
+}
+
+/* bytes of host memory holding the data of @z now. */
+uint64_t gdev_zswap_bytes(struct gdev_zswap *z)
+{
+	uint64_t bytes = sizeof(*z) + sizeof(z->page[0]) * z->pages;
+	int i;
+
+	for (i = 0; i < z->pages; i++)
+		bytes += z->page[i].size;
+
+	return bytes;
+}
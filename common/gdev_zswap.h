@@ -0,0 +1,76 @@
+/*
+ * Copyright (C) Shinpei Kato
+ *
+ * University of California, Santa Cruz
+ * Systems Research Lab.
+ *
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef __GDEV_ZSWAP_H__
+#define __GDEV_ZSWAP_H__
+
+#ifndef __KERNEL__
+#include <stdint.h>
+#endif
+
+/**
+ * compressed host swap: data evicted from the device is kept by pages,
+ * each of which is either a repeated 32-bit word (zero pages included),
+ * compressed by a fast LZ77 coder, or stored as is if it does not shrink.
+ * pages must not exceed 64KB, the reach of the coder.
+ */
+#define GDEV_ZSWAP_PAGE_MAX 0x10000
+
+#define GDEV_ZSWAP_NONE 0 /* never stored */
+#define GDEV_ZSWAP_FILL 1 /* repeated 32-bit word */
+#define GDEV_ZSWAP_LZ 2 /* compressed */
+#define GDEV_ZSWAP_RAW 3 /* stored as is */
+
+struct gdev_zswap_page {
+	void *buf; /* compressed or raw data, NULL if filled */
+	uint32_t size; /* bytes of buf */
+	uint32_t fill; /* the word repeated */
+	int type;
+};
+
+struct gdev_zswap {
+	uint64_t size; /* bytes of data */
+	uint32_t page_size;
+	int pages;
+	uint64_t stored; /* bytes stored so far */
+	uint64_t kept; /* bytes kept for them */
+	void *work; /* work of compress and a page, allocated at the first store */
+	struct gdev_zswap_page page[0];
+};
+
+struct gdev_zswap *gdev_zswap_alloc(uint64_t size, uint32_t page_size);
+void gdev_zswap_free(struct gdev_zswap *z);
+int gdev_zswap_store(struct gdev_zswap *z, uint64_t offset, const void *buf, uint64_t size);
+int gdev_zswap_fetch(struct gdev_zswap *z, uint64_t offset, void *buf, uint64_t size);
+uint64_t gdev_zswap_bytes(struct gdev_zswap *z);
+int gdev_zswap_compress(const void *src, int size, void *dst, int max, void *work);
+int gdev_zswap_decompress(const void *src, int size, void *dst, int max);
+
+#define GDEV_ZSWAP_WORK_SIZE (sizeof(uint32_t) << 12) /* work of compress */
+
+#endif
@@ -128,6 +128,10 @@ CUresult cuCtxCreate_v2(CUcontext *pctx, unsigned int flags, CUdevice dev)
 	/* initialize context event list. */
 	gdev_list_init(&ctx->event_list, NULL);
 
+	/* local memory is allocated when modules are loaded. */
+	ctx->lmem_addr = 0;
+	ctx->lmem_size = 0;
+
 	/* we will trace # of kernels. */
 	ctx->launch_id = 0;
 	/* save the device ID. */
@@ -199,11 +203,51 @@ CUresult cuCtxCreate(CUcontext *pctx, unsigned int flags, CUdevice dev)
 	return cuCtxCreate_v2(pctx, flags, dev);
 }
 
+/* grow the local memory window shared by all kernels of @ctx so that it
+   can hold at least @size bytes. the window is never shrunk. */
+CUresult gdev_cuda_reserve_lmem(struct CUctx_st *ctx, uint32_t size)
+{
+	Ghandle handle = ctx->gdev_handle;
+	uint64_t addr;
+
+	if (size <= ctx->lmem_size)
+		return CUDA_SUCCESS;
+
+	if (!(addr = gmalloc(handle, size)))
+		return CUDA_ERROR_OUT_OF_MEMORY;
+
+	/* kernels in flight may still be using the old window. @ctx may not
+	   be current, so its handle is waited for rather than the context. */
+	if (ctx->lmem_size > 0) {
+		if (gbarrier(handle)) {
+			gfree(handle, addr);
+			return CUDA_ERROR_UNKNOWN;
+		}
+		gfree(handle, ctx->lmem_addr);
+	}
+
+	ctx->lmem_addr = addr;
+	ctx->lmem_size = size;
+
+	return CUDA_SUCCESS;
+}
+
+void gdev_cuda_release_lmem(struct CUctx_st *ctx)
+{
+	if (ctx->lmem_size > 0) {
+		gfree(ctx->gdev_handle, ctx->lmem_addr);
+		ctx->lmem_addr = 0;
+		ctx->lmem_size = 0;
+	}
+}
+
 static int freeDestroyedContext(CUcontext ctx)
 {
 	if (ctx->usage > 0)
 		return CUDA_ERROR_INVALID_CONTEXT;
 
+	gdev_cuda_release_lmem(ctx);
+
 	if (gclose(ctx->gdev_handle))
 		return CUDA_ERROR_INVALID_CONTEXT;
 
@@ -92,6 +92,7 @@ CUresult cuDeviceComputeCapability(int *major, int *minor, CUdevice dev)
 {
 	Ghandle handle;
 	uint64_t chipset;
+	int sm;
 
 	if (!gdev_initialized)
 		return CUDA_ERROR_NOT_INITIALIZED;
@@ -112,35 +113,11 @@ CUresult cuDeviceComputeCapability(int *major, int *minor, CUdevice dev)
 	}
 	__gclose(handle);
 
-	switch (chipset) {
-	case 0x0c0:
-	case 0x0c8:
-		*major = 2;
-		*minor = 0;
-		break;
-	case 0x0c1:
-	case 0x0c3:
-	case 0x0c4:
-	case 0x0ce:
-	case 0x0cf:
-	case 0x0d9:
-		*major = 2;
-		*minor = 1;
-		break;
-	case 0x0e4:
-	case 0x0e6:
-	case 0x0e7:
-		*major = 3;
-		*minor = 0;
-		break;
-	case 0x0f0:
-	case 0x108:
-		*major = 3;
-		*minor = 5;
-		break;
-	default:
+	if (!(sm = gdev_cuda_chipset_to_sm(chipset)))
 		return CUDA_ERROR_INVALID_DEVICE;
-	}
+
+	*major = sm / 10;
+	*minor = sm % 10;
 
 	return CUDA_SUCCESS;
 }
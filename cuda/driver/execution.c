@@ -122,6 +122,30 @@ CUresult cuFuncSetSharedSize(CUfunction hfunc, unsigned int bytes)
 	return CUDA_SUCCESS;
 }
 
+/* set up the launch of @func on a @grid_width x @grid_height grid. the 
+   block shape and the parameters must have been set already. */
+void gdev_cuda_setup_kernel
+(struct CUctx_st *ctx, struct CUfunc_st *func, int grid_width, int grid_height)
+{
+	struct gdev_kernel *k = &func->kernel;
+
+	k->grid_x = grid_width;
+	k->grid_y = grid_height;
+	k->grid_z = 1;
+	k->grid_id = ++ctx->launch_id;
+	k->name = func->raw_func.name;
+	/* the local memory window may have been moved by a later module load. */
+	k->lmem_addr = ctx->lmem_addr;
+
+#ifdef GDEV_DRIVER_NOUVEAU /* this is a quick hack until Nouveau supports flexible vspace */
+	k->smem_base = 0xe << 24; 
+	k->lmem_base = 0xf << 24;
+#else
+	k->smem_base = gdev_cuda_align_base(0);
+	k->lmem_base = k->smem_base + gdev_cuda_align_base(k->smem_size);
+#endif
+}
+
 /**
  * Invokes the kernel f on a 1 x 1 x 1 grid of blocks. The block contains the
  *  number of threads specified by a previous call to cuFuncSetBlockShape().
@@ -181,21 +205,8 @@ CUresult cuLaunchGrid(CUfunction f, int grid_width, int grid_height)
 	if (!(fence = (struct gdev_cuda_fence *)MALLOC(sizeof(*fence))))
 		return CUDA_ERROR_LAUNCH_OUT_OF_RESOURCES;
 
+	gdev_cuda_setup_kernel(ctx, func, grid_width, grid_height);
 	k = &func->kernel;
-	k->grid_x = grid_width;
-	k->grid_y = grid_height;
-	k->grid_z = 1;
-	k->grid_id = ++ctx->launch_id;
-	k->name = func->raw_func.name;
-
-
-#ifdef GDEV_DRIVER_NOUVEAU /* this is a quick hack until Nouveau supports flexible vspace */
-	k->smem_base = 0xe << 24; 
-	k->lmem_base = 0xf << 24;
-#else
-	k->smem_base = gdev_cuda_align_base(0);
-	k->lmem_base = k->smem_base + gdev_cuda_align_base(k->smem_size);
-#endif
 
 	handle = cur->gdev_handle;
 
@@ -215,6 +226,38 @@ CUresult cuLaunchGridAsync
 	return CUDA_SUCCESS;
 }
 
+/* set the block shape, the dynamic shared memory size, and the parameters
+   of @func in the same manner as cuLaunchKernel(). */
+CUresult gdev_cuda_set_kernel_params
+(struct CUfunc_st *func, 
+ unsigned int blockDimX, unsigned int blockDimY, unsigned int blockDimZ,
+ unsigned int sharedMemBytes, void **kernelParams)
+{
+	struct gdev_cuda_raw_func *rf;
+	struct gdev_cuda_param *param_data;
+	CUresult res;
+
+	res = cuFuncSetSharedSize(func, sharedMemBytes);
+	if (res != CUDA_SUCCESS)
+		return res;
+
+	res = cuFuncSetBlockShape(func, blockDimX, blockDimY, blockDimZ);
+	if (res != CUDA_SUCCESS)
+		return res;
+
+	rf = &func->raw_func;
+	param_data = rf->param_data;
+	while (param_data) {
+		void *p = kernelParams[param_data->idx];
+		int offset = param_data->offset;
+		uint32_t size = param_data->size;
+		cuParamSetv(func, offset, p, size);
+		param_data = param_data->next;
+	}
+
+	return cuParamSetSize(func, rf->param_size);
+}
+
 /**
  * Invokes the kernel @f on a @gridDimX x @gridDimY x @gridDimZ grid of blocks. 
  * Each block contains @blockDimX x @blockDimY x @blockDimZ threads.
@@ -222,7 +265,8 @@ CUresult cuLaunchGridAsync
  * available to each thread block.
  *
  * cuLaunchKernel() can optionally be associated to a stream by passing a 
- * non-zero hStream argument.
+ * non-zero hStream argument. Gdev supports only streams being captured by
+ * cuStreamBeginCapture(), to which the launch is recorded.
  *
  * Kernel parameters to @f can be specified in one of two ways:
  *
@@ -312,11 +356,11 @@ CUresult cuLaunchKernel
  unsigned int sharedMemBytes, CUstream hStream, 
  void **kernelParams, void **extra)
 {
-	struct gdev_cuda_raw_func *rf;
-	struct gdev_cuda_param *param_data;
+	struct CUstream_st *stream = hStream;
 	CUresult res;
 
-	if (hStream) {
+	/* streams are supported only for capturing graphs so far. */
+	if (stream && !stream->capture) {
 		GDEV_PRINT("cuLaunchKernel: Stream is not supported.\n");
 		return CUDA_ERROR_INVALID_HANDLE;
 	}
@@ -326,27 +370,17 @@ CUresult cuLaunchKernel
 		return CUDA_ERROR_INVALID_HANDLE;
 	}
 
-	res = cuFuncSetSharedSize(f, sharedMemBytes);
-	if (res != CUDA_SUCCESS)
+	res = gdev_cuda_set_kernel_params
+		(f, blockDimX, blockDimY, blockDimZ, sharedMemBytes, kernelParams);
+	if (res != CUDA_SUCCESS) {
+		if (stream)
+			stream->capture->invalidated = 1;
 		return res;
-
-	res = cuFuncSetBlockShape(f, blockDimX, blockDimY, blockDimZ);
-	if (res != CUDA_SUCCESS)
-		return res;
-
-	rf = &f->raw_func;
-	param_data = rf->param_data;
-	while (param_data) {
-		void *p = kernelParams[param_data->idx];
-		int offset = param_data->offset;
-		uint32_t size = param_data->size;
-		cuParamSetv(f, offset, p, size);
-		param_data = param_data->next;
 	}
 
-	res = cuParamSetSize(f, rf->param_size);
-	if (res != CUDA_SUCCESS)
-		return res;
+	/* record the launch in the graph instead of launching it. */
+	if (stream)
+		return gdev_cuda_graph_add_kernel(stream->capture, f, gridDimX, gridDimY);
 
 	res = cuLaunchGrid(f, gridDimX, gridDimY);
 	if (res != CUDA_SUCCESS)
@@ -0,0 +1,116 @@
+/*
+ * Copyright (C) 2011 Shinpei Kato
+ *
+ * Systems Research Lab, University of California at Santa Cruz
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "../cuda.h"
+#include "gdev_api.h"
+#include "../gdev_cuda.h"
+
+/**
+ * Gdev extension: declares that the kernel takes the hidden parameters of
+ * grid slicing, i.e., the block offset X and Y of the slice and the grid
+ * width and height of the whole launch, as four 32-bit words at offset.
+ * the kernel must add the offset to its block index, and use the grid
+ * size instead of gridDim. launches of such a kernel are sliced, once
+ * the context is given a slice size by cuCtxSetSliceSize().
+ *
+ * Parameters:
+ * hfunc - Kernel to set the hidden parameters for
+ * offset - Offset in bytes of the hidden parameters, as in cuParamSeti()
+ *
+ * Returns:
+ * CUDA_SUCCESS, CUDA_ERROR_DEINITIALIZED, CUDA_ERROR_NOT_INITIALIZED,
+ * CUDA_ERROR_INVALID_CONTEXT, CUDA_ERROR_INVALID_VALUE
+ */
+CUresult cuFuncSetSliceParam(CUfunction hfunc, int offset)
+{
+	CUresult res;
+	struct CUfunc_st *func = hfunc;
+	struct CUctx_st *cur;
+	struct gdev_kernel *k;
+	struct gdev_cuda_raw_func *f;
+	uint32_t index;
+
+	if (!gdev_initialized)
+		return CUDA_ERROR_NOT_INITIALIZED;
+
+	res = cuCtxGetCurrent(&cur);
+	if (res != CUDA_SUCCESS)
+		return res;
+
+	if (!func)
+		return CUDA_ERROR_INVALID_VALUE;
+	if (!func->mod->ctx || func->mod->ctx != cur)
+		return CUDA_ERROR_INVALID_CONTEXT;
+
+	k = &func->kernel;
+	f = &func->raw_func;
+	if (offset < 0 || offset % 4)
+		return CUDA_ERROR_INVALID_VALUE;
+	index = (f->param_base + offset) / 4;
+	if (index < GDEV_SLICE_PARAM_MIN ||
+		index + GDEV_SLICE_PARAM_COUNT > k->param_size / 4)
+		return CUDA_ERROR_INVALID_VALUE;
+
+	k->slice_param = index;
+
+	return CUDA_SUCCESS;
+}
+
+/**
+ * Gdev extension: sets the number of CTAs per slice of the launches made
+ * in the current context. zero stops slicing. only the kernels declared
+ * by cuFuncSetSliceParam() are sliced. a sliced launch returns once its
+ * last slice is launched, as the slices wait for each other so that other
+ * contexts are scheduled in between.
+ *
+ * Parameters:
+ * blocks - CTAs per slice
+ *
+ * Returns:
+ * CUDA_SUCCESS, CUDA_ERROR_DEINITIALIZED, CUDA_ERROR_NOT_INITIALIZED,
+ * CUDA_ERROR_INVALID_CONTEXT, CUDA_ERROR_UNKNOWN
+ */
+CUresult cuCtxSetSliceSize(unsigned int blocks)
+{
+	CUresult res;
+	struct CUctx_st *ctx;
+	Ghandle handle;
+
+	if (!gdev_initialized)
+		return CUDA_ERROR_NOT_INITIALIZED;
+
+	res = cuCtxGetCurrent(&ctx);
+	if (res != CUDA_SUCCESS)
+		return res;
+
+	handle = ctx->gdev_handle;
+
+	/* the runtime may be built without the scheduler. */
+	if (gtune(handle, GDEV_TUNE_SLICE_SIZE, blocks))
+		return CUDA_ERROR_UNKNOWN;
+
+	return CUDA_SUCCESS;
+}
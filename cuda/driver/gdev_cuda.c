@@ -31,6 +31,9 @@
 #include <linux/errno.h>
 #else
 #include <sys/errno.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <dlfcn.h>
 #endif
 
 #define SH_TEXT ".text."
@@ -84,10 +87,47 @@ typedef struct symbol_entry {
 	uint32_t sym_idx;
 } symbol_entry_t;
 
+/* fat binaries embedded by nvcc: a wrapper points to a header followed by
+   a sequence of entries, each of which holds a PTX or an ELF image. */
+#define FATBIN_WRAPPER_MAGIC 0x466243b1
+#define FATBIN_MAGIC 0xba55ed50
+#define FATBIN_KIND_PTX 0x1
+#define FATBIN_KIND_ELF 0x2
+#define FATBIN_FLAG_COMPRESSED 0x1000
+
+typedef struct fatbin_wrapper {
+	uint32_t magic;
+	uint32_t version;
+	const void *data;
+	void *unk;
+} fatbin_wrapper_t;
+
+typedef struct fatbin_header {
+	uint32_t magic;
+	uint16_t version;
+	uint16_t header_size;
+	uint64_t size; /* total size of the entries. */
+} fatbin_header_t;
+
+typedef struct fatbin_entry {
+	uint16_t kind;
+	uint16_t unk16;
+	uint32_t header_size;
+	uint64_t size; /* size of the (compressed) image. */
+	uint32_t unk32[3];
+	uint32_t arch; /* sm_xy or compute_xy as x * 10 + y. */
+	uint32_t name_offset;
+	uint32_t name_size;
+	uint64_t flags;
+	uint64_t unk64;
+	uint64_t uncompressed_size;
+} fatbin_entry_t;
+
 /* prototype definition. */
 static int cubin_func_type
 (char **pos, section_entry_t *e, struct gdev_cuda_raw_func *raw_func);
 
+#ifdef __KERNEL__
 static int load_file(char **pbin, const char *fname)
 {
 	char *bin;
@@ -118,12 +158,60 @@ static int load_file(char **pbin, const char *fname)
 
 	return 0;
 }
+#endif
+
+#ifndef __KERNEL__
+/* map the file instead of reading it: sections are paged in only when 
+   they are actually used, and code is copied straight from the mapping. */
+static int map_file(char **pbin, size_t *psize, const char *fname)
+{
+	struct stat st;
+	void *bin;
+	int fd;
+
+	if ((fd = open(fname, O_RDONLY)) < 0)
+		return -ENOENT;
+
+	if (fstat(fd, &st) || st.st_size == 0) {
+		close(fd);
+		return -ENOENT;
+	}
+
+	bin = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (bin == MAP_FAILED)
+		return -ENOMEM;
+
+	*pbin = (char *)bin;
+	*psize = st.st_size;
+
+	return 0;
+}
+#endif
+
+/* a file is mapped in user-space, while it is read into memory in the
+   kernel. @psize is set to zero if the file has been read. */
+static int open_cubin(char **pbin, size_t *psize, const char *fname)
+{
+#ifdef __KERNEL__
+	*psize = 0;
+	return load_file(pbin, fname);
+#else
+	return map_file(pbin, psize, fname);
+#endif
+}
 
 static void unload_cubin(struct CUmod_st *mod)
 {
 	if (mod->bin) {
-		FREE(mod->bin);
+#ifndef __KERNEL__
+		if (mod->bin_size)
+			munmap(mod->bin, mod->bin_size);
+		else
+#endif
+			FREE(mod->bin);
 		mod->bin = NULL;
+		mod->bin_size = 0;
 	}
 }
 
@@ -322,11 +410,13 @@ static int cubin_func_type
 	return 0;
 }
 
-static void init_mod(struct CUmod_st *mod, char *bin)
+static void init_mod(struct CUmod_st *mod, char *bin, size_t size)
 {
 	int i;
 
 	mod->bin = bin;
+	mod->bin_size = size;
+	mod->symbol_loaded = 0;
 	mod->func_count = 0;
 	mod->symbol_count = 0;
 	for (i = 0; i < GDEV_NVIDIA_CONST_SEGMENT_MAX_COUNT; i++) {
@@ -337,6 +427,7 @@ static void init_mod(struct CUmod_st *mod, char *bin)
 	}
 	gdev_list_init(&mod->func_list, NULL);
 	gdev_list_init(&mod->symbol_list, NULL);
+	gdev_list_init(&mod->cmem_list, NULL);
 	mod->arch = 0;
 }
 
@@ -374,6 +465,7 @@ static void init_kernel(struct gdev_kernel *k)
 	k->block_x = 0;
 	k->block_y = 0;
 	k->block_z = 0;
+	k->slice_param = 0;
 }
 
 static void init_raw_func(struct gdev_cuda_raw_func *f)
@@ -444,6 +536,8 @@ static struct CUfunc_st* lookup_func_by_name(struct CUmod_st *mod, const char *n
 static struct CUfunc_st* malloc_func_if_necessary(struct CUmod_st *mod, const char *name)
 {
 	struct CUfunc_st *func = NULL;
+	int i;
+
 	if ((func = lookup_func_by_name(mod, name))) {
 		return func;
 	}
@@ -456,6 +550,8 @@ static struct CUfunc_st* malloc_func_if_necessary(struct CUmod_st *mod, const ch
 	init_kernel(&func->kernel);
 	init_raw_func(&func->raw_func);
 	func->raw_func.name = STRDUP(name);
+	for (i = 0; i < GDEV_NVIDIA_CONST_SEGMENT_MAX_COUNT; i++)
+		func->cmem_seg[i] = NULL;
 
 	/* insert this function to the module's function list. */
 	gdev_list_init(&func->list_entry, func);
@@ -470,14 +566,8 @@ static int load_cubin(struct CUmod_st *mod, char *bin)
 	Elf_Ehdr *ehead;
 	Elf_Shdr *sheads;
 	Elf_Phdr *pheads;
-	Elf_Sym *symbols, *sym;
-	char *strings;
 	char *shstrings;
-	char *nvinfo, *nvrel, *nvglobal_init;
-	uint32_t symbols_size;
-	int symbols_idx, strings_idx;
-	int nvinfo_idx, nvrel_idx, nvrel_const_idx,	nvglobal_idx, nvglobal_init_idx;
-	symbol_entry_t *sym_entry;
+	char *nvinfo;
 	section_entry_t *se;
 	void *sh;
 	char *sh_name;
@@ -491,38 +581,19 @@ static int load_cubin(struct CUmod_st *mod, char *bin)
 	ehead = (Elf_Ehdr *)bin;
 	sheads = (Elf_Shdr *)(bin + ehead->e_shoff);
 	pheads = (Elf_Phdr *)(bin + ehead->e_phoff);
-	symbols = NULL;
-	strings = NULL;
 	nvinfo = NULL;
-	nvrel = NULL;
-	nvglobal_init = NULL;
-	symbols_idx = 0;
-	strings_idx = 0;
-	nvinfo_idx = 0;
-	nvrel_idx = 0;
-	nvrel_const_idx = 0;
-	nvglobal_idx = 0;
-	nvglobal_init_idx = 0;
 	shstrings = bin + sheads[ehead->e_shstrndx].sh_offset;
 
 	/* seek the ELF header. */
 	for (i = 0; i < ehead->e_shnum; i++) {
 		sh_name = (char *)(shstrings + sheads[i].sh_name);
 		sh = bin + sheads[i].sh_offset;
-		/* the following are function-independent sections. */
+		/* the following are function-independent sections: symbols
+		   are parsed by load_symbols(), and relocations are unused. */
 		switch (sheads[i].sh_type) {
 		case SHT_SYMTAB: /* symbol table */
-			symbols_idx = i;
-			symbols = (Elf_Sym *)sh;
-			break;
 		case SHT_STRTAB: /* string table */
-			strings_idx = i;
-			strings = (char *)sh;
-			break;
 		case SHT_REL: /* relocatable: not sure if nvcc uses it... */
-			nvrel_idx = i;
-			nvrel = (char *)sh;
-			sscanf(sh_name, "%*s%d", &nvrel_const_idx);
 			break;
 		default:
 			/* we never know what sections (.text.XXX, .info.XXX, etc.)
@@ -615,34 +686,69 @@ static int load_cubin(struct CUmod_st *mod, char *bin)
 				}
 			}
 			else if (!strcmp(sh_name, SH_INFO)) {
-				nvinfo_idx = i;
 				nvinfo = (char *) sh;
 			}
-			else if (!strcmp(sh_name, SH_GLOBAL)) {
-				/* symbol space size. */
-				symbols_size = sheads[i].sh_size;
-				nvglobal_idx = i;
-			}
-			else if (!strcmp(sh_name, SH_GLOBAL_INIT)) {
-				nvglobal_init_idx = i;
-				nvglobal_init = (char *) sh;
-			}
 			break;
 		}
 	}
 
-	/* nv.rel... "__device__" symbols? */
-	for (sym_entry = (symbol_entry_t *)nvrel; 
-		 (void *)sym_entry < (void *)nvrel + sheads[nvrel_idx].sh_size;
-		 sym_entry++) {
-		/*
-		 char *sym_name, *sh_name;
-		 uint32_t size;
-		 sym  = &symbols[se->sym_idx];
-		 sym_name = strings + sym->st_name;
-		 sh_name = strings + sheads[sym->st_shndx].sh_name;
-		 size = sym->st_size;
-		*/
+	/* the global nv.info section only points to the function sections 
+	   that we have already seen, so its entries are not parsed here. */
+	if (nvinfo) { /* >= sm_20 */
+		mod->arch = GDEV_ARCH_SM_2X;
+	}
+	else { /* < sm_13 */
+		mod->arch = GDEV_ARCH_SM_1X;
+	}
+
+	return 0;
+
+fail_cubin_func_type:
+fail_malloc_func:
+	destroy_all_functions(mod);
+
+	return ret;
+}
+
+/* __constant__ symbols are only needed by cuModuleGetGlobal(), so the 
+   symbol table is parsed on first use. */
+static int load_symbols(struct CUmod_st *mod, char *bin)
+{
+	Elf_Ehdr *ehead;
+	Elf_Shdr *sheads;
+	Elf_Sym *symbols, *sym;
+	char *strings;
+	char *shstrings;
+	char *sh_name;
+	int symbols_idx, nvglobal_idx;
+	int i, ret = 0;
+
+	if (mod->symbol_loaded)
+		return 0;
+
+	ehead = (Elf_Ehdr *)bin;
+	sheads = (Elf_Shdr *)(bin + ehead->e_shoff);
+	symbols = NULL;
+	strings = NULL;
+	symbols_idx = 0;
+	nvglobal_idx = 0;
+	shstrings = bin + sheads[ehead->e_shstrndx].sh_offset;
+
+	for (i = 0; i < ehead->e_shnum; i++) {
+		sh_name = (char *)(shstrings + sheads[i].sh_name);
+		switch (sheads[i].sh_type) {
+		case SHT_SYMTAB: /* symbol table */
+			symbols_idx = i;
+			symbols = (Elf_Sym *)(bin + sheads[i].sh_offset);
+			break;
+		case SHT_STRTAB: /* string table */
+			strings = bin + sheads[i].sh_offset;
+			break;
+		default:
+			if (!strcmp(sh_name, SH_GLOBAL))
+				nvglobal_idx = i;
+			break;
+		}
 	}
 
 	/* symbols: __constant__ variable and built-in function names. */
@@ -688,41 +794,17 @@ static int load_cubin(struct CUmod_st *mod, char *bin)
 			 break;
 		 default: /* ??? */
 			 GDEV_PRINT("/* unknown symbols: 0x%x\n */", sym->st_info);
+			 ret = -EINVAL;
 			 goto fail_symbol;
 		 }
 	}
-	if (nvinfo) { /* >= sm_20 */
-		/* parse nv.info sections. */
-		pos = (char*)nvinfo;
-		while (pos < nvinfo + sheads[nvinfo_idx].sh_size) {
-			section_entry_t *e = (section_entry_t*) pos;
-			switch (e->type) {
-			case 0x0704: /* texture */
-				cubin_func_skip(&pos, e);
-				break;
-			case 0x1104:  /* function */
-				cubin_func_skip(&pos, e);
-				break;
-			case 0x1204: /* some counters but what is this? */
-				cubin_func_skip(&pos, e);
-				break;
-			default:
-				cubin_func_unknown(&pos, e);
-				/* goto fail_function; */
-			}
-		}
-		mod->arch = GDEV_ARCH_SM_2X;
-	}
-	else { /* < sm_13 */
-		mod->arch = GDEV_ARCH_SM_1X;
-	}
+
+	mod->symbol_loaded = 1;
 
 	return 0;
 
 fail_symbol:
-fail_cubin_func_type:
-fail_malloc_func:
-	destroy_all_functions(mod);
+	destroy_all_symbols(mod);
 
 	return ret;
 }
@@ -801,6 +883,7 @@ static int assemble_ptx(char *cubin_file, const char *ptx_file)
 CUresult gdev_cuda_load_cubin_ptx(struct CUmod_st *mod, const char *fname)
 {
 	char *bin;
+	size_t size;
 	int ret;
 	char cubin_file[16] = "/tmp/GDEVXXXXXX";
 
@@ -808,12 +891,12 @@ CUresult gdev_cuda_load_cubin_ptx(struct CUmod_st *mod, const char *fname)
 	if (ret)
 		goto fail_compile_ptx;
 
-	ret = load_file(&bin, cubin_file);
+	ret = open_cubin(&bin, &size, cubin_file);
 	if (ret)
 		goto fail_load_file;
 
 	/* initialize module. */
-	init_mod(mod, bin);
+	init_mod(mod, bin, size);
 
 	ret = load_cubin(mod, bin);
 	if (ret)
@@ -847,14 +930,15 @@ CUresult gdev_cuda_load_cubin(struct CUmod_st *mod, const char *fname)
 CUresult gdev_cuda_load_cubin_file(struct CUmod_st *mod, const char *fname)
 {
 	char *bin;
+	size_t size;
 	int ret;
 
-	ret = load_file(&bin, fname);
+	ret = open_cubin(&bin, &size, fname);
 	if (ret)
 		goto fail_load_file;
 
 	/* initialize module. */
-	init_mod(mod, bin);
+	init_mod(mod, bin, size);
 
 	ret = load_cubin(mod, bin);
 	if (ret) {
@@ -889,9 +973,13 @@ CUresult gdev_cuda_load_cubin_image(struct CUmod_st *mod, const void *image)
 	int ret;
 
 	/* initialize module. */
-	init_mod(mod, NULL);
+	init_mod(mod, NULL, 0);
 
+	/* the image may be released by the caller once the module is loaded,
+	   so symbols cannot be parsed lazily. */
 	ret = load_cubin(mod, (char *)image);
+	if (!ret && (ret = load_symbols(mod, (char *)image)))
+		destroy_all_functions(mod);
 	if (ret) {
 #ifdef __KERNEL__
 		goto fail_load_cubin;
@@ -930,6 +1018,214 @@ fail_save_ptx:
 	}
 }
 
+/* returns x * 10 + y for the sm_xy of @chipset, or zero if unknown. */
+int gdev_cuda_chipset_to_sm(uint64_t chipset)
+{
+	switch (chipset) {
+	case 0x0c0:
+	case 0x0c8:
+		return 20;
+	case 0x0c1:
+	case 0x0c3:
+	case 0x0c4:
+	case 0x0ce:
+	case 0x0cf:
+	case 0x0d9:
+		return 21;
+	case 0x0e4:
+	case 0x0e6:
+	case 0x0e7:
+		return 30;
+	case 0x0f0:
+	case 0x108:
+		return 35;
+	default:
+		return 0;
+	}
+}
+
+static const fatbin_header_t *fatbin_header(const void *image)
+{
+	const fatbin_wrapper_t *wrapper = image;
+
+	if (wrapper->magic == FATBIN_WRAPPER_MAGIC)
+		image = wrapper->data;
+	if (!image || ((const fatbin_header_t *)image)->magic != FATBIN_MAGIC)
+		return NULL;
+
+	return image;
+}
+
+int gdev_cuda_is_fatbin(const void *image)
+{
+	return fatbin_header(image) != NULL;
+}
+
+/* pick the image to run on sm_@sm: a native ELF image of the same major
+   version is preferred, newest first, and PTX is a fallback to be JIT 
+   compiled only if there is no such ELF image. */
+static const fatbin_entry_t *fatbin_select(const fatbin_header_t *fh, int sm)
+{
+	const fatbin_entry_t *e, *elf = NULL, *ptx = NULL;
+	const char *pos = (const char *)fh + fh->header_size;
+	const char *end = pos + fh->size;
+
+	while (pos + sizeof(*e) <= end) {
+		e = (const fatbin_entry_t *)pos;
+		if (e->arch <= sm) {
+			switch (e->kind) {
+			case FATBIN_KIND_ELF:
+				if (e->arch / 10 == sm / 10 &&
+					(!elf || e->arch > elf->arch))
+					elf = e;
+				break;
+			case FATBIN_KIND_PTX:
+				if (!ptx || e->arch > ptx->arch)
+					ptx = e;
+				break;
+			}
+		}
+		if (e->header_size == 0)
+			break;
+		pos += e->header_size + e->size;
+	}
+
+	return elf ? elf : ptx;
+}
+
+#ifndef __KERNEL__
+typedef int (*uncompress_t)(unsigned char *, unsigned long *, 
+							const unsigned char *, unsigned long);
+
+/* inflate the image of @e, which has been deflated by zlib. libz is 
+   opened on demand, as compressed fat binaries are not that common. */
+static int fatbin_uncompress(char *buf, const fatbin_entry_t *e)
+{
+	void *libz;
+	uncompress_t uncompress;
+	unsigned long size = e->uncompressed_size;
+	int ret = 0;
+
+	if (!(libz = dlopen("libz.so.1", RTLD_LAZY)) &&
+		!(libz = dlopen("libz.so", RTLD_LAZY))) {
+		GDEV_PRINT("Failed to open libz\n");
+		return -ENOENT;
+	}
+
+	if (!(uncompress = (uncompress_t)dlsym(libz, "uncompress")))
+		ret = -ENOENT;
+	else if (uncompress((unsigned char *)buf, &size, 
+						(const unsigned char *)e + e->header_size, e->size) ||
+			 size != e->uncompressed_size)
+		ret = -EINVAL;
+
+	dlclose(libz);
+
+	return ret;
+}
+#endif
+
+/* copy (or uncompress) the image of @e into a new buffer. the buffer is
+   NULL-terminated so that a PTX image can be saved as a string. */
+static int fatbin_extract(char **pbin, const fatbin_entry_t *e)
+{
+	char *bin;
+	uint64_t size;
+	int ret;
+
+	size = (e->flags & FATBIN_FLAG_COMPRESSED) ? e->uncompressed_size : e->size;
+	if (!(bin = MALLOC(size + 1)))
+		return -ENOMEM;
+
+	if (e->flags & FATBIN_FLAG_COMPRESSED) {
+#ifdef __KERNEL__
+		ret = -EINVAL;
+#else
+		ret = fatbin_uncompress(bin, e);
+#endif
+		if (ret) {
+			FREE(bin);
+			return ret;
+		}
+	}
+	else
+		memcpy(bin, (const char *)e + e->header_size, size);
+	bin[size] = 0;
+
+	*pbin = bin;
+
+	return 0;
+}
+
+/* load the image that best fits @chipset out of the fat binary @fatbin. 
+   other images are never touched, and only the selected one is 
+   uncompressed if necessary. */
+CUresult gdev_cuda_load_fatbin
+(struct CUmod_st *mod, const void *fatbin, uint64_t chipset)
+{
+	const fatbin_header_t *fh;
+	const fatbin_entry_t *e;
+	char *bin;
+	int ret;
+
+	if (!(fh = fatbin_header(fatbin)))
+		return CUDA_ERROR_INVALID_IMAGE;
+
+	if (!(e = fatbin_select(fh, gdev_cuda_chipset_to_sm(chipset))))
+		return CUDA_ERROR_NO_BINARY_FOR_GPU;
+
+	/* an uncompressed ELF image is parsed in place. */
+	if (e->kind == FATBIN_KIND_ELF && !(e->flags & FATBIN_FLAG_COMPRESSED))
+		return gdev_cuda_load_cubin_image(mod, (const char *)e + e->header_size);
+
+	ret = fatbin_extract(&bin, e);
+	if (ret)
+		goto fail_extract;
+
+	if (e->kind == FATBIN_KIND_PTX) {
+#ifdef __KERNEL__
+		FREE(bin);
+		return CUDA_ERROR_NO_BINARY_FOR_GPU;
+#else
+		CUresult res;
+		char ptx_file[16] = "/tmp/GDEVXXXXXX";
+
+		ret = save_ptx(ptx_file, bin);
+		FREE(bin);
+		if (ret)
+			goto fail_extract;
+
+		res = gdev_cuda_load_cubin_ptx(mod, ptx_file);
+
+		unlink(ptx_file);
+
+		return res;
+#endif
+	}
+
+	/* the module owns the uncompressed ELF image, so symbols can be 
+	   parsed lazily as with cubin files. */
+	init_mod(mod, bin, 0);
+
+	ret = load_cubin(mod, bin);
+	if (ret)
+		goto fail_load_cubin;
+
+	return CUDA_SUCCESS;
+
+fail_load_cubin:
+	unload_cubin(mod);
+fail_extract:
+	switch (ret) {
+	case -ENOMEM:
+		return CUDA_ERROR_OUT_OF_MEMORY;
+	case -ENOENT:
+		return CUDA_ERROR_FILE_NOT_FOUND;
+	default:
+		return CUDA_ERROR_INVALID_IMAGE;
+	}
+}
+
 CUresult gdev_cuda_unload_cubin(struct CUmod_st *mod)
 {
 	/* destroy functions and constant symbols:
@@ -959,6 +1255,92 @@ static uint64_t __round_up_pow2(uint64_t x)
 	return ++x;
 }
 
+/* find a constant segment of the same size and contents in @mod, or add a
+   new one to the code area. @buf may be NULL for zero-filled segments, even
+   if the section has a size, e.g., SHT_NOBITS. */
+static struct gdev_cuda_cmem_seg *__gdev_cuda_cmem_get
+(struct CUmod_st *mod, void *buf, uint32_t raw_size, uint32_t size, int share)
+{
+	struct gdev_cuda_cmem_seg *seg;
+
+	if (!buf)
+		raw_size = 0;
+	if (raw_size > size)
+		raw_size = size;
+
+	if (share) {
+		gdev_list_for_each(seg, &mod->cmem_list, list_entry) {
+			if (!seg->share || seg->size != size || seg->raw_size != raw_size)
+				continue;
+			if (raw_size == 0 || memcmp(seg->buf, buf, raw_size) == 0)
+				return seg;
+		}
+	}
+
+	if (!(seg = MALLOC(sizeof(*seg))))
+		return NULL;
+	seg->buf = raw_size ? buf : NULL;
+	seg->raw_size = raw_size;
+	seg->size = size;
+	seg->addr = 0;
+	seg->share = share;
+	seg->alloc = 0;
+	gdev_list_init(&seg->list_entry, seg);
+	gdev_list_add_tail(&seg->list_entry, &mod->cmem_list);
+	mod->code_size += size;
+
+	return seg;
+}
+
+/* c1[] is used by nvcc as a driver constant bank. the pre-Kepler launchers
+   fill it in on every launch, and the host image holds the same words, so
+   that the segment is shared only by kernels that see the same contents. */
+static struct gdev_cuda_cmem_seg *__gdev_cuda_cmem_get_c1
+(struct CUmod_st *mod, struct gdev_cuda_raw_func *f, uint32_t size)
+{
+	struct gdev_cuda_cmem_seg *seg;
+	uint32_t raw_size = f->cmem[1].size > 0x104 ? f->cmem[1].size : 0x104;
+	uint32_t *buf;
+
+	if (!(buf = MALLOC(raw_size)))
+		return NULL;
+	memset(buf, 0, raw_size);
+	if (f->cmem[1].buf)
+		memcpy(buf, f->cmem[1].buf, f->cmem[1].size);
+	memset(buf, 0, 0x80);
+	buf[0x100 / 4] = 0x00fffc40;
+
+	if (!(seg = __gdev_cuda_cmem_get(mod, buf, raw_size, size, 1))) {
+		FREE(buf);
+		return NULL;
+	}
+	if (seg->buf == buf)
+		seg->alloc = 1;
+	else
+		FREE(buf);
+
+	return seg;
+}
+
+static void __gdev_cuda_cmem_put_all(struct CUmod_st *mod)
+{
+	struct gdev_cuda_cmem_seg *seg;
+	struct CUfunc_st *func;
+	int i;
+
+	while ((seg = gdev_list_container(gdev_list_head(&mod->cmem_list)))) {
+		gdev_list_del(&seg->list_entry);
+		if (seg->alloc)
+			FREE(seg->buf);
+		FREE(seg);
+	}
+
+	gdev_list_for_each(func, &mod->func_list, list_entry) {
+		for (i = 0; i < GDEV_NVIDIA_CONST_SEGMENT_MAX_COUNT; i++)
+			func->cmem_seg[i] = NULL;
+	}
+}
+
 CUresult gdev_cuda_construct_kernels
 (struct CUmod_st *mod, struct gdev_cuda_info *cuda_info)
 {
@@ -992,7 +1374,8 @@ CUresult gdev_cuda_construct_kernels
 
 		/* the following c[] setup is NVIDIA's nvcc-specific. */
 		k->cmem_count = GDEV_NVIDIA_CONST_SEGMENT_MAX_COUNT;
-		/* c0[] is a parameter list. */
+		/* c0[] is a parameter list. it is rewritten on every launch, 
+		   so it is never shared with other kernels. */
 		gdev_io_memcpy(k->param_buf, f->cmem[0].buf, f->param_base);
 		if (f->param_size > 0)
 			k->cmem[0].size = gdev_cuda_align_cmem_size(f->param_size + cmem_size_align);
@@ -1005,7 +1388,9 @@ CUresult gdev_cuda_construct_kernels
 		}
 
 		/* c{1,15,17}[] are something unknown... 
-		   CUDA doesn't work properly without the following for some reason. */
+		   CUDA doesn't work properly without the following for some reason.
+		   their usage is not visible in the cubin, but their contents 
+		   are the same for all kernels, so they are shared below. */
 		if (k->cmem[1].size == 0) {
 			k->cmem[1].size = 0x10000;
 		}
@@ -1016,6 +1401,22 @@ CUresult gdev_cuda_construct_kernels
 			k->cmem[17].size = k->cmem[0].size;
 		}
 
+		/* code size includes local constant memory sizes: identical
+		   segments are allocated only once per module. */
+		for (i = 0; i < GDEV_NVIDIA_CONST_SEGMENT_MAX_COUNT; i++) {
+			if (k->cmem[i].size == 0)
+				continue;
+			if (i == 1 && (chipset & 0xf0) < 0xe0) {
+				if (k->cmem[i].size < gdev_cuda_align_cmem_size(0x104))
+					k->cmem[i].size = gdev_cuda_align_cmem_size(0x104);
+				func->cmem_seg[i] = __gdev_cuda_cmem_get_c1(mod, f, k->cmem[i].size);
+			}
+			else
+				func->cmem_seg[i] = __gdev_cuda_cmem_get(mod, f->cmem[i].buf, f->cmem[i].size, k->cmem[i].size, i != 0);
+			if (!func->cmem_seg[i])
+				goto fail_cmem;
+		}
+
 		/* FIXME: what is the right local memory size?
 		   the blob trace says lmem_size > 0xf0 and lmem_size_neg > 0x7fc. */
 		k->lmem_size = gdev_cuda_align_lmem_size(f->local_size);
@@ -1054,11 +1455,13 @@ CUresult gdev_cuda_construct_kernels
 		k->reg_count = f->reg_count;
 		k->bar_count = f->bar_count;
 
-		/* code size includes code and local constant memory sizes. */
+		/* code size also includes the code itself. */
 		mod->code_size += k->code_size;
-		for (i = 0; i < GDEV_NVIDIA_CONST_SEGMENT_MAX_COUNT; i++)
-			mod->code_size += k->cmem[i].size;
-		mod->sdata_size += k->lmem_size_total;
+		/* kernels in the same context never use local memory 
+		   concurrently, so the module only needs as much local memory
+		   as its most demanding kernel. */
+		if (k->lmem_size_total > mod->sdata_size)
+			mod->sdata_size = k->lmem_size_total;
 	}
 
 	/* code size also includes global constant memory size. */
@@ -1069,11 +1472,15 @@ CUresult gdev_cuda_construct_kernels
 
 	return CUDA_SUCCESS;
 
+fail_cmem:
 fail_malloc_param:
+	__gdev_cuda_cmem_put_all(mod);
 	gdev_list_for_each(func, &mod->func_list, list_entry) {
 		k = &func->kernel;
-		if (k->param_buf)
+		if (k->param_buf) {
 			FREE(k->param_buf);
+			k->param_buf = NULL;
+		}
 	}
 	return CUDA_ERROR_OUT_OF_MEMORY;
 }
@@ -1084,6 +1491,8 @@ CUresult gdev_cuda_destruct_kernels(struct CUmod_st *mod)
 	struct CUfunc_st *func;
 	struct gdev_kernel *k;
 
+	__gdev_cuda_cmem_put_all(mod);
+
 	gdev_list_for_each(func, &mod->func_list, list_entry) {
 		k = &func->kernel;
 		if (k->param_buf)
@@ -1095,30 +1504,10 @@ CUresult gdev_cuda_destruct_kernels(struct CUmod_st *mod)
 	return res;
 }
 
-CUresult gdev_cuda_locate_sdata(struct CUmod_st *mod)
-{
-	struct CUfunc_st *func;
-	struct gdev_kernel *k;
-	uint64_t addr = mod->sdata_addr;
-	uint32_t size = mod->sdata_size;
-	uint32_t offset = 0;
-	
-	gdev_list_for_each(func, &mod->func_list, list_entry) {
-		k = &func->kernel;
-		if (k->lmem_size > 0) {
-			k->lmem_addr = addr + offset;
-		}
-		offset += k->lmem_size;
-		if (offset > size)
-			return CUDA_ERROR_UNKNOWN;
-	}
-	
-	return CUDA_SUCCESS;
-}
-
 CUresult gdev_cuda_locate_code(struct CUmod_st *mod)
 {
 	struct CUfunc_st *func;
+	struct gdev_cuda_cmem_seg *seg;
 	struct gdev_kernel *k;
 	uint64_t addr = mod->code_addr;
 	uint32_t size = mod->code_size;
@@ -1134,6 +1523,12 @@ CUresult gdev_cuda_locate_code(struct CUmod_st *mod)
 		}
 	}
 
+	/* local constant memory segments are shared by kernels. */
+	gdev_list_for_each(seg, &mod->cmem_list, list_entry) {
+		seg->addr = addr + offset;
+		offset += seg->size;
+	}
+
 	gdev_list_for_each(func, &mod->func_list, list_entry) {
 		k = &func->kernel;
 		if (k->code_size > 0) {
@@ -1143,9 +1538,8 @@ CUresult gdev_cuda_locate_code(struct CUmod_st *mod)
 		if (offset > size)
 			return CUDA_ERROR_UNKNOWN;
 		for (i = 0; i < GDEV_NVIDIA_CONST_SEGMENT_MAX_COUNT; i++) {
-			if (k->cmem[i].size > 0) {
-				k->cmem[i].addr = addr + offset;
-				offset += k->cmem[i].size;
+			if (func->cmem_seg[i]) {
+				k->cmem[i].addr = func->cmem_seg[i]->addr;
 			}
 			else if (mod->cmem[i].size > 0) {
 				k->cmem[i].addr = mod->cmem[i].addr;
@@ -1162,6 +1556,7 @@ CUresult gdev_cuda_locate_code(struct CUmod_st *mod)
 CUresult gdev_cuda_memcpy_code(struct CUmod_st *mod, void *buf)
 {
 	struct CUfunc_st *func;
+	struct gdev_cuda_cmem_seg *seg;
 	struct gdev_kernel *k;
 	struct gdev_cuda_raw_func *f;
 	uint64_t addr = mod->code_addr;
@@ -1175,6 +1570,13 @@ CUresult gdev_cuda_memcpy_code(struct CUmod_st *mod, void *buf)
 		}
 	}
 
+	gdev_list_for_each(seg, &mod->cmem_list, list_entry) {
+		if (seg->buf) {
+			offset = seg->addr - addr;
+			gdev_io_memcpy(buf + offset, seg->buf, seg->raw_size);
+		}
+	}
+
 	gdev_list_for_each(func, &mod->func_list, list_entry) {
 		k = &func->kernel;
 		f = &func->raw_func;
@@ -1182,12 +1584,6 @@ CUresult gdev_cuda_memcpy_code(struct CUmod_st *mod, void *buf)
 			offset = k->code_addr - addr;
 			gdev_io_memcpy(buf + offset, f->code_buf, f->code_size);
 		}
-		for (i = 0; i < GDEV_NVIDIA_CONST_SEGMENT_MAX_COUNT; i++) {
-			if (f->cmem[i].buf) {
-				offset = k->cmem[i].addr - addr;
-				gdev_io_memcpy(buf + offset, f->cmem[i].buf, f->cmem[i].size);
-			}
-		}
 	}
 	
 	return CUDA_SUCCESS;
@@ -1213,6 +1609,11 @@ CUresult gdev_cuda_search_symbol
 {
 	struct gdev_cuda_const_symbol *cs;
 
+	if (!mod->symbol_loaded) {
+		if (!mod->bin || load_symbols(mod, mod->bin))
+			return CUDA_ERROR_NOT_FOUND;
+	}
+
 	gdev_list_for_each(cs, &mod->symbol_list, list_entry) {
 		if (strcmp(cs->name, name) == 0) {
 			*addr = mod->cmem[cs->idx].addr + cs->offset;
@@ -125,12 +125,26 @@ struct gdev_cuda_const_symbol {
 	struct gdev_list list_entry; /* entry to symbol list. */
 };
 
+/* constant memory segment in the module's code area. segments with the
+   same contents are shared by functions, and uploaded only once. */
+struct gdev_cuda_cmem_seg {
+	void *buf; /* host image, or NULL if the segment is just zero-filled. */
+	uint32_t raw_size; /* size of the host image. */
+	uint32_t size; /* size on the device. */
+	uint64_t addr;
+	int share; /* can be shared with other functions. */
+	int alloc; /* @buf has been allocated for this segment. */
+	struct gdev_list list_entry; /* entry to cmem_list. */
+};
+
 struct CUctx_st {
 	Ghandle gdev_handle;
 	struct gdev_list list_entry; /* entry to ctx_list. */
 	struct gdev_list sync_list;
 	struct gdev_list event_list;
 	struct gdev_cuda_info cuda_info;
+	uint64_t lmem_addr; /* local memory window shared by all kernels. */
+	uint32_t lmem_size;
 	int launch_id;
 	int minor;
 	unsigned int flags;
@@ -144,16 +158,18 @@ struct CUctx_st {
 struct CUmod_st {
 	file_t *fp;
 	void *bin;
+	size_t bin_size; /* size of the mapping, or zero if @bin is allocated. */
+	int symbol_loaded; /* symbol_list is parsed on first use. */
 	uint64_t code_addr;
 	uint32_t code_size;
-	uint64_t sdata_addr;
-	uint32_t sdata_size;
+	uint32_t sdata_size; /* local memory needed by the largest kernel. */
 	struct {
 		uint64_t addr;
 		uint32_t size;
 		uint32_t raw_size;
 		void *buf;
 	} cmem[GDEV_NVIDIA_CONST_SEGMENT_MAX_COUNT]; /* global to functions. */
+	struct gdev_list cmem_list; /* constant segments local to functions. */
 	uint32_t func_count;
 	uint32_t symbol_count;
 	struct gdev_list func_list;
@@ -165,6 +181,7 @@ struct CUmod_st {
 struct CUfunc_st {
 	struct gdev_kernel kernel;
 	struct gdev_cuda_raw_func raw_func;
+	struct gdev_cuda_cmem_seg *cmem_seg[GDEV_NVIDIA_CONST_SEGMENT_MAX_COUNT];
 	struct gdev_list list_entry;
 	struct CUmod_st *mod;
 };
@@ -191,11 +208,39 @@ struct CUstream_st {
 	struct gdev_list sync_list; /* for gdev_cuda_fence.list_entry */
 	struct gdev_list event_list;
 	int wait;
+	struct CUgraph_st *capture; /* graph being captured, if any. */
 };
 
 struct CUgraphicsResource_st {
 };
 
+struct CUgraphNode_st {
+	CUgraphNodeType type;
+	int idx; /* index in the graph. */
+	struct CUfunc_st *func;
+	struct gdev_kernel kernel; /* own copy, incl. param_buf. */
+	uint64_t dst_addr; /* in the address space of the context. */
+	uint64_t src_addr;
+	uint32_t size;
+	struct gdev_list list_entry; /* entry to node_list. */
+};
+
+struct CUgraph_st {
+	struct CUctx_st *ctx;
+	struct gdev_list node_list;
+	int node_count;
+	int invalidated; /* some work failed to be captured. */
+};
+
+struct CUgraphExec_st {
+	struct CUctx_st *ctx;
+	struct gdev_cmdbuf *cmdbuf; /* nodes encoded in advance. */
+	struct CUgraphNode_st *node; /* copies of the graph nodes. */
+	int *cmd; /* command index of each node in @cmdbuf. */
+	int node_count;
+	uint64_t lmem_addr; /* local memory window the nodes are encoded with. */
+};
+
 extern int gdev_initialized;
 extern int gdev_device_count;
 extern struct gdev_list gdev_ctx_list;
@@ -204,17 +249,32 @@ extern LOCK_T gdev_ctx_list_lock;
 CUresult gdev_cuda_load_cubin(struct CUmod_st *mod, const char *fname);
 CUresult gdev_cuda_load_cubin_file(struct CUmod_st *mod, const char *fname);
 CUresult gdev_cuda_load_cubin_image(struct CUmod_st *mod, const void *image);
+CUresult gdev_cuda_load_fatbin
+(struct CUmod_st *mod, const void *fatbin, uint64_t chipset);
+int gdev_cuda_is_fatbin(const void *image);
+int gdev_cuda_chipset_to_sm(uint64_t chipset);
 CUresult gdev_cuda_unload_cubin(struct CUmod_st *mod);
 CUresult gdev_cuda_construct_kernels
 (struct CUmod_st *mod, struct gdev_cuda_info *cuda_info);
 CUresult gdev_cuda_destruct_kernels(struct CUmod_st *mod);
-CUresult gdev_cuda_locate_sdata(struct CUmod_st *mod);
+CUresult gdev_cuda_reserve_lmem(struct CUctx_st *ctx, uint32_t size);
+void gdev_cuda_release_lmem(struct CUctx_st *ctx);
 CUresult gdev_cuda_locate_code(struct CUmod_st *mod);
 CUresult gdev_cuda_memcpy_code(struct CUmod_st *mod, void *buf);
 CUresult gdev_cuda_search_function
 (struct CUfunc_st **pptr, struct CUmod_st *mod, const char *name);
 CUresult gdev_cuda_search_symbol
 (uint64_t *addr, uint32_t *size, struct CUmod_st *mod, const char *name);
+CUresult gdev_cuda_set_kernel_params
+(struct CUfunc_st *func, 
+ unsigned int blockDimX, unsigned int blockDimY, unsigned int blockDimZ,
+ unsigned int sharedMemBytes, void **kernelParams);
+void gdev_cuda_setup_kernel
+(struct CUctx_st *ctx, struct CUfunc_st *func, int grid_width, int grid_height);
+CUresult gdev_cuda_graph_add_kernel
+(struct CUgraph_st *graph, struct CUfunc_st *func, int grid_width, int grid_height);
+CUresult gdev_cuda_graph_add_memcpy
+(struct CUgraph_st *graph, uint64_t dst_addr, uint64_t src_addr, uint32_t size);
 
 static inline uint32_t __gdev_cuda_align_pow2(uint32_t val, uint32_t pow)
 {
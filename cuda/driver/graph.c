@@ -0,0 +1,558 @@
+/*
+ * Copyright (C) 2011 Shinpei Kato
+ *
+ * Systems Research Lab, University of California at Santa Cruz
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "cuda.h"
+#include "gdev_cuda.h"
+#include "gdev_api.h"
+#include "gdev_list.h"
+#ifdef __KERNEL__
+#include <linux/errno.h>
+#else
+#include <sys/errno.h>
+#endif
+
+/* copy @kernel into @node. the parameter buffer is copied as well, as the
+   function may be launched with other parameters later. */
+static int __gdev_cuda_graph_set_kernel
+(struct CUgraphNode_st *node, struct gdev_kernel *kernel)
+{
+	uint32_t *param_buf = NULL;
+
+	if (kernel->param_size) {
+		if (!(param_buf = (uint32_t *)MALLOC(kernel->param_size)))
+			return -ENOMEM;
+		memcpy(param_buf, kernel->param_buf, kernel->param_size);
+	}
+
+	if (node->kernel.param_buf)
+		FREE(node->kernel.param_buf);
+	node->kernel = *kernel;
+	node->kernel.param_buf = param_buf;
+
+	return 0;
+}
+
+static struct CUgraphNode_st *__gdev_cuda_graph_new_node
+(struct CUgraph_st *graph, CUgraphNodeType type)
+{
+	struct CUgraphNode_st *node;
+
+	if (!(node = (struct CUgraphNode_st *)MALLOC(sizeof(*node))))
+		return NULL;
+	memset(node, 0, sizeof(*node));
+
+	node->type = type;
+	node->idx = graph->node_count;
+	gdev_list_init(&node->list_entry, node);
+
+	return node;
+}
+
+static void __gdev_cuda_graph_add_node
+(struct CUgraph_st *graph, struct CUgraphNode_st *node)
+{
+	gdev_list_add_tail(&node->list_entry, &graph->node_list);
+	graph->node_count++;
+}
+
+/**
+ * record the launch of @func on a @grid_width x @grid_height grid in 
+ * @graph. the block shape and the parameters must have been set already.
+ */
+CUresult gdev_cuda_graph_add_kernel
+(struct CUgraph_st *graph, struct CUfunc_st *func, int grid_width, int grid_height)
+{
+	struct CUgraphNode_st *node;
+
+	if (func->mod->ctx != graph->ctx) {
+		graph->invalidated = 1;
+		return CUDA_ERROR_INVALID_CONTEXT;
+	}
+	if (grid_width <= 0 || grid_height <= 0) {
+		graph->invalidated = 1;
+		return CUDA_ERROR_INVALID_VALUE;
+	}
+
+	if (!(node = __gdev_cuda_graph_new_node(graph, CU_GRAPH_NODE_TYPE_KERNEL)))
+		goto fail_node;
+
+	gdev_cuda_setup_kernel(graph->ctx, func, grid_width, grid_height);
+	node->func = func;
+	if (__gdev_cuda_graph_set_kernel(node, &func->kernel))
+		goto fail_kernel;
+
+	__gdev_cuda_graph_add_node(graph, node);
+
+	return CUDA_SUCCESS;
+
+fail_kernel:
+	FREE(node);
+fail_node:
+	graph->invalidated = 1;
+	return CUDA_ERROR_OUT_OF_MEMORY;
+}
+
+/**
+ * record the copy of data of @size from @src_addr to @dst_addr in @graph.
+ * the addresses are those of the context, i.e., host buffers must have 
+ * been translated already.
+ */
+CUresult gdev_cuda_graph_add_memcpy
+(struct CUgraph_st *graph, uint64_t dst_addr, uint64_t src_addr, uint32_t size)
+{
+	struct CUgraphNode_st *node;
+
+	if (!(node = __gdev_cuda_graph_new_node(graph, CU_GRAPH_NODE_TYPE_MEMCPY))) {
+		graph->invalidated = 1;
+		return CUDA_ERROR_OUT_OF_MEMORY;
+	}
+
+	node->dst_addr = dst_addr;
+	node->src_addr = src_addr;
+	node->size = size;
+
+	__gdev_cuda_graph_add_node(graph, node);
+
+	return CUDA_SUCCESS;
+}
+
+/**
+ * Destroys the specified graph. Executable graphs instantiated from it 
+ * are not affected.
+ *
+ * Parameters:
+ * hGraph - Graph to destroy
+ *
+ * Returns:
+ * CUDA_SUCCESS, CUDA_ERROR_DEINITIALIZED, CUDA_ERROR_NOT_INITIALIZED, 
+ * CUDA_ERROR_INVALID_VALUE
+ */
+CUresult cuGraphDestroy(CUgraph hGraph)
+{
+	struct CUgraph_st *graph = hGraph;
+	struct CUgraphNode_st *node;
+	struct gdev_list *p;
+
+	if (!gdev_initialized)
+		return CUDA_ERROR_NOT_INITIALIZED;
+	if (!graph)
+		return CUDA_ERROR_INVALID_VALUE;
+
+	while ((p = gdev_list_head(&graph->node_list))) {
+		gdev_list_del(p);
+		node = gdev_list_container(p);
+		if (node->kernel.param_buf)
+			FREE(node->kernel.param_buf);
+		FREE(node);
+	}
+
+	FREE(graph);
+
+	return CUDA_SUCCESS;
+}
+
+/**
+ * Returns a list of @hGraph's nodes in the order of capture. @nodes may be
+ * NULL, in which case this function will return the number of nodes in 
+ * @numNodes. Otherwise, @numNodes entries will be filled in. If @numNodes 
+ * is higher than the actual number of nodes, the remaining entries in 
+ * @nodes will be set to NULL, and the number of nodes actually obtained 
+ * will be returned in @numNodes.
+ *
+ * Parameters:
+ * hGraph - Graph to query
+ * nodes - Pointer to return the nodes
+ * numNodes - See description
+ *
+ * Returns:
+ * CUDA_SUCCESS, CUDA_ERROR_DEINITIALIZED, CUDA_ERROR_NOT_INITIALIZED, 
+ * CUDA_ERROR_INVALID_VALUE
+ */
+CUresult cuGraphGetNodes(CUgraph hGraph, CUgraphNode *nodes, size_t *numNodes)
+{
+	struct CUgraph_st *graph = hGraph;
+	struct CUgraphNode_st *node;
+	size_t i = 0, j;
+
+	if (!gdev_initialized)
+		return CUDA_ERROR_NOT_INITIALIZED;
+	if (!graph || !numNodes)
+		return CUDA_ERROR_INVALID_VALUE;
+
+	if (!nodes) {
+		*numNodes = graph->node_count;
+		return CUDA_SUCCESS;
+	}
+
+	gdev_list_for_each(node, &graph->node_list, list_entry) {
+		if (i == *numNodes)
+			break;
+		nodes[i++] = node;
+	}
+	for (j = i; j < *numNodes; j++)
+		nodes[j] = NULL;
+	*numNodes = i;
+
+	return CUDA_SUCCESS;
+}
+
+/**
+ * Returns the node type of @hNode in @type.
+ *
+ * Parameters:
+ * hNode - Node to query
+ * type - Pointer to return the node type
+ *
+ * Returns:
+ * CUDA_SUCCESS, CUDA_ERROR_DEINITIALIZED, CUDA_ERROR_NOT_INITIALIZED, 
+ * CUDA_ERROR_INVALID_VALUE
+ */
+CUresult cuGraphNodeGetType(CUgraphNode hNode, CUgraphNodeType *type)
+{
+	if (!gdev_initialized)
+		return CUDA_ERROR_NOT_INITIALIZED;
+	if (!hNode || !type)
+		return CUDA_ERROR_INVALID_VALUE;
+
+	*type = hNode->type;
+
+	return CUDA_SUCCESS;
+}
+
+/* append @node to the command buffer of @exec. */
+static int __gdev_cuda_graph_exec_add
+(struct CUgraphExec_st *exec, struct CUgraphNode_st *node)
+{
+	Ghandle handle = exec->ctx->gdev_handle;
+
+	switch (node->type) {
+	case CU_GRAPH_NODE_TYPE_KERNEL:
+		return gcmdbuf_launch(handle, exec->cmdbuf, &node->kernel);
+	case CU_GRAPH_NODE_TYPE_MEMCPY:
+		return gcmdbuf_memcpy(handle, exec->cmdbuf, node->dst_addr, node->src_addr, node->size);
+	}
+
+	return -EINVAL;
+}
+
+/**
+ * Instantiates @hGraph as an executable graph. The nodes are encoded into 
+ * a command buffer once here, so that the executable graph is launched 
+ * by a single submission, without going through every launch and copy.
+ * The executable graph is a snapshot of @hGraph: later changes to the 
+ * function state do not affect it.
+ *
+ * Parameters:
+ * phGraphExec - Returns instantiated graph
+ * hGraph - Graph to instantiate
+ * phErrorNode - In case of an instantiation error, this may be modified 
+ *               to indicate a node contributing to the error
+ * logBuffer - A character buffer to store diagnostic messages
+ * bufferSize - Size of the log buffer in bytes
+ *
+ * Returns:
+ * CUDA_SUCCESS, CUDA_ERROR_DEINITIALIZED, CUDA_ERROR_NOT_INITIALIZED, 
+ * CUDA_ERROR_INVALID_CONTEXT, CUDA_ERROR_INVALID_VALUE, 
+ * CUDA_ERROR_OUT_OF_MEMORY
+ */
+CUresult cuGraphInstantiate(CUgraphExec *phGraphExec, CUgraph hGraph, CUgraphNode *phErrorNode, char *logBuffer, size_t bufferSize)
+{
+	CUresult res;
+	struct CUctx_st *ctx;
+	struct CUgraph_st *graph = hGraph;
+	struct CUgraphExec_st *exec;
+	struct CUgraphNode_st *node;
+	int i, count;
+
+	if (!gdev_initialized)
+		return CUDA_ERROR_NOT_INITIALIZED;
+	if (!phGraphExec || !graph)
+		return CUDA_ERROR_INVALID_VALUE;
+
+	res = cuCtxGetCurrent(&ctx);
+	if (res != CUDA_SUCCESS)
+		return res;
+	if (ctx != graph->ctx)
+		return CUDA_ERROR_INVALID_CONTEXT;
+
+	if (logBuffer && bufferSize)
+		logBuffer[0] = 0; /* no diagnostic messages so far. */
+
+	count = graph->node_count;
+
+	if (!(exec = (struct CUgraphExec_st *)MALLOC(sizeof(*exec))))
+		goto fail_exec;
+	memset(exec, 0, sizeof(*exec));
+	exec->ctx = ctx;
+	exec->lmem_addr = ctx->lmem_addr;
+
+	if (count) {
+		exec->node = (struct CUgraphNode_st *)MALLOC(sizeof(*node) * count);
+		if (!exec->node)
+			goto fail_node;
+		memset(exec->node, 0, sizeof(*node) * count);
+		if (!(exec->cmd = (int *)MALLOC(sizeof(int) * count)))
+			goto fail_cmd;
+	}
+
+	if (!(exec->cmdbuf = gcmdbuf_alloc(ctx->gdev_handle)))
+		goto fail_cmdbuf;
+
+	gdev_list_for_each(node, &graph->node_list, list_entry) {
+		struct CUgraphNode_st *n = &exec->node[exec->node_count];
+		*n = *node;
+		n->kernel.param_buf = NULL;
+		if (node->type == CU_GRAPH_NODE_TYPE_KERNEL &&
+			__gdev_cuda_graph_set_kernel(n, &node->kernel))
+			goto fail_add;
+		/* the local memory window may have been moved since captured. */
+		n->kernel.lmem_addr = ctx->lmem_addr;
+		exec->node_count++;
+		if ((exec->cmd[n->idx] = __gdev_cuda_graph_exec_add(exec, n)) < 0)
+			goto fail_add;
+	}
+
+	*phGraphExec = exec;
+
+	return CUDA_SUCCESS;
+
+fail_add:
+	if (phErrorNode)
+		*phErrorNode = node;
+	gcmdbuf_free(ctx->gdev_handle, exec->cmdbuf);
+fail_cmdbuf:
+	for (i = 0; i < exec->node_count; i++) {
+		if (exec->node[i].kernel.param_buf)
+			FREE(exec->node[i].kernel.param_buf);
+	}
+	if (exec->cmd)
+		FREE(exec->cmd);
+fail_cmd:
+	if (exec->node)
+		FREE(exec->node);
+fail_node:
+	FREE(exec);
+fail_exec:
+	return CUDA_ERROR_OUT_OF_MEMORY;
+}
+
+/**
+ * Destroys the executable graph specified by @hGraphExec.
+ *
+ * Parameters:
+ * hGraphExec - Executable graph to destroy
+ *
+ * Returns:
+ * CUDA_SUCCESS, CUDA_ERROR_DEINITIALIZED, CUDA_ERROR_NOT_INITIALIZED, 
+ * CUDA_ERROR_INVALID_VALUE
+ */
+CUresult cuGraphExecDestroy(CUgraphExec hGraphExec)
+{
+	struct CUgraphExec_st *exec = hGraphExec;
+	int i;
+
+	if (!gdev_initialized)
+		return CUDA_ERROR_NOT_INITIALIZED;
+	if (!exec)
+		return CUDA_ERROR_INVALID_VALUE;
+
+	gcmdbuf_free(exec->ctx->gdev_handle, exec->cmdbuf);
+	for (i = 0; i < exec->node_count; i++) {
+		if (exec->node[i].kernel.param_buf)
+			FREE(exec->node[i].kernel.param_buf);
+	}
+	if (exec->cmd)
+		FREE(exec->cmd);
+	if (exec->node)
+		FREE(exec->node);
+	FREE(exec);
+
+	return CUDA_SUCCESS;
+}
+
+/**
+ * Sets the parameters of the kernel node @hNode in @hGraphExec, which is 
+ * instantiated from the graph containing @hNode. The function cannot be 
+ * changed. Only the command of this node is encoded again, and the graph 
+ * from which @hGraphExec is instantiated is not affected.
+ *
+ * Parameters:
+ * hGraphExec - The executable graph in which to set the specified node
+ * hNode - Kernel node from the graph from which graphExec was instantiated
+ * nodeParams - Updated parameters to set
+ *
+ * Returns:
+ * CUDA_SUCCESS, CUDA_ERROR_DEINITIALIZED, CUDA_ERROR_NOT_INITIALIZED, 
+ * CUDA_ERROR_INVALID_CONTEXT, CUDA_ERROR_INVALID_VALUE, 
+ * CUDA_ERROR_OUT_OF_MEMORY
+ */
+CUresult cuGraphExecKernelNodeSetParams(CUgraphExec hGraphExec, CUgraphNode hNode, const CUDA_KERNEL_NODE_PARAMS *nodeParams)
+{
+	CUresult res;
+	struct CUctx_st *ctx;
+	struct CUgraphExec_st *exec = hGraphExec;
+	struct CUgraphNode_st *node, new;
+	struct CUfunc_st *func, local;
+	const CUDA_KERNEL_NODE_PARAMS *p = nodeParams;
+	uint32_t size;
+
+	if (!gdev_initialized)
+		return CUDA_ERROR_NOT_INITIALIZED;
+	if (!exec || !hNode || !p)
+		return CUDA_ERROR_INVALID_VALUE;
+	if (hNode->idx >= exec->node_count)
+		return CUDA_ERROR_INVALID_VALUE;
+
+	res = cuCtxGetCurrent(&ctx);
+	if (res != CUDA_SUCCESS)
+		return res;
+	if (ctx != exec->ctx)
+		return CUDA_ERROR_INVALID_CONTEXT;
+
+	node = &exec->node[hNode->idx];
+	func = node->func;
+	if (node->type != CU_GRAPH_NODE_TYPE_KERNEL || p->func != func)
+		return CUDA_ERROR_INVALID_VALUE;
+	if (p->extra) {
+		GDEV_PRINT("cuGraphExecKernelNodeSetParams: Extra Parameters are not supported.\n");
+		return CUDA_ERROR_INVALID_VALUE;
+	}
+
+	if ((int)p->gridDimX <= 0 || (int)p->gridDimY <= 0)
+		return CUDA_ERROR_INVALID_VALUE;
+
+	/* marshal the parameters in the same manner as cuLaunchKernel(), but
+	   into a copy of the function, as the node does not change the state
+	   of the function used by other launches. */
+	local = *func;
+	size = func->raw_func.param_base + func->raw_func.param_size;
+	if (size) {
+		if (!(local.kernel.param_buf = (uint32_t *)MALLOC(size)))
+			return CUDA_ERROR_OUT_OF_MEMORY;
+		memcpy(local.kernel.param_buf, func->kernel.param_buf, func->raw_func.param_base);
+	}
+	local.kernel.param_size = size;
+
+	res = gdev_cuda_set_kernel_params
+		(&local, p->blockDimX, p->blockDimY, p->blockDimZ, p->sharedMemBytes, 
+		 p->kernelParams);
+	if (res != CUDA_SUCCESS)
+		goto end;
+	gdev_cuda_setup_kernel(ctx, &local, p->gridDimX, p->gridDimY);
+	local.kernel.lmem_addr = exec->lmem_addr;
+
+	/* the node is replaced only if the command is encoded again. */
+	new = *node;
+	new.kernel.param_buf = NULL;
+	if (__gdev_cuda_graph_set_kernel(&new, &local.kernel)) {
+		res = CUDA_ERROR_OUT_OF_MEMORY;
+		goto end;
+	}
+	if (gcmdbuf_update(ctx->gdev_handle, exec->cmdbuf, exec->cmd[node->idx], &new.kernel)) {
+		if (new.kernel.param_buf)
+			FREE(new.kernel.param_buf);
+		res = CUDA_ERROR_OUT_OF_MEMORY;
+		goto end;
+	}
+	if (node->kernel.param_buf)
+		FREE(node->kernel.param_buf);
+	*node = new;
+
+end:
+	if (local.kernel.param_buf)
+		FREE(local.kernel.param_buf);
+	return res;
+}
+
+/**
+ * Executes @hGraphExec. The whole graph is submitted at once, and its 
+ * completion is synchronized by cuCtxSynchronize(). Gdev supports only 
+ * the NULL stream so far.
+ *
+ * Parameters:
+ * hGraphExec - Executable graph to launch
+ * hStream - Stream in which to launch the graph
+ *
+ * Returns:
+ * CUDA_SUCCESS, CUDA_ERROR_DEINITIALIZED, CUDA_ERROR_NOT_INITIALIZED, 
+ * CUDA_ERROR_INVALID_CONTEXT, CUDA_ERROR_INVALID_HANDLE, 
+ * CUDA_ERROR_INVALID_VALUE, CUDA_ERROR_LAUNCH_FAILED, 
+ * CUDA_ERROR_LAUNCH_OUT_OF_RESOURCES
+ */
+CUresult cuGraphLaunch(CUgraphExec hGraphExec, CUstream hStream)
+{
+	CUresult res;
+	struct CUctx_st *ctx;
+	struct CUgraphExec_st *exec = hGraphExec;
+	struct CUgraphNode_st *node;
+	struct gdev_cuda_fence *fence;
+	Ghandle handle;
+	int i;
+
+	if (!gdev_initialized)
+		return CUDA_ERROR_NOT_INITIALIZED;
+	if (!exec)
+		return CUDA_ERROR_INVALID_VALUE;
+	if (hStream) {
+		GDEV_PRINT("cuGraphLaunch: Stream is not supported.\n");
+		return CUDA_ERROR_INVALID_HANDLE;
+	}
+
+	res = cuCtxGetCurrent(&ctx);
+	if (res != CUDA_SUCCESS)
+		return res;
+	if (ctx != exec->ctx)
+		return CUDA_ERROR_INVALID_CONTEXT;
+
+	handle = ctx->gdev_handle;
+
+	/* the local memory window may have been moved by a later module load:
+	   kernels must be encoded again with the new one. */
+	if (exec->lmem_addr != ctx->lmem_addr) {
+		for (i = 0; i < exec->node_count; i++) {
+			node = &exec->node[i];
+			if (node->type != CU_GRAPH_NODE_TYPE_KERNEL)
+				continue;
+			node->kernel.lmem_addr = ctx->lmem_addr;
+			if (gcmdbuf_update(handle, exec->cmdbuf, exec->cmd[i], &node->kernel))
+				return CUDA_ERROR_LAUNCH_OUT_OF_RESOURCES;
+		}
+		exec->lmem_addr = ctx->lmem_addr;
+	}
+
+	if (!(fence = (struct gdev_cuda_fence *)MALLOC(sizeof(*fence))))
+		return CUDA_ERROR_LAUNCH_OUT_OF_RESOURCES;
+
+	if (gcmdbuf_submit(handle, exec->cmdbuf, &fence->id)) {
+		FREE(fence);
+		return CUDA_ERROR_LAUNCH_FAILED;
+	}
+	fence->addr_ref = 0; /* no address to unreference later. */
+	gdev_list_init(&fence->list_entry, fence);
+	gdev_list_add(&fence->list_entry, &ctx->sync_list);
+
+	return CUDA_SUCCESS;
+}
@@ -309,6 +309,16 @@ CUresult cuMemcpyHtoDAsync_v2(CUdeviceptr dstDevice, const void *srcHost, unsign
 	if (ctx != stream->ctx)
 		return CUDA_ERROR_INVALID_CONTEXT;
 
+	/* record the copy in the graph instead of copying. */
+	if (stream->capture) {
+		/* pageable host memory cannot be copied from the graph. */
+		if (!(src_addr = gvirtget(ctx->gdev_handle, src_buf))) {
+			stream->capture->invalidated = 1;
+			return CUDA_ERROR_INVALID_VALUE;
+		}
+		return gdev_cuda_graph_add_memcpy(stream->capture, dst_addr, src_addr, size);
+	}
+
 	fence = (struct gdev_cuda_fence *)MALLOC(sizeof(*fence));
 	if (!fence)
 		return CUDA_ERROR_OUT_OF_MEMORY; /* this API shouldn't return it... */
@@ -446,6 +456,16 @@ CUresult cuMemcpyDtoHAsync_v2(void *dstHost, CUdeviceptr srcDevice, unsigned int
 	if (ctx != stream->ctx)
 		return CUDA_ERROR_INVALID_CONTEXT;
 
+	/* record the copy in the graph instead of copying. */
+	if (stream->capture) {
+		/* pageable host memory cannot be copied from the graph. */
+		if (!(dst_addr = gvirtget(ctx->gdev_handle, dst_buf))) {
+			stream->capture->invalidated = 1;
+			return CUDA_ERROR_INVALID_VALUE;
+		}
+		return gdev_cuda_graph_add_memcpy(stream->capture, dst_addr, src_addr, size);
+	}
+
 	fence = (struct gdev_cuda_fence *)MALLOC(sizeof(*fence));
 	if (!fence)
 		return CUDA_ERROR_OUT_OF_MEMORY; /* this API shouldn't return it... */
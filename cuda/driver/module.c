@@ -28,6 +28,96 @@
 #include "gdev_api.h"
 #include "gdev_cuda.h"
 
+/* set up the kernels of @mod, which has been loaded from a cubin, and 
+   upload their code and constant memory onto the device of @ctx. */
+static CUresult __gdev_cuda_setup_module(struct CUctx_st *ctx, struct CUmod_st *mod)
+{
+	CUresult res;
+	Ghandle handle = ctx->gdev_handle;
+	void *bnc_buf;
+	int dma = 1;
+
+	/* construct the kernels based on the cubin data. */
+	if ((res = gdev_cuda_construct_kernels(mod, &ctx->cuda_info)) 
+		!= CUDA_SUCCESS) {
+		GDEV_PRINT("Failed to construct kernels\n");
+		goto fail_construct_kernels;
+	}
+
+	/* make sure the context-wide local memory window is large enough
+	   for every kernel in this module. */
+	if ((res = gdev_cuda_reserve_lmem(ctx, mod->sdata_size)) 
+		!= CUDA_SUCCESS) {
+		GDEV_PRINT("Failed to allocate device memory for static data\n");
+		goto fail_reserve_lmem;
+	}
+
+	/* allocate code and constant memory. */
+	if (!(mod->code_addr = gmalloc(handle, mod->code_size))) {
+		GDEV_PRINT("Failed to allocate device memory for code\n");
+		res = CUDA_ERROR_OUT_OF_MEMORY;
+		goto fail_gmalloc_code;
+	}
+
+	/* locate the code information for each kernel. */
+	if ((res = gdev_cuda_locate_code(mod)) != CUDA_SUCCESS) {
+		GDEV_PRINT("Failed to locate code\n");
+		goto fail_locate_code;
+	}
+
+	/* the code image is assembled straight from the cubin into host DMA 
+	   memory, so that it is transferred to the device without another 
+	   copy through the bounce buffers of gmemcpy_to_device(). the heap 
+	   is used if DMA memory is not available. */
+	if (!(bnc_buf = gmalloc_dma(handle, mod->code_size))) {
+		dma = 0;
+		if (!(bnc_buf = MALLOC(mod->code_size))) {
+			GDEV_PRINT("Failed to allocate host memory for code\n");
+			res = CUDA_ERROR_OUT_OF_MEMORY;
+			goto fail_malloc_code;
+		}
+	}
+	memset(bnc_buf, 0, mod->code_size);
+
+	if ((res = gdev_cuda_memcpy_code(mod, bnc_buf)) 
+		!= CUDA_SUCCESS) {
+		GDEV_PRINT("Failed to copy code to host\n");
+		goto fail_memcpy_code;
+	}
+
+	/* transfer the code and constant memory onto the device. */
+	if (gmemcpy_to_device(handle, mod->code_addr, bnc_buf, mod->code_size)) {
+		GDEV_PRINT("Failed to copy code to device\n");
+		res = CUDA_ERROR_UNKNOWN;
+		goto fail_gmemcpy_code;
+	}
+
+	/* free the bounce buffer now. */
+	if (dma)
+		gfree_dma(handle, bnc_buf);
+	else
+		FREE(bnc_buf);
+
+	mod->ctx = ctx;
+
+	return CUDA_SUCCESS;
+
+fail_gmemcpy_code:
+fail_memcpy_code:
+	if (dma)
+		gfree_dma(handle, bnc_buf);
+	else
+		FREE(bnc_buf);
+fail_malloc_code:
+fail_locate_code:
+	gfree(handle, mod->code_addr);
+fail_gmalloc_code:
+fail_reserve_lmem:
+	gdev_cuda_destruct_kernels(mod);
+fail_construct_kernels:
+	return res;
+}
+
 /**
  * Takes a filename fname and loads the corresponding module module into the
  * current context. The CUDA driver API does not attempt to lazily allocate 
@@ -50,8 +140,6 @@ CUresult cuModuleLoad(CUmodule *module, const char *fname)
 	CUresult res;
 	struct CUmod_st *mod;
 	struct CUctx_st *ctx;
-	void *bnc_buf;
-	Ghandle handle;
 
 	if (!gdev_initialized)
 		return CUDA_ERROR_NOT_INITIALIZED;
@@ -62,8 +150,6 @@ CUresult cuModuleLoad(CUmodule *module, const char *fname)
 	if (res != CUDA_SUCCESS)
 		return res;
 
-	handle = ctx->gdev_handle;
-
 	if (!(mod = MALLOC(sizeof(*mod)))) {
 		GDEV_PRINT("Failed to allocate memory for module\n");
 		res = CUDA_ERROR_OUT_OF_MEMORY;
@@ -81,102 +167,90 @@ CUresult cuModuleLoad(CUmodule *module, const char *fname)
 	    if ((ctx->cuda_info.chipset & 0xf0) !=  0xe0 &&
 	    	(ctx->cuda_info.chipset & 0xf0) !=  0xf0 ) { /* fix this */
 		res = CUDA_ERROR_INVALID_SOURCE;
-		goto fail_load_cubin;
+		goto fail_check_arch;
 	    }
 	}
-	/* construct the kernels based on the cubin data. */
-	if ((res = gdev_cuda_construct_kernels(mod, &ctx->cuda_info)) 
-		!= CUDA_SUCCESS) {
-		GDEV_PRINT("Failed to construct kernels\n");
-		goto fail_construct_kernels;
-	}
 
-	/* allocate (local) static data memory. */
-	if (mod->sdata_size > 0) {
-		if (!(mod->sdata_addr = gmalloc(handle, mod->sdata_size))) {
-			GDEV_PRINT("Failed to allocate device memory for static data\n");
-			res = CUDA_ERROR_OUT_OF_MEMORY;
-			goto fail_gmalloc_sdata;
-		}
-	}
+	if ((res = __gdev_cuda_setup_module(ctx, mod)) != CUDA_SUCCESS)
+		goto fail_setup_module;
 
-	/* locate the static data information for each kernel. */
-	if ((res = gdev_cuda_locate_sdata(mod)) != CUDA_SUCCESS) {
-		GDEV_PRINT("Failed to locate static data\n");
-		goto fail_locate_sdata;
-	}
+	*module = mod;
 
-	/* allocate code and constant memory. */
-	if (!(mod->code_addr = gmalloc(handle, mod->code_size))) {
-		GDEV_PRINT("Failed to allocate device memory for code\n");
-		goto fail_gmalloc_code;
-	}
+	return CUDA_SUCCESS;
 
-	/* locate the code information for each kernel. */
-	if ((res = gdev_cuda_locate_code(mod)) != CUDA_SUCCESS) {
-		GDEV_PRINT("Failed to locate code\n");
-		goto fail_locate_code;
-	}
+fail_setup_module:
+fail_check_arch:
+	gdev_cuda_unload_cubin(mod);
+fail_load_cubin:
+	FREE(mod);
+fail_malloc_mod:
+	*module = NULL;
+	return res;
+}
+
+/**
+ * Takes a pointer fatCubin and loads the corresponding module module into 
+ * the current context. The pointer represents a fat binary object, which is
+ * a collection of different cubin files, all representing the same device 
+ * code, but compiled and optimized for different architectures. The image
+ * that best fits the device is selected: a cubin of the same major compute
+ * capability first, and PTX to be compiled just in time otherwise.
+ *
+ * Parameters:
+ * module - Returned module
+ * fatCubin - Fat binary to load
+ *
+ * Returns:
+ * CUDA_SUCCESS, CUDA_ERROR_DEINITIALIZED, CUDA_ERROR_NOT_INITIALIZED, 
+ * CUDA_ERROR_INVALID_CONTEXT, CUDA_ERROR_INVALID_VALUE, CUDA_ERROR_NOT_FOUND, 
+ * CUDA_ERROR_OUT_OF_MEMORY, CUDA_ERROR_NO_BINARY_FOR_GPU, 
+ * CUDA_ERROR_INVALID_IMAGE 
+ */
+CUresult cuModuleLoadFatBinary(CUmodule *module, const void *fatCubin)
+{
+	CUresult res;
+	struct CUmod_st *mod;
+	struct CUctx_st *ctx;
 
+	if (!gdev_initialized)
+		return CUDA_ERROR_NOT_INITIALIZED;
+	if (!module || !fatCubin)
+		return CUDA_ERROR_INVALID_VALUE;
 
-	/* the following malloc() and memcpy() for bounce buffer could be 
-	   removed if we use gmalloc_host() here, but they are just an easy 
-	   implementation, and don't really affect performance anyway. */
-	if (!(bnc_buf = MALLOC(mod->code_size))) {
-		GDEV_PRINT("Failed to allocate host memory for code\n");
-		res = CUDA_ERROR_OUT_OF_MEMORY;
-		goto fail_malloc_code;
-	}
-	memset(bnc_buf, 0, mod->code_size);
+	res = cuCtxGetCurrent(&ctx);
+	if (res != CUDA_SUCCESS)
+		return res;
 
-	if ((res = gdev_cuda_memcpy_code(mod, bnc_buf)) 
-		!= CUDA_SUCCESS) {
-		GDEV_PRINT("Failed to copy code to host\n");
-		goto fail_memcpy_code;
+	if (!(mod = MALLOC(sizeof(*mod)))) {
+		GDEV_PRINT("Failed to allocate memory for module\n");
+		res = CUDA_ERROR_OUT_OF_MEMORY;
+		goto fail_malloc_mod;
 	}
 
-	/* transfer the code and constant memory onto the device. */
-	if (gmemcpy_to_device(handle, mod->code_addr, bnc_buf, mod->code_size)) {
-		GDEV_PRINT("Failed to copy code to device\n");
-		res = CUDA_ERROR_UNKNOWN;
-		goto fail_gmemcpy_code;
+	/* load the image for this device out of the fat binary. the image
+	   has been matched with the chipset, so the arch is not checked. */
+	res = gdev_cuda_load_fatbin(mod, fatCubin, ctx->cuda_info.chipset);
+	if (res != CUDA_SUCCESS) {
+		GDEV_PRINT("Failed to load fat binary\n");
+		goto fail_load_fatbin;
 	}
 
-	/* free the bounce buffer now. */
-	FREE(bnc_buf);
+	if ((res = __gdev_cuda_setup_module(ctx, mod)) != CUDA_SUCCESS)
+		goto fail_setup_module;
 
-	mod->ctx = ctx;
 	*module = mod;
 
 	return CUDA_SUCCESS;
 
-fail_gmemcpy_code:
-fail_memcpy_code:
-	FREE(bnc_buf);
-fail_malloc_code:
-fail_locate_code:
-	gfree(handle, mod->code_addr);
-fail_gmalloc_code:
-fail_locate_sdata:
-	if (mod->sdata_size > 0)
-		gfree(handle, mod->sdata_addr);
-fail_gmalloc_sdata:
-	gdev_cuda_destruct_kernels(mod);
-fail_construct_kernels:
+fail_setup_module:
 	gdev_cuda_unload_cubin(mod);
-fail_load_cubin:
+fail_load_fatbin:
 	FREE(mod);
 fail_malloc_mod:
 	*module = NULL;
 	return res;
 }
 
-CUresult cuModuleLoadFatBinary(CUmodule *module, const void *fatCubin)
-{
-	GDEV_PRINT("cuModuleLoadFatBinary: Not Implemented Yet\n");
-	return CUDA_SUCCESS;
-}
-
 /**
  * Unloads a module hmod from the current context.
  *
@@ -205,9 +279,9 @@ CUresult cuModuleUnload(CUmodule hmod)
 
 	handle = ctx->gdev_handle;
 
+	/* the local memory window belongs to the context and is released
+	   when the context is destroyed. */
 	gfree(handle, mod->code_addr);
-	if (mod->sdata_size > 0)
-		gfree(handle, mod->sdata_addr);
 
 	if ((res = gdev_cuda_destruct_kernels(mod)) != CUDA_SUCCESS)
 		return res;
@@ -263,20 +337,20 @@ CUresult cuModuleLoadData(CUmodule *module, const void *image)
 	CUresult res;
 	struct CUmod_st *mod;
 	struct CUctx_st *ctx;
-	void *bnc_buf;
-	Ghandle handle;
 
 	if (!gdev_initialized)
 		return CUDA_ERROR_NOT_INITIALIZED;
 	if (!module || !image)
 		return CUDA_ERROR_INVALID_VALUE;
 
+	/* the image may also be a fat binary embedded by nvcc. */
+	if (gdev_cuda_is_fatbin(image))
+		return cuModuleLoadFatBinary(module, image);
+
 	res = cuCtxGetCurrent(&ctx);
 	if (res != CUDA_SUCCESS)
 		return res;
 
-	handle = ctx->gdev_handle;
-
 	if (!(mod = MALLOC(sizeof(*mod)))) {
 		GDEV_PRINT("Failed to allocate memory for module\n");
 		res = CUDA_ERROR_OUT_OF_MEMORY;
@@ -292,88 +366,18 @@ CUresult cuModuleLoadData(CUmodule *module, const void *image)
 	/* check compatibility of code and device. */
 	if ((ctx->cuda_info.chipset & 0xf0) != mod->arch) {
 		res = CUDA_ERROR_INVALID_SOURCE;
-		goto fail_load_cubin;
-	}
-
-	/* construct the kernels based on the cubin data. */
-	if ((res = gdev_cuda_construct_kernels(mod, &ctx->cuda_info)) 
-		!= CUDA_SUCCESS) {
-		GDEV_PRINT("Failed to construct kernels\n");
-		goto fail_construct_kernels;
-	}
-
-	/* allocate (local) static data memory. */
-	if (mod->sdata_size > 0) {
-		if (!(mod->sdata_addr = gmalloc(handle, mod->sdata_size))) {
-			GDEV_PRINT("Failed to allocate device memory for static data\n");
-			res = CUDA_ERROR_OUT_OF_MEMORY;
-			goto fail_gmalloc_sdata;
-		}
-	}
-
-	/* locate the static data information for each kernel. */
-	if ((res = gdev_cuda_locate_sdata(mod)) != CUDA_SUCCESS) {
-		GDEV_PRINT("Failed to locate static data\n");
-		goto fail_locate_sdata;
-	}
-
-	/* allocate code and constant memory. */
-	if (!(mod->code_addr = gmalloc(handle, mod->code_size))) {
-		GDEV_PRINT("Failed to allocate device memory for code\n");
-		goto fail_gmalloc_code;
-	}
-
-	/* locate the code information for each kernel. */
-	if ((res = gdev_cuda_locate_code(mod)) != CUDA_SUCCESS) {
-		GDEV_PRINT("Failed to locate code\n");
-		goto fail_locate_code;
-	}
-
-
-	/* the following malloc() and memcpy() for bounce buffer could be 
-	   removed if we use gmalloc_host() here, but they are just an easy 
-	   implementation, and don't really affect performance anyway. */
-	if (!(bnc_buf = MALLOC(mod->code_size))) {
-		GDEV_PRINT("Failed to allocate host memory for code\n");
-		res = CUDA_ERROR_OUT_OF_MEMORY;
-		goto fail_malloc_code;
-	}
-	memset(bnc_buf, 0, mod->code_size);
-
-	if ((res = gdev_cuda_memcpy_code(mod, bnc_buf)) 
-		!= CUDA_SUCCESS) {
-		GDEV_PRINT("Failed to copy code to host\n");
-		goto fail_memcpy_code;
-	}
-
-	/* transfer the code and constant memory onto the device. */
-	if (gmemcpy_to_device(handle, mod->code_addr, bnc_buf, mod->code_size)) {
-		GDEV_PRINT("Failed to copy code to device\n");
-		res = CUDA_ERROR_UNKNOWN;
-		goto fail_gmemcpy_code;
+		goto fail_check_arch;
 	}
 
-	/* free the bounce buffer now. */
-	FREE(bnc_buf);
+	if ((res = __gdev_cuda_setup_module(ctx, mod)) != CUDA_SUCCESS)
+		goto fail_setup_module;
 
-	mod->ctx = ctx;
 	*module = mod;
 
 	return CUDA_SUCCESS;
 
-fail_gmemcpy_code:
-fail_memcpy_code:
-	FREE(bnc_buf);
-fail_malloc_code:
-fail_locate_code:
-	gfree(handle, mod->code_addr);
-fail_gmalloc_code:
-fail_locate_sdata:
-	if (mod->sdata_size > 0)
-		gfree(handle, mod->sdata_addr);
-fail_gmalloc_sdata:
-	gdev_cuda_destruct_kernels(mod);
-fail_construct_kernels:
+fail_setup_module:
+fail_check_arch:
 	gdev_cuda_unload_cubin(mod);
 fail_load_cubin:
 	FREE(mod);
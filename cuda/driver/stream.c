@@ -76,6 +76,7 @@ CUresult cuStreamCreate(CUstream *phStream, unsigned int Flags)
 	gdev_list_init(&stream->sync_list, NULL);	
 	gdev_list_init(&stream->event_list, NULL);	
 	stream->wait = 0;
+	stream->capture = NULL;
 
 	*phStream = stream;
 
@@ -117,6 +118,12 @@ CUresult cuStreamDestroy(CUstream hStream)
 	if (!stream)
 		return CUDA_ERROR_INVALID_VALUE;
 
+	/* the graph being captured is just discarded. */
+	if (stream->capture) {
+		cuGraphDestroy(stream->capture);
+		stream->capture = NULL;
+	}
+
 	/* synchronize with the stream before destroying it. */
 	cuStreamSynchronize(stream);
 
@@ -168,6 +175,8 @@ CUresult cuStreamSynchronize(CUstream hStream)
 		return res;
 	if (ctx != stream->ctx)
 		return CUDA_ERROR_INVALID_CONTEXT;
+	if (stream->capture)
+		return CUDA_ERROR_STREAM_CAPTURE_UNSUPPORTED;
 
 	if (gdev_list_empty(&stream->sync_list))
 		return CUDA_SUCCESS;
@@ -273,3 +282,139 @@ CUresult cuStreamWaitEvent(CUstream hStream, CUevent hEvent, unsigned int Flags)
 
 	return res;
 }
+
+/**
+ * Begin graph capture on @hStream. While capturing, kernel launches and 
+ * asynchronous memory copies issued into the stream are not executed but
+ * recorded into a graph, which is returned by cuStreamEndCapture(). The 
+ * graph can be instantiated and launched many times afterward.
+ *
+ * Parameters:
+ * hStream - Stream in which to initiate capture
+ *
+ * Returns:
+ * CUDA_SUCCESS, CUDA_ERROR_DEINITIALIZED, CUDA_ERROR_NOT_INITIALIZED, 
+ * CUDA_ERROR_INVALID_CONTEXT, CUDA_ERROR_INVALID_HANDLE, 
+ * CUDA_ERROR_INVALID_VALUE, CUDA_ERROR_OUT_OF_MEMORY
+ */
+CUresult cuStreamBeginCapture(CUstream hStream)
+{
+	CUresult res;
+	struct CUctx_st *ctx;
+	struct CUstream_st *stream = hStream;
+	struct CUgraph_st *graph;
+
+	if (!gdev_initialized)
+		return CUDA_ERROR_NOT_INITIALIZED;
+	/* the legacy stream cannot be captured. */
+	if (!stream)
+		return CUDA_ERROR_INVALID_HANDLE;
+
+	res = cuCtxGetCurrent(&ctx);
+	if (res != CUDA_SUCCESS)
+		return res;
+	if (ctx != stream->ctx)
+		return CUDA_ERROR_INVALID_CONTEXT;
+	if (stream->capture)
+		return CUDA_ERROR_INVALID_VALUE;
+
+	if (!(graph = (struct CUgraph_st *)MALLOC(sizeof(*graph))))
+		return CUDA_ERROR_OUT_OF_MEMORY;
+
+	graph->ctx = ctx;
+	gdev_list_init(&graph->node_list, NULL);
+	graph->node_count = 0;
+	graph->invalidated = 0;
+
+	stream->capture = graph;
+
+	return CUDA_SUCCESS;
+}
+
+/**
+ * End capture on @hStream, returning the captured graph via @phGraph. If 
+ * some work could not be captured, the graph is discarded and NULL is 
+ * returned.
+ *
+ * Parameters:
+ * hStream - Stream to query
+ * phGraph - The captured graph
+ *
+ * Returns:
+ * CUDA_SUCCESS, CUDA_ERROR_DEINITIALIZED, CUDA_ERROR_NOT_INITIALIZED, 
+ * CUDA_ERROR_INVALID_CONTEXT, CUDA_ERROR_INVALID_HANDLE, 
+ * CUDA_ERROR_INVALID_VALUE, CUDA_ERROR_STREAM_CAPTURE_INVALIDATED
+ */
+CUresult cuStreamEndCapture(CUstream hStream, CUgraph *phGraph)
+{
+	CUresult res;
+	struct CUctx_st *ctx;
+	struct CUstream_st *stream = hStream;
+	struct CUgraph_st *graph;
+
+	if (!gdev_initialized)
+		return CUDA_ERROR_NOT_INITIALIZED;
+	if (!stream)
+		return CUDA_ERROR_INVALID_HANDLE;
+	if (!phGraph)
+		return CUDA_ERROR_INVALID_VALUE;
+
+	res = cuCtxGetCurrent(&ctx);
+	if (res != CUDA_SUCCESS)
+		return res;
+	if (ctx != stream->ctx)
+		return CUDA_ERROR_INVALID_CONTEXT;
+	if (!stream->capture)
+		return CUDA_ERROR_INVALID_VALUE;
+
+	graph = stream->capture;
+	stream->capture = NULL;
+
+	if (graph->invalidated) {
+		cuGraphDestroy(graph);
+		*phGraph = NULL;
+		return CUDA_ERROR_STREAM_CAPTURE_INVALIDATED;
+	}
+
+	*phGraph = graph;
+
+	return CUDA_SUCCESS;
+}
+
+/**
+ * Return the capture status of @hStream via @captureStatus.
+ *
+ * Parameters:
+ * hStream - Stream to query
+ * captureStatus - Returns the stream's capture status
+ *
+ * Returns:
+ * CUDA_SUCCESS, CUDA_ERROR_DEINITIALIZED, CUDA_ERROR_NOT_INITIALIZED, 
+ * CUDA_ERROR_INVALID_CONTEXT, CUDA_ERROR_INVALID_VALUE
+ */
+CUresult cuStreamIsCapturing(CUstream hStream, CUstreamCaptureStatus *captureStatus)
+{
+	CUresult res;
+	struct CUctx_st *ctx;
+	struct CUstream_st *stream = hStream;
+
+	if (!gdev_initialized)
+		return CUDA_ERROR_NOT_INITIALIZED;
+	if (!captureStatus)
+		return CUDA_ERROR_INVALID_VALUE;
+
+	res = cuCtxGetCurrent(&ctx);
+	if (res != CUDA_SUCCESS)
+		return res;
+	if (stream && ctx != stream->ctx)
+		return CUDA_ERROR_INVALID_CONTEXT;
+
+	if (!stream || !stream->capture)
+		*captureStatus = CU_STREAM_CAPTURE_STATUS_NONE;
+	else if (stream->capture->invalidated)
+		*captureStatus = CU_STREAM_CAPTURE_STATUS_INVALIDATED;
+	else
+		*captureStatus = CU_STREAM_CAPTURE_STATUS_ACTIVE;
+
+	return CUDA_SUCCESS;
+}
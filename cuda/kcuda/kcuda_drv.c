@@ -119,9 +119,25 @@ EXPORT_SYMBOL(cuStreamDestroy);
 EXPORT_SYMBOL(cuStreamQuery);
 EXPORT_SYMBOL(cuStreamSynchronize);
 EXPORT_SYMBOL(cuStreamWaitEvent);
+EXPORT_SYMBOL(cuStreamBeginCapture);
+EXPORT_SYMBOL(cuStreamEndCapture);
+EXPORT_SYMBOL(cuStreamIsCapturing);
+
+/* Graph Management */
+EXPORT_SYMBOL(cuGraphDestroy);
+EXPORT_SYMBOL(cuGraphGetNodes);
+EXPORT_SYMBOL(cuGraphNodeGetType);
+EXPORT_SYMBOL(cuGraphInstantiate);
+EXPORT_SYMBOL(cuGraphExecDestroy);
+EXPORT_SYMBOL(cuGraphExecKernelNodeSetParams);
+EXPORT_SYMBOL(cuGraphLaunch);
 
 /* Inter-Process Communication (IPC) - Gdev extension */
 EXPORT_SYMBOL(cuShmGet);
 EXPORT_SYMBOL(cuShmAt);
 EXPORT_SYMBOL(cuShmDt);
 EXPORT_SYMBOL(cuShmCtl);
+
+/* Grid slicing - Gdev extension */
+EXPORT_SYMBOL(cuFuncSetSliceParam);
+EXPORT_SYMBOL(cuCtxSetSliceSize);
@@ -342,6 +342,129 @@ int glaunch(struct gdev_handle *h, struct gdev_kernel *kernel, uint32_t *id)
 	return ioctl(fd, GDEV_IOCTL_GLAUNCH, &launch);
 }
 
+/* commands cannot be encoded in advance through the ioctl interface, so 
+   they are just recorded here and issued one by one on submit. */
+struct gdev_cmdbuf {
+	struct gdev_cmd {
+		struct gdev_kernel kernel;
+		uint64_t dst_addr;
+		uint64_t src_addr;
+		uint64_t size;
+	} *cmd;
+	int count;
+	int max_count;
+};
+
+struct gdev_cmdbuf *gcmdbuf_alloc(struct gdev_handle *h)
+{
+	struct gdev_cmdbuf *cb;
+
+	if (!(cb = malloc(sizeof(*cb))))
+		return NULL;
+	memset(cb, 0, sizeof(*cb));
+
+	return cb;
+}
+
+int gcmdbuf_free(struct gdev_handle *h, struct gdev_cmdbuf *cb)
+{
+	int i;
+
+	for (i = 0; i < cb->count; i++)
+		free(cb->cmd[i].kernel.param_buf);
+	free(cb->cmd);
+	free(cb);
+
+	return 0;
+}
+
+static struct gdev_cmd *__gcmdbuf_add(struct gdev_cmdbuf *cb)
+{
+	struct gdev_cmd *cmd;
+
+	if (cb->count == cb->max_count) {
+		int max_count = cb->max_count ? cb->max_count * 2 : 16;
+		if (!(cmd = realloc(cb->cmd, sizeof(*cmd) * max_count)))
+			return NULL;
+		cb->cmd = cmd;
+		cb->max_count = max_count;
+	}
+
+	cmd = &cb->cmd[cb->count];
+	memset(cmd, 0, sizeof(*cmd));
+
+	return cmd;
+}
+
+static int __gcmdbuf_set_kernel(struct gdev_cmd *cmd, struct gdev_kernel *kernel)
+{
+	uint32_t *param_buf = NULL;
+
+	if (kernel->param_size) {
+		if (!(param_buf = malloc(kernel->param_size)))
+			return -ENOMEM;
+		memcpy(param_buf, kernel->param_buf, kernel->param_size);
+	}
+
+	free(cmd->kernel.param_buf);
+	cmd->kernel = *kernel;
+	cmd->kernel.param_buf = param_buf;
+
+	return 0;
+}
+
+int gcmdbuf_launch(struct gdev_handle *h, struct gdev_cmdbuf *cb, struct gdev_kernel *kernel)
+{
+	struct gdev_cmd *cmd;
+
+	if (!(cmd = __gcmdbuf_add(cb)))
+		return -ENOMEM;
+	if (__gcmdbuf_set_kernel(cmd, kernel))
+		return -ENOMEM;
+
+	return cb->count++;
+}
+
+int gcmdbuf_memcpy(struct gdev_handle *h, struct gdev_cmdbuf *cb, uint64_t dst_addr, uint64_t src_addr, uint64_t size)
+{
+	struct gdev_cmd *cmd;
+
+	if (!(cmd = __gcmdbuf_add(cb)))
+		return -ENOMEM;
+	cmd->dst_addr = dst_addr;
+	cmd->src_addr = src_addr;
+	cmd->size = size;
+
+	return cb->count++;
+}
+
+int gcmdbuf_update(struct gdev_handle *h, struct gdev_cmdbuf *cb, int index, struct gdev_kernel *kernel)
+{
+	if (index < 0 || index >= cb->count || cb->cmd[index].size)
+		return -EINVAL;
+
+	return __gcmdbuf_set_kernel(&cb->cmd[index], kernel);
+}
+
+int gcmdbuf_submit(struct gdev_handle *h, struct gdev_cmdbuf *cb, uint32_t *id)
+{
+	struct gdev_cmd *cmd;
+	int i, ret;
+
+	*id = 0;
+	for (i = 0; i < cb->count; i++) {
+		cmd = &cb->cmd[i];
+		if (cmd->size)
+			ret = gmemcpy_async(h, cmd->dst_addr, cmd->src_addr, cmd->size, id);
+		else
+			ret = glaunch(h, &cmd->kernel, id);
+		if (ret)
+			return ret;
+	}
+
+	return 0;
+}
+
 int gsync(struct gdev_handle *h, uint32_t id, struct gdev_time *timeout)
 {
 	struct gdev_ioctl_sync sync;
@@ -387,6 +510,28 @@ int gtune(struct gdev_handle *h, uint32_t type, uint32_t value)
 	return 0;
 }
 
+int gwriteset(struct gdev_handle *h, uint64_t addr, uint64_t size)
+{
+	struct gdev_ioctl_mem m;
+	int fd = h->fd;
+
+	m.addr = addr;
+	m.size = size;
+
+	return ioctl(fd, GDEV_IOCTL_GWRITESET, &m);
+}
+
+int guseset(struct gdev_handle *h, uint64_t addr, uint64_t size)
+{
+	struct gdev_ioctl_mem m;
+	int fd = h->fd;
+
+	m.addr = addr;
+	m.size = size;
+
+	return ioctl(fd, GDEV_IOCTL_GUSESET, &m);
+}
+
 int gshmget(struct gdev_handle *h, int key, uint64_t size, int flags)
 {
 	struct gdev_ioctl_shm s;
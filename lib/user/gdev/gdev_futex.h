@@ -0,0 +1,271 @@
+/*
+* Copyright (C) Shinpei Kato
+* All Rights Reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice (including the next
+* paragraph) shall be included in all copies or substantial portions of the
+* Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+* OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+* ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+* OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef __GDEV_FUTEX_H__
+#define __GDEV_FUTEX_H__
+
+#include <errno.h>
+#include <limits.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+
+/* how long a waiter sleeps before checking if the lock holder is alive. */
+#define GDEV_FUTEX_TIMEOUT_NS 100000000 /* 100ms */
+
+/* a lock placed in the shared memory. not process-private futexes are used,
+   since the memory is mapped at different addresses in each process. */
+struct gdev_futex_lock {
+	int futex; /* 0: unlocked, 1: locked, 2: locked and contended */
+	int owner; /* thread ID of the holder, 0 if unknown */
+	int nested; /* times the holder has locked it again */
+};
+
+static inline int __gdev_futex_wait(int *addr, int val, const struct timespec *timeout)
+{
+	return syscall(SYS_futex, addr, FUTEX_WAIT, val, timeout, NULL, 0);
+}
+
+static inline int __gdev_futex_wake(int *addr, int count)
+{
+	return syscall(SYS_futex, addr, FUTEX_WAKE, count, NULL, NULL, 0);
+}
+
+static inline int __gdev_gettid(void)
+{
+	return syscall(SYS_gettid);
+}
+
+/* words changed by atomic operations are read atomically as well. */
+static inline int __gdev_futex_read(int *addr)
+{
+	return __atomic_load_n(addr, __ATOMIC_ACQUIRE);
+}
+
+static inline void gdev_futex_lock_init(struct gdev_futex_lock *p)
+{
+	p->futex = 0;
+	p->owner = 0;
+	p->nested = 0;
+}
+
+/* take over the lock if its holder has died, as robust mutexes do. */
+static inline int __gdev_futex_lock_recover(struct gdev_futex_lock *p, int tid)
+{
+	int owner = __gdev_futex_read(&p->owner);
+
+	if (!owner || kill(owner, 0) == 0 || errno != ESRCH)
+		return 0;
+	if (!__sync_bool_compare_and_swap(&p->owner, owner, tid))
+		return 0;
+	/* other waiters may be sleeping, so leave it contended. */
+	__atomic_store_n(&p->futex, 2, __ATOMIC_RELEASE);
+	return 1;
+}
+
+static inline void gdev_futex_lock(struct gdev_futex_lock *p)
+{
+	struct timespec timeout = {0, GDEV_FUTEX_TIMEOUT_NS};
+	int tid = __gdev_gettid();
+	int c;
+
+	c = __sync_val_compare_and_swap(&p->futex, 0, 1);
+	if (c != 0) {
+		if (c != 2)
+			c = __sync_lock_test_and_set(&p->futex, 2);
+		while (c != 0) {
+			if (__gdev_futex_wait(&p->futex, 2, &timeout) < 0 &&
+				errno == ETIMEDOUT && __gdev_futex_lock_recover(p, tid))
+				break;
+			c = __sync_lock_test_and_set(&p->futex, 2);
+		}
+	}
+	__atomic_store_n(&p->owner, tid, __ATOMIC_RELAXED);
+	p->nested = 0;
+}
+
+/* the lock is released by an atomic decrement, which is a full barrier, 
+   so that nothing done under the lock is seen after it is released. */
+static inline void gdev_futex_unlock(struct gdev_futex_lock *p)
+{
+	__atomic_store_n(&p->owner, 0, __ATOMIC_RELAXED);
+	if (__sync_fetch_and_sub(&p->futex, 1) != 1) {
+		__sync_lock_release(&p->futex);
+		__gdev_futex_wake(&p->futex, 1);
+	}
+}
+
+/* the same lock may be taken again by its holder, e.g., when the virtual
+   device is the physical device itself. */
+static inline void gdev_futex_lock_nested(struct gdev_futex_lock *p)
+{
+	if (__gdev_futex_read(&p->owner) == __gdev_gettid())
+		p->nested++;
+	else
+		gdev_futex_lock(p);
+}
+
+static inline void gdev_futex_unlock_nested(struct gdev_futex_lock *p)
+{
+	if (p->nested)
+		p->nested--;
+	else
+		gdev_futex_unlock(p);
+}
+
+/* a counting semaphore for sleep and wakeup: wakeups posted before the
+   sleep are not lost. */
+static inline void gdev_futex_sleep(int *wakeups)
+{
+	int c;
+
+	for (;;) {
+		c = __gdev_futex_read(wakeups);
+		if (c > 0) {
+			if (__sync_bool_compare_and_swap(wakeups, c, c - 1))
+				return;
+		}
+		else
+			__gdev_futex_wait(wakeups, c, NULL);
+	}
+}
+
+static inline void gdev_futex_wakeup(int *wakeups)
+{
+	__sync_fetch_and_add(wakeups, 1);
+	__gdev_futex_wake(wakeups, 1);
+}
+
+/* an event that waiters wait for with a timeout, e.g., an arrival of
+   another task. the sequence is read before the condition is released, so
+   that an event in between is not missed. */
+struct gdev_futex_event {
+	int seq;
+	int waiters;
+};
+
+static inline void gdev_futex_event_init(struct gdev_futex_event *p)
+{
+	p->seq = 0;
+	p->waiters = 0;
+}
+
+static inline void gdev_futex_event_wait(struct gdev_futex_event *p, int seq, unsigned long timeout_us)
+{
+	struct timespec timeout;
+
+	timeout.tv_sec = timeout_us / 1000000;
+	timeout.tv_nsec = (timeout_us % 1000000) * 1000;
+	__sync_fetch_and_add(&p->waiters, 1);
+	/* an interrupted wait is just as good as an early end. */
+	__gdev_futex_wait(&p->seq, seq, &timeout);
+	__sync_fetch_and_sub(&p->waiters, 1);
+}
+
+static inline void gdev_futex_event_signal(struct gdev_futex_event *p)
+{
+	__sync_fetch_and_add(&p->seq, 1);
+	if (__gdev_futex_read(&p->waiters))
+		__gdev_futex_wake(&p->seq, INT_MAX);
+}
+
+/* a reader-writer lock for data looked up far more often than changed, 
+   e.g., the memory objects of an address space. readers are preferred, so
+   that a reader may lock it again while a writer is waiting. waiters sleep
+   on @seq, which is advanced whenever the lock may have become available.
+   unlike gdev_futex_lock, a holder that died is not recovered. */
+struct gdev_futex_rwlock {
+	int state; /* # of readers, -1 if locked by a writer */
+	int seq;
+	int waiters;
+};
+
+static inline void gdev_futex_rwlock_init(struct gdev_futex_rwlock *p)
+{
+	p->state = 0;
+	p->seq = 0;
+	p->waiters = 0;
+}
+
+/* the sequence is read before the lock is checked again, so that a release
+   in between is not missed. */
+static inline void __gdev_futex_rwlock_wait(struct gdev_futex_rwlock *p, int seq)
+{
+	__sync_fetch_and_add(&p->waiters, 1);
+	__gdev_futex_wait(&p->seq, seq, NULL);
+	__sync_fetch_and_sub(&p->waiters, 1);
+}
+
+static inline void __gdev_futex_rwlock_wake(struct gdev_futex_rwlock *p)
+{
+	__sync_fetch_and_add(&p->seq, 1);
+	if (__gdev_futex_read(&p->waiters))
+		__gdev_futex_wake(&p->seq, INT_MAX);
+}
+
+static inline void gdev_futex_read_lock(struct gdev_futex_rwlock *p)
+{
+	int s, seq;
+
+	for (;;) {
+		s = __gdev_futex_read(&p->state);
+		if (s >= 0) {
+			if (__sync_bool_compare_and_swap(&p->state, s, s + 1))
+				return;
+			continue;
+		}
+		seq = __gdev_futex_read(&p->seq);
+		if (__gdev_futex_read(&p->state) < 0)
+			__gdev_futex_rwlock_wait(p, seq);
+	}
+}
+
+static inline void gdev_futex_read_unlock(struct gdev_futex_rwlock *p)
+{
+	if (__sync_sub_and_fetch(&p->state, 1) == 0)
+		__gdev_futex_rwlock_wake(p);
+}
+
+static inline void gdev_futex_write_lock(struct gdev_futex_rwlock *p)
+{
+	int seq;
+
+	for (;;) {
+		if (__sync_bool_compare_and_swap(&p->state, 0, -1))
+			return;
+		seq = __gdev_futex_read(&p->seq);
+		if (__gdev_futex_read(&p->state) != 0)
+			__gdev_futex_rwlock_wait(p, seq);
+	}
+}
+
+static inline void gdev_futex_write_unlock(struct gdev_futex_rwlock *p)
+{
+	__sync_bool_compare_and_swap(&p->state, -1, 0);
+	__gdev_futex_rwlock_wake(p);
+}
+
+#endif
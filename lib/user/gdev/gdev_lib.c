@@ -46,7 +46,7 @@ void *gdev_sched_get_current_task(void)
 
 int gdev_sched_get_static_prio(void *task)
 {
-        return 0;
+        return GDEV_PRIO_DEFAULT;
 }
 
 void gdev_sched_sleep(void)
@@ -58,46 +58,6 @@ int gdev_sched_wakeup(void *task)
         return 0;
 }
 
-void gdev_lock_init(struct gdev_lock *p)
-{
-}
-
-void gdev_lock(struct gdev_lock *p)
-{
-}
-
-void gdev_unlock(struct gdev_lock *p)
-{
-}
-
-void gdev_lock_save(struct gdev_lock *p, unsigned long *pflags)
-{
-}
-
-void gdev_unlock_restore(struct gdev_lock *p, unsigned long *pflags)
-{
-}
-
-void gdev_lock_nested(struct gdev_lock *p)
-{
-}
-
-void gdev_unlock_nested(struct gdev_lock *p)
-{
-}
-
-void gdev_mutex_init(struct gdev_mutex *p)
-{
-}
-
-void gdev_mutex_lock(struct gdev_mutex *p)
-{
-}
-
-void gdev_mutex_unlock(struct gdev_mutex *p)
-{
-}
-
 void* gdev_current_com_get(struct gdev_device *gdev)
 {
         return !gdev->current_com? NULL:(void*)gdev->current_com;
@@ -131,37 +91,58 @@ struct gdev_device *gdev_phys_get(struct gdev_device *gdev)
         return !gdev?NULL:gdev->parent;
 }
 
+/* nothing is shared with other processes. */
+static int __in_shm(void *p)
+{
+        return false;
+}
+
 #else /* for User-Space Scheduling*/
 
-int __msgid;
 int gdev_shm_initialized=0;
 int device_count=0;
 void *attach_mem=NULL;
+static unsigned long attach_size=0;
 extern struct gdev_device *lgdev;
 struct gdev_time now,last,elapse,interval;
 
 static int __alloc_shm(int dev_size)
 {
         int shmid;
+        unsigned long size;
 
-        shmid = shmget(GDEV_SHM_KEYS(1),/*fix this: SHM_KEYS(x) value, */
-	        sizeof(struct gdev_device) * dev_size +
+        size = sizeof(struct gdev_device) * dev_size +
 	        sizeof(struct gdev_vas) * GDEV_CONTEXT_MAX_COUNT +
 	        sizeof(struct gdev_sched_entity) * GDEV_CONTEXT_MAX_COUNT +
-	        sizeof(struct gdev_mem) * GDEV_CONTEXT_MAX_COUNT * 10,
-	        S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP);
+	        sizeof(struct gdev_mem) * GDEV_CONTEXT_MAX_COUNT * 10 +
+	        sizeof(struct gdev_task) * GDEV_NR_TASKS;
+        shmid = shmget(GDEV_SHM_KEYS(1),/*fix this: SHM_KEYS(x) value, */
+	        size, S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP);
         if (shmid == -1){
 	GDEV_PRINT("Failed get shared memory for user-space scheduling\nPlease start/restart gdev_usched_monitor\n");
 	return false;
         }
         attach_mem = shmat(shmid, NULL, 0);
+        if (attach_mem == (void *)-1) {
+	GDEV_PRINT("Failed to attach shared memory for user-space scheduling\n");
+	attach_mem = NULL;
+	return false;
+        }
+        attach_size = size;
         return true;
 }
 
+/* the locks in the shared memory are initialized by the monitor. other
+   processes may be holding them, so they must not be initialized again. */
+static int __in_shm(void *p)
+{
+        return attach_mem && (unsigned long)ADDR_SUB(p, attach_mem) < attach_size;
+}
+
 static void *__attach_shms(int size,int attach_offset)
 {
-        if(!attach_mem)
-	    __alloc_shm(size);
+        if (!attach_mem && !__alloc_shm(size))
+	    return NULL;
         return (void *)ADDR_ADD(attach_mem, attach_offset);
 }
 
@@ -181,6 +162,8 @@ void *gdev_attach_shms_vas(int size)
 
         base = (struct gdev_vas *)__attach_shms(size/sizeof(struct gdev_device), 
 		device_count * sizeof(struct gdev_device));
+        if (!base)
+	    return NULL;
         for (i = 0; i < 128; i++){
 	    if (!base->gdev)
 		break;
@@ -197,6 +180,8 @@ void *gdev_attach_shms_se(int size)
         base = __attach_shms(size/sizeof(struct gdev_device), 
 		device_count * sizeof(struct gdev_device) +
 		GDEV_CONTEXT_MAX_COUNT * sizeof(struct gdev_vas));
+        if (!base)
+	    return NULL;
         for (i=0; i<128; i++){
 	if (!base->gdev)
 	        break;
@@ -214,6 +199,8 @@ void *gdev_attach_shms_mem(int size)
 		device_count * sizeof(struct gdev_device) + 
 		GDEV_CONTEXT_MAX_COUNT * sizeof(struct gdev_vas) + 
 		GDEV_CONTEXT_MAX_COUNT * sizeof(struct gdev_sched_entity));
+        if (!base)
+	    return NULL;
 	for ( i=0; i<256; i++){
 	    if (!base->vas)
 		break;
@@ -228,29 +215,49 @@ struct gdev_sched_entity *gdev_sched_entity_alloc(int size)
         return gdev_attach_shms_se(size);
 }
 
-static int __init_sem_lock(void)
+/* the task table follows the memory objects. */
+static struct gdev_task *__attach_shms_task(void)
 {
-        return true;
+        return __attach_shms(GDEV_DEVICE_MAX_COUNT,
+		GDEV_DEVICE_MAX_COUNT * sizeof(struct gdev_device) +
+		GDEV_CONTEXT_MAX_COUNT * sizeof(struct gdev_vas) +
+		GDEV_CONTEXT_MAX_COUNT * sizeof(struct gdev_sched_entity) +
+		GDEV_CONTEXT_MAX_COUNT * 10 * sizeof(struct gdev_mem));
 }
 
-static int __init_msg_sched(void)
+static struct gdev_task *__tasks = NULL;
+static __thread int __task_id = 0; /* index + 1 of the slot of this thread */
+static __thread int __task_tid = 0; /* the thread that claimed __task_id */
+
+/* claim a free slot, or a slot left by a thread that has exited. */
+static int __claim_task(int tid)
 {
-        __msgid = msgget(GDEV_MSG_KEY, S_IRUSR|S_IWUSR|S_IRGRP|S_IWGRP);
-        if (__msgid == -1)
-		return false;
+        int i, owner;
 
-        return true;
-}
+        for (i = 0; i < GDEV_NR_TASKS; i++) {
+	    owner = __tasks[i].tid;
+	    if (owner == tid)
+		return i + 1;
+	    if (owner && (kill(owner, 0) == 0 || errno != ESRCH))
+		continue;
+	    if (__sync_bool_compare_and_swap(&__tasks[i].tid, owner, tid)) {
+		__tasks[i].wakeups = 0;
+		return i + 1;
+	    }
+        }
 
+        return 0;
+}
 
 int gdev_sched_create_scheduler(struct gdev_device *gdev)
 {
-        /* init the message queue for a scheduler. */
-    	if (!__init_msg_sched()) {
-		printf("Failed to initialize GDEV semaphore\n");
+        /* the task table for sleep and wakeup. */
+        __tasks = __attach_shms_task();
+        if (!__tasks) {
+		printf("Failed to initialize GDEV task table\n");
 		exit(1);
 		return false;
-    	}
+        }
         gdev_shm_initialized=1;
 
         return true;
@@ -263,45 +270,71 @@ void gdev_sched_destroy_scheduler(struct gdev_device *gdev)
 
 void *gdev_sched_get_current_task(void)
 {
+	int tid = __gdev_gettid();
+
 	if (!gdev_shm_initialized)
 	        gdev_sched_create_scheduler(NULL);
 
-        return (void*)(long long)getpid();
+	/* a slot per thread, so that the threads sharing a handle wake each
+	   other up. a forked child must not share the slot of its parent. */
+	if (__task_tid != tid) {
+	    __task_id = __claim_task(tid);
+	    if (!__task_id) {
+		GDEV_PRINT("Failed to allocate a task slot\n");
+		return NULL;
+	    }
+	    __task_tid = tid;
+	}
+
+        return (void*)(long long)__task_id;
+}
+
+static struct gdev_task *__get_task(void *task)
+{
+        long long id = (long long)task;
+
+        if (!__tasks || id <= 0 || id > GDEV_NR_TASKS)
+		return NULL;
+        return &__tasks[id - 1];
 }
 
 int gdev_sched_get_static_prio(void *task)
 {
-        return (int)getpriority(PRIO_PROCESS, (long long)task);
+        struct gdev_task *t = __get_task(task);
+        int nice = t ? (int)getpriority(PRIO_PROCESS, t->tid) : 0;
+
+        /* nice values, PRIO_MIN..PRIO_MAX - 1. */
+        return gdev_sched_prio_map(nice, PRIO_MIN, PRIO_MAX - 1);
 }
+/* @prio is a nice value. */
 int gdev_sched_set_static_prio(void *task, int prio)
 {
-        return (int)setpriority(PRIO_PROCESS, (long long)task, prio);
+        struct gdev_task *t = __get_task(task);
+        return t ? (int)setpriority(PRIO_PROCESS, t->tid, prio) : -ESRCH;
 }
 
 
 void gdev_sched_sleep(void)
 {
-        int pid = getpid();
-        struct gdev_msg_struct *msg = (struct gdev_msg_struct *)malloc(sizeof(*msg));
+        struct gdev_task *t = __get_task(gdev_sched_get_current_task());
 
-        msgrcv(__msgid, msg, GDEV_SZ_MSG, pid, 0);
+        if (t)
+		gdev_futex_sleep(&t->wakeups);
 }
 
 
 
 int gdev_sched_wakeup(void *task)
 {
-        int pid=getpid();
+        struct gdev_task *t = __get_task(task);
 
-	if ((long long)task == pid){
+        if (!t)
+		return false;
+	if (t->tid == __gdev_gettid()){
 	    printf("Warning: task tried to wake up itself\n");
         }
         else {
-	    struct gdev_msg_struct *msg;
-	    msg = (struct gdev_msg_struct *)malloc(sizeof(*msg));
-	    msg->mtype = (long long)task;
-	    msg->mtext = (long long)task;
-	    msgsnd(__msgid, msg, GDEV_SZ_MSG, 0);
+	    gdev_futex_wakeup(&t->wakeups);
 	}
         return true;
 }
@@ -313,102 +346,151 @@ void gdev_next_compute(struct gdev_device *gdev)
 }
 
 
+void gdev_enqueue(struct gdev_sched_entity *se)
+{
+}
+
+void gdev_dequeue(struct gdev_sched_entity *se)
+{
+}
+
+struct gdev_device *gdev_phys_get(struct gdev_device *gdev)
+{
+        return !gdev?NULL:(struct gdev_device*)ADDR_SUB(gdev,gdev->parent);
+}
+
+struct gdev_mem *gdev_swap_get(struct gdev_device *gdev)
+{
+ 	return lgdev->swap;
+}
+
+void *gdev_current_com_get(struct gdev_device *gdev)
+{
+ 	return (gdev->current_com==NULL)? NULL:(void*)ADDR_SUB(gdev, gdev->current_com);
+}
+
+void gdev_current_com_set(struct gdev_device *gdev,void *com)
+{
+	if(com!=NULL){
+		gdev->current_com = (void *)ADDR_SUB(gdev,com);
+    	}else{
+		gdev->current_com = NULL;
+    	}
+}
+
+void *gdev_compute_get(struct gdev_device *gdev)
+{
+        return lgdev->compute;
+}
+
+void *gdev_priv_get(struct gdev_device *gdev)
+{
+        return lgdev->priv;
+}
+
+#endif
+
+/* the locks are real even if the scheduler is disabled, since threads of a
+   process may share a handle. lock_save does not save anything in user 
+   space, and the nested variants let the holder lock again. */
 void gdev_lock_init(struct gdev_lock *p)
 {
-        return;
+        if (!__in_shm(p))
+		gdev_futex_lock_init(&p->futex);
 }
 
 void gdev_lock(struct gdev_lock *p)
 {
-        struct sembuf *sem = &p->sembuf;
-        sem->sem_num = 0;
-        sem->sem_op = -1;
-        sem->sem_flg = SEM_UNDO;
-        semop(p->semid, sem, 1);
-
+        gdev_futex_lock(&p->futex);
 }
 
 void gdev_unlock(struct gdev_lock *p)
 {
-        struct sembuf *sem = &p->sembuf;
-        sem->sem_num = 0;
-        sem->sem_op = 1;
-        sem->sem_flg = SEM_UNDO;
-        semop(p->semid, sem, 1);
+        gdev_futex_unlock(&p->futex);
 }
 
 void gdev_lock_save(struct gdev_lock *p, unsigned long *pflags)
 {
+        gdev_futex_lock(&p->futex);
 }
 
 void gdev_unlock_restore(struct gdev_lock *p, unsigned long *pflags)
 {
+        gdev_futex_unlock(&p->futex);
 }
 
 void gdev_lock_nested(struct gdev_lock *p)
 {
+        gdev_futex_lock_nested(&p->futex);
 }
 
 void gdev_unlock_nested(struct gdev_lock *p)
 {
+        gdev_futex_unlock_nested(&p->futex);
 }
 
 void gdev_mutex_init(struct gdev_mutex *p)
 {
+        if (!__in_shm(p))
+		gdev_futex_lock_init(&p->futex);
 }
 
 void gdev_mutex_lock(struct gdev_mutex *p)
 {
+        gdev_futex_lock(&p->futex);
 }
 
 void gdev_mutex_unlock(struct gdev_mutex *p)
 {
+        gdev_futex_unlock(&p->futex);
 }
 
-
-void gdev_enqueue(struct gdev_sched_entity *se)
+void gdev_rwlock_init(struct gdev_rwlock *p)
 {
+        if (!__in_shm(p))
+		gdev_futex_rwlock_init(&p->futex);
 }
 
-void gdev_dequeue(struct gdev_sched_entity *se)
+void gdev_read_lock(struct gdev_rwlock *p)
 {
+        gdev_futex_read_lock(&p->futex);
 }
 
-struct gdev_device *gdev_phys_get(struct gdev_device *gdev)
+void gdev_read_unlock(struct gdev_rwlock *p)
 {
-        return !gdev?NULL:(struct gdev_device*)ADDR_SUB(gdev,gdev->parent);
+        gdev_futex_read_unlock(&p->futex);
 }
 
-struct gdev_mem *gdev_swap_get(struct gdev_device *gdev)
+void gdev_write_lock(struct gdev_rwlock *p)
 {
- 	return lgdev->swap;
+        gdev_futex_write_lock(&p->futex);
 }
 
-void *gdev_current_com_get(struct gdev_device *gdev)
+void gdev_write_unlock(struct gdev_rwlock *p)
 {
- 	return (gdev->current_com==NULL)? NULL:(void*)ADDR_SUB(gdev, gdev->current_com);
+        gdev_futex_write_unlock(&p->futex);
 }
 
-void gdev_current_com_set(struct gdev_device *gdev,void *com)
+void gdev_event_init(struct gdev_event *p)
 {
-	if(com!=NULL){
-		gdev->current_com = (void *)ADDR_SUB(gdev,com);
-    	}else{
-		gdev->current_com = NULL;
-    	}
+        if (!__in_shm(p))
+		gdev_futex_event_init(&p->futex);
 }
 
-void *gdev_compute_get(struct gdev_device *gdev)
+unsigned int gdev_event_seq(struct gdev_event *p)
 {
-        return lgdev->compute;
+        return __gdev_futex_read(&p->futex.seq);
 }
 
-void *gdev_priv_get(struct gdev_device *gdev)
+void gdev_event_wait(struct gdev_event *p, unsigned int seq, unsigned long timeout_us)
 {
-        return lgdev->priv;
+        gdev_futex_event_wait(&p->futex, seq, timeout_us);
 }
 
-#endif
+void gdev_event_signal(struct gdev_event *p)
+{
+        gdev_futex_event_signal(&p->futex);
+}
 
 int gdev_getinfo_device_count(void)
 {
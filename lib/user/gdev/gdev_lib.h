@@ -31,8 +31,6 @@
 #include <stdio.h> /* printf, etc. */
 #include <stdlib.h> /* malloc/free, etc. */
 #include <string.h> /* memcpy, etc. */
-#include <sys/sem.h> /* struct sembuf */
-#include <sys/msg.h>
 #include <sys/shm.h>
 #include <sys/wait.h>
 #include <sys/unistd.h>
@@ -49,27 +47,32 @@
 #define GDEV_SHM_KEY 0xdeadbabe
 #define GDEV_SHM_KEYS(x) (0xdead0000|x)
 #define GDEV_SHM_SE_KEY GDEV_SHM_KEYS(0x100)
-#define GDEV_SEM_KEY 0x600dbeef
-#define GDEV_SEM_KEYS(x) (0x600d0000|x)
-#define GDEV_MSG_KEY 0xdeadcafe
 
 #define GDEV_NR_TASKS 64
-#define GDEV_SZ_MSG sizeof(struct gdev_msg_struct)
-#define GDEV_SZ_OPS sizeof(struct gdev_msgops_struct)
+
+#include "gdev_futex.h"
 
 struct gdev_lock {
-	int semid;
-	struct sembuf sembuf;
+	struct gdev_futex_lock futex;
 };
 
 struct gdev_mutex {
-	int semid;
-	struct sembuf sembuf;
+	struct gdev_futex_lock futex;
+};
+
+struct gdev_rwlock {
+	struct gdev_futex_rwlock futex;
+};
+
+struct gdev_event {
+	struct gdev_futex_event futex;
 };
 
-struct gdev_msg_struct {
-    long mtype;
-    char mtext;
+/* a task that sleeps and is woken up through the shared memory.
+   the scheduler refers to it by its index in the task table plus one. */
+struct gdev_task {
+	int tid; /* thread of the slot, 0 if free */
+	int wakeups; /* futex word counting pending wakeups */
 };
 
 extern int gdev_shm_initialized;
@@ -492,7 +492,7 @@ int gdev_raw_read(struct gdev_mem *mem, void *buf, uint64_t addr, uint32_t size)
 	}
 
 	uint64_t offset = addr - mem->addr;
-	gdev_io_memcpy(buf, ptr + offset, size);
+	gdev_io_memcpy_fromio(buf, ptr + offset, size);
 
 	if (!mem->map) {
 		nvrm_bo_host_unmap(bo);
@@ -511,7 +511,7 @@ int gdev_raw_write(struct gdev_mem *mem, uint64_t addr, const void *buf, uint32_
 	}
 
 	uint64_t offset = addr - mem->addr;
-	gdev_io_memcpy(ptr + offset, buf, size);
+	gdev_io_memcpy_toio(ptr + offset, buf, size);
 
 	if (!mem->map) {
 		nvrm_bo_host_unmap(bo);
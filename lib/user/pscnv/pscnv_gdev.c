@@ -375,7 +375,7 @@ int gdev_raw_read(struct gdev_mem *mem, void *buf, uint64_t addr, uint32_t size)
 	uint64_t offset = addr - bo->vm_base;
 
 	if (bo->map) {
-		gdev_io_memcpy(buf, bo->map + offset, size);
+		gdev_io_memcpy_fromio(buf, bo->map + offset, size);
 		return 0;
 	}
 	else
@@ -391,7 +391,7 @@ int gdev_raw_write(struct gdev_mem *mem, uint64_t addr, const void *buf, uint32_
 	uint64_t offset = addr - bo->vm_base;
 
 	if (bo->map) {
-		gdev_io_memcpy(bo->map + offset, buf, size);
+		gdev_io_memcpy_toio(bo->map + offset, buf, size);
 		return 0;
 	}
 	else
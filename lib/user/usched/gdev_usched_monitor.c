@@ -30,15 +30,12 @@ struct gdev_device *gdevs;
 struct gdev_sched_entity *se;
 struct gdev_mem *mem;
 struct gdev_vas *vas;
+struct gdev_task *tasks;
 
 int shmid;
-int semid;
-int msgid;
 int gdev_count;
 int *_gdev_vcount;
-int semno = 0;
 
-int semid_array[VDEVICE_MAX_COUNT+1];
 int gdev_bw_set[VDEVICE_MAX_COUNT]={
     0,  /* phys   */
     25, /* vgpu0  */
@@ -49,9 +46,11 @@ int gdev_bw_set[VDEVICE_MAX_COUNT]={
 
 void __gdev_lock(gdev_lock_t *p)
 {
+    gdev_futex_lock(&p->futex);
 }
 void __gdev_unlock(gdev_lock_t *p)
 {
+    gdev_futex_unlock(&p->futex);
 }
 
 
@@ -65,12 +64,28 @@ void gdev_vsched_band_replenish_compute(struct gdev_device *gdev)
     if (gdev_time_gt(&gdev->credit_com, &threshold))
 	gdev_time_us(&gdev->credit_com, 0);
     /* when the credit exceeds the threshold in negative, even it. */
-    threshold.neg = 1;
+    gdev_time_neg(&threshold, &threshold);
     if (gdev_time_lt(&gdev->credit_com, &threshold))
 	gdev_time_us(&gdev->credit_com, 0);
 }
 
 
+void gdev_vsched_band_replenish_memory(struct gdev_device *gdev)
+{
+    struct gdev_time credit, threshold;
+    gdev_time_us(&credit, gdev->period * gdev->mem_bw / 100);
+    gdev_time_add(&gdev->credit_mem, &gdev->credit_mem, &credit);
+    /* when the credit exceeds the threshold, all credits taken away. */
+    gdev_time_us(&threshold, GDEV_CREDIT_INACTIVE_THRESHOLD);
+    if (gdev_time_gt(&gdev->credit_mem, &threshold))
+	gdev_time_us(&gdev->credit_mem, 0);
+    /* when the credit exceeds the threshold in negative, even it. */
+    gdev_time_neg(&threshold, &threshold);
+    if (gdev_time_lt(&gdev->credit_mem, &threshold))
+	gdev_time_us(&gdev->credit_mem, 0);
+}
+
+
 void gdev_vsched_credit_replenish_compute(struct gdev_device *gdev)
 {
     GDEV_PRINT("not implemented....\n");
@@ -88,20 +103,95 @@ void gdev_vsched_null_replenish_compute(struct gdev_device *gdev)
     return;
 }
 
-#define GDEV_VSCHED_POLICY_BAND
-//#define GDEV_VSCHED_POLICY_CREDIT
-//#define GDEV_VSCHED_POLICY_FIFO
-//#define GDEV_VSCHED_POLICY_NULL
-
-#if defined(GDEV_VSCHED_POLICY_BAND)
-void (*gdev_replenish_compute)(struct gdev_device *gdev) = &gdev_vsched_band_replenish_compute;
-#elif defined(GDEV_VSCHED_POLICY_CREDIT)
-void (*gdev_replenish_compute)(struct gdev_device *gdev) = &gdev_vsched_credit_replenish_compute;
-#elif defined(GDEV_VSCHED_POLICY_FIFO)
-void (*gdev_replenish_compute)(struct gdev_device *gdev) = &gdev_vsched_fifo_replenish_compute;
-#elif defined(GDEV_VSCHED_POLICY_NULL)
-void (*gdev_replenish_compute)(struct gdev_device *gdev) = &gdev_vsched_null_replenish_compute;
-#endif
+void gdev_vsched_edf_replenish_compute(struct gdev_device *gdev)
+{
+    return;
+}
+
+void gdev_vsched_sfq_replenish_compute(struct gdev_device *gdev)
+{
+    return;
+}
+
+/* indexed by GDEV_VSCHED_*. memory copies are replenished only by band. */
+struct gdev_vsched_replenish {
+    const char *name;
+    void (*replenish_compute)(struct gdev_device *gdev);
+    void (*replenish_memory)(struct gdev_device *gdev);
+} gdev_vsched_replenish[GDEV_VSCHED_POLICY_COUNT] = {
+    [GDEV_VSCHED_BAND] = {"band", &gdev_vsched_band_replenish_compute, &gdev_vsched_band_replenish_memory},
+    [GDEV_VSCHED_CREDIT] = {"credit", &gdev_vsched_credit_replenish_compute},
+    [GDEV_VSCHED_FIFO] = {"fifo", &gdev_vsched_fifo_replenish_compute},
+    [GDEV_VSCHED_NULL] = {"null", &gdev_vsched_null_replenish_compute},
+    [GDEV_VSCHED_EDF] = {"edf", &gdev_vsched_edf_replenish_compute},
+    [GDEV_VSCHED_SFQ] = {"sfq", &gdev_vsched_sfq_replenish_compute},
+};
+
+/* the policy given by GDEV_VSCHED_POLICY in the environment. */
+int gdev_vsched_policy = GDEV_VSCHED_DEFAULT;
+/* the queueing method given by GDEV_SCHED_QUEUEING in the environment. */
+int gdev_sched_queueing = GDEV_SCHED_QUEUEING_DEFAULT;
+/* the memcpy rate (bytes/s) given by GDEV_MEM_RATE in the environment. */
+uint64_t gdev_mem_rate = 0;
+/* scheduler events are written to the file given by GDEV_TRACE. */
+int gdev_trace_enabled = 0;
+static FILE *gdev_trace_file = NULL;
+
+static const char *__gdev_sched_queueing_names[GDEV_SCHED_QUEUEING_COUNT] = {
+    [GDEV_SCHED_SDQ] = "sdq",
+    [GDEV_SCHED_MRQ] = "mrq",
+};
+
+static int __gdev_sched_queueing_lookup(const char *name)
+{
+    int i;
+
+    for (i = 0; i < GDEV_SCHED_QUEUEING_COUNT; i++) {
+	if (!strcmp(__gdev_sched_queueing_names[i], name))
+	    return i;
+    }
+    return -EINVAL;
+}
+
+static int __gdev_vsched_lookup(const char *name)
+{
+    int i;
+
+    for (i = 0; i < GDEV_VSCHED_POLICY_COUNT; i++) {
+	if (!strcmp(gdev_vsched_replenish[i].name, name))
+	    return i;
+    }
+    return -EINVAL;
+}
+
+/* the physical device comes first in the shared memory. */
+static void __gdev_trace_replenish(struct gdev_device *gdev, int res, struct gdev_time *credit)
+{
+    gdev_trace_record(&gdevs[0].trace, GDEV_TRACE_REPLENISH, res, gdev->id, -1, gdev_time_to_ns(credit) / NSEC_1USEC);
+}
+
+/* the policy may be switched while running, so look it up every period.
+   devices in the shared memory have no parent, and keep their own policy. */
+static void gdev_replenish_compute(struct gdev_device *gdev)
+{
+    int policy = gdev->vsched_policy;
+
+    if (policy < 0 || policy >= GDEV_VSCHED_POLICY_COUNT)
+	policy = GDEV_VSCHED_DEFAULT;
+    gdev_vsched_replenish[policy].replenish_compute(gdev);
+    __gdev_trace_replenish(gdev, GDEV_TRACE_COMPUTE, &gdev->credit_com);
+}
+
+static void gdev_replenish_memory(struct gdev_device *gdev)
+{
+    int policy = gdev->vsched_policy;
+
+    if (policy < 0 || policy >= GDEV_VSCHED_POLICY_COUNT)
+	policy = GDEV_VSCHED_DEFAULT;
+    if (gdev_vsched_replenish[policy].replenish_memory)
+	gdev_vsched_replenish[policy].replenish_memory(gdev);
+    __gdev_trace_replenish(gdev, GDEV_TRACE_MEMORY, &gdev->credit_mem);
+}
 
 static void *__gdev_credit_com_thread(void *__offset)
 {
@@ -132,17 +222,70 @@ static void *__gdev_credit_com_thread(void *__offset)
     return NULL;
 }
 
+static void *__gdev_credit_mem_thread(void *__offset)
+{
+    struct gdev_device *gdev = (struct gdev_device*)((unsigned long long)shmat(shmid, NULL, 0) + (unsigned long long)__offset);
+    struct gdev_time now, last, elapse, interval;
 
+    GDEV_PRINT("Gdev#%d memory reserve running\n", gdev->id);
 
+    gdev_time_us(&interval, GDEV_UPDATE_INTERVAL);
+    gdev_time_stamp(&last);
 
-static void __exit_gdev_monitor(void)
+    while(1){
+	gdev_replenish_memory(gdev);
+	pthread_testcancel();
+	usleep(GDEV_PERIOD_DEFAULT * 1000);
+	__gdev_lock(&gdev->sched_mem_lock);
+	gdev_time_stamp(&now);
+	gdev_time_sub(&elapse, &now, &last);
+	gdev->mem_bw_used = gdev->mem_time * 100 / gdev_time_to_us(&elapse);
+	if (gdev->mem_bw_used > 100)
+	    gdev->mem_bw_used = 100;
+	if (gdev_time_ge(&elapse, &interval)) {
+	    gdev->mem_time = 0;
+	    gdev_time_stamp(&last);
+	}
+	__gdev_unlock(&gdev->sched_mem_lock);
+    }
+    return NULL;
+}
+
+
+/* drain the trace rings of the physical devices into the trace file, in
+   the same format as /proc/gdev/pdN/trace. */
+static void *__gdev_trace_thread(void *unused)
 {
+    struct gdev_trace_event ev;
+    uint32_t pos[GDEV_DEVICE_MAX_COUNT] = {0};
+    uint32_t last, count;
     int i;
-    for (i = 0; i < semno; i++)
-	semctl(semid_array[i], 0, IPC_RMID);
 
+    while(1){
+	for (i = 0; i < gdev_count; i++) {
+	    last = pos[i];
+	    count = 0;
+	    while (gdev_trace_read(&gdevs[i].trace, &pos[i], &ev)) {
+		fprintf(gdev_trace_file, "%llu %s %s %d %d %lld\n",
+			(unsigned long long)ev.ts,
+			gdev_trace_type_name(ev.type),
+			gdev_trace_res_name(ev.res),
+			ev.vid, ev.cid, (long long)ev.val);
+		count++;
+	    }
+	    if (pos[i] - last > count)
+		GDEV_PRINT("Gdev#%d lost %u trace events\n", i, pos[i] - last - count);
+	}
+	fflush(gdev_trace_file);
+	pthread_testcancel();
+	usleep(GDEV_TRACE_INTERVAL);
+    }
+    return NULL;
+}
+
+static void __exit_gdev_monitor(void)
+{
     shmctl(shmid, IPC_RMID, NULL);
-    msgctl(msgid, IPC_RMID, NULL);
 }
 
 static void __kill_handler(int signum)
@@ -229,6 +372,43 @@ int main(int argc, char *argv[])
 	exit(1);
     }
 
+    /* get the virtual device scheduling policy. */
+    if (getenv("GDEV_VSCHED_POLICY")) {
+	gdev_vsched_policy = __gdev_vsched_lookup(getenv("GDEV_VSCHED_POLICY"));
+	if (gdev_vsched_policy < 0) {
+	    GDEV_PRINT("Unknown scheduling policy %s\n", getenv("GDEV_VSCHED_POLICY"));
+	    exit(1);
+	}
+    }
+    GDEV_PRINT("Use %s scheduling policy\n", gdev_vsched_replenish[gdev_vsched_policy].name);
+
+    /* get the queueing method. */
+    if (getenv("GDEV_SCHED_QUEUEING")) {
+	gdev_sched_queueing = __gdev_sched_queueing_lookup(getenv("GDEV_SCHED_QUEUEING"));
+	if (gdev_sched_queueing < 0) {
+	    GDEV_PRINT("Unknown queueing method %s\n", getenv("GDEV_SCHED_QUEUEING"));
+	    exit(1);
+	}
+    }
+    GDEV_PRINT("Use %s queueing\n", __gdev_sched_queueing_names[gdev_sched_queueing]);
+
+    /* get the memcpy rate to be shared by virtual devices. */
+    if (getenv("GDEV_MEM_RATE")) {
+	gdev_mem_rate = strtoull(getenv("GDEV_MEM_RATE"), NULL, 0);
+	GDEV_PRINT("Throttle memcpy at %llu bytes/s\n", (unsigned long long)gdev_mem_rate);
+    }
+
+    /* get the file to write scheduler events. */
+    if (getenv("GDEV_TRACE")) {
+	gdev_trace_file = fopen(getenv("GDEV_TRACE"), "w");
+	if (!gdev_trace_file) {
+	    GDEV_PRINT("Failed to open trace file %s\n", getenv("GDEV_TRACE"));
+	    exit(1);
+	}
+	gdev_trace_enabled = 1;
+	GDEV_PRINT("Trace scheduler events to %s\n", getenv("GDEV_TRACE"));
+    }
+
     if (!init_gdev_monitor()){
 	GDEV_PRINT("Initialize Error\n");
 	return 0;
@@ -240,6 +420,14 @@ int main(int argc, char *argv[])
 	if (pthread_create(&thread[0], NULL, __gdev_credit_com_thread, (void*)((unsigned long long)&gdevs[i]-(unsigned long long)&gdevs[0]))!=0){
 	    perror("pthread_create()\n");
 	}
+	if (pthread_create(&thread[0], NULL, __gdev_credit_mem_thread, (void*)((unsigned long long)&gdevs[i]-(unsigned long long)&gdevs[0]))!=0){
+	    perror("pthread_create()\n");
+	}
+    }
+    if (gdev_trace_enabled) {
+	if (pthread_create(&thread[0], NULL, __gdev_trace_thread, NULL)!=0){
+	    perror("pthread_create()\n");
+	}
     }
 
     /* clean up zombie descriptors periodically  */
@@ -32,20 +32,22 @@
 #define GDEV_DEVICE_MAX_COUNT 32
 #define VDEVICE_MAX_COUNT 16
 #define GDEV_PERIOD_DEFAULT 30000 /* microseconds */
+#define GDEV_TRACE_INTERVAL 100000 /* microseconds */
 
 extern struct gdev_device *phys;
 extern struct gdev_device *gdevs;
 extern struct gdev_sched_entity *se;
 extern struct gdev_mem *mem;
 extern struct gdev_vas *vas;
+extern struct gdev_task *tasks;
 extern int shmid;
-extern int semid;
-extern int msgid;
 extern int gdev_count;
 extern int *_gdev_vcount;
-extern int semno;
-extern int semid_array[];
 extern int gdev_bw_set[];
+extern int gdev_vsched_policy;
+extern int gdev_sched_queueing;
+extern uint64_t gdev_mem_rate;
+extern int gdev_trace_enabled;
 
 void gdev_mutex_init(struct gdev_mutex *);
 int init_gdev_monitor();
@@ -25,15 +25,14 @@
 
 void __gdev_lock_init(struct gdev_lock *p)
 {
-    semid_array[semno] = p->semid = semget(GDEV_SEM_KEYS(semno), 1,
-	    IPC_CREAT | S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP);
-    semctl(p->semid, 0, SETVAL, 1);
-    semno++;
+    gdev_futex_lock_init(&p->futex);
     return;
 }
 
 void __gdev_init_device(struct gdev_device *gdev, int id)
 {
+    int i;
+
     gdev->id = id;
     gdev->users = 0;
     gdev->accessed = 0;
@@ -49,9 +48,19 @@ void __gdev_init_device(struct gdev_device *gdev, int id)
     gdev->com_bw_used = 0;
     gdev->mem_bw_used = 0;
     gdev->period = 0;
+    gdev->vsched_policy = gdev_vsched_policy;
+    gdev->sched_queueing = gdev_sched_queueing;
+    gdev->deadline_util = 0;
     gdev->com_time = 0;
     gdev->mem_time = 0;
+    gdev->com_time_rem = 0;
+    gdev->mem_time_rem = 0;
+    gdev->com_time_uncharged = 0;
+    gdev->mem_time_uncharged = 0;
+    gdev->vtime_com = 0;
+    gdev->vtime_mem = 0;
     gdev->swap = NULL;
+    gdev->swap_compress = GDEV_SWAP_COMPRESS;
     gdev->sched_com_thread = NULL;
     gdev->sched_mem_thread = NULL;
     gdev->credit_com_thread = NULL;
@@ -62,15 +71,36 @@ void __gdev_init_device(struct gdev_device *gdev, int id)
     gdev->priv = NULL;
     gdev_time_us(&gdev->credit_com, 0);
     gdev_time_us(&gdev->credit_mem, 0);
+    gdev_time_us(&gdev->arrival_com, 0);
+    gdev_time_us(&gdev->arrival_mem, 0);
+    gdev->interarrival_com = 0;
+    gdev->interarrival_mem = 0;
+    gdev->mem_rate = gdev_mem_rate;
+    gdev->mem_tokens = 0;
+    gdev_time_stamp(&gdev->mem_tokens_stamp);
     gdev_list_init(&gdev->sched_com_list, NULL);
     gdev_list_init(&gdev->sched_mem_list, NULL);
+    gdev_queue_init(&gdev->sched_com_queue);
+    gdev_queue_init(&gdev->sched_mem_queue);
     gdev_list_init(&gdev->vas_list, NULL);
     gdev_list_init(&gdev->shm_list, NULL);
+    gdev_list_init(&gdev->map_cache, NULL);
+    gdev->map_cache_size = 0;
+    gdev_iotune_init(&gdev->iowrite, GDEV_MEMCPY_IOWRITE_LIMIT);
+    gdev_iotune_init(&gdev->ioread, GDEV_MEMCPY_IOREAD_LIMIT);
+    for (i = 0; i < GDEV_EVICT_CLASSES; i++)
+        gdev_queue_init(&gdev->evict_index[i]);
     __gdev_lock_init(&gdev->sched_com_lock);
     __gdev_lock_init(&gdev->sched_mem_lock);
     __gdev_lock_init(&gdev->vas_lock);
     __gdev_lock_init(&gdev->global_lock);
     gdev_mutex_init(&gdev->shm_mutex);
+    gdev_mutex_init(&gdev->map_mutex);
+    gdev_futex_event_init(&gdev->sched_com_event.futex);
+    gdev_futex_event_init(&gdev->sched_mem_event.futex);
+    gdev_futex_event_init(&gdev->throttle_mem_event.futex);
+    gdev_trace_init(&gdev->trace);
+    gdev->trace.enabled = gdev_trace_enabled;
 }
 
 void __gdev_init_sched_entity(struct gdev_sched_entity *se, int id)
@@ -84,7 +114,7 @@ void __gdev_init_sched_entity(struct gdev_sched_entity *se, int id)
 
 
 void __gdev_init_vas(struct gdev_vas *vas){
-    __gdev_lock_init(&vas->lock);
+    gdev_futex_rwlock_init(&vas->lock.futex);
 }
 void gdev_mutex_init(struct gdev_mutex *p){
     __gdev_lock_init((struct gdev_lock*)p);
@@ -113,7 +143,8 @@ int __alloc_shm(int device_size)
 	    sizeof(struct gdev_device) *device_size+ 
 	    sizeof(struct gdev_vas) * GDEV_CONTEXT_MAX_COUNT +
 	    sizeof(struct gdev_sched_entity)*GDEV_CONTEXT_MAX_COUNT +
-	    sizeof(struct gdev_mem) * GDEV_CONTEXT_MAX_COUNT * 10,
+	    sizeof(struct gdev_mem) * GDEV_CONTEXT_MAX_COUNT * 10 +
+	    sizeof(struct gdev_task) * GDEV_NR_TASKS,
 	    IPC_CREAT | S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP);
     if (__shmid == -1){
 	GDEV_PRINT("Failed get shared memory for user-space scheduling\n");
@@ -153,20 +184,17 @@ int init_gdev_monitor()
     GDEV_PRINT("Prepared %d scheduling entities.\n",GDEV_CONTEXT_MAX_COUNT);
 
     __attach_shm(shmid, (void **)&mem, 256, attach_offset);
-    attach_offset += sizeof(struct gdev_mem) * 256;
+    attach_offset += sizeof(struct gdev_mem) * GDEV_CONTEXT_MAX_COUNT * 10;
 
     GDEV_PRINT("Prepared %d memory entities.\n",256);
 
-    /*
-     *
-     */
+    /* tasks sleep and are woken up through this table. */
+    __attach_shm(shmid, (void **)&tasks, GDEV_NR_TASKS, attach_offset);
+    attach_offset += sizeof(struct gdev_task) * GDEV_NR_TASKS;
+    memset(tasks, 0, sizeof(struct gdev_task) * GDEV_NR_TASKS);
 
+    GDEV_PRINT("Prepared %d task slots.\n", GDEV_NR_TASKS);
 
-    msgid = msgget(GDEV_MSG_KEY, IPC_CREAT| S_IRUSR| S_IWUSR | S_IRGRP | S_IWGRP);
-    if (msgid==-1) {
-	printf("Failed to initialize gdev message\n");
-	exit(1);
-    }
     return 1;
 }
 
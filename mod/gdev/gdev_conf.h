@@ -32,6 +32,7 @@
 
 #define GDEV_CONTEXT_MAX_COUNT 128 /* # of GPU contexts */
 #define GDEV_CONTEXT_LIMIT 16
+#define GDEV_CTX_POOL_SIZE 0 /* contexts kept initialized per device for gopen(), 0 for no pool */
 
 #define GDEV_PIPELINE_MAX_COUNT 4
 #define GDEV_PIPELINE_MIN_COUNT 1
@@ -41,9 +42,16 @@
 #define GDEV_CHUNK_DEFAULT_SIZE 0x40000 /* 256KB */
 
 #define GDEV_SWAP_MEM_SIZE 0x8000000 /* 128MB */
+#define GDEV_SWAP_PAGE_SIZE 0x10000 /* 64KB */
+#define GDEV_SWAP_COMPRESS 1 /* compress the host swap */
+
+#define GDEV_MEM_MAP_CACHE_SIZE 0x10000000 /* 256MB of BAR space to keep mapped */
 
 #define GDEV_MEMCPY_IOREAD_LIMIT 0x1000 /* 4KB */
 #define GDEV_MEMCPY_IOWRITE_LIMIT 0x400000 /* 4MB */
+#define GDEV_MEMCPY_THREADS 0 /* host copy workers, not available in the kernel */
+#define GDEV_MEMCPY_THREAD_SIZE 0x80000 /* 512KB, the least bytes a worker copies */
+#define GDEV_MEMCPY_BOUNCE_COUNT 4 /* sets of bounce buffers per handle, for threads copying at once */
 
 #define GDEV0_VIRTUAL_DEVICE_COUNT 4 /* # of virtual devices */
 #define GDEV1_VIRTUAL_DEVICE_COUNT 0 /* # of virtual devices */
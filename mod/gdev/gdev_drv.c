@@ -290,7 +290,7 @@ void *gdev_sched_get_current_task(void)
 int gdev_sched_get_static_prio(void *task)
 {
 	struct task_struct *p = (struct task_struct *)task;
-	return p->static_prio;
+	return gdev_sched_prio_map(p->static_prio, MAX_RT_PRIO, MAX_PRIO - 1);
 }
 
 void gdev_sched_sleep(void)
@@ -359,6 +359,54 @@ void gdev_mutex_unlock(struct gdev_mutex *p)
 	mutex_unlock(&p->mutex);
 }
 
+void gdev_rwlock_init(struct gdev_rwlock *p)
+{
+	init_rwsem(&p->sem);
+}
+
+void gdev_read_lock(struct gdev_rwlock *p)
+{
+	down_read(&p->sem);
+}
+
+void gdev_read_unlock(struct gdev_rwlock *p)
+{
+	up_read(&p->sem);
+}
+
+void gdev_write_lock(struct gdev_rwlock *p)
+{
+	down_write(&p->sem);
+}
+
+void gdev_write_unlock(struct gdev_rwlock *p)
+{
+	up_write(&p->sem);
+}
+
+void gdev_event_init(struct gdev_event *p)
+{
+	init_waitqueue_head(&p->wq);
+	p->seq = 0;
+}
+
+unsigned int gdev_event_seq(struct gdev_event *p)
+{
+	return *(volatile unsigned int *)&p->seq;
+}
+
+void gdev_event_wait(struct gdev_event *p, unsigned int seq, unsigned long timeout_us)
+{
+	wait_event_timeout(p->wq, *(volatile unsigned int *)&p->seq != seq, usecs_to_jiffies(timeout_us));
+}
+
+void gdev_event_signal(struct gdev_event *p)
+{
+	p->seq++;
+	if (waitqueue_active(&p->wq))
+		wake_up_all(&p->wq);
+}
+
 void* gdev_current_com_get(struct gdev_device *gdev)
 {
    	return !gdev->current_com? NULL:(void*)gdev->current_com;
@@ -629,10 +677,18 @@ EXPORT_SYMBOL(gmemcpy_user_from_device_async);
 EXPORT_SYMBOL(gmemcpy);
 EXPORT_SYMBOL(gmemcpy_async);
 EXPORT_SYMBOL(glaunch);
+EXPORT_SYMBOL(gcmdbuf_alloc);
+EXPORT_SYMBOL(gcmdbuf_free);
+EXPORT_SYMBOL(gcmdbuf_launch);
+EXPORT_SYMBOL(gcmdbuf_memcpy);
+EXPORT_SYMBOL(gcmdbuf_update);
+EXPORT_SYMBOL(gcmdbuf_submit);
 EXPORT_SYMBOL(gsync);
 EXPORT_SYMBOL(gbarrier);
 EXPORT_SYMBOL(gquery);
 EXPORT_SYMBOL(gtune);
+EXPORT_SYMBOL(gwriteset);
+EXPORT_SYMBOL(guseset);
 EXPORT_SYMBOL(gshmget);
 EXPORT_SYMBOL(gshmat);
 EXPORT_SYMBOL(gshmdt);
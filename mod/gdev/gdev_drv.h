@@ -32,10 +32,12 @@
 #include <asm/io.h>
 #include <linux/kernel.h>
 #include <linux/mutex.h>
+#include <linux/rwsem.h>
 #include <linux/sched.h>
 #include <linux/slab.h>
 #include <linux/version.h>
 #include <linux/uaccess.h>
+#include <linux/wait.h>
 #if LINUX_VERSION_CODE < KERNEL_VERSION(3,7,0)
 #include "drmP.h"
 #include "drm.h"
@@ -52,4 +54,13 @@ struct gdev_mutex {
 	struct mutex mutex;
 };
 
+struct gdev_rwlock {
+	struct rw_semaphore sem;
+};
+
+struct gdev_event {
+	wait_queue_head_t wq;
+	unsigned int seq;
+};
+
 #endif
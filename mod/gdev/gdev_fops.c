@@ -122,6 +122,10 @@ static int gdev_ioctl
 		return gdev_ioctl_gquery(handle, arg);
 	case GDEV_IOCTL_GTUNE:
 		return gdev_ioctl_gtune(handle, arg);
+	case GDEV_IOCTL_GWRITESET:
+		return gdev_ioctl_gwriteset(handle, arg);
+	case GDEV_IOCTL_GUSESET:
+		return gdev_ioctl_guseset(handle, arg);
 	case GDEV_IOCTL_GSHMGET:
 		return gdev_ioctl_gshmget(handle, arg);
 	case GDEV_IOCTL_GSHMAT:
@@ -403,6 +403,26 @@ int gdev_ioctl_gtune(Ghandle handle, unsigned long arg)
 	return gtune(handle, c.type, c.value);
 }
 
+int gdev_ioctl_gwriteset(Ghandle handle, unsigned long arg)
+{
+	struct gdev_ioctl_mem m;
+
+	if (copy_from_user(&m, (void __user *)arg, sizeof(m)))
+		return -EFAULT;
+
+	return gwriteset(handle, m.addr, m.size);
+}
+
+int gdev_ioctl_guseset(Ghandle handle, unsigned long arg)
+{
+	struct gdev_ioctl_mem m;
+
+	if (copy_from_user(&m, (void __user *)arg, sizeof(m)))
+		return -EFAULT;
+
+	return guseset(handle, m.addr, m.size);
+}
+
 int gdev_ioctl_gshmget(Ghandle handle, unsigned long arg)
 {
 	struct gdev_ioctl_shm s;
@@ -51,6 +51,8 @@ int gdev_ioctl_gsync(Ghandle h, unsigned long arg);
 int gdev_ioctl_gbarrier(Ghandle h, unsigned long arg);
 int gdev_ioctl_gquery(Ghandle h, unsigned long arg);
 int gdev_ioctl_gtune(Ghandle h, unsigned long arg);
+int gdev_ioctl_gwriteset(Ghandle h, unsigned long arg);
+int gdev_ioctl_guseset(Ghandle h, unsigned long arg);
 int gdev_ioctl_gshmget(Ghandle h, unsigned long arg);
 int gdev_ioctl_gshmat(Ghandle h, unsigned long arg);
 int gdev_ioctl_gshmdt(Ghandle h, unsigned long arg);
@@ -29,8 +29,10 @@
 #include <linux/proc_fs.h>
 #include "gdev_device.h"
 #include "gdev_drv.h"
+#include "gdev_sched.h"
 
 #define GDEV_PROC_MAX_BUF 64
+#define GDEV_PROC_TRACE_LINE 96 /* maximum length of a trace event line */
 
 static struct proc_dir_entry *gdev_proc = NULL;
 static struct proc_dir_entry *proc_dev_count;
@@ -45,8 +47,68 @@ static struct gdev_proc_vd {
 	struct proc_dir_entry *mem_bw_used;
 	struct proc_dir_entry *phys;
 } *proc_vd = NULL;
+static struct gdev_proc_pd {
+	struct proc_dir_entry *dir;
+	struct proc_dir_entry *vsched_policy;
+	struct proc_dir_entry *queueing;
+	struct proc_dir_entry *mem_rate;
+	struct proc_dir_entry *trace;
+} *proc_pd = NULL;
 static struct semaphore proc_sem;
 
+static void __gdev_proc_pd_delete(void)
+{
+	int i;
+	char name[256];
+
+	if (!proc_pd)
+		return;
+
+	for (i = 0; i < gdev_count; i++) {
+		if (!proc_pd[i].dir)
+			continue;
+		if (proc_pd[i].vsched_policy)
+			remove_proc_entry("vsched_policy", proc_pd[i].dir);
+		if (proc_pd[i].queueing)
+			remove_proc_entry("queueing", proc_pd[i].dir);
+		if (proc_pd[i].mem_rate)
+			remove_proc_entry("mem_rate", proc_pd[i].dir);
+		if (proc_pd[i].trace)
+			remove_proc_entry("trace", proc_pd[i].dir);
+		sprintf(name, "pd%d", i);
+		remove_proc_entry(name, gdev_proc);
+	}
+	kfree(proc_pd);
+	proc_pd = NULL;
+}
+
+/* one line per event: "ts type resource vid cid val". */
+static int __gdev_proc_trace_line(char *buf, struct gdev_trace_event *ev)
+{
+	return sprintf(buf, "%llu %s %s %d %d %lld\n",
+	               (unsigned long long)ev->ts,
+	               gdev_trace_type_name(ev->type),
+	               gdev_trace_res_name(ev->res),
+	               ev->vid, ev->cid, (long long)ev->val);
+}
+
+/* writing 1 starts tracing, and 0 stops it. */
+static int __gdev_proc_trace_enable(struct gdev_device *gdev, char *kbuf)
+{
+	int enabled;
+
+	if (sscanf(kbuf, "%d", &enabled) != 1) {
+		GDEV_PRINT("Invalid trace switch %s\n", kbuf);
+		return -EINVAL;
+	}
+
+	down(&proc_sem);
+	gdev->trace.enabled = !!enabled;
+	up(&proc_sem);
+
+	return 0;
+}
+
 #if 1 //LINUX_VERSION_CODE >= KERNEL_VERSION(3,10,0)
 
 #include <linux/module.h>
@@ -107,8 +169,269 @@ static const struct file_operations gdev_proc_virt_dev_count_fops = {
 	.release = single_release,
 };
 
+/* list the policies with the current one bracketed. */
+static int gdev_proc_vsched_show(struct seq_file *seq, void *offset)
+{
+	struct gdev_device *gdev = seq->private;
+	int i;
+
+	down(&proc_sem);
+	for (i = 0; i < GDEV_VSCHED_POLICY_COUNT; i++) {
+		if (i == gdev->vsched_policy)
+			seq_printf(seq, "[%s]", gdev_vsched_policies[i]->name);
+		else
+			seq_printf(seq, "%s", gdev_vsched_policies[i]->name);
+		seq_printf(seq, i < GDEV_VSCHED_POLICY_COUNT - 1 ? " " : "\n");
+	}
+	up(&proc_sem);
+
+	return 0;
+}
+
+/* switch the policy by name. this fails with -EBUSY unless idle. */
+static ssize_t gdev_proc_vsched_write(struct file *file,
+                                      const char __user *buffer,
+                                      size_t count, loff_t *ppos)
+{
+	char kbuf[GDEV_PROC_MAX_BUF];
+	struct seq_file *seq = file->private_data;
+	struct gdev_device *gdev = seq->private;
+	int policy, ret;
+
+	if (count > GDEV_PROC_MAX_BUF - 1)
+		count = GDEV_PROC_MAX_BUF - 1;
+	if (copy_from_user(kbuf, buffer, count)) {
+		GDEV_PRINT("Failed to write /proc entry\n");
+		return -EFAULT;
+	}
+	kbuf[count] = '\0';
+
+	policy = gdev_vsched_lookup(strim(kbuf));
+	if (policy < 0) {
+		GDEV_PRINT("Invalid virtual device scheduling policy %s\n", kbuf);
+		return policy;
+	}
+
+	down(&proc_sem);
+	ret = gdev_vsched_set(gdev, policy);
+	up(&proc_sem);
+	if (ret)
+		return ret;
+
+	return count;
+}
+
+static int gdev_proc_vsched_open_fs(struct inode *inode, struct file *file)
+{
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(3,10,0)
+	return single_open(file, gdev_proc_vsched_show, PDE_DATA(inode));
+#else
+	return single_open(file, gdev_proc_vsched_show, PDE(inode)->data);
+#endif
+}
+
+static const struct file_operations gdev_proc_vsched_policy_fops = {
+	.owner = THIS_MODULE,
+	.open = gdev_proc_vsched_open_fs,
+	.read = seq_read,
+	.write = gdev_proc_vsched_write,
+	.llseek = seq_lseek,
+	.release = single_release,
+};
+
+/* list the queueing methods with the current one bracketed. */
+static int gdev_proc_queueing_show(struct seq_file *seq, void *offset)
+{
+	struct gdev_device *gdev = seq->private;
+	int i;
+
+	down(&proc_sem);
+	for (i = 0; i < GDEV_SCHED_QUEUEING_COUNT; i++) {
+		if (i == gdev->sched_queueing)
+			seq_printf(seq, "[%s]", gdev_sched_queueing_names[i]);
+		else
+			seq_printf(seq, "%s", gdev_sched_queueing_names[i]);
+		seq_printf(seq, i < GDEV_SCHED_QUEUEING_COUNT - 1 ? " " : "\n");
+	}
+	up(&proc_sem);
+
+	return 0;
+}
+
+/* switch the queueing method by name. this fails with -EBUSY unless idle. */
+static ssize_t gdev_proc_queueing_write(struct file *file,
+                                        const char __user *buffer,
+                                        size_t count, loff_t *ppos)
+{
+	char kbuf[GDEV_PROC_MAX_BUF];
+	struct seq_file *seq = file->private_data;
+	struct gdev_device *gdev = seq->private;
+	int queueing, ret;
+
+	if (count > GDEV_PROC_MAX_BUF - 1)
+		count = GDEV_PROC_MAX_BUF - 1;
+	if (copy_from_user(kbuf, buffer, count)) {
+		GDEV_PRINT("Failed to write /proc entry\n");
+		return -EFAULT;
+	}
+	kbuf[count] = '\0';
+
+	queueing = gdev_sched_queueing_lookup(strim(kbuf));
+	if (queueing < 0) {
+		GDEV_PRINT("Invalid queueing method %s\n", kbuf);
+		return queueing;
+	}
+
+	down(&proc_sem);
+	ret = gdev_sched_queueing_set(gdev, queueing);
+	up(&proc_sem);
+	if (ret)
+		return ret;
+
+	return count;
+}
+
+static int gdev_proc_queueing_open_fs(struct inode *inode, struct file *file)
+{
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(3,10,0)
+	return single_open(file, gdev_proc_queueing_show, PDE_DATA(inode));
+#else
+	return single_open(file, gdev_proc_queueing_show, PDE(inode)->data);
+#endif
+}
+
+static const struct file_operations gdev_proc_queueing_fops = {
+	.owner = THIS_MODULE,
+	.open = gdev_proc_queueing_open_fs,
+	.read = seq_read,
+	.write = gdev_proc_queueing_write,
+	.llseek = seq_lseek,
+	.release = single_release,
+};
+
+/* memcpy rate (bytes/s) shared by virtual devices. 0 if unlimited. */
+static int gdev_proc_mem_rate_show(struct seq_file *seq, void *offset)
+{
+	struct gdev_device *gdev = seq->private;
+
+	down(&proc_sem);
+	seq_printf(seq, "%llu\n", (unsigned long long)gdev_throttle_rate_get(gdev));
+	up(&proc_sem);
+
+	return 0;
+}
+
+static ssize_t gdev_proc_mem_rate_write(struct file *file,
+                                        const char __user *buffer,
+                                        size_t count, loff_t *ppos)
+{
+	char kbuf[GDEV_PROC_MAX_BUF];
+	struct seq_file *seq = file->private_data;
+	struct gdev_device *gdev = seq->private;
+	unsigned long long rate;
+
+	if (count > GDEV_PROC_MAX_BUF - 1)
+		count = GDEV_PROC_MAX_BUF - 1;
+	if (copy_from_user(kbuf, buffer, count)) {
+		GDEV_PRINT("Failed to write /proc entry\n");
+		return -EFAULT;
+	}
+	kbuf[count] = '\0';
+
+	if (sscanf(kbuf, "%llu", &rate) != 1) {
+		GDEV_PRINT("Invalid memcpy rate %s\n", kbuf);
+		return -EINVAL;
+	}
+
+	down(&proc_sem);
+	gdev_throttle_rate_set(gdev, rate);
+	up(&proc_sem);
+
+	return count;
+}
+
+static int gdev_proc_mem_rate_open_fs(struct inode *inode, struct file *file)
+{
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(3,10,0)
+	return single_open(file, gdev_proc_mem_rate_show, PDE_DATA(inode));
+#else
+	return single_open(file, gdev_proc_mem_rate_show, PDE(inode)->data);
+#endif
+}
+
+static const struct file_operations gdev_proc_mem_rate_fops = {
+	.owner = THIS_MODULE,
+	.open = gdev_proc_mem_rate_open_fs,
+	.read = seq_read,
+	.write = gdev_proc_mem_rate_write,
+	.llseek = seq_lseek,
+	.release = single_release,
+};
+
+/* events in the trace ring, from the oldest. */
+static int gdev_proc_trace_show(struct seq_file *seq, void *offset)
+{
+	struct gdev_device *gdev = seq->private;
+	struct gdev_trace_event ev;
+	char line[GDEV_PROC_TRACE_LINE];
+	uint32_t pos;
+
+	down(&proc_sem);
+	pos = gdev_trace_tail(&gdev->trace);
+	while (gdev_trace_read(&gdev->trace, &pos, &ev)) {
+		__gdev_proc_trace_line(line, &ev);
+		seq_puts(seq, line);
+	}
+	up(&proc_sem);
+
+	return 0;
+}
+
+static ssize_t gdev_proc_trace_write(struct file *file,
+                                     const char __user *buffer,
+                                     size_t count, loff_t *ppos)
+{
+	char kbuf[GDEV_PROC_MAX_BUF];
+	struct seq_file *seq = file->private_data;
+	struct gdev_device *gdev = seq->private;
+	int ret;
+
+	if (count > GDEV_PROC_MAX_BUF - 1)
+		count = GDEV_PROC_MAX_BUF - 1;
+	if (copy_from_user(kbuf, buffer, count)) {
+		GDEV_PRINT("Failed to write /proc entry\n");
+		return -EFAULT;
+	}
+	kbuf[count] = '\0';
+
+	ret = __gdev_proc_trace_enable(gdev, kbuf);
+	if (ret)
+		return ret;
+
+	return count;
+}
+
+static int gdev_proc_trace_open_fs(struct inode *inode, struct file *file)
+{
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(3,10,0)
+	return single_open(file, gdev_proc_trace_show, PDE_DATA(inode));
+#else
+	return single_open(file, gdev_proc_trace_show, PDE(inode)->data);
+#endif
+}
+
+static const struct file_operations gdev_proc_trace_fops = {
+	.owner = THIS_MODULE,
+	.open = gdev_proc_trace_open_fs,
+	.read = seq_read,
+	.write = gdev_proc_trace_write,
+	.llseek = seq_lseek,
+	.release = single_release,
+};
+
 int gdev_proc_create(void)
 {
+	int i;
 	char name[256];
 
 	gdev_proc = proc_mkdir("gdev", NULL);
@@ -143,8 +466,65 @@ int gdev_proc_create(void)
 		GDEV_PRINT("Failed to create /proc/gdev/%s\n", name);
 		goto fail_alloc_proc_vd;
 	}
+
+	/* physical devices information */
+	proc_pd = kzalloc(sizeof(*proc_pd) * gdev_count, GFP_KERNEL);
+	if (!proc_pd) {
+		GDEV_PRINT("Failed to create /proc/gdev/%s\n", name);
+		goto fail_alloc_proc_pd;
+	}
+	for (i = 0; i < gdev_count; i++) {
+		sprintf(name, "pd%d", i);
+		proc_pd[i].dir = proc_mkdir(name, gdev_proc);
+		if (!proc_pd[i].dir) {
+			GDEV_PRINT("Failed to create /proc/gdev/%s\n", name);
+			goto fail_proc_pd;
+		}
+		sprintf(name, "vsched_policy");
+		proc_pd[i].vsched_policy = proc_create_data(name, S_IFREG | S_IRUGO | S_IWUSR,
+		                                            proc_pd[i].dir,
+		                                            &gdev_proc_vsched_policy_fops,
+		                                            &gdevs[i]);
+		if (!proc_pd[i].vsched_policy) {
+			GDEV_PRINT("Failed to create /proc/gdev/pd%d/%s\n", i, name);
+			goto fail_proc_pd;
+		}
+		sprintf(name, "queueing");
+		proc_pd[i].queueing = proc_create_data(name, S_IFREG | S_IRUGO | S_IWUSR,
+		                                       proc_pd[i].dir,
+		                                       &gdev_proc_queueing_fops,
+		                                       &gdevs[i]);
+		if (!proc_pd[i].queueing) {
+			GDEV_PRINT("Failed to create /proc/gdev/pd%d/%s\n", i, name);
+			goto fail_proc_pd;
+		}
+		sprintf(name, "mem_rate");
+		proc_pd[i].mem_rate = proc_create_data(name, S_IFREG | S_IRUGO | S_IWUSR,
+		                                       proc_pd[i].dir,
+		                                       &gdev_proc_mem_rate_fops,
+		                                       &gdevs[i]);
+		if (!proc_pd[i].mem_rate) {
+			GDEV_PRINT("Failed to create /proc/gdev/pd%d/%s\n", i, name);
+			goto fail_proc_pd;
+		}
+		sprintf(name, "trace");
+		proc_pd[i].trace = proc_create_data(name, S_IFREG | S_IRUGO | S_IWUSR,
+		                                    proc_pd[i].dir,
+		                                    &gdev_proc_trace_fops,
+		                                    &gdevs[i]);
+		if (!proc_pd[i].trace) {
+			GDEV_PRINT("Failed to create /proc/gdev/pd%d/%s\n", i, name);
+			goto fail_proc_pd;
+		}
+	}
+
 	return 0;
 
+fail_proc_pd:
+	__gdev_proc_pd_delete();
+fail_alloc_proc_pd:
+	kfree(proc_vd);
+	proc_vd = NULL;
 fail_alloc_proc_vd:
 	remove_proc_entry("gdev/virtual_device_count", gdev_proc);
 fail_proc_virt_dev_count:
@@ -502,8 +882,169 @@ static int gdev_proc_util_write(struct file *filp, const char __user *buf, unsig
 	return count;
 }
 
+/* virtual device scheduling policy read. */
+static int gdev_proc_vsched_read(char *page, char **start, off_t off, int count, int *eof, void *data)
+{
+	char kbuf[64];
+	struct gdev_device *gdev = (struct gdev_device*)data;
+	char *p = kbuf;
+	int i;
+
+	for (i = 0; i < GDEV_VSCHED_POLICY_COUNT; i++) {
+		if (i == gdev->vsched_policy)
+			p += sprintf(p, "[%s]", gdev_vsched_policies[i]->name);
+		else
+			p += sprintf(p, "%s", gdev_vsched_policies[i]->name);
+		p += sprintf(p, i < GDEV_VSCHED_POLICY_COUNT - 1 ? " " : "\n");
+	}
+
+	return gdev_proc_read(kbuf, page, count, eof);
+}
+
+/* virtual device scheduling policy write. */
+static int gdev_proc_vsched_write(struct file *filp, const char __user *buf, unsigned long count, void *data)
+{
+	char kbuf[64];
+	struct gdev_device *gdev = (struct gdev_device*)data;
+	int policy, ret;
+
+	count = gdev_proc_write(kbuf, buf, count);
+	kbuf[count] = '\0';
+
+	policy = gdev_vsched_lookup(strim(kbuf));
+	if (policy < 0) {
+		GDEV_PRINT("Invalid virtual device scheduling policy %s\n", kbuf);
+		return policy;
+	}
+
+	down(&proc_sem);
+	ret = gdev_vsched_set(gdev, policy);
+	up(&proc_sem);
+	if (ret)
+		return ret;
+
+	return count;
+}
+
+/* queueing method read. */
+static int gdev_proc_queueing_read(char *page, char **start, off_t off, int count, int *eof, void *data)
+{
+	char kbuf[64];
+	struct gdev_device *gdev = (struct gdev_device*)data;
+	char *p = kbuf;
+	int i;
+
+	for (i = 0; i < GDEV_SCHED_QUEUEING_COUNT; i++) {
+		if (i == gdev->sched_queueing)
+			p += sprintf(p, "[%s]", gdev_sched_queueing_names[i]);
+		else
+			p += sprintf(p, "%s", gdev_sched_queueing_names[i]);
+		p += sprintf(p, i < GDEV_SCHED_QUEUEING_COUNT - 1 ? " " : "\n");
+	}
+
+	return gdev_proc_read(kbuf, page, count, eof);
+}
+
+/* queueing method write. */
+static int gdev_proc_queueing_write(struct file *filp, const char __user *buf, unsigned long count, void *data)
+{
+	char kbuf[64];
+	struct gdev_device *gdev = (struct gdev_device*)data;
+	int queueing, ret;
+
+	count = gdev_proc_write(kbuf, buf, count);
+	kbuf[count] = '\0';
+
+	queueing = gdev_sched_queueing_lookup(strim(kbuf));
+	if (queueing < 0) {
+		GDEV_PRINT("Invalid queueing method %s\n", kbuf);
+		return queueing;
+	}
+
+	down(&proc_sem);
+	ret = gdev_sched_queueing_set(gdev, queueing);
+	up(&proc_sem);
+	if (ret)
+		return ret;
+
+	return count;
+}
+
+/* memcpy rate read. */
+static int gdev_proc_mem_rate_read(char *page, char **start, off_t off, int count, int *eof, void *data)
+{
+	char kbuf[64];
+	struct gdev_device *gdev = (struct gdev_device*)data;
+
+	sprintf(kbuf, "%llu\n", (unsigned long long)gdev_throttle_rate_get(gdev));
+
+	return gdev_proc_read(kbuf, page, count, eof);
+}
+
+/* memcpy rate write. */
+static int gdev_proc_mem_rate_write(struct file *filp, const char __user *buf, unsigned long count, void *data)
+{
+	char kbuf[64];
+	struct gdev_device *gdev = (struct gdev_device*)data;
+	unsigned long long rate;
+
+	count = gdev_proc_write(kbuf, buf, count);
+	kbuf[count] = '\0';
+
+	if (sscanf(kbuf, "%llu", &rate) != 1) {
+		GDEV_PRINT("Invalid memcpy rate %s\n", kbuf);
+		return -EINVAL;
+	}
+
+	down(&proc_sem);
+	gdev_throttle_rate_set(gdev, rate);
+	up(&proc_sem);
+
+	return count;
+}
+
+/* trace read. only the latest events fit in the page. */
+static int gdev_proc_trace_read(char *page, char **start, off_t off, int count, int *eof, void *data)
+{
+	struct gdev_device *gdev = (struct gdev_device*)data;
+	struct gdev_trace_event ev;
+	uint32_t pos, head, lines = count / GDEV_PROC_TRACE_LINE;
+	int len = 0;
+
+	down(&proc_sem);
+	pos = gdev_trace_tail(&gdev->trace);
+	head = gdev->trace.head;
+	if (head - pos > lines)
+		pos = head - lines;
+	while (len + GDEV_PROC_TRACE_LINE <= count &&
+	       gdev_trace_read(&gdev->trace, &pos, &ev))
+		len += __gdev_proc_trace_line(page + len, &ev);
+	*eof = 1;
+	up(&proc_sem);
+
+	return len;
+}
+
+/* trace write. */
+static int gdev_proc_trace_write(struct file *filp, const char __user *buf, unsigned long count, void *data)
+{
+	char kbuf[64];
+	struct gdev_device *gdev = (struct gdev_device*)data;
+	int ret;
+
+	count = gdev_proc_write(kbuf, buf, count);
+	kbuf[count] = '\0';
+
+	ret = __gdev_proc_trace_enable(gdev, kbuf);
+	if (ret)
+		return ret;
+
+	return count;
+}
+
 int gdev_proc_create(void)
 {
+	int i;
 	char name[256];
 
 	gdev_proc = proc_mkdir("gdev", NULL);
@@ -542,8 +1083,65 @@ int gdev_proc_create(void)
 		GDEV_PRINT("Failed to create /proc/gdev/%s\n", name);
 		goto fail_alloc_proc_vd;
 	}
+
+	/* physical devices information */
+	proc_pd = kzalloc(sizeof(*proc_pd) * gdev_count, GFP_KERNEL);
+	if (!proc_pd) {
+		GDEV_PRINT("Failed to create /proc/gdev/%s\n", name);
+		goto fail_alloc_proc_pd;
+	}
+	for (i = 0; i < gdev_count; i++) {
+		sprintf(name, "pd%d", i);
+		proc_pd[i].dir = proc_mkdir(name, gdev_proc);
+		if (!proc_pd[i].dir) {
+			GDEV_PRINT("Failed to create /proc/gdev/%s\n", name);
+			goto fail_proc_pd;
+		}
+		sprintf(name, "vsched_policy");
+		proc_pd[i].vsched_policy = create_proc_entry(name, 0644, proc_pd[i].dir);
+		if (!proc_pd[i].vsched_policy) {
+			GDEV_PRINT("Failed to create /proc/gdev/pd%d/%s\n", i, name);
+			goto fail_proc_pd;
+		}
+		proc_pd[i].vsched_policy->read_proc = gdev_proc_vsched_read;
+		proc_pd[i].vsched_policy->write_proc = gdev_proc_vsched_write;
+		proc_pd[i].vsched_policy->data = (void*)&gdevs[i];
+		sprintf(name, "queueing");
+		proc_pd[i].queueing = create_proc_entry(name, 0644, proc_pd[i].dir);
+		if (!proc_pd[i].queueing) {
+			GDEV_PRINT("Failed to create /proc/gdev/pd%d/%s\n", i, name);
+			goto fail_proc_pd;
+		}
+		proc_pd[i].queueing->read_proc = gdev_proc_queueing_read;
+		proc_pd[i].queueing->write_proc = gdev_proc_queueing_write;
+		proc_pd[i].queueing->data = (void*)&gdevs[i];
+		sprintf(name, "mem_rate");
+		proc_pd[i].mem_rate = create_proc_entry(name, 0644, proc_pd[i].dir);
+		if (!proc_pd[i].mem_rate) {
+			GDEV_PRINT("Failed to create /proc/gdev/pd%d/%s\n", i, name);
+			goto fail_proc_pd;
+		}
+		proc_pd[i].mem_rate->read_proc = gdev_proc_mem_rate_read;
+		proc_pd[i].mem_rate->write_proc = gdev_proc_mem_rate_write;
+		proc_pd[i].mem_rate->data = (void*)&gdevs[i];
+		sprintf(name, "trace");
+		proc_pd[i].trace = create_proc_entry(name, 0644, proc_pd[i].dir);
+		if (!proc_pd[i].trace) {
+			GDEV_PRINT("Failed to create /proc/gdev/pd%d/%s\n", i, name);
+			goto fail_proc_pd;
+		}
+		proc_pd[i].trace->read_proc = gdev_proc_trace_read;
+		proc_pd[i].trace->write_proc = gdev_proc_trace_write;
+		proc_pd[i].trace->data = (void*)&gdevs[i];
+	}
+
 	return 0;
 
+fail_proc_pd:
+	__gdev_proc_pd_delete();
+fail_alloc_proc_pd:
+	kfree(proc_vd);
+	proc_vd = NULL;
 fail_alloc_proc_vd:
 	remove_proc_entry("gdev/virtual_device_count", gdev_proc);
 fail_proc_virt_dev_count:
@@ -682,6 +1280,8 @@ int gdev_proc_delete(void)
 	if (!gdev_proc)
 		goto end;
 
+	__gdev_proc_pd_delete();
+
 	if (!proc_vd)
 		goto remove_gdev_proc_root;
 
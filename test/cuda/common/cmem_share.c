@@ -0,0 +1,94 @@
+#include "cuda.h"
+#include "gdev_cuda.h"
+#include <stdio.h>
+
+/* Fermi-class device geometry. */
+#define TEST_CHIPSET 0xc0
+#define TEST_MP_COUNT 14
+#define TEST_WARP_COUNT 48
+#define TEST_WARP_SIZE 32
+
+/* the code size that the module used to allocate and upload: every kernel 
+   had its own copy of every constant segment. */
+static uint32_t legacy_code_size(struct CUmod_st *mod)
+{
+	struct CUfunc_st *func;
+	struct gdev_kernel *k;
+	uint32_t size = 0;
+	int i;
+
+	gdev_list_for_each(func, &mod->func_list, list_entry) {
+		k = &func->kernel;
+		size += k->code_size;
+		for (i = 0; i < GDEV_NVIDIA_CONST_SEGMENT_MAX_COUNT; i++) {
+			if (i == 1 || i == 15) {
+				if (func->raw_func.cmem[i].size == 0)
+					size += 0x10000;
+				else
+					size += gdev_cuda_align_cmem_size(func->raw_func.cmem[i].size);
+			}
+			else if (func->cmem_seg[i])
+				size += k->cmem[i].size;
+		}
+	}
+	for (i = 0; i < GDEV_NVIDIA_CONST_SEGMENT_MAX_COUNT; i++)
+		size += mod->cmem[i].size;
+
+	return size;
+}
+
+/* parse the cubin offline and compare the device memory (which is also the
+   number of bytes uploaded) for code and constant memory before and after
+   sharing identical constant segments among kernels. */
+int cuda_test_cmem_share(char *path)
+{
+	CUresult res;
+	struct CUmod_st mod;
+	struct CUfunc_st *func;
+	struct gdev_cuda_cmem_seg *seg;
+	struct gdev_cuda_info info;
+	uint32_t legacy;
+	int count = 0, seg_count = 0, ret = 0;
+	char fname[256];
+
+	sprintf(fname, "%s/cmem_share_gpu.cubin", path);
+	if ((res = gdev_cuda_load_cubin_file(&mod, fname)) != CUDA_SUCCESS) {
+		printf("gdev_cuda_load_cubin_file failed: res = %u\n", res);
+		return -1;
+	}
+
+	info.chipset = TEST_CHIPSET;
+	info.mp_count = TEST_MP_COUNT;
+	info.warp_count = TEST_WARP_COUNT;
+	info.warp_size = TEST_WARP_SIZE;
+	if ((res = gdev_cuda_construct_kernels(&mod, &info)) != CUDA_SUCCESS) {
+		printf("gdev_cuda_construct_kernels failed: res = %u\n", res);
+		gdev_cuda_unload_cubin(&mod);
+		return -1;
+	}
+
+	gdev_list_for_each(func, &mod.func_list, list_entry)
+		count++;
+	gdev_list_for_each(seg, &mod.cmem_list, list_entry)
+		seg_count++;
+
+	legacy = legacy_code_size(&mod);
+	printf("kernels: %d\n", count);
+	printf("local constant segments: %d\n", seg_count);
+	printf("code_size (per-kernel segments): 0x%x\n", legacy);
+	printf("code_size (shared segments): 0x%x\n", mod.code_size);
+
+	/* every kernel still has c1[], c15[] and c17[] bound. */
+	gdev_list_for_each(func, &mod.func_list, list_entry) {
+		if (!func->cmem_seg[1] || !func->cmem_seg[15] || !func->cmem_seg[17])
+			ret = -1;
+	}
+
+	if (count > 1 && mod.code_size >= legacy)
+		ret = -1;
+
+	gdev_cuda_destruct_kernels(&mod);
+	gdev_cuda_unload_cubin(&mod);
+
+	return ret;
+}
@@ -0,0 +1,19 @@
+/* several small kernels that only differ in their code: their constant
+   segments are identical and should be shared. */
+
+__constant__ int coef[16];
+
+#define CMEM_KERNEL(name, op)										\
+extern "C" __global__ void name(int *out, int *in, int n)			\
+{																	\
+	int i = blockIdx.x * blockDim.x + threadIdx.x;					\
+	if (i < n)														\
+		out[i] = in[i] op coef[i & 15];								\
+}
+
+CMEM_KERNEL(cmem_add, +)
+CMEM_KERNEL(cmem_sub, -)
+CMEM_KERNEL(cmem_mul, *)
+CMEM_KERNEL(cmem_and, &)
+CMEM_KERNEL(cmem_or, |)
+CMEM_KERNEL(cmem_xor, ^)
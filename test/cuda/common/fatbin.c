@@ -0,0 +1,250 @@
+#include <cuda.h>
+#include <elf.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <zlib.h>
+#include "gdev_cuda.h"
+
+#define FATBIN_WRAPPER_MAGIC 0x466243b1
+#define FATBIN_MAGIC 0xba55ed50
+#define FATBIN_KIND_PTX 0x1
+#define FATBIN_KIND_ELF 0x2
+#define FATBIN_FLAG_COMPRESSED 0x1000
+
+struct fatbin_wrapper {
+	uint32_t magic;
+	uint32_t version;
+	const void *data;
+	void *unk;
+};
+
+struct fatbin_header {
+	uint32_t magic;
+	uint16_t version;
+	uint16_t header_size;
+	uint64_t size;
+};
+
+struct fatbin_entry {
+	uint16_t kind;
+	uint16_t unk16;
+	uint32_t header_size;
+	uint64_t size;
+	uint32_t unk32[3];
+	uint32_t arch;
+	uint32_t name_offset;
+	uint32_t name_size;
+	uint64_t flags;
+	uint64_t unk64;
+	uint64_t uncompressed_size;
+};
+
+#define FATBIN_MAX_SIZE 0x10000
+
+struct fatbin {
+	struct fatbin_wrapper wrapper;
+	uint64_t data[FATBIN_MAX_SIZE / 8];
+};
+
+/* make a synthetic cubin with a single kernel named "sm<arch>", so that
+   the selected image can be told by the kernel name. */
+static int make_cubin(char *buf, int arch)
+{
+	Elf64_Ehdr *eh = (Elf64_Ehdr *)buf;
+	Elf64_Shdr *sh;
+	char *names, *p;
+	uint32_t *code;
+	int i, shnum = 5; /* null, .text, .nv.info.func, .nv.info, .shstrtab */
+	int size;
+
+	memset(eh, 0, sizeof(*eh));
+	memcpy(eh->e_ident, ELFMAG, SELFMAG);
+	eh->e_ident[EI_CLASS] = ELFCLASS64;
+	eh->e_ident[EI_DATA] = ELFDATA2LSB;
+	eh->e_ident[EI_VERSION] = EV_CURRENT;
+	eh->e_type = ET_EXEC;
+	eh->e_machine = 190; /* EM_CUDA */
+	eh->e_version = EV_CURRENT;
+	eh->e_flags = 0x140100 | arch;
+	eh->e_ehsize = sizeof(*eh);
+	eh->e_phentsize = sizeof(Elf64_Phdr);
+	eh->e_shentsize = sizeof(Elf64_Shdr);
+	eh->e_shnum = shnum;
+	eh->e_shstrndx = shnum - 1;
+
+	/* code. */
+	code = (uint32_t *)(buf + sizeof(*eh));
+	for (i = 0; i < 64; i++)
+		code[i] = (arch << 16) | i;
+
+	/* section names. */
+	names = (char *)(code + 64);
+	p = names;
+	*p++ = 0;
+
+	eh->e_shoff = (names - buf) + 128;
+	sh = (Elf64_Shdr *)(buf + eh->e_shoff);
+	memset(sh, 0, sizeof(*sh) * shnum);
+
+	sh[1].sh_name = p - names;
+	sh[1].sh_type = SHT_PROGBITS;
+	sh[1].sh_offset = (char *)code - buf;
+	sh[1].sh_size = 64 * 4;
+	sh[1].sh_info = 16 << 24; /* register count. */
+	p += sprintf(p, ".text.sm%d", arch) + 1;
+	sh[2].sh_name = p - names;
+	sh[2].sh_type = SHT_LOPROC;
+	sh[2].sh_offset = names - buf;
+	p += sprintf(p, ".nv.info.sm%d", arch) + 1;
+	sh[3].sh_name = p - names;
+	sh[3].sh_type = SHT_LOPROC;
+	sh[3].sh_offset = names - buf;
+	p += sprintf(p, ".nv.info") + 1;
+	sh[4].sh_name = p - names;
+	sh[4].sh_type = SHT_STRTAB;
+	sh[4].sh_offset = names - buf;
+	p += sprintf(p, ".shstrtab") + 1;
+	sh[4].sh_size = p - names;
+
+	size = eh->e_shoff + sizeof(*sh) * shnum;
+
+	return size;
+}
+
+/* append an entry of @kind for @arch to @fb. a corrupted entry cannot be
+   uncompressed, so it must never be selected. */
+static void add_entry(struct fatbin *fb, int kind, int arch, int compressed, int corrupted)
+{
+	struct fatbin_header *fh = (struct fatbin_header *)fb->data;
+	struct fatbin_entry *e;
+	char image[4096];
+	unsigned long size;
+	int image_size;
+
+	e = (struct fatbin_entry *)((char *)fh + fh->header_size + fh->size);
+	memset(e, 0, sizeof(*e));
+	e->kind = kind;
+	e->header_size = sizeof(*e);
+	e->arch = arch;
+
+	if (kind == FATBIN_KIND_ELF)
+		image_size = make_cubin(image, arch);
+	else
+		image_size = sprintf(image, ".version 3.0\n.target sm_%d\n", arch) + 1;
+
+	if (compressed) {
+		size = FATBIN_MAX_SIZE - fh->size;
+		compress((unsigned char *)(e + 1), &size, (unsigned char *)image, image_size);
+		if (corrupted)
+			memset(e + 1, 0xff, size);
+		e->flags = FATBIN_FLAG_COMPRESSED;
+		e->uncompressed_size = image_size;
+		e->size = (size + 7) & ~7;
+	}
+	else {
+		memcpy(e + 1, image, image_size);
+		e->size = (image_size + 7) & ~7;
+	}
+
+	fh->size += e->header_size + e->size;
+}
+
+static void init_fatbin(struct fatbin *fb)
+{
+	struct fatbin_header *fh = (struct fatbin_header *)fb->data;
+
+	memset(fb, 0, sizeof(*fb));
+	fb->wrapper.magic = FATBIN_WRAPPER_MAGIC;
+	fb->wrapper.version = 1;
+	fb->wrapper.data = fb->data;
+	fh->magic = FATBIN_MAGIC;
+	fh->version = 1;
+	fh->header_size = sizeof(*fh);
+}
+
+/* load @image on @chipset and see if the kernel compiled for @arch has
+   been selected. */
+static int check_select(const void *image, uint64_t chipset, int arch, CUresult expected)
+{
+	CUresult res;
+	struct CUmod_st mod;
+	struct CUfunc_st *func;
+	char name[16];
+
+	res = gdev_cuda_load_fatbin(&mod, image, chipset);
+	if (res != expected) {
+		printf("chipset 0x%lx: res = %u, expected %u\n",
+			   (unsigned long)chipset, res, expected);
+		if (res == CUDA_SUCCESS)
+			gdev_cuda_unload_cubin(&mod);
+		return -1;
+	}
+	if (res != CUDA_SUCCESS)
+		return 0;
+
+	sprintf(name, "sm%d", arch);
+	res = gdev_cuda_search_function(&func, &mod, name);
+	gdev_cuda_unload_cubin(&mod);
+	if (res != CUDA_SUCCESS) {
+		printf("chipset 0x%lx: %s is not selected\n",
+			   (unsigned long)chipset, name);
+		return -1;
+	}
+
+	return 0;
+}
+
+int cuda_test_fatbin(char *path)
+{
+	static struct fatbin fb;
+	char cubin[4096];
+
+	/* plain cubins are not fat binaries. */
+	make_cubin(cubin, 20);
+	if (gdev_cuda_is_fatbin(cubin)) {
+		printf("cubin is detected as a fat binary\n");
+		return -1;
+	}
+
+	/* native images of the same major version are preferred to PTX. */
+	init_fatbin(&fb);
+	add_entry(&fb, FATBIN_KIND_PTX, 20, 0, 0);
+	add_entry(&fb, FATBIN_KIND_ELF, 20, 0, 0);
+	add_entry(&fb, FATBIN_KIND_ELF, 21, 0, 0);
+	add_entry(&fb, FATBIN_KIND_PTX, 35, 0, 0);
+	add_entry(&fb, FATBIN_KIND_ELF, 30, 0, 0);
+	if (!gdev_cuda_is_fatbin(&fb) || !gdev_cuda_is_fatbin(fb.data)) {
+		printf("fat binary is not detected\n");
+		return -1;
+	}
+	if (check_select(&fb, 0xc0, 20, CUDA_SUCCESS) ||
+		check_select(&fb, 0xc1, 21, CUDA_SUCCESS) ||
+		check_select(&fb, 0xe4, 30, CUDA_SUCCESS) ||
+		check_select(&fb, 0xf0, 30, CUDA_SUCCESS) ||
+		check_select(fb.data, 0xc1, 21, CUDA_SUCCESS))
+		return -1;
+
+	/* only the selected image is uncompressed. */
+	init_fatbin(&fb);
+	add_entry(&fb, FATBIN_KIND_ELF, 35, 1, 1);
+	add_entry(&fb, FATBIN_KIND_PTX, 20, 1, 1);
+	add_entry(&fb, FATBIN_KIND_ELF, 20, 1, 0);
+	add_entry(&fb, FATBIN_KIND_ELF, 30, 1, 0);
+	if (check_select(&fb, 0xc0, 20, CUDA_SUCCESS) ||
+		check_select(&fb, 0xc1, 20, CUDA_SUCCESS) ||
+		check_select(&fb, 0xe4, 30, CUDA_SUCCESS) ||
+		check_select(&fb, 0xf0, 35, CUDA_ERROR_INVALID_IMAGE))
+		return -1;
+
+	/* no image runs on this device. */
+	init_fatbin(&fb);
+	add_entry(&fb, FATBIN_KIND_ELF, 30, 0, 0);
+	add_entry(&fb, FATBIN_KIND_PTX, 30, 0, 0);
+	if (check_select(&fb, 0xc0, 0, CUDA_ERROR_NO_BINARY_FOR_GPU) ||
+		check_select(&fb, 0x50, 0, CUDA_ERROR_NO_BINARY_FOR_GPU))
+		return -1;
+
+	return 0;
+}
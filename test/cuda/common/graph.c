@@ -0,0 +1,298 @@
+#include <cuda.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/time.h>
+
+#define NR_LAUNCHES 8 /* kernel launches per iteration. */
+
+/* tvsub: ret = x - y. */
+static inline void tvsub(struct timeval *x, 
+						 struct timeval *y, 
+						 struct timeval *ret)
+{
+	ret->tv_sec = x->tv_sec - y->tv_sec;
+	ret->tv_usec = x->tv_usec - y->tv_usec;
+	if (ret->tv_usec < 0) {
+		ret->tv_sec--;
+		ret->tv_usec += 1000000;
+	}
+}
+
+/* the work repeated every iteration: copy data in, add @val to each 
+   element NR_LAUNCHES times, and copy data out. */
+static CUresult submit(CUfunction function, CUdeviceptr d_data, uint32_t *data, 
+					   uint32_t n, uint32_t val, CUstream stream)
+{
+	CUresult res;
+	void *params[] = {&d_data, &n, &val};
+	int i;
+
+	res = cuMemcpyHtoDAsync(d_data, data, n * sizeof(uint32_t), stream);
+	if (res != CUDA_SUCCESS)
+		return res;
+	for (i = 0; i < NR_LAUNCHES; i++) {
+		res = cuLaunchKernel(function, (n + 127) / 128, 1, 1, 128, 1, 1, 0, 
+							 stream, params, NULL);
+		if (res != CUDA_SUCCESS)
+			return res;
+	}
+	res = cuMemcpyDtoHAsync(data, d_data, n * sizeof(uint32_t), stream);
+	if (res != CUDA_SUCCESS)
+		return res;
+
+	return CUDA_SUCCESS;
+}
+
+static int check(uint32_t *data, uint32_t n, uint32_t expected)
+{
+	uint32_t i;
+
+	for (i = 0; i < n; i++) {
+		if (data[i] != expected) {
+			printf("data[%u] = %u, expected %u\n", i, data[i], expected);
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+int cuda_test_graph(unsigned int n, int count, char *path)
+{
+	CUresult res;
+	CUdevice dev;
+	CUcontext ctx;
+	CUfunction function;
+	CUmodule module;
+	CUstream stream;
+	CUgraph graph;
+	CUgraphExec exec;
+	CUgraphNode nodes[NR_LAUNCHES + 2];
+	CUgraphNodeType type;
+	CUDA_KERNEL_NODE_PARAMS kp;
+	CUdeviceptr d_data;
+	uint32_t *data;
+	uint32_t val;
+	size_t nr_nodes;
+	void *params[3];
+	char fname[256];
+	struct timeval tv_start, tv_end, tv_loop, tv_graph;
+	int i;
+
+	res = cuInit(0);
+	if (res != CUDA_SUCCESS) {
+		printf("cuInit failed: res = %lu\n", (unsigned long)res);
+		return -1;
+	}
+
+	res = cuDeviceGet(&dev, 0);
+	if (res != CUDA_SUCCESS) {
+		printf("cuDeviceGet failed: res = %lu\n", (unsigned long)res);
+		return -1;
+	}
+
+	res = cuCtxCreate(&ctx, 0, dev);
+	if (res != CUDA_SUCCESS) {
+		printf("cuCtxCreate failed: res = %lu\n", (unsigned long)res);
+		return -1;
+	}
+
+	sprintf(fname, "%s/graph_gpu.cubin", path);
+	res = cuModuleLoad(&module, fname);
+	if (res != CUDA_SUCCESS) {
+		printf("cuModuleLoad() failed\n");
+		return -1;
+	}
+	res = cuModuleGetFunction(&function, module, "_Z3addPjjj");
+	if (res != CUDA_SUCCESS) {
+		printf("cuModuleGetFunction() failed\n");
+		return -1;
+	}
+
+	res = cuMemAlloc(&d_data, n * sizeof(uint32_t));
+	if (res != CUDA_SUCCESS) {
+		printf("cuMemAlloc failed\n");
+		return -1;
+	}
+	/* asynchronous copies need page-locked memory. */
+	res = cuMemAllocHost((void **)&data, n * sizeof(uint32_t));
+	if (res != CUDA_SUCCESS) {
+		printf("cuMemAllocHost failed\n");
+		return -1;
+	}
+
+	res = cuStreamCreate(&stream, 0);
+	if (res != CUDA_SUCCESS) {
+		printf("cuStreamCreate failed: res = %lu\n", (unsigned long)res);
+		return -1;
+	}
+
+	/* the original launch loop. */
+	for (i = 0; i < n; i++)
+		data[i] = 0;
+	gettimeofday(&tv_start, NULL);
+	for (i = 0; i < count; i++) {
+		res = submit(function, d_data, data, n, 1, NULL);
+		if (res != CUDA_SUCCESS) {
+			printf("submit failed: res = %lu\n", (unsigned long)res);
+			return -1;
+		}
+	}
+	gettimeofday(&tv_end, NULL);
+	tvsub(&tv_end, &tv_start, &tv_loop);
+	if (check(data, n, count * NR_LAUNCHES))
+		return -1;
+
+	/* capture the same work into a graph. */
+	res = cuStreamBeginCapture(stream);
+	if (res != CUDA_SUCCESS) {
+		printf("cuStreamBeginCapture failed: res = %lu\n", (unsigned long)res);
+		return -1;
+	}
+	res = submit(function, d_data, data, n, 1, stream);
+	if (res != CUDA_SUCCESS) {
+		printf("submit failed: res = %lu\n", (unsigned long)res);
+		return -1;
+	}
+	res = cuStreamEndCapture(stream, &graph);
+	if (res != CUDA_SUCCESS) {
+		printf("cuStreamEndCapture failed: res = %lu\n", (unsigned long)res);
+		return -1;
+	}
+
+	nr_nodes = NR_LAUNCHES + 2;
+	res = cuGraphGetNodes(graph, nodes, &nr_nodes);
+	if (res != CUDA_SUCCESS || nr_nodes != NR_LAUNCHES + 2) {
+		printf("cuGraphGetNodes failed: res = %lu\n", (unsigned long)res);
+		return -1;
+	}
+	res = cuGraphNodeGetType(nodes[1], &type);
+	if (res != CUDA_SUCCESS || type != CU_GRAPH_NODE_TYPE_KERNEL) {
+		printf("cuGraphNodeGetType failed: res = %lu\n", (unsigned long)res);
+		return -1;
+	}
+
+	res = cuGraphInstantiate(&exec, graph, NULL, NULL, 0);
+	if (res != CUDA_SUCCESS) {
+		printf("cuGraphInstantiate failed: res = %lu\n", (unsigned long)res);
+		return -1;
+	}
+
+	/* replay it: nothing has been run on capture. */
+	for (i = 0; i < n; i++)
+		data[i] = 0;
+	gettimeofday(&tv_start, NULL);
+	for (i = 0; i < count; i++) {
+		res = cuGraphLaunch(exec, NULL);
+		if (res != CUDA_SUCCESS) {
+			printf("cuGraphLaunch failed: res = %lu\n", (unsigned long)res);
+			return -1;
+		}
+	}
+	gettimeofday(&tv_end, NULL);
+	tvsub(&tv_end, &tv_start, &tv_graph);
+	cuCtxSynchronize();
+	if (check(data, n, count * NR_LAUNCHES))
+		return -1;
+
+	printf("launch loop: %lu.%06lu sec\n", tv_loop.tv_sec, tv_loop.tv_usec);
+	printf("graph replay: %lu.%06lu sec\n", tv_graph.tv_sec, tv_graph.tv_usec);
+
+	/* change the value added by the first launch. */
+	val = 100;
+	params[0] = &d_data;
+	params[1] = &n;
+	params[2] = &val;
+	kp.func = function;
+	kp.gridDimX = (n + 127) / 128;
+	kp.gridDimY = 1;
+	kp.gridDimZ = 1;
+	kp.blockDimX = 128;
+	kp.blockDimY = 1;
+	kp.blockDimZ = 1;
+	kp.sharedMemBytes = 0;
+	kp.kernelParams = params;
+	kp.extra = NULL;
+	res = cuGraphExecKernelNodeSetParams(exec, nodes[1], &kp);
+	if (res != CUDA_SUCCESS) {
+		printf("cuGraphExecKernelNodeSetParams failed: res = %lu\n", 
+			   (unsigned long)res);
+		return -1;
+	}
+
+	for (i = 0; i < n; i++)
+		data[i] = 0;
+	res = cuGraphLaunch(exec, NULL);
+	if (res != CUDA_SUCCESS) {
+		printf("cuGraphLaunch failed: res = %lu\n", (unsigned long)res);
+		return -1;
+	}
+	cuCtxSynchronize();
+	if (check(data, n, val + NR_LAUNCHES - 1))
+		return -1;
+
+	/* the function itself still adds the value it was launched with. */
+	for (i = 0; i < n; i++)
+		data[i] = 0;
+	res = cuMemcpyHtoD(d_data, data, n * sizeof(uint32_t));
+	if (res != CUDA_SUCCESS) {
+		printf("cuMemcpyHtoD failed: res = %lu\n", (unsigned long)res);
+		return -1;
+	}
+	res = cuLaunchGrid(function, (n + 127) / 128, 1);
+	if (res != CUDA_SUCCESS) {
+		printf("cuLaunchGrid failed: res = %lu\n", (unsigned long)res);
+		return -1;
+	}
+	res = cuMemcpyDtoH(data, d_data, n * sizeof(uint32_t));
+	if (res != CUDA_SUCCESS) {
+		printf("cuMemcpyDtoH failed: res = %lu\n", (unsigned long)res);
+		return -1;
+	}
+	if (check(data, n, 1))
+		return -1;
+
+	res = cuGraphExecDestroy(exec);
+	if (res != CUDA_SUCCESS) {
+		printf("cuGraphExecDestroy failed: res = %lu\n", (unsigned long)res);
+		return -1;
+	}
+	res = cuGraphDestroy(graph);
+	if (res != CUDA_SUCCESS) {
+		printf("cuGraphDestroy failed: res = %lu\n", (unsigned long)res);
+		return -1;
+	}
+
+	res = cuStreamDestroy(stream);
+	if (res != CUDA_SUCCESS) {
+		printf("cuStreamDestroy failed: res = %lu\n", (unsigned long)res);
+		return -1;
+	}
+
+	res = cuMemFreeHost(data);
+	if (res != CUDA_SUCCESS) {
+		printf("cuMemFreeHost failed: res = %lu\n", (unsigned long)res);
+		return -1;
+	}
+
+	res = cuMemFree(d_data);
+	if (res != CUDA_SUCCESS) {
+		printf("cuMemFree failed: res = %lu\n", (unsigned long)res);
+		return -1;
+	}
+
+	res = cuModuleUnload(module);
+	if (res != CUDA_SUCCESS) {
+		printf("cuModuleUnload failed: res = %lu\n", (unsigned long)res);
+		return -1;
+	}
+
+	res = cuCtxDestroy(ctx);
+	if (res != CUDA_SUCCESS) {
+		printf("cuCtxDestroy failed: res = %lu\n", (unsigned long)res);
+		return -1;
+	}
+
+	return 0;
+}
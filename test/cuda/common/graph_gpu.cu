@@ -0,0 +1,11 @@
+#include <stdint.h>
+#include <cuda.h>
+
+__global__
+void add(uint32_t *data, uint32_t n, uint32_t val)
+{
+	int i = blockIdx.x * blockDim.x + threadIdx.x;
+
+	if (i < n)
+		data[i] += val;
+}
@@ -0,0 +1,64 @@
+#include "cuda.h"
+#include "gdev_cuda.h"
+#include <stdio.h>
+
+/* Fermi-class device geometry: it only scales the numbers below. */
+#define TEST_CHIPSET 0xc0
+#define TEST_MP_COUNT 14
+#define TEST_WARP_COUNT 48
+#define TEST_WARP_SIZE 32
+
+/* parse the cubin offline and compare the static data size that the module
+   used to reserve (one local memory region per kernel) with the size of the
+   local memory window shared by all kernels. */
+int cuda_test_lmem_share(char *path)
+{
+	CUresult res;
+	struct CUmod_st mod;
+	struct CUfunc_st *func;
+	struct gdev_cuda_info info;
+	uint64_t sum = 0, max = 0;
+	int count = 0;
+	char fname[256];
+
+	sprintf(fname, "%s/lmem_share_gpu.cubin", path);
+	if ((res = gdev_cuda_load_cubin_file(&mod, fname)) != CUDA_SUCCESS) {
+		printf("gdev_cuda_load_cubin_file failed: res = %u\n", res);
+		return -1;
+	}
+
+	info.chipset = TEST_CHIPSET;
+	info.mp_count = TEST_MP_COUNT;
+	info.warp_count = TEST_WARP_COUNT;
+	info.warp_size = TEST_WARP_SIZE;
+	if ((res = gdev_cuda_construct_kernels(&mod, &info)) != CUDA_SUCCESS) {
+		printf("gdev_cuda_construct_kernels failed: res = %u\n", res);
+		gdev_cuda_unload_cubin(&mod);
+		return -1;
+	}
+
+	gdev_list_for_each(func, &mod.func_list, list_entry) {
+		struct gdev_kernel *k = &func->kernel;
+		printf("%s: lmem_size_total = 0x%llx\n", 
+			   func->raw_func.name, (unsigned long long)k->lmem_size_total);
+		sum += k->lmem_size_total;
+		if (k->lmem_size_total > max)
+			max = k->lmem_size_total;
+		count++;
+	}
+
+	printf("kernels: %d\n", count);
+	printf("sdata_size (per-kernel regions): 0x%llx\n", 
+		   (unsigned long long)sum);
+	printf("sdata_size (shared window): 0x%x\n", mod.sdata_size);
+
+	gdev_cuda_destruct_kernels(&mod);
+	gdev_cuda_unload_cubin(&mod);
+
+	if (mod.sdata_size != max)
+		return -1;
+	if (count > 1 && mod.sdata_size >= sum)
+		return -1;
+
+	return 0;
+}
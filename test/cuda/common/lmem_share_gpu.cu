@@ -0,0 +1,19 @@
+/* several kernels with differently sized per-thread local arrays. the 
+   arrays are indexed dynamically so that nvcc keeps them in local memory. */
+
+#define LMEM_KERNEL(name, n)							\
+extern "C" __global__ void name(int *out, int idx)			\
+{															\
+	volatile int buf[n];									\
+	int i;													\
+	for (i = 0; i < n; i++)									\
+		buf[i] = i * threadIdx.x;							\
+	out[blockIdx.x * blockDim.x + threadIdx.x] = buf[idx % n];	\
+}
+
+LMEM_KERNEL(lmem_16, 16)
+LMEM_KERNEL(lmem_32, 32)
+LMEM_KERNEL(lmem_64, 64)
+LMEM_KERNEL(lmem_128, 128)
+LMEM_KERNEL(lmem_256, 256)
+LMEM_KERNEL(lmem_512, 512)
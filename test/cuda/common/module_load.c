@@ -0,0 +1,205 @@
+#include <cuda.h>
+#include <elf.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include "gdev_cuda.h"
+
+/* tvsub: ret = x - y. */
+static inline void tvsub(struct timeval *x, 
+						 struct timeval *y, 
+						 struct timeval *ret)
+{
+	ret->tv_sec = x->tv_sec - y->tv_sec;
+	ret->tv_usec = x->tv_usec - y->tv_usec;
+	if (ret->tv_usec < 0) {
+		ret->tv_sec--;
+		ret->tv_usec += 1000000;
+	}
+}
+
+static float tvms(struct timeval *start, struct timeval *end)
+{
+	struct timeval tv;
+	tvsub(end, start, &tv);
+	return tv.tv_sec * 1000.0 + (float) tv.tv_usec / 1000.0;
+}
+
+#define SECTIONS_PER_KERNEL 4 /* .text, .nv.constant0, .nv.local, .nv.info */
+
+/* write a synthetic sm_20 cubin with @nr kernels of @code_size bytes each.
+   the code is never launched: it is only parsed and uploaded. */
+static int write_cubin(const char *fname, int nr, uint32_t code_size)
+{
+	Elf64_Ehdr eh;
+	Elf64_Shdr *sh;
+	char *names, *p;
+	uint32_t *code;
+	uint64_t offset;
+	int shnum = nr * SECTIONS_PER_KERNEL + 3; /* null, .nv.info, .shstrtab */
+	int names_size = nr * 96 + 64;
+	int i, j;
+	FILE *fp;
+
+	sh = calloc(shnum, sizeof(*sh));
+	names = calloc(names_size, 1);
+	code = malloc(code_size);
+	if (!sh || !names || !code)
+		return -1;
+	for (i = 0; i < code_size / 4; i++)
+		code[i] = 0x10000000 | i;
+
+	/* section names and headers. */
+	p = names + 1;
+	offset = sizeof(eh);
+	for (i = 0; i < nr; i++) {
+		Elf64_Shdr *s = &sh[1 + i * SECTIONS_PER_KERNEL];
+		for (j = 0; j < SECTIONS_PER_KERNEL; j++) {
+			s[j].sh_name = p - names;
+			s[j].sh_type = SHT_PROGBITS;
+			s[j].sh_addralign = 4;
+			switch (j) {
+			case 0:
+				p += sprintf(p, ".text.kernel%d", i) + 1;
+				s[j].sh_size = code_size;
+				s[j].sh_info = 16 << 24; /* register count. */
+				break;
+			case 1:
+				p += sprintf(p, ".nv.constant0.kernel%d", i) + 1;
+				s[j].sh_size = 0x40;
+				break;
+			case 2:
+				p += sprintf(p, ".nv.local.kernel%d", i) + 1;
+				s[j].sh_type = SHT_NOBITS;
+				s[j].sh_size = 0x10 << (i % 8);
+				break;
+			case 3:
+				p += sprintf(p, ".nv.info.kernel%d", i) + 1;
+				s[j].sh_type = SHT_LOPROC;
+				s[j].sh_size = 0;
+				break;
+			}
+			s[j].sh_offset = offset;
+			if (s[j].sh_type != SHT_NOBITS)
+				offset += s[j].sh_size;
+		}
+	}
+	sh[shnum - 2].sh_name = p - names;
+	sh[shnum - 2].sh_type = SHT_LOPROC;
+	sh[shnum - 2].sh_offset = offset;
+	p += sprintf(p, ".nv.info") + 1;
+	sh[shnum - 1].sh_name = p - names;
+	sh[shnum - 1].sh_type = SHT_STRTAB;
+	sh[shnum - 1].sh_offset = offset;
+	p += sprintf(p, ".shstrtab") + 1;
+	sh[shnum - 1].sh_size = p - names;
+	offset += sh[shnum - 1].sh_size;
+
+	memset(&eh, 0, sizeof(eh));
+	memcpy(eh.e_ident, ELFMAG, SELFMAG);
+	eh.e_ident[EI_CLASS] = ELFCLASS64;
+	eh.e_ident[EI_DATA] = ELFDATA2LSB;
+	eh.e_ident[EI_VERSION] = EV_CURRENT;
+	eh.e_type = ET_EXEC;
+	eh.e_machine = 190; /* EM_CUDA */
+	eh.e_version = EV_CURRENT;
+	eh.e_flags = 0x140114; /* sm_20 */
+	eh.e_ehsize = sizeof(eh);
+	eh.e_phentsize = sizeof(Elf64_Phdr);
+	eh.e_shentsize = sizeof(Elf64_Shdr);
+	eh.e_shoff = offset;
+	eh.e_shnum = shnum;
+	eh.e_shstrndx = shnum - 1;
+
+	if (!(fp = fopen(fname, "w")))
+		return -1;
+	fwrite(&eh, sizeof(eh), 1, fp);
+	for (i = 0; i < nr; i++) {
+		char zero[0x40] = {0};
+		fwrite(code, code_size, 1, fp);
+		fwrite(zero, sizeof(zero), 1, fp);
+	}
+	fwrite(names, sh[shnum - 1].sh_size, 1, fp);
+	fwrite(sh, sizeof(*sh), shnum, fp);
+	fclose(fp);
+
+	free(code);
+	free(names);
+	free(sh);
+
+	return 0;
+}
+
+/* measure the startup time of a large multi-kernel module: host-side 
+   parsing alone, and a complete cuModuleLoad() if a device is present. */
+int cuda_test_module_load(int nr, uint32_t code_size, int loops, char *path)
+{
+	CUresult res;
+	CUdevice dev;
+	CUcontext ctx;
+	CUmodule module;
+	struct CUmod_st mod;
+	struct gdev_cuda_info info;
+	struct timeval tv_start, tv_end;
+	void *buf;
+	char fname[256];
+	int i;
+
+	sprintf(fname, "%s/module_load.cubin", path);
+	if (write_cubin(fname, nr, code_size)) {
+		printf("Failed to write %s\n", fname);
+		return -1;
+	}
+	printf("module: %d kernels, 0x%x bytes of code each\n", nr, code_size);
+
+	/* host-side parsing and code image assembly. */
+	info.chipset = 0xc0;
+	info.mp_count = 14;
+	info.warp_count = 48;
+	info.warp_size = 32;
+	gettimeofday(&tv_start, NULL);
+	for (i = 0; i < loops; i++) {
+		if ((res = gdev_cuda_load_cubin_file(&mod, fname)) != CUDA_SUCCESS) {
+			printf("gdev_cuda_load_cubin_file failed: res = %u\n", res);
+			return -1;
+		}
+		if ((res = gdev_cuda_construct_kernels(&mod, &info)) != CUDA_SUCCESS) {
+			printf("gdev_cuda_construct_kernels failed: res = %u\n", res);
+			return -1;
+		}
+		mod.code_addr = 0;
+		gdev_cuda_locate_code(&mod);
+		buf = calloc(1, mod.code_size);
+		gdev_cuda_memcpy_code(&mod, buf);
+		free(buf);
+		gdev_cuda_destruct_kernels(&mod);
+		gdev_cuda_unload_cubin(&mod);
+	}
+	gettimeofday(&tv_end, NULL);
+	printf("Parse: %f (ms)\n", tvms(&tv_start, &tv_end) / loops);
+
+	/* complete module loading onto the device. */
+	if (cuInit(0) != CUDA_SUCCESS || cuDeviceGet(&dev, 0) != CUDA_SUCCESS ||
+		cuCtxCreate(&ctx, 0, dev) != CUDA_SUCCESS) {
+		printf("No device: skip cuModuleLoad()\n");
+		return 0;
+	}
+
+	gettimeofday(&tv_start, NULL);
+	for (i = 0; i < loops; i++) {
+		res = cuModuleLoad(&module, fname);
+		if (res != CUDA_SUCCESS) {
+			printf("cuModuleLoad() failed: res = %u\n", res);
+			cuCtxDestroy(ctx);
+			return -1;
+		}
+		cuModuleUnload(module);
+	}
+	gettimeofday(&tv_end, NULL);
+	printf("Load: %f (ms)\n", tvms(&tv_start, &tv_end) / loops);
+
+	cuCtxDestroy(ctx);
+
+	return 0;
+}
@@ -0,0 +1 @@
+../../common/cmem_share.c
\ No newline at end of file
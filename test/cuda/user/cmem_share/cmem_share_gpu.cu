@@ -0,0 +1 @@
+../../common/cmem_share_gpu.cu
\ No newline at end of file
@@ -0,0 +1 @@
+../../common/fatbin.c
\ No newline at end of file
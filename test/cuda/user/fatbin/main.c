@@ -0,0 +1,17 @@
+#include <stdio.h>
+
+int cuda_test_fatbin(char *path);
+
+int main(int argc, char *argv[])
+{
+	int rc;
+
+	rc = cuda_test_fatbin(".");
+	if ( rc != 0)
+		printf("Test failed\n");
+	else
+		printf("Test passed\n");
+	
+	return rc;
+
+}
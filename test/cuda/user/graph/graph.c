@@ -0,0 +1 @@
+../../common/graph.c
\ No newline at end of file
@@ -0,0 +1 @@
+../../common/graph_gpu.cu
\ No newline at end of file
@@ -0,0 +1,24 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+int cuda_test_graph(unsigned int n, int count, char *path);
+
+int main(int argc, char *argv[])
+{
+	int rc;
+	unsigned int n = 1024;
+	int count = 1000;
+
+	if (argc > 1)
+		n = atoi(argv[1]);
+	if (argc > 2)
+		count = atoi(argv[2]);
+
+	rc = cuda_test_graph(n, count, ".");
+	if ( rc != 0)
+		printf("Test failed\n");
+	else
+		printf("Test passed\n");
+
+	return rc;
+}
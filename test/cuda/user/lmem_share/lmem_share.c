@@ -0,0 +1 @@
+../../common/lmem_share.c
\ No newline at end of file
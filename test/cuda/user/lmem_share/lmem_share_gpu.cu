@@ -0,0 +1 @@
+../../common/lmem_share_gpu.cu
\ No newline at end of file
@@ -0,0 +1,29 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+int cuda_test_module_load(int nr, uint32_t code_size, int loops, char *path);
+
+int main(int argc, char *argv[])
+{
+	int rc;
+	int nr = 256;
+	uint32_t code_size = 0x4000;
+	int loops = 10;
+
+	if (argc > 1)
+		nr = atoi(argv[1]);
+	if (argc > 2)
+		code_size = strtoul(argv[2], NULL, 0);
+	if (argc > 3)
+		loops = atoi(argv[3]);
+
+	rc = cuda_test_module_load(nr, code_size, loops, ".");
+	if ( rc != 0)
+		printf("Test failed\n");
+	else
+		printf("Test passed\n");
+	
+	return rc;
+
+}
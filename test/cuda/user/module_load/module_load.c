@@ -0,0 +1 @@
+../../common/module_load.c
\ No newline at end of file
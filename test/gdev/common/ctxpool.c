@@ -0,0 +1,275 @@
+/*
+ * the context pool of a device, on the software device of softdev.c where
+ * creating a context takes as long as the driver would. short-lived users
+ * open a handle, copy data in and out, and close it, with and without the
+ * pool. a user closing a handle with work left running must not have its
+ * memory freed before the work is done, every time the context is pooled.
+ * build it with TSAN=1 to check for data races.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <unistd.h>
+#include "softdev.c"
+
+#define POOL_SIZE 4
+#define BENCH_MAX_THREADS 4
+#define BENCH_USERS 200
+#define USE_SIZE 0x100000 /* 1MB copied in and out by a user. */
+#define SETTLE_MS 10000
+#define RUNNING_SIZE 0x1000000 /* 16MB added to and copied, left running. */
+
+static Ghandle holder; /* keeps the device opened, and tunes the pool. */
+
+static int pool_count(void)
+{
+	int n;
+
+	gdev_lock(&soft_dev.ctx_pool_lock);
+	n = soft_dev.ctx_pool_count;
+	gdev_unlock(&soft_dev.ctx_pool_lock);
+
+	return n;
+}
+
+/* wait for the pool to hold @pooled contexts, and the device @alive. */
+static int settle(int pooled, int alive)
+{
+	int i;
+
+	for (i = 0; i < SETTLE_MS; i++) {
+		if (pool_count() == pooled && __sync_fetch_and_add(&soft_ctxs, 0) == alive)
+			return 0;
+		usleep(1000);
+	}
+	printf("%d contexts pooled and %d alive, not %d and %d\n", pool_count(), soft_ctxs, pooled, alive);
+
+	return -1;
+}
+
+/* a short-lived user, which leaves its device memory for gclose(). */
+static int use(unsigned int seed, uint64_t *open_ns, uint64_t *close_ns)
+{
+	uint32_t *src = malloc(USE_SIZE), *dst = malloc(USE_SIZE);
+	uint64_t start, addr;
+	Ghandle h;
+	uint32_t i;
+	int ret = -1;
+
+	for (i = 0; i < USE_SIZE / 4; i++)
+		src[i] = seed + i;
+
+	start = now_ns();
+	if (!(h = gopen(0))) {
+		printf("gopen() failed\n");
+		goto end;
+	}
+	*open_ns += now_ns() - start;
+
+	if (!(addr = gmalloc(h, USE_SIZE)))
+		printf("gmalloc() failed\n");
+	else if (gmemcpy_to_device(h, addr, src, USE_SIZE) || gmemcpy_from_device(h, dst, addr, USE_SIZE))
+		printf("gmemcpy() failed\n");
+	else if (memcmp(src, dst, USE_SIZE))
+		printf("the data copied back differ\n");
+	else
+		ret = 0;
+
+	start = now_ns();
+	gclose(h);
+	*close_ns += now_ns() - start;
+
+end:
+	free(dst);
+	free(src);
+	return ret;
+}
+
+/* a user that leaves a kernel and an asynchronous copy running for
+   gclose(), which has to wait for them before freeing the memory. */
+static int leave_running(void)
+{
+	struct gdev_kernel k;
+	uint32_t param[6];
+	uint64_t in, out;
+	uint32_t id;
+	Ghandle h;
+	int ret = -1;
+
+	if (!(h = gopen(0))) {
+		printf("gopen() failed\n");
+		return -1;
+	}
+
+	in = gmalloc(h, RUNNING_SIZE);
+	out = gmalloc(h, RUNNING_SIZE);
+	if (!in || !out)
+		printf("gmalloc() failed\n");
+	else {
+		param[0] = in;
+		param[1] = in >> 32;
+		param[2] = out;
+		param[3] = out >> 32;
+		param[4] = RUNNING_SIZE / 4;
+		param[5] = 1;
+		memset(&k, 0, sizeof(k));
+		k.param_buf = param;
+		k.param_size = sizeof(param);
+		if (glaunch(h, &k, &id))
+			printf("glaunch() failed\n");
+		else if (gmemcpy_async(h, in, out, RUNNING_SIZE, &id))
+			printf("gmemcpy_async() failed\n");
+		else
+			ret = 0;
+	}
+
+	gclose(h);
+	return ret;
+}
+
+/* every context in the pool is pooled twice, with work left running. */
+static int pool_twice(void)
+{
+	int i, before, created, frees;
+
+	if (settle(POOL_SIZE, POOL_SIZE + 1))
+		return -1;
+
+	before = __sync_fetch_and_add(&soft_cid, 0);
+	pthread_mutex_lock(&soft_mutex);
+	soft_busy_frees = 0;
+	pthread_mutex_unlock(&soft_mutex);
+
+	for (i = 0; i < POOL_SIZE * 2; i++) {
+		if (leave_running())
+			return -1;
+	}
+
+	created = __sync_fetch_and_add(&soft_cid, 0) - before;
+	pthread_mutex_lock(&soft_mutex);
+	frees = soft_busy_frees;
+	pthread_mutex_unlock(&soft_mutex);
+	if (created) {
+		printf("%d contexts created, not taken from the pool\n", created);
+		return -1;
+	}
+	if (frees) {
+		printf("%d device memory objects freed with work running\n", frees);
+		return -1;
+	}
+
+	return 0;
+}
+
+static int bench_users;
+
+static void *bench_thread(void *arg)
+{
+	uint64_t open_ns = 0, close_ns = 0;
+	int i;
+
+	while ((i = __sync_fetch_and_sub(&bench_users, 1)) > 0) {
+		if (use(i, &open_ns, &close_ns))
+			return (void *)-1;
+	}
+
+	return NULL;
+}
+
+/* users per second with @n threads. */
+static long bench(int n)
+{
+	pthread_t t[BENCH_MAX_THREADS];
+	uint64_t start = now_ns();
+	void *ret;
+	int err = 0;
+	long i;
+
+	bench_users = BENCH_USERS;
+	for (i = 0; i < n; i++)
+		pthread_create(&t[i], NULL, bench_thread, (void *)i);
+	for (i = 0; i < n; i++) {
+		pthread_join(t[i], &ret);
+		if (ret)
+			err = -1;
+	}
+	if (err)
+		return -1;
+
+	return BENCH_USERS * 1000000000ull / (now_ns() - start);
+}
+
+static int bench_pool(int size)
+{
+	uint64_t open_ns = 0, close_ns = 0;
+	int n, i, before, created;
+	long users;
+
+	if (gtune(holder, GDEV_TUNE_CTX_POOL_SIZE, size)) {
+		printf("gtune() failed\n");
+		return -1;
+	}
+	if (settle(size, size + 1))
+		return -1;
+
+	/* one user after another, as short-lived processes. */
+	before = __sync_fetch_and_add(&soft_cid, 0);
+	for (i = 0; i < BENCH_USERS; i++) {
+		if (use(i, &open_ns, &close_ns))
+			return -1;
+	}
+	created = __sync_fetch_and_add(&soft_cid, 0) - before;
+	printf("  pool of %d: %llu us to open, %llu us to close, %d contexts created for %d users\n", size,
+		   (unsigned long long)open_ns / BENCH_USERS / 1000, (unsigned long long)close_ns / BENCH_USERS / 1000,
+		   created, BENCH_USERS);
+
+	for (n = 1; n <= BENCH_MAX_THREADS; n *= 2) {
+		if ((users = bench(n)) < 0)
+			return -1;
+		printf("    %ld users/s with %d threads\n", users, n);
+	}
+
+	/* the pooled contexts are left with no device memory of the users. */
+	if (settle(size, size + 1))
+		return -1;
+	if (__sync_fetch_and_add(&soft_mems, 0)) {
+		printf("%d device memory objects left\n", soft_mems);
+		return -1;
+	}
+
+	return 0;
+}
+
+int gdev_test_ctxpool(void)
+{
+	int fd, null, ret;
+
+	if (!(holder = gopen(0)))
+		return -1;
+
+	/* gopen() and gclose() print every time. */
+	fd = dup(2);
+	null = open("/dev/null", O_WRONLY);
+	dup2(null, 2);
+	close(null);
+
+	printf("short-lived users of %d KB (%ld cores):\n", USE_SIZE >> 10, sysconf(_SC_NPROCESSORS_ONLN));
+	if ((ret = bench_pool(0)))
+		goto end;
+	if ((ret = bench_pool(POOL_SIZE)))
+		goto end;
+	if ((ret = pool_twice()))
+		goto end;
+
+	/* the pool is drained when no longer wanted. */
+	if (gtune(holder, GDEV_TUNE_CTX_POOL_SIZE, 0) || settle(0, 1))
+		ret = -1;
+
+end:
+	dup2(fd, 2);
+	close(fd);
+	gclose(holder);
+	return ret;
+}
@@ -0,0 +1,203 @@
+/*
+ * the futex primitives of the user-space scheduler between two processes.
+ * a task is handed over to the other process and back, as the scheduler
+ * does at every schedule point, and the latency is compared with the
+ * SysV message queue the scheduler used before.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/ipc.h>
+#include <sys/mman.h>
+#include <sys/msg.h>
+#include <sys/wait.h>
+#include "gdev_futex.h"
+
+#define ROUNDS 100000
+#define LOCK_ROUNDS 100000
+
+struct shared {
+	int ping;
+	int pong;
+	struct gdev_futex_lock lock;
+	int counter;
+};
+
+struct msg {
+	long mtype;
+	char mtext;
+};
+
+static unsigned long now_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000UL + ts.tv_nsec;
+}
+
+static int wait_child(pid_t pid)
+{
+	int status;
+
+	if (waitpid(pid, &status, 0) < 0 || !WIFEXITED(status) || WEXITSTATUS(status))
+		return -1;
+	return 0;
+}
+
+/* nanoseconds to switch from one process to the other. */
+static long pingpong_futex(struct shared *sh)
+{
+	unsigned long start;
+	pid_t pid;
+	int i;
+
+	sh->ping = sh->pong = 0;
+	pid = fork();
+	if (pid < 0)
+		return -1;
+	if (pid == 0) {
+		for (i = 0; i < ROUNDS; i++) {
+			gdev_futex_sleep(&sh->ping);
+			gdev_futex_wakeup(&sh->pong);
+		}
+		_exit(0);
+	}
+
+	start = now_ns();
+	for (i = 0; i < ROUNDS; i++) {
+		gdev_futex_wakeup(&sh->ping);
+		gdev_futex_sleep(&sh->pong);
+	}
+	if (wait_child(pid))
+		return -1;
+
+	return (now_ns() - start) / (ROUNDS * 2);
+}
+
+static long pingpong_msg(void)
+{
+	struct msg msg;
+	unsigned long start;
+	long ret = -1;
+	pid_t pid;
+	int msgid, i;
+
+	msgid = msgget(IPC_PRIVATE, IPC_CREAT | 0600);
+	if (msgid < 0)
+		return -1;
+	pid = fork();
+	if (pid < 0)
+		goto fail_fork;
+	if (pid == 0) {
+		for (i = 0; i < ROUNDS; i++) {
+			msgrcv(msgid, &msg, sizeof(msg.mtext), 1, 0);
+			msg.mtype = 2;
+			msgsnd(msgid, &msg, sizeof(msg.mtext), 0);
+		}
+		_exit(0);
+	}
+
+	start = now_ns();
+	for (i = 0; i < ROUNDS; i++) {
+		msg.mtype = 1;
+		msgsnd(msgid, &msg, sizeof(msg.mtext), 0);
+		msgrcv(msgid, &msg, sizeof(msg.mtext), 2, 0);
+	}
+	if (!wait_child(pid))
+		ret = (now_ns() - start) / (ROUNDS * 2);
+
+fail_fork:
+	msgctl(msgid, IPC_RMID, NULL);
+	return ret;
+}
+
+/* both processes update the counter under the lock. */
+static int check_lock(struct shared *sh)
+{
+	pid_t pid;
+	int i;
+
+	gdev_futex_lock_init(&sh->lock);
+	sh->counter = 0;
+	pid = fork();
+	if (pid < 0)
+		return -1;
+	for (i = 0; i < LOCK_ROUNDS; i++) {
+		gdev_futex_lock(&sh->lock);
+		sh->counter++;
+		gdev_futex_unlock(&sh->lock);
+	}
+	if (pid == 0)
+		_exit(0);
+	if (wait_child(pid))
+		return -1;
+
+	if (sh->counter != LOCK_ROUNDS * 2) {
+		printf("counter %d, expected %d\n", sh->counter, LOCK_ROUNDS * 2);
+		return -1;
+	}
+	return 0;
+}
+
+/* a process that dies holding the lock must not block the others. */
+static int check_dead_owner(struct shared *sh)
+{
+	unsigned long start;
+	pid_t pid;
+
+	gdev_futex_lock_init(&sh->lock);
+	pid = fork();
+	if (pid < 0)
+		return -1;
+	if (pid == 0) {
+		gdev_futex_lock(&sh->lock);
+		_exit(0);
+	}
+	if (wait_child(pid))
+		return -1;
+
+	start = now_ns();
+	gdev_futex_lock(&sh->lock);
+	if (sh->lock.owner != __gdev_gettid()) {
+		printf("the lock is not taken over\n");
+		return -1;
+	}
+	gdev_futex_unlock(&sh->lock);
+	printf("lock of a dead owner taken over in %lu ms\n",
+		   (now_ns() - start) / 1000000);
+
+	/* it is an ordinary lock again. */
+	return check_lock(sh);
+}
+
+int gdev_test_futex(void)
+{
+	struct shared *sh;
+	long futex_ns, msg_ns;
+	int ret = -1;
+
+	sh = mmap(NULL, sizeof(*sh), PROT_READ | PROT_WRITE,
+			  MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if (sh == MAP_FAILED)
+		return -1;
+	memset(sh, 0, sizeof(*sh));
+
+	futex_ns = pingpong_futex(sh);
+	msg_ns = pingpong_msg();
+	if (futex_ns < 0 || msg_ns < 0) {
+		printf("ping-pong failed\n");
+		goto end;
+	}
+	printf("context switch: futex %ld ns, message queue %ld ns\n",
+		   futex_ns, msg_ns);
+
+	if (check_lock(sh) || check_dead_owner(sh))
+		goto end;
+
+	ret = 0;
+
+end:
+	munmap(sh, sizeof(*sh));
+	return ret;
+}
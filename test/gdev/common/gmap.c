@@ -0,0 +1,317 @@
+/*
+ * host mappings of device memory reused across gmap()/gunmap().
+ * gdev_nvidia_mem.c is linked directly with this file, which stands in for
+ * the driver and a BAR of limited size, so that the mappings made and torn
+ * down can be counted without GPUs.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "gdev_device.h"
+
+#define BAR_SIZE 0x20000000ULL /* 512MB */
+#define BIG_SIZE 0x4000000ULL /* 64MB, larger than GDEV_MEM_MAPPABLE_LIMIT. */
+#define SMALL_SIZE 0x100000ULL /* 1MB */
+#define BIG_COUNT 8
+#define LOOP_COUNT 10000
+
+static struct gdev_device dev;
+static struct gdev_vas vas;
+
+/* raw mappings made and torn down, and the BAR space they take. */
+static uint64_t raw_maps, raw_unmaps, bar_used;
+
+/* BAR space taken by someone else, e.g., other processes. */
+static uint64_t bar_foreign;
+
+static uint64_t next_addr = 0x20000000;
+
+void gdev_lock_save(gdev_lock_t *p, unsigned long *flags)
+{
+}
+
+void gdev_unlock_restore(gdev_lock_t *p, unsigned long *flags)
+{
+}
+
+/* the harness is single-threaded. */
+void gdev_mutex_init(gdev_mutex_t *p)
+{
+}
+
+void gdev_mutex_lock(gdev_mutex_t *p)
+{
+}
+
+void gdev_mutex_unlock(gdev_mutex_t *p)
+{
+}
+
+void gdev_rwlock_init(gdev_rwlock_t *p)
+{
+}
+
+void gdev_read_lock(gdev_rwlock_t *p)
+{
+}
+
+void gdev_read_unlock(gdev_rwlock_t *p)
+{
+}
+
+void gdev_write_lock(gdev_rwlock_t *p)
+{
+}
+
+void gdev_write_unlock(gdev_rwlock_t *p)
+{
+}
+
+struct gdev_mem *gdev_raw_mem_alloc(struct gdev_vas *vas, uint64_t size)
+{
+	struct gdev_mem *mem = calloc(1, sizeof(*mem));
+
+	mem->size = size;
+	mem->addr = next_addr;
+	next_addr += size;
+	/* small buffers are mapped for good when allocated. */
+	if (size <= GDEV_MEM_MAPPABLE_LIMIT)
+		mem->map = malloc(size);
+
+	return mem;
+}
+
+struct gdev_mem *gdev_raw_mem_alloc_dma(struct gdev_vas *vas, uint64_t size)
+{
+	return NULL;
+}
+
+void gdev_raw_mem_free(struct gdev_mem *mem)
+{
+	if (mem->size <= GDEV_MEM_MAPPABLE_LIMIT)
+		free(mem->map);
+	else if (mem->map) {
+		printf("0x%llx is freed while mapped\n", (unsigned long long)mem->addr);
+		exit(1);
+	}
+	free(mem);
+}
+
+/* the mapping is never dereferenced, so the address will do. */
+void *gdev_raw_mem_map(struct gdev_mem *mem)
+{
+	if (bar_foreign + bar_used + mem->size > BAR_SIZE)
+		return NULL;
+	bar_used += mem->size;
+	raw_maps++;
+
+	return (void *)(unsigned long)mem->addr;
+}
+
+void gdev_raw_mem_unmap(struct gdev_mem *mem, void *map)
+{
+	if (map != (void *)(unsigned long)mem->addr) {
+		printf("0x%llx is unmapped at %p\n", (unsigned long long)mem->addr, map);
+		exit(1);
+	}
+	bar_used -= mem->size;
+	raw_unmaps++;
+}
+
+uint64_t gdev_raw_mem_phys_getaddr(struct gdev_mem *mem, uint64_t offset)
+{
+	return 0;
+}
+
+struct gdev_mem *gdev_shm_attach(struct gdev_vas *vas, struct gdev_mem *mem, uint64_t size)
+{
+	return NULL;
+}
+
+void gdev_shm_detach(struct gdev_mem *mem)
+{
+}
+
+void gdev_shm_index_add(struct gdev_mem *mem)
+{
+}
+
+void gdev_shm_index_del(struct gdev_mem *mem)
+{
+}
+
+static int check(int cond, const char *what)
+{
+	if (!cond)
+		printf("%s\n", what);
+	return cond ? 0 : -1;
+}
+
+/* the budget is never exceeded, and only mappings in use are beyond it. */
+static int check_budget(void)
+{
+	if (dev.map_cache_size != bar_used)
+		return check(0, "map_cache_size does not match the BAR space used");
+	if (dev.map_cache_size > GDEV_MEM_MAP_CACHE_SIZE)
+		return check(0, "map_cache_size exceeds the budget");
+	return 0;
+}
+
+/* map and unmap @mem once. */
+static int map_once(struct gdev_mem *mem)
+{
+	void *buf = gdev_mem_map(mem, 0, mem->size);
+
+	if (!buf)
+		return check(0, "gdev_mem_map() failed");
+	if (gdev_mem_unmap(mem))
+		return check(0, "gdev_mem_unmap() failed");
+
+	return check_budget();
+}
+
+/* @count buffers mapped by turns, @loop times in total. */
+static int round_robin(struct gdev_mem **mems, int count, int loop, uint64_t *maps)
+{
+	uint64_t base = raw_maps;
+	int i;
+
+	for (i = 0; i < loop; i++) {
+		if (map_once(mems[i % count]))
+			return -1;
+	}
+	*maps = raw_maps - base;
+
+	return 0;
+}
+
+/* buffers mapped at random, most often the first few of them. */
+static int skewed(struct gdev_mem **mems, int count, int loop, uint64_t *maps)
+{
+	uint64_t base = raw_maps;
+	int i, k;
+
+	for (i = 0; i < loop; i++) {
+		k = rand() % 10 < 8 ? rand() % 2 : rand() % count;
+		if (map_once(mems[k]))
+			return -1;
+	}
+	*maps = raw_maps - base;
+
+	return 0;
+}
+
+int gdev_test_gmap(void)
+{
+	struct gdev_mem *big[BIG_COUNT], *small, *huge;
+	int fit = GDEV_MEM_MAP_CACHE_SIZE / BIG_SIZE;
+	uint64_t maps;
+	void *buf;
+	int i;
+
+	gdev_list_init(&dev.map_cache, NULL);
+	dev.map_cache_size = 0;
+	gdev_mutex_init(&dev.map_mutex);
+	gdev_mutex_init(&dev.shm_mutex);
+	vas.gdev = &dev;
+	gdev_list_init(&vas.mem_list, NULL);
+	gdev_list_init(&vas.dma_mem_list, NULL);
+
+	if (check(fit >= 2 && fit < BIG_COUNT, "the budget does not suit the test"))
+		return -1;
+
+	for (i = 0; i < BIG_COUNT; i++) {
+		if (!(big[i] = gdev_mem_alloc(&vas, BIG_SIZE, GDEV_MEM_DEVICE)))
+			return check(0, "gdev_mem_alloc() failed");
+	}
+	if (!(small = gdev_mem_alloc(&vas, SMALL_SIZE, GDEV_MEM_DEVICE)))
+		return check(0, "gdev_mem_alloc() failed");
+
+	/* the same buffer over and over: mapped only once. */
+	if (round_robin(big, 1, LOOP_COUNT, &maps))
+		return -1;
+	printf("one buffer: %llu mappings for %d gmap() (%d uncached)\n",
+		   (unsigned long long)maps, LOOP_COUNT, LOOP_COUNT);
+	if (check(maps == 1, "a cached mapping is not reused"))
+		return -1;
+
+	/* as many buffers as the budget holds: mapped once each. */
+	if (round_robin(big, fit, LOOP_COUNT, &maps))
+		return -1;
+	printf("%d buffers: %llu mappings for %d gmap() (%d uncached)\n",
+		   fit, (unsigned long long)maps, LOOP_COUNT, LOOP_COUNT);
+	if (check(maps <= fit, "the working set does not stay mapped"))
+		return -1;
+
+	/* one more buffer than the budget holds: LRU evicts the next one, 
+	   except those left cached above. */
+	if (round_robin(big, fit + 1, LOOP_COUNT, &maps))
+		return -1;
+	printf("%d buffers: %llu mappings for %d gmap() (%d uncached)\n",
+		   fit + 1, (unsigned long long)maps, LOOP_COUNT, LOOP_COUNT);
+	if (check(maps >= LOOP_COUNT - fit, "LRU is not followed"))
+		return -1;
+
+	/* hot buffers stay mapped while the rest go around. */
+	srand(0);
+	if (skewed(big, BIG_COUNT, LOOP_COUNT, &maps))
+		return -1;
+	printf("%d buffers, skewed: %llu mappings for %d gmap() (%d uncached)\n",
+		   BIG_COUNT, (unsigned long long)maps, LOOP_COUNT, LOOP_COUNT);
+	if (check(maps < LOOP_COUNT / 2, "hot buffers do not stay mapped"))
+		return -1;
+
+	/* mappings in use are never evicted, even beyond the budget. */
+	for (i = 0; i < BIG_COUNT; i++) {
+		if (!gdev_mem_map(big[i], 0, BIG_SIZE))
+			return check(0, "gdev_mem_map() failed");
+	}
+	if (check(bar_used == BIG_COUNT * BIG_SIZE, "a mapping in use is evicted"))
+		return -1;
+	for (i = 0; i < BIG_COUNT; i++) {
+		if (gdev_mem_unmap(big[i]))
+			return check(0, "gdev_mem_unmap() failed");
+	}
+	if (check_budget())
+		return -1;
+
+	/* unmapped twice: the cached mapping must survive. */
+	if (check(gdev_mem_unmap(big[0]) == -ENOENT, "a double unmap is not caught"))
+		return -1;
+	if (check_budget())
+		return -1;
+
+	/* small buffers are mapped for good, and never cached. */
+	maps = raw_maps;
+	for (i = 0; i < LOOP_COUNT; i++) {
+		if (!(buf = gdev_mem_map(small, 0, SMALL_SIZE)) || buf != small->map)
+			return check(0, "gdev_mem_map() failed");
+		gdev_mem_unmap(small);
+	}
+	if (check(raw_maps == maps && gdev_list_empty(&small->list_entry_map),
+			  "a small buffer is cached"))
+		return -1;
+
+	/* the BAR space taken by others: all cached mappings give way. */
+	bar_foreign = BAR_SIZE - bar_used - BIG_SIZE;
+	if (!(huge = gdev_mem_alloc(&vas, 2 * BIG_SIZE, GDEV_MEM_DEVICE)))
+		return check(0, "gdev_mem_alloc() failed");
+	if (map_once(huge))
+		return check(0, "the BAR space is not reclaimed");
+	bar_foreign = 0;
+
+	/* freed buffers take their cached mappings with them. */
+	gdev_mem_free(huge);
+	for (i = 0; i < BIG_COUNT; i++)
+		gdev_mem_free(big[i]);
+	gdev_mem_free(small);
+	if (check(bar_used == 0 && dev.map_cache_size == 0 &&
+			  gdev_list_empty(&dev.map_cache), "a freed mapping is left"))
+		return -1;
+	if (check(raw_maps == raw_unmaps, "mappings are leaked"))
+		return -1;
+
+	printf("%llu mappings in total\n", (unsigned long long)raw_maps);
+
+	return 0;
+}
@@ -0,0 +1,323 @@
+/*
+ * host copies of the memcpy pipelines split across worker threads.
+ * gdev_copy.c is linked directly with this file, which stands in for the
+ * DMA engine by a thread moving the bounce buffers to the device memory at
+ * the PCIe bandwidth, so that the pipelines can be measured without GPUs.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+#include "gdev_copy.h"
+
+#define COPY_MAX 0x800000 /* 8MB */
+#define COPY_COUNT 300
+#define GUARD 64
+#define CALLER_COUNT 4
+#define BENCH_SIZE 0x10000000 /* 256MB per round. */
+#define BENCH_CHUNK 0x200000 /* 2MB, GDEV_CHUNK_DEFAULT_SIZE. */
+#define BENCH_PIPELINE 2
+#define BENCH_ROUNDS 3
+#define DMA_BANDWIDTH 12000 /* MB/s, PCIe gen3 x16. */
+
+static long elapsed_us(struct timeval *start)
+{
+	struct timeval now;
+
+	gettimeofday(&now, NULL);
+	return (now.tv_sec - start->tv_sec) * 1000000 + (now.tv_usec - start->tv_usec);
+}
+
+static void fill(char *p, uint64_t size, unsigned int seed)
+{
+	uint64_t i;
+
+	for (i = 0; i < size; i++) {
+		seed = seed * 1103515245 + 12345;
+		p[i] = seed >> 16;
+	}
+}
+
+/* copy @size bytes at odd offsets, and check nothing around is touched. */
+static int copy_once(char *dst, char *src, uint64_t size, int flags)
+{
+	int doff = rand() % GUARD, soff = rand() % GUARD;
+	char *d = dst + GUARD + doff, *s = src + GUARD + soff;
+	int i;
+
+	memset(dst, 0x5a, size + 3 * GUARD);
+	gdev_copy(d, s, size, flags);
+	if (memcmp(d, s, size)) {
+		printf("0x%llx bytes are not copied\n", (unsigned long long)size);
+		return -1;
+	}
+	for (i = 0; i < GUARD + doff; i++) {
+		if (dst[i] != 0x5a)
+			goto overrun;
+	}
+	for (i = 0; i < 2 * GUARD - doff; i++) {
+		if (d[size + i] != 0x5a)
+			goto overrun;
+	}
+
+	return 0;
+
+overrun:
+	printf("0x%llx bytes are copied out of bounds\n", (unsigned long long)size);
+	return -1;
+}
+
+static int copy_test(unsigned int seed)
+{
+	char *src = malloc(COPY_MAX + 3 * GUARD);
+	char *dst = malloc(COPY_MAX + 3 * GUARD);
+	uint64_t size;
+	int i, ret = 0;
+
+	fill(src, COPY_MAX + 3 * GUARD, seed);
+	srand(seed);
+	for (i = 0; i < COPY_COUNT && !ret; i++) {
+		/* both small and large copies. */
+		size = i % 2 ? rand() % COPY_MAX : rand() % 0x10000;
+		ret = copy_once(dst, src, size, i % 4 < 2 ? GDEV_COPY_NT : 0);
+	}
+
+	free(src);
+	free(dst);
+
+	return ret;
+}
+
+static void *caller_thread(void *arg)
+{
+	return (void *)(long)copy_test((unsigned int)(long)arg);
+}
+
+/* copies at a time: only one of them uses the pool. */
+static int caller_test(void)
+{
+	pthread_t thread[CALLER_COUNT];
+	void *ret;
+	int i, failed = 0;
+
+	for (i = 0; i < CALLER_COUNT; i++)
+		pthread_create(&thread[i], NULL, caller_thread, (void *)(long)(i + 1));
+	for (i = 0; i < CALLER_COUNT; i++) {
+		pthread_join(thread[i], &ret);
+		if (ret)
+			failed = 1;
+	}
+
+	return failed ? -1 : 0;
+}
+
+/* the child of fork() must not wait for the workers it does not have. */
+static int fork_test(void)
+{
+	pid_t pid;
+	int status;
+
+	pid = fork();
+	if (pid == 0)
+		exit(copy_test(100) ? 1 : 0);
+	if (waitpid(pid, &status, 0) != pid || !WIFEXITED(status) || WEXITSTATUS(status)) {
+		printf("the copy failed after fork()\n");
+		return -1;
+	}
+
+	return 0;
+}
+
+/**
+ * the DMA engine: moves the bounce buffers to the device memory one after
+ * another, taking as long as the PCIe bus would. it takes no CPU time but
+ * when data are verified. fences are sequence numbers of the copies done.
+ */
+static struct dma_engine {
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	pthread_t thread;
+	struct { char *dst; const char *src; uint32_t size; } queue[BENCH_PIPELINE];
+	uint32_t issued, done;
+	int verify; /* move data indeed. */
+	int stopping;
+} dma = {
+	.lock = PTHREAD_MUTEX_INITIALIZER,
+	.cond = PTHREAD_COND_INITIALIZER,
+};
+
+static void *dma_thread(void *arg)
+{
+	struct timeval start;
+	long us;
+	int i;
+
+	pthread_mutex_lock(&dma.lock);
+	for (;;) {
+		while (!dma.stopping && dma.done == dma.issued)
+			pthread_cond_wait(&dma.cond, &dma.lock);
+		if (dma.stopping)
+			break;
+		i = dma.done % BENCH_PIPELINE;
+		pthread_mutex_unlock(&dma.lock);
+
+		gettimeofday(&start, NULL);
+		if (dma.verify)
+			memcpy(dma.queue[i].dst, dma.queue[i].src, dma.queue[i].size);
+		us = dma.queue[i].size / DMA_BANDWIDTH - elapsed_us(&start);
+		if (us > 0)
+			usleep(us);
+
+		pthread_mutex_lock(&dma.lock);
+		dma.done++;
+		pthread_cond_broadcast(&dma.cond);
+	}
+	pthread_mutex_unlock(&dma.lock);
+
+	return NULL;
+}
+
+static uint32_t dma_memcpy(char *dst, const char *src, uint32_t size)
+{
+	uint32_t fence;
+
+	pthread_mutex_lock(&dma.lock);
+	dma.queue[dma.issued % BENCH_PIPELINE].dst = dst;
+	dma.queue[dma.issued % BENCH_PIPELINE].src = src;
+	dma.queue[dma.issued % BENCH_PIPELINE].size = size;
+	fence = ++dma.issued;
+	pthread_cond_broadcast(&dma.cond);
+	pthread_mutex_unlock(&dma.lock);
+
+	return fence;
+}
+
+static void dma_poll(uint32_t fence)
+{
+	pthread_mutex_lock(&dma.lock);
+	while (dma.done < fence)
+		pthread_cond_wait(&dma.cond, &dma.lock);
+	pthread_mutex_unlock(&dma.lock);
+}
+
+/* __gmemcpy_to_device_p() with the host copy given. */
+static void pipeline(char *dev, const char *src, char **bounce, int pool)
+{
+	uint32_t fence[BENCH_PIPELINE] = {0};
+	uint64_t offset;
+	int i = 0;
+
+	for (offset = 0; offset < BENCH_SIZE; offset += BENCH_CHUNK) {
+		if (fence[i])
+			dma_poll(fence[i]);
+		if (pool)
+			gdev_copy(bounce[i], src + offset, BENCH_CHUNK, GDEV_COPY_NT);
+		else
+			memcpy(bounce[i], src + offset, BENCH_CHUNK);
+		fence[i] = dma_memcpy(dev + offset, bounce[i], BENCH_CHUNK);
+		i = (i + 1) % BENCH_PIPELINE;
+	}
+	for (i = 0; i < BENCH_PIPELINE; i++)
+		dma_poll(fence[i]);
+}
+
+/* MB/s of the pipeline, the best of the rounds. */
+static long bench(char *dev, const char *src, char **bounce, int pool)
+{
+	struct timeval start;
+	long us, best = 0;
+	int i;
+
+	/* the data first. */
+	memset(dev, 0, BENCH_SIZE);
+	dma.verify = 1;
+	pipeline(dev, src, bounce, pool);
+	dma.verify = 0;
+	if (memcmp(dev, src, BENCH_SIZE)) {
+		printf("the pipeline corrupted data\n");
+		return -1;
+	}
+
+	for (i = 0; i < BENCH_ROUNDS; i++) {
+		gettimeofday(&start, NULL);
+		pipeline(dev, src, bounce, pool);
+		us = elapsed_us(&start);
+		if (!best || us < best)
+			best = us;
+	}
+
+	return (long)((uint64_t)BENCH_SIZE / best);
+}
+
+static int bench_test(void)
+{
+	char *src = malloc(BENCH_SIZE), *dev = malloc(BENCH_SIZE);
+	char *bounce[BENCH_PIPELINE];
+	long single, pooled, forced;
+	int i, workers, ret = -1;
+
+	for (i = 0; i < BENCH_PIPELINE; i++)
+		bounce[i] = malloc(BENCH_CHUNK);
+	fill(src, BENCH_SIZE, 1);
+	pthread_create(&dma.thread, NULL, dma_thread, NULL);
+
+	if ((single = bench(dev, src, bounce, 0)) < 0)
+		goto end;
+
+	/* as many workers as the other cores. */
+	gdev_copy_stop();
+	workers = gdev_copy_start(-1);
+	if ((pooled = bench(dev, src, bounce, 1)) < 0)
+		goto end;
+
+	/* more workers than the cores. */
+	gdev_copy_stop();
+	gdev_copy_start(3);
+	if ((forced = bench(dev, src, bounce, 1)) < 0)
+		goto end;
+
+	printf("pipeline (%ld cores, DMA at %d MB/s):\n", sysconf(_SC_NPROCESSORS_ONLN), DMA_BANDWIDTH);
+	printf("  %ld MB/s by the caller\n", single);
+	printf("  %ld MB/s with %d workers\n", pooled, workers);
+	printf("  %ld MB/s with 3 workers\n", forced);
+	ret = 0;
+
+end:
+	pthread_mutex_lock(&dma.lock);
+	dma.stopping = 1;
+	pthread_cond_broadcast(&dma.cond);
+	pthread_mutex_unlock(&dma.lock);
+	pthread_join(dma.thread, NULL);
+	for (i = 0; i < BENCH_PIPELINE; i++)
+		free(bounce[i]);
+	free(src);
+	free(dev);
+
+	return ret;
+}
+
+int gdev_test_hostcopy(void)
+{
+	/* the workers run even on a single core. */
+	if (gdev_copy_start(3) != 3) {
+		printf("the workers are not started\n");
+		return -1;
+	}
+
+	if (copy_test(0))
+		return -1;
+	if (caller_test())
+		return -1;
+	if (fork_test())
+		return -1;
+
+	/* the pool is started again at the next copy. */
+	gdev_copy_stop();
+	if (copy_test(1))
+		return -1;
+
+	return bench_test();
+}
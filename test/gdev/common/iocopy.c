@@ -0,0 +1,204 @@
+/*
+ * copies to and from I/O memory, and the direct I/O limits tuned online.
+ * the copy routines and the tuner are inline, so that they are tested
+ * here on host memory, and the tuner against a cost model of the BAR and
+ * the DMA engine, without GPUs.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include "gdev_io_memcpy.h"
+#include "gdev_iotune.h"
+
+#define SIZE_MAX_CHECKED 300
+#define ALIGN_MAX 16
+#define GUARD 64
+#define BENCH_BYTES 0x10000000 /* 256MB per measure. */
+#define TUNE_COPIES 20000
+
+typedef void *(*copy_t)(void *, const void *, size_t);
+
+/* gdev_io_memcpy() as it used to be: byte by byte. */
+static void *bytewise(void *s1, const void *s2, size_t n)
+{
+	volatile char *out = (volatile char *)s1;
+	const volatile char *in = (const volatile char *)s2;
+	size_t i;
+
+	for (i = 0; i < n; ++i)
+		out[i] = in[i];
+	return s1;
+}
+
+static struct {
+	const char *name;
+	copy_t copy;
+} copies[] = {
+	{"bytewise", bytewise},
+	{"gdev_io_memcpy", gdev_io_memcpy},
+	{"gdev_io_memcpy_toio", gdev_io_memcpy_toio},
+	{"gdev_io_memcpy_fromio", gdev_io_memcpy_fromio},
+};
+
+#define COPY_COUNT (int)(sizeof(copies) / sizeof(copies[0]))
+
+/* every size at every alignment of both sides. */
+static int check_copy(int k)
+{
+	static char src[SIZE_MAX_CHECKED + ALIGN_MAX + 2 * GUARD];
+	static char dst[SIZE_MAX_CHECKED + ALIGN_MAX + 2 * GUARD];
+	char *d, *s;
+	int size, da, sa, i;
+
+	for (i = 0; i < (int)sizeof(src); i++)
+		src[i] = rand();
+
+	for (size = 0; size <= SIZE_MAX_CHECKED; size++) {
+		for (da = 0; da < ALIGN_MAX; da++) {
+			for (sa = 0; sa < ALIGN_MAX; sa++) {
+				memset(dst, 0x5a, sizeof(dst));
+				d = dst + GUARD + da;
+				s = src + GUARD + sa;
+				if (copies[k].copy(d, s, size) != d || memcmp(d, s, size))
+					goto fail;
+				for (i = 0; i < GUARD + da; i++) {
+					if (dst[i] != 0x5a)
+						goto fail;
+				}
+				for (i = GUARD + da + size; i < (int)sizeof(dst); i++) {
+					if (dst[i] != 0x5a)
+						goto fail;
+				}
+			}
+		}
+	}
+
+	return 0;
+
+fail:
+	printf("%s: %d bytes at +%d from +%d are not copied right\n",
+		   copies[k].name, size, da, sa);
+	return -1;
+}
+
+static long elapsed_us(struct timeval *start)
+{
+	struct timeval now;
+
+	gettimeofday(&now, NULL);
+	return (now.tv_sec - start->tv_sec) * 1000000 + (now.tv_usec - start->tv_usec);
+}
+
+/* MB/s of copying @size bytes over and over. */
+static long bench_copy(copy_t copy, char *dst, const char *src, size_t size)
+{
+	struct timeval start;
+	long n = BENCH_BYTES / size, i, us;
+
+	gettimeofday(&start, NULL);
+	for (i = 0; i < n; i++)
+		copy(dst, src, size);
+	us = elapsed_us(&start);
+
+	return us ? (long)((uint64_t)n * size / us) : 0;
+}
+
+/**
+ * only ordinary host memory is at hand here: a write-combined mapping of
+ * the BAR needs a device, which is where the streaming stores and loads
+ * pay off most.
+ */
+static void bench(void)
+{
+	static const size_t sizes[] = {64, 256, 4096, 0x8000};
+	char *src = malloc(0x8000 + 64), *dst = malloc(0x8000 + 64);
+	int i, k;
+
+	memset(src, 1, 0x8000 + 64);
+	memset(dst, 0, 0x8000 + 64);
+	printf("MB/s on cached host memory (aligned / unaligned):\n");
+	for (k = 0; k < COPY_COUNT; k++) {
+		printf("  %-22s", copies[k].name);
+		for (i = 0; i < (int)(sizeof(sizes) / sizeof(sizes[0])); i++) {
+			printf(" %6zuB %6ld / %6ld", sizes[i],
+				   bench_copy(copies[k].copy, dst, src, sizes[i]),
+				   bench_copy(copies[k].copy, dst + 3, src + 1, sizes[i]));
+		}
+		printf("\n");
+	}
+
+	free(src);
+	free(dst);
+}
+
+/**
+ * a cost model: direct I/O costs @io_us_per_kb per KB, and DMA costs
+ * @dma_us plus @dma_us_per_mb per MB. they cross at @cross bytes. copy
+ * sizes are spread log-uniformly over 256B to 1MB.
+ */
+static int check_tune(const char *what, uint32_t limit, double io_us_per_kb, double dma_us, double dma_us_per_mb)
+{
+	struct gdev_iotune t;
+	double cross = dma_us / (io_us_per_kb / 1024 - dma_us_per_mb / 0x100000);
+	double cost;
+	uint64_t size, explored = 0, timed_count = 0;
+	int direct, timed, i;
+
+	gdev_iotune_init(&t, limit);
+	srand(0);
+	for (i = 0; i < TUNE_COPIES; i++) {
+		size = 256 << (rand() % 12);
+		size += rand() % size;
+		direct = gdev_iotune_direct(&t, size, &timed);
+		if (!timed)
+			continue;
+		timed_count++;
+		if (direct != (size <= t.limit))
+			explored++;
+		if (direct)
+			cost = size * io_us_per_kb / 1024;
+		else
+			cost = dma_us + size * dma_us_per_mb / 0x100000;
+		gdev_iotune_update(&t, direct, size, (uint64_t)(cost * 1000));
+	}
+
+	printf("%s: limit %u -> %u, crossover %.0f, %llu of %llu timed copies explored\n",
+		   what, limit, t.limit, cross, (unsigned long long)explored,
+		   (unsigned long long)timed_count);
+
+	if (t.limit < cross / 2 || t.limit > cross * 2) {
+		printf("the limit does not converge\n");
+		return -1;
+	}
+	if (explored * GDEV_IOTUNE_EXPLORE > timed_count * 2) {
+		printf("too many copies are explored\n");
+		return -1;
+	}
+
+	return 0;
+}
+
+int gdev_test_iocopy(void)
+{
+	int k;
+
+	for (k = 0; k < COPY_COUNT; k++) {
+		if (check_copy(k))
+			return -1;
+	}
+
+	bench();
+
+	/* writes to a WC BAR at 1GB/s against 20us + 8GB/s of DMA. */
+	if (check_tune("write", 0x8000, 1.0, 20, 128))
+		return -1;
+	/* the same from a limit too large. */
+	if (check_tune("write", 0x80000, 1.0, 20, 128))
+		return -1;
+	/* uncached reads at 64MB/s, where DMA pays off much earlier. */
+	if (check_tune("read", 0x1000, 16.0, 20, 128))
+		return -1;
+
+	return 0;
+}
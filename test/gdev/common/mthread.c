@@ -0,0 +1,280 @@
+/*
+ * threads sharing a Gdev handle on the software device of softdev.c. the
+ * engine runs one command at a time, so threads gain by overlapping their
+ * host work with the commands of others. build it with TSAN=1 to check for
+ * data races. with the scheduler, the threads stressed share two handles,
+ * so that they sleep for and wake up each other.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+#include "softdev.c"
+
+#define STRESS_THREADS 8
+#define STRESS_HANDLES 2
+#define STRESS_ROUNDS 100
+#define STRESS_ADD 7
+#define BENCH_MAX_THREADS 8
+#define BENCH_SIZE 0x100000 /* 1MB per launch. */
+#define BENCH_OPS 256
+#define BENCH_SCALE 65 /* percent of one thread per core used at least. */
+#define BENCH_BUSY 80 /* percent of the time that a shared resource is used up. */
+
+/**
+ * the tests.
+ */
+static Ghandle handle, stress_handle[STRESS_HANDLES];
+
+static void fill(uint32_t *p, uint64_t count, unsigned int seed)
+{
+	uint64_t i;
+
+	for (i = 0; i < count; i++) {
+		seed = seed * 1103515245 + 12345;
+		p[i] = seed;
+	}
+}
+
+/* launch the kernel over @count words from @in to @out, and wait for it. */
+static int add(Ghandle h, uint64_t in, uint64_t out, uint32_t count, uint32_t val)
+{
+	struct gdev_kernel k;
+	uint32_t param[6] = {in, in >> 32, out, out >> 32, count, val};
+	uint32_t id;
+
+	memset(&k, 0, sizeof(k));
+	k.param_buf = param;
+	k.param_size = sizeof(param);
+	if (guseset(h, in, count * 4) || guseset(h, out, count * 4))
+		return -1;
+	if (glaunch(h, &k, &id))
+		return -1;
+
+	return gsync(h, id, NULL);
+}
+
+/* copy @size bytes in, add to them on the device, and copy them back. */
+static int round_trip(Ghandle h, uint64_t size, int dma, unsigned int seed)
+{
+	uint32_t count = size / 4;
+	uint32_t *src = malloc(size), *dst = malloc(size);
+	void *buf = NULL;
+	uint64_t in, out;
+	uint32_t i;
+	int ret = -1;
+
+	fill(src, count, seed);
+	in = gmalloc(h, size);
+	out = gmalloc(h, size);
+	if (!in || !out) {
+		printf("gmalloc() failed\n");
+		goto end;
+	}
+
+	if (dma) {
+		/* host DMA memory is copied from without bounce buffers. */
+		if (!(buf = gmalloc_dma(h, size))) {
+			printf("gmalloc_dma() failed\n");
+			goto end;
+		}
+		memcpy(buf, src, size);
+		ret = gmemcpy_to_device(h, in, buf, size);
+	}
+	else
+		ret = gmemcpy_to_device(h, in, src, size);
+	if (ret) {
+		printf("gmemcpy_to_device() failed\n");
+		goto end;
+	}
+
+	if ((ret = add(h, in, out, count, STRESS_ADD))) {
+		printf("glaunch() failed\n");
+		goto end;
+	}
+
+	if ((ret = gmemcpy_from_device(h, dst, out, size))) {
+		printf("gmemcpy_from_device() failed\n");
+		goto end;
+	}
+	for (i = 0; i < count; i++) {
+		if (dst[i] != src[i] + STRESS_ADD) {
+			printf("0x%llx bytes: word %u is 0x%x, not 0x%x\n", (unsigned long long)size, i, dst[i], src[i] + STRESS_ADD);
+			ret = -1;
+			goto end;
+		}
+	}
+
+end:
+	if (buf)
+		gfree_dma(h, buf);
+	if (out)
+		gfree(h, out);
+	if (in)
+		gfree(h, in);
+	free(dst);
+	free(src);
+	return ret;
+}
+
+static void *stress(void *arg)
+{
+	/* direct I/O, one bounce chunk, and pipelined over 2MB chunks. */
+	static const uint64_t sizes[] = {4, 0x100, 0x1000, 0x10000, 0x300000};
+	long id = (long)arg;
+	Ghandle h = stress_handle[id % STRESS_HANDLES];
+	unsigned int seed = id;
+	int i, ret;
+
+	for (i = 0; i < STRESS_ROUNDS; i++) {
+		seed = seed * 1103515245 + 12345;
+		if (round_trip(h, sizes[(seed >> 16) % 5], (seed >> 8) % 4 == 0, seed))
+			return (void *)-1;
+		/* the bounce buffers may be reallocated while others copy. */
+		if (id < STRESS_HANDLES && i % 10 == 0) {
+			ret = gtune(h, GDEV_TUNE_MEMCPY_CHUNK_SIZE, i % 20 ? 0x100000 : 0x200000);
+			if (ret && ret != -EBUSY) {
+				printf("gtune() failed\n");
+				return (void *)-1;
+			}
+		}
+	}
+
+	return NULL;
+}
+
+static int stress_test(void)
+{
+	pthread_t t[STRESS_THREADS];
+	void *ret;
+	int err = 0;
+	long i;
+
+	stress_handle[0] = handle;
+	for (i = 1; i < STRESS_HANDLES; i++) {
+#ifdef GDEV_SCHED_DISABLED
+		stress_handle[i] = handle;
+#else
+		if (!(stress_handle[i] = gopen(0)))
+			return -1;
+#endif
+	}
+
+	for (i = 0; i < STRESS_THREADS; i++)
+		pthread_create(&t[i], NULL, stress, (void *)i);
+	for (i = 0; i < STRESS_THREADS; i++) {
+		pthread_join(t[i], &ret);
+		if (ret)
+			err = -1;
+	}
+
+	for (i = 1; i < STRESS_HANDLES; i++) {
+		if (stress_handle[i] != handle)
+			gclose(stress_handle[i]);
+	}
+
+	return err;
+}
+
+static int bench_ops;
+
+static void *bench_thread(void *arg)
+{
+	long id = (long)arg;
+	unsigned int seed = id;
+
+	while (__sync_fetch_and_sub(&bench_ops, 1) > 0) {
+		seed = seed * 1103515245 + 12345;
+		if (round_trip(handle, BENCH_SIZE, 0, seed))
+			return (void *)-1;
+	}
+
+	return NULL;
+}
+
+static uint64_t cpu_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/* round trips per second with @n threads on the handle. @engine and @cpu
+   are set to the percent of the time that the engine and the @cores were
+   busy. */
+static long bench(int n, long cores, int *engine, int *cpu)
+{
+	pthread_t t[BENCH_MAX_THREADS];
+	uint64_t start = now_ns(), cpu_start = cpu_ns(), busy, elapse;
+	void *ret;
+	int err = 0;
+	long i;
+
+	pthread_mutex_lock(&soft_mutex);
+	busy = soft_busy_ns;
+	pthread_mutex_unlock(&soft_mutex);
+
+	bench_ops = BENCH_OPS;
+	for (i = 0; i < n; i++)
+		pthread_create(&t[i], NULL, bench_thread, (void *)i);
+	for (i = 0; i < n; i++) {
+		pthread_join(t[i], &ret);
+		if (ret)
+			err = -1;
+	}
+	if (err)
+		return -1;
+
+	elapse = now_ns() - start;
+	pthread_mutex_lock(&soft_mutex);
+	*engine = (soft_busy_ns - busy) * 100 / elapse;
+	pthread_mutex_unlock(&soft_mutex);
+	*cpu = (cpu_ns() - cpu_start) * 100 / elapse / cores;
+
+	return BENCH_OPS * 1000000000ull / elapse;
+}
+
+/* the threads share the handle, the engine, and the cores. the throughput
+   must scale with the cores used, unless the engine or the cores are used
+   up, which is all that may hold them back. */
+static int bench_test(void)
+{
+	long ops, base = 0, cores = sysconf(_SC_NPROCESSORS_ONLN);
+	int n, engine, cpu;
+
+	printf("round trips of %d KB (%ld cores, DMA at %d GB/s):\n", BENCH_SIZE >> 10, cores, DMA_BANDWIDTH);
+	for (n = 1; n <= BENCH_MAX_THREADS; n *= 2) {
+		if ((ops = bench(n, cores, &engine, &cpu)) < 0)
+			return -1;
+		if (n == 1)
+			base = ops;
+		printf("  %ld ops/s with %d threads (x%ld.%02ld), engine %d%% cpu %d%%\n", ops, n, ops / base, ops * 100 / base % 100, engine, cpu);
+		if (ops * 100 < base * (n < cores ? n : cores) * BENCH_SCALE &&
+			engine < BENCH_BUSY && cpu < BENCH_BUSY) {
+			printf("the threads are held back by neither the engine nor the cores\n");
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+int gdev_test_mthread(void)
+{
+	int ret;
+
+	if (!(handle = gopen(0)))
+		return -1;
+
+	if ((ret = stress_test())) {
+		printf("the threads corrupted data\n");
+		goto end;
+	}
+	ret = bench_test();
+
+end:
+	gclose(handle);
+	return ret;
+}
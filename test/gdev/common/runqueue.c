@@ -0,0 +1,292 @@
+/*
+ * a microbenchmark of the wait queues of the scheduler.
+ * gdev_sched.c is included here to reach the static queue operations,
+ * which are compared against the priority-sorted list they replaced.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "gdev_sched.c"
+
+#define ENTITY_MAX 4096
+#define DEADLINE_RATIO 64 /* one in every DEADLINE_RATIO has a deadline. */
+#define BENCH_ROUNDS 4
+
+int gdev_sched_create_scheduler(struct gdev_device *gdev)
+{
+	return 0;
+}
+
+void gdev_sched_destroy_scheduler(struct gdev_device *gdev)
+{
+}
+
+void *gdev_sched_get_current_task(void)
+{
+	return NULL;
+}
+
+int gdev_sched_get_static_prio(void *task)
+{
+	return GDEV_PRIO_DEFAULT;
+}
+
+void gdev_sched_sleep(void)
+{
+}
+
+int gdev_sched_wakeup(void *task)
+{
+	return 0;
+}
+
+/* the benchmark is single-threaded. */
+void gdev_lock(gdev_lock_t *p)
+{
+}
+
+void gdev_unlock(gdev_lock_t *p)
+{
+}
+
+void gdev_lock_nested(gdev_lock_t *p)
+{
+}
+
+void gdev_unlock_nested(gdev_lock_t *p)
+{
+}
+
+unsigned int gdev_event_seq(gdev_event_t *p)
+{
+	return 0;
+}
+
+void gdev_event_wait(gdev_event_t *p, unsigned int seq, unsigned long timeout_us)
+{
+}
+
+void gdev_event_signal(gdev_event_t *p)
+{
+}
+
+void *gdev_current_com_get(struct gdev_device *gdev)
+{
+	return gdev->current_com;
+}
+
+void gdev_current_com_set(struct gdev_device *gdev, void *com)
+{
+	gdev->current_com = com;
+}
+
+struct gdev_device *gdev_phys_get(struct gdev_device *gdev)
+{
+	return !gdev ? NULL : gdev->parent;
+}
+
+struct gdev_sched_entity *gdev_sched_entity_alloc(int size)
+{
+	return calloc(1, size);
+}
+
+int gdev_ctx_get_cid(gdev_ctx_t *ctx)
+{
+	return ctx->cid % GDEV_CONTEXT_MAX_COUNT;
+}
+
+void gdev_access_start(struct gdev_device *gdev)
+{
+}
+
+void gdev_access_end(struct gdev_device *gdev)
+{
+}
+
+static struct gdev_device dev;
+static gdev_ctx_t ctxs[ENTITY_MAX];
+static struct gdev_sched_entity *ses[ENTITY_MAX];
+static struct gdev_list list; /* the priority-sorted list as before. */
+static unsigned int seed;
+
+static unsigned int random_next(void)
+{
+	seed = seed * 1103515245 + 12345;
+	return (seed >> 16) & 0x7fff;
+}
+
+/* give @se a new priority, or a deadline once in a while. */
+static void reprioritize(struct gdev_sched_entity *se)
+{
+	unsigned int r = random_next();
+
+	if (r % DEADLINE_RATIO == 0) {
+		se->deadline = 1000;
+		gdev_time_us(&se->abs_deadline, random_next());
+	}
+	else {
+		se->deadline = 0;
+		se->prio = r % (GDEV_PRIO_MAX + 1);
+	}
+}
+
+static void list_enqueue(struct gdev_sched_entity *se)
+{
+	struct gdev_sched_entity *p;
+
+	gdev_list_for_each (p, &list, list_entry_com) {
+		if (__gdev_sched_before(se, p)) {
+			gdev_list_add_prev(&se->list_entry_com, &p->list_entry_com);
+			break;
+		}
+	}
+	if (gdev_list_empty(&se->list_entry_com))
+		gdev_list_add_tail(&se->list_entry_com, &list);
+}
+
+static struct gdev_sched_entity *list_dequeue(void)
+{
+	struct gdev_sched_entity *se = gdev_list_container(gdev_list_head(&list));
+
+	gdev_list_del(&se->list_entry_com);
+	return se;
+}
+
+static void queue_enqueue(struct gdev_sched_entity *se)
+{
+	__gdev_enqueue_compute(&dev, se);
+}
+
+static struct gdev_sched_entity *queue_dequeue(void)
+{
+	struct gdev_sched_entity *se;
+
+	se = gdev_list_container(gdev_queue_head(&dev.sched_com_queue));
+	__gdev_dequeue_compute(se);
+	return se;
+}
+
+/* nanoseconds per dispatch, i.e., taking the first of @n waiting entities
+   and queueing it again with a new priority. */
+static unsigned long bench(int n, void (*enqueue)(struct gdev_sched_entity *),
+						   struct gdev_sched_entity *(*dequeue)(void))
+{
+	struct timespec start, end;
+	unsigned long ns;
+	int i;
+
+	seed = n;
+	for (i = 0; i < n; i++) {
+		reprioritize(ses[i]);
+		enqueue(ses[i]);
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (i = 0; i < n * BENCH_ROUNDS; i++) {
+		struct gdev_sched_entity *se = dequeue();
+		reprioritize(se);
+		enqueue(se);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	for (i = 0; i < n; i++)
+		dequeue();
+
+	ns = (end.tv_sec - start.tv_sec) * 1000000000UL + end.tv_nsec - start.tv_nsec;
+	return ns / (n * BENCH_ROUNDS);
+}
+
+/* entities must come out in order of deadlines and priorities, and in
+   FIFO order among the same priority. */
+static int check_order(int n)
+{
+	struct gdev_sched_entity *se, *prev = NULL;
+	int i;
+
+	seed = 1;
+	for (i = 0; i < n; i++) {
+		reprioritize(ses[i]);
+		queue_enqueue(ses[i]);
+	}
+
+	for (i = 0; i < n; i++) {
+		se = queue_dequeue();
+		if (prev && (__gdev_sched_before(se, prev) ||
+					 (!se->deadline && !prev->deadline &&
+					  se->prio == prev->prio && se->ctx < prev->ctx))) {
+			printf("context %d is dispatched after %d\n",
+				   se->ctx->cid, prev->ctx->cid);
+			return -1;
+		}
+		prev = se;
+	}
+
+	if (!gdev_queue_empty(&dev.sched_com_queue)) {
+		printf("queue is not empty\n");
+		return -1;
+	}
+
+	return 0;
+}
+
+/* the priorities of the OS, e.g., static priorities of Linux tasks and
+   nice values, must come out in the order they had as they were. */
+static int check_os_prio(int min, int max)
+{
+	int raw[ENTITY_MAX];
+	struct gdev_sched_entity *se, *prev = NULL;
+	int n = (max - min + 1) * 4, i, ret = 0;
+
+	seed = max;
+	for (i = 0; i < n; i++) {
+		raw[i] = min + random_next() % (max - min + 1);
+		ses[i]->deadline = 0;
+		ses[i]->prio = gdev_sched_prio_map(raw[i], min, max);
+		queue_enqueue(ses[i]);
+	}
+
+	for (i = 0; i < n; i++) {
+		se = queue_dequeue();
+		if (!ret && prev && (raw[se->ctx->cid] > raw[prev->ctx->cid] ||
+							 (raw[se->ctx->cid] == raw[prev->ctx->cid] && se->ctx < prev->ctx))) {
+			printf("priority %d is dispatched after %d of %d..%d\n",
+				   raw[se->ctx->cid], raw[prev->ctx->cid], min, max);
+			ret = -1; /* the queue is emptied still. */
+		}
+		prev = se;
+	}
+
+	return ret;
+}
+
+int gdev_test_runqueue(void)
+{
+	int sizes[] = {16, 256, 1024, ENTITY_MAX};
+	int i, ret = 0;
+
+	memset(&dev, 0, sizeof(dev));
+	gdev_queue_init(&dev.sched_com_queue);
+	gdev_list_init(&list, NULL);
+	for (i = 0; i < ENTITY_MAX; i++) {
+		ctxs[i].cid = i;
+		ses[i] = gdev_sched_entity_create(&dev, &ctxs[i]);
+	}
+
+	if (check_order(ENTITY_MAX))
+		ret = -1;
+	if (check_os_prio(100, 139) || check_os_prio(-20, 19))
+		ret = -1;
+
+	for (i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+		unsigned long q = bench(sizes[i], queue_enqueue, queue_dequeue);
+		unsigned long l = bench(sizes[i], list_enqueue, list_dequeue);
+		printf("%d entities: queue %lu ns, list %lu ns per dispatch\n",
+			   sizes[i], q, l);
+	}
+
+	for (i = 0; i < ENTITY_MAX; i++)
+		free(ses[i]);
+
+	return ret;
+}
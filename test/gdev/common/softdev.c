@@ -0,0 +1,365 @@
+/*
+ * a software device standing in for the driver, for the tests linked 
+ * directly with the runtime: device memory is host memory whose address is
+ * the device address, and the commands are carried out by the host when 
+ * submitted, while their fences are written only after the time the 
+ * commands would take on a GPU. creating a context takes the time the 
+ * driver would wait for the device meanwhile.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+#include "gdev_api.h"
+#include "gdev_device.h"
+#ifndef GDEV_SCHED_DISABLED
+#include <sys/ipc.h>
+#include <sys/shm.h>
+#include "gdev_lib.h"
+#include "gdev_sched.h"
+#include "gdev_util.h"
+#endif
+
+#define DMA_BANDWIDTH 12 /* bytes per ns, PCIe gen3 x16. */
+#define MEM_BANDWIDTH 200 /* bytes per ns, device memory. */
+#define COMMAND_NS 5000 /* overhead of a command. */
+#define VAS_NEW_NS 200000 /* setting up the page directory. */
+#define CTX_NEW_NS 500000 /* setting up the channel. */
+#define CTX_FREE_NS 100000 /* tearing down the channel. */
+#define PIN_BANDWIDTH 4 /* bytes per ns, pinning host DMA memory. */
+
+/**
+ * the software device.
+ */
+struct soft_ctx {
+	uint64_t done; /* when the last command submitted completes. */
+	uint64_t ready[GDEV_FENCE_COUNT]; /* when each fence is written, plus
+									   one, or 0 once it is written. */
+};
+
+static struct gdev_device soft_dev;
+static int soft_users;
+static pthread_mutex_t soft_mutex = PTHREAD_MUTEX_INITIALIZER;
+static uint64_t soft_busy; /* when the engine becomes idle. */
+static uint64_t soft_busy_ns; /* the time the engine has been busy for. */
+static int soft_cid;
+static int soft_ctxs; /* contexts alive. */
+static int soft_mems; /* device memory objects alive. */
+static int soft_dma_mems; /* host DMA memory objects alive. */
+static int soft_busy_frees; /* memory objects freed while the engine is busy. */
+#ifndef GDEV_SCHED_DISABLED
+#define SOFT_DEVICE_COUNT 32 /* GDEV_DEVICE_MAX_COUNT of the runtime. */
+struct gdev_device *lgdev; /* the local device of the runtime. */
+#endif
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/* the driver waits for the device for @ns. */
+static void soft_wait(uint64_t ns)
+{
+	struct timespec ts = {ns / 1000000000, ns % 1000000000};
+
+	nanosleep(&ts, NULL);
+}
+
+/* queue a command taking @ns on the engine. */
+static void soft_run(struct gdev_ctx *ctx, uint64_t ns)
+{
+	struct soft_ctx *sc = ctx->pdata;
+	uint64_t now = now_ns();
+
+	pthread_mutex_lock(&soft_mutex);
+	if (soft_busy < now)
+		soft_busy = now;
+	soft_busy += ns + COMMAND_NS;
+	soft_busy_ns += ns + COMMAND_NS;
+	sc->done = soft_busy;
+	pthread_mutex_unlock(&soft_mutex);
+}
+
+/* the kernel: out[i] = in[i] + add for @count words. */
+static int soft_launch(struct gdev_ctx *ctx, struct gdev_kernel *k)
+{
+	uint32_t *p = k->param_buf;
+	uint32_t *in = (uint32_t *)(((uint64_t)p[1] << 32) | p[0]);
+	uint32_t *out = (uint32_t *)(((uint64_t)p[3] << 32) | p[2]);
+	uint32_t i;
+
+	for (i = 0; i < p[4]; i++)
+		out[i] = in[i] + p[5];
+	soft_run(ctx, (uint64_t)p[4] * 8 / MEM_BANDWIDTH);
+
+	return 0;
+}
+
+static uint32_t soft_fence_read(struct gdev_ctx *ctx, uint32_t seq)
+{
+	struct soft_ctx *sc = ctx->pdata;
+	uint32_t *slot = &ctx->fence.map[seq * GDEV_FENCE_QUERY_SIZE / 4];
+	uint64_t ready = __atomic_load_n(&sc->ready[seq], __ATOMIC_RELAXED);
+	uint32_t val;
+
+	/* the slot keeps what was written last until the fence is done, as
+	   the memory of a GPU does. */
+	if (ready && now_ns() >= ready && __sync_bool_compare_and_swap(&sc->ready[seq], ready, 0))
+		__atomic_store_n(slot, seq, __ATOMIC_RELEASE);
+
+	val = __atomic_load_n(slot, __ATOMIC_ACQUIRE);
+	if (val != seq) {
+		/* the host would spin on another core. */
+		sched_yield();
+	}
+
+	return val;
+}
+
+static void soft_fence_write(struct gdev_ctx *ctx, int op, uint32_t seq)
+{
+	struct soft_ctx *sc = ctx->pdata;
+
+	__atomic_store_n(&sc->ready[seq], sc->done + 1, __ATOMIC_RELAXED);
+}
+
+static void soft_fence_reset(struct gdev_ctx *ctx, uint32_t seq)
+{
+	__atomic_store_n(&ctx->fence.map[seq * GDEV_FENCE_QUERY_SIZE / 4], ~seq, __ATOMIC_RELAXED);
+}
+
+static void soft_memcpy(struct gdev_ctx *ctx, uint64_t dst_addr, uint64_t src_addr, uint32_t size)
+{
+	memcpy((void *)dst_addr, (void *)src_addr, size);
+	soft_run(ctx, size / DMA_BANDWIDTH);
+}
+
+static void soft_nop(struct gdev_ctx *ctx)
+{
+}
+
+static struct gdev_compute soft_compute = {
+	.launch = soft_launch,
+	.fence_read = soft_fence_read,
+	.fence_write = soft_fence_write,
+	.fence_reset = soft_fence_reset,
+	.memcpy = soft_memcpy,
+	.memcpy_async = soft_memcpy,
+	.membar = soft_nop,
+	.notify_intr = soft_nop,
+	.init = soft_nop,
+};
+
+int gdev_raw_query(struct gdev_device *gdev, uint32_t type, uint64_t *result)
+{
+	switch (type) {
+	case GDEV_QUERY_CHIPSET:
+		*result = 0xe4; /* fences follow the copies. */
+		return 0;
+	case GDEV_QUERY_DEVICE_MEM_SIZE:
+		*result = 0x40000000 + 0xc010000;
+		return 0;
+	}
+
+	return -EINVAL;
+}
+
+struct gdev_device *gdev_raw_dev_open(int minor)
+{
+	struct gdev_device *gdev;
+
+	pthread_mutex_lock(&soft_mutex);
+	if (soft_users++ == 0) {
+		memset(&soft_dev, 0, sizeof(soft_dev));
+		gdev_init_device(&soft_dev, 0, NULL);
+		soft_dev.compute = &soft_compute;
+#ifndef GDEV_SCHED_DISABLED
+		/* the shared memory is created as gdev_usched_monitor does, and
+		   holds the physical device and a virtual device of it. it is
+		   removed at once, and goes away when the process exits. */
+		if (!gdevs) {
+			int shmid = shmget(GDEV_SHM_KEYS(1),
+				sizeof(struct gdev_device) * SOFT_DEVICE_COUNT +
+				sizeof(struct gdev_vas) * GDEV_CONTEXT_MAX_COUNT +
+				sizeof(struct gdev_sched_entity) * GDEV_CONTEXT_MAX_COUNT +
+				sizeof(struct gdev_mem) * GDEV_CONTEXT_MAX_COUNT * 10 +
+				sizeof(struct gdev_task) * GDEV_NR_TASKS,
+				IPC_CREAT | IPC_EXCL | 0600);
+			if (shmid != -1) {
+				gdevs = gdev_attach_shms_dev(SOFT_DEVICE_COUNT);
+				shmctl(shmid, IPC_RMID, NULL);
+			}
+			if (!gdevs) {
+				GDEV_PRINT("Failed to create the shared memory, is gdev_usched_monitor running?\n");
+				soft_users--;
+				pthread_mutex_unlock(&soft_mutex);
+				return NULL;
+			}
+		}
+		memset(gdevs, 0, sizeof(*gdevs) * 2);
+		lgdev = &soft_dev;
+		gdev_init_device(&gdevs[0], 0, NULL);
+		gdevs[0].compute = &soft_compute;
+		gdev_init_virtual_device(&gdevs[1], 1, 100, (void *)ADDR_SUB(&gdevs[1], gdevs));
+		/* linked to the physical device, as gdev_init_scheduler() does. */
+		gdev_list_init(&gdevs[1].list_entry_com, &gdevs[1]);
+		gdev_list_add(&gdevs[1].list_entry_com, &gdevs[0].sched_com_list);
+		gdev_list_init(&gdevs[1].list_entry_mem, &gdevs[1]);
+		gdev_list_add(&gdevs[1].list_entry_mem, &gdevs[0].sched_mem_list);
+#endif
+	}
+#ifndef GDEV_SCHED_DISABLED
+	gdev = &gdevs[1];
+#else
+	gdev = &soft_dev;
+#endif
+	gdev->users++; /* the next entities are selected only while used. */
+	pthread_mutex_unlock(&soft_mutex);
+
+	return gdev;
+}
+
+void gdev_raw_dev_close(struct gdev_device *gdev)
+{
+	pthread_mutex_lock(&soft_mutex);
+	gdev->users--;
+	soft_users--;
+	pthread_mutex_unlock(&soft_mutex);
+}
+
+struct gdev_vas *gdev_raw_vas_new(struct gdev_device *gdev, uint64_t size)
+{
+	soft_wait(VAS_NEW_NS);
+	return calloc(1, sizeof(struct gdev_vas));
+}
+
+void gdev_raw_vas_free(struct gdev_vas *vas)
+{
+	free(vas);
+}
+
+struct gdev_ctx *gdev_raw_ctx_new(struct gdev_device *gdev, struct gdev_vas *vas)
+{
+	struct gdev_ctx *ctx = calloc(1, sizeof(*ctx));
+
+	soft_wait(CTX_NEW_NS);
+	__sync_fetch_and_add(&soft_ctxs, 1);
+	ctx->pdata = calloc(1, sizeof(struct soft_ctx));
+	ctx->fence.map = calloc(1, GDEV_FENCE_BUF_SIZE);
+	ctx->fence.addr = (uint64_t)ctx->fence.map;
+	ctx->fence.seq = 0;
+	pthread_mutex_lock(&soft_mutex);
+	ctx->cid = soft_cid++;
+	pthread_mutex_unlock(&soft_mutex);
+
+	return ctx;
+}
+
+void gdev_raw_ctx_free(struct gdev_ctx *ctx)
+{
+	soft_wait(CTX_FREE_NS);
+	__sync_fetch_and_sub(&soft_ctxs, 1);
+	free(ctx->fence.map);
+	free(ctx->pdata);
+	free(ctx);
+}
+
+static struct gdev_mem *soft_mem_alloc(uint64_t size, int mapped, int *alive)
+{
+	struct gdev_mem *mem = calloc(1, sizeof(*mem));
+	void *buf;
+
+	if (posix_memalign(&buf, 0x1000, size)) {
+		free(mem);
+		return NULL;
+	}
+	mem->bo = buf;
+	mem->addr = (uint64_t)buf;
+	mem->size = size;
+	/* small device memory is mapped for good, like the drivers do. */
+	mem->map = mapped ? buf : NULL;
+	__sync_fetch_and_add(alive, 1);
+
+	return mem;
+}
+
+struct gdev_mem *gdev_raw_mem_alloc(struct gdev_vas *vas, uint64_t size)
+{
+	return soft_mem_alloc(size, size <= GDEV_MEM_MAPPABLE_LIMIT, &soft_mems);
+}
+
+struct gdev_mem *gdev_raw_mem_alloc_dma(struct gdev_vas *vas, uint64_t size)
+{
+	soft_wait(size / PIN_BANDWIDTH);
+	return soft_mem_alloc(size, 1, &soft_dma_mems);
+}
+
+void gdev_raw_mem_free(struct gdev_mem *mem)
+{
+	pthread_mutex_lock(&soft_mutex);
+	if (now_ns() < soft_busy)
+		soft_busy_frees++;
+	pthread_mutex_unlock(&soft_mutex);
+	__sync_fetch_and_sub(mem->type == GDEV_MEM_DMA ? &soft_dma_mems : &soft_mems, 1);
+	free(mem->bo);
+	free(mem);
+}
+
+struct gdev_mem *gdev_raw_swap_alloc(struct gdev_device *gdev, uint64_t size)
+{
+	return NULL;
+}
+
+void gdev_raw_swap_free(struct gdev_mem *mem)
+{
+}
+
+struct gdev_mem *gdev_raw_mem_share(struct gdev_vas *vas, struct gdev_mem *mem)
+{
+	return NULL;
+}
+
+void gdev_raw_mem_unshare(struct gdev_mem *mem)
+{
+}
+
+void *gdev_raw_mem_map(struct gdev_mem *mem)
+{
+	return mem->bo;
+}
+
+void gdev_raw_mem_unmap(struct gdev_mem *mem, void *map)
+{
+}
+
+uint64_t gdev_raw_mem_phys_getaddr(struct gdev_mem *mem, uint64_t offset)
+{
+	return mem->addr + offset;
+}
+
+uint32_t gdev_raw_read32(struct gdev_mem *mem, uint64_t addr)
+{
+	return *(uint32_t *)addr;
+}
+
+void gdev_raw_write32(struct gdev_mem *mem, uint64_t addr, uint32_t val)
+{
+	*(uint32_t *)addr = val;
+}
+
+int gdev_raw_read(struct gdev_mem *mem, void *buf, uint64_t addr, uint32_t size)
+{
+	memcpy(buf, (void *)addr, size);
+	return 0;
+}
+
+int gdev_raw_write(struct gdev_mem *mem, uint64_t addr, const void *buf, uint32_t size)
+{
+	memcpy((void *)addr, buf, size);
+	return 0;
+}
+
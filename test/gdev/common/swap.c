@@ -0,0 +1,788 @@
+/*
+ * synthetic device memory oversubscribed by several address spaces.
+ * gdev_nvidia_shm.c is linked directly with this file, which stands in for
+ * the driver and the copy callbacks, so that swap can be tested and the
+ * bytes it moves can be counted without GPUs.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "gdev_device.h"
+#include "gdev_sched.h"
+#include "gdev_zswap.h"
+
+#define VAS_COUNT 3
+#define BUF_SIZE 0x800000 /* 8MB, shared by all the address spaces. */
+#define SWAP_SIZE 0x200000 /* 2MB of device swap, smaller than a buffer. */
+#define OP_COUNT 3000
+#define WRITE_MAX 0x30000 /* the largest write of one operation. */
+#define MEM_MAX 8192
+#define INDEX_VAS_COUNT 64
+#define INDEX_MEM_PER_VAS 64 /* thousands of objects on the device. */
+#define INDEX_OP_COUNT 1000
+#define ZSWAP_SIZE 0x1000000 /* 16MB of each kind of data to compress. */
+#define ZSWAP_ROUNDS 3
+
+static struct gdev_device dev;
+static struct gdev_vas vases[VAS_COUNT];
+static struct gdev_ctx ctxs[VAS_COUNT];
+
+/* every memory object has its own address, but shares the buffer object. */
+static struct gdev_mem *mems[MEM_MAX];
+static uint64_t next_addr = 0x20000000;
+
+/* what each address space should see in the shared buffer. */
+static char *expected[VAS_COUNT];
+
+/* bytes copied by the swap callbacks. */
+static uint64_t saved_host, saved_dev, loaded_host, loaded_dev;
+
+/* bytes compressed by the swap callbacks, and the time (us) spent. */
+static uint64_t zstored, zkept, zstore_us, zfetch_us;
+
+struct bo {
+	char *data;
+	uint64_t size;
+};
+
+static struct gdev_mem *new_mem(struct gdev_vas *vas, struct bo *bo)
+{
+	struct gdev_mem *mem = calloc(1, sizeof(*mem));
+	int i;
+
+	mem->bo = bo;
+	mem->vas = vas;
+	mem->size = bo->size;
+	mem->addr = next_addr;
+	next_addr += bo->size;
+	for (i = 0; i < MEM_MAX; i++) {
+		if (!mems[i]) {
+			mems[i] = mem;
+			break;
+		}
+	}
+
+	return mem;
+}
+
+static void del_mem(struct gdev_mem *mem)
+{
+	int i;
+
+	for (i = 0; i < MEM_MAX; i++) {
+		if (mems[i] == mem)
+			mems[i] = NULL;
+	}
+	free(mem);
+}
+
+/* the device memory at @addr. */
+static char *dev_ptr(uint64_t addr, uint64_t size)
+{
+	struct gdev_mem *mem;
+	int i;
+
+	for (i = 0; i < MEM_MAX; i++) {
+		mem = mems[i];
+		if (mem && addr >= mem->addr && addr + size <= mem->addr + mem->size)
+			return ((struct bo *)mem->bo)->data + (addr - mem->addr);
+	}
+	printf("0x%llx is not mapped\n", (unsigned long long)addr);
+	exit(1);
+}
+
+void gdev_lock_save(gdev_lock_t *p, unsigned long *flags)
+{
+}
+
+void gdev_unlock_restore(gdev_lock_t *p, unsigned long *flags)
+{
+}
+
+void gdev_lock_nested(gdev_lock_t *p)
+{
+}
+
+void gdev_unlock_nested(gdev_lock_t *p)
+{
+}
+
+/* the harness is single-threaded. */
+void gdev_mutex_init(gdev_mutex_t *p)
+{
+}
+
+void gdev_mutex_lock(gdev_mutex_t *p)
+{
+}
+
+void gdev_mutex_unlock(gdev_mutex_t *p)
+{
+}
+
+void gdev_rwlock_init(gdev_rwlock_t *p)
+{
+}
+
+void gdev_read_lock(gdev_rwlock_t *p)
+{
+}
+
+void gdev_read_unlock(gdev_rwlock_t *p)
+{
+}
+
+void gdev_write_lock(gdev_rwlock_t *p)
+{
+}
+
+void gdev_write_unlock(gdev_rwlock_t *p)
+{
+}
+
+void gdev_trace(struct gdev_device *gdev, int type, int res, int cid, int64_t val)
+{
+}
+
+void gdev_nvidia_mem_setup(struct gdev_mem *mem, struct gdev_vas *vas, int type)
+{
+	mem->vas = vas;
+	mem->type = type;
+	mem->evicted = 0;
+	mem->swap_mem = NULL;
+	mem->swap_buf = NULL;
+	mem->swap_zbuf = NULL;
+	mem->swap_dirty = NULL;
+	mem->swap_saved = NULL;
+	mem->swap_dev = NULL;
+	mem->shm = NULL;
+	gdev_list_init(&mem->list_entry_heap, (void *)mem);
+	gdev_list_init(&mem->list_entry_shm, (void *)mem);
+	gdev_list_init(&mem->list_entry_evict, (void *)mem);
+	mem->evict_level = -1;
+}
+
+void gdev_nvidia_mem_list_add(struct gdev_mem *mem)
+{
+	gdev_list_add(&mem->list_entry_heap, &mem->vas->mem_list);
+	gdev_shm_index_add(mem);
+}
+
+void gdev_nvidia_mem_list_del(struct gdev_mem *mem)
+{
+	gdev_shm_index_del(mem);
+	gdev_list_del(&mem->list_entry_heap);
+}
+
+struct gdev_mem *gdev_raw_mem_alloc(struct gdev_vas *vas, uint64_t size)
+{
+	struct bo *bo = malloc(sizeof(*bo));
+
+	bo->data = calloc(1, size);
+	bo->size = size;
+
+	return new_mem(vas, bo);
+}
+
+struct gdev_mem *gdev_raw_mem_share(struct gdev_vas *vas, struct gdev_mem *mem)
+{
+	return new_mem(vas, mem->bo);
+}
+
+void gdev_raw_mem_unshare(struct gdev_mem *mem)
+{
+	del_mem(mem);
+}
+
+void gdev_raw_mem_free(struct gdev_mem *mem)
+{
+	struct bo *bo = mem->bo;
+
+	free(bo->data);
+	free(bo);
+	del_mem(mem);
+}
+
+void gdev_mem_free(struct gdev_mem *mem)
+{
+	gdev_raw_mem_free(mem);
+}
+
+struct gdev_mem *gdev_raw_swap_alloc(struct gdev_device *gdev, uint64_t size)
+{
+	return gdev_raw_mem_alloc(NULL, size);
+}
+
+void gdev_raw_swap_free(struct gdev_mem *mem)
+{
+	gdev_raw_mem_free(mem);
+}
+
+int gdev_callback_save_to_host(void *h, void *dst_buf, uint64_t src_addr, uint64_t size)
+{
+	memcpy(dst_buf, dev_ptr(src_addr, size), size);
+	saved_host += size;
+	return 0;
+}
+
+int gdev_callback_save_to_device(void *h, uint64_t dst_addr, uint64_t src_addr, uint64_t size)
+{
+	memcpy(dev_ptr(dst_addr, size), dev_ptr(src_addr, size), size);
+	saved_dev += size;
+	return 0;
+}
+
+int gdev_callback_load_from_host(void *h, uint64_t dst_addr, void *src_buf, uint64_t size)
+{
+	memcpy(dev_ptr(dst_addr, size), src_buf, size);
+	loaded_host += size;
+	return 0;
+}
+
+int gdev_callback_load_from_device(void *h, uint64_t dst_addr, uint64_t src_addr, uint64_t size)
+{
+	memcpy(dev_ptr(dst_addr, size), dev_ptr(src_addr, size), size);
+	loaded_dev += size;
+	return 0;
+}
+
+static unsigned long elapsed_us(struct gdev_time *start)
+{
+	struct gdev_time now, elapse;
+
+	gdev_time_stamp(&now);
+	gdev_time_sub(&elapse, &now, start);
+
+	return gdev_time_to_us(&elapse);
+}
+
+int gdev_callback_save_to_zswap(void *h, struct gdev_zswap *z, uint64_t offset, uint64_t src_addr, uint64_t size)
+{
+	struct gdev_time start;
+	uint64_t kept = z->kept;
+	int ret;
+
+	gdev_time_stamp(&start);
+	ret = gdev_zswap_store(z, offset, dev_ptr(src_addr, size), size);
+	zstore_us += elapsed_us(&start);
+	saved_host += size;
+	zstored += size;
+	zkept += z->kept - kept;
+	return ret;
+}
+
+int gdev_callback_load_from_zswap(void *h, uint64_t dst_addr, struct gdev_zswap *z, uint64_t offset, uint64_t size)
+{
+	struct gdev_time start;
+	int ret;
+
+	gdev_time_stamp(&start);
+	ret = gdev_zswap_fetch(z, offset, dev_ptr(dst_addr, size), size);
+	zfetch_us += elapsed_us(&start);
+	loaded_host += size;
+	return ret;
+}
+
+static uint64_t swap_bytes(void)
+{
+	return saved_host + saved_dev + loaded_host + loaded_dev;
+}
+
+/* kinds of data written, some of which are compressed well. */
+#define ZSWAP_KINDS 5
+static const char *kind_names[ZSWAP_KINDS] = {
+	"zero", "pattern", "sparse", "text", "random"
+};
+
+static void fill_data(char *p, uint64_t size, int kind)
+{
+	static const char *words[] = {
+		"kernel ", "launch ", "memory ", "device ", "context ", "swap ",
+		"page ", "the ", "of ", "buffer ", "copy ", "engine ", "queue "
+	};
+	uint32_t word = rand();
+	uint64_t k, n;
+
+	switch (kind) {
+	case 0:
+		memset(p, 0, size);
+		break;
+	case 1:
+		for (k = 0; k < size; k++)
+			p[k] = ((char *)&word)[k % 4];
+		break;
+	case 2:
+		/* a float vector mostly zero. */
+		memset(p, 0, size);
+		for (k = 0; k + 4 <= size; k += 64) {
+			float f = (float)rand() / RAND_MAX;
+			memcpy(p + k, &f, 4);
+		}
+		break;
+	case 3:
+		for (k = 0; k < size; k += n) {
+			const char *w = words[rand() % (sizeof(words) / sizeof(words[0]))];
+			n = strlen(w);
+			if (n > size - k)
+				n = size - k;
+			memcpy(p + k, w, n);
+		}
+		break;
+	default:
+		for (k = 0; k < size; k++)
+			p[k] = rand();
+		break;
+	}
+}
+
+/* write @size bytes at @offset of @mem from @i's point of view, either by
+   copying it from the host (@launch = 0) or by a launch declaring it as 
+   written, which uses the whole buffer (1) or declares it as used too (2). */
+static int write_range(int i, struct gdev_mem *mem, uint64_t offset, uint64_t size, int launch)
+{
+	char *p;
+	int ret;
+
+	if (launch) {
+		if (launch == 2)
+			ret = gdev_shm_retrieve_range(&ctxs[i], mem, mem->addr + offset, size);
+		else
+			ret = gdev_shm_retrieve_swap(&ctxs[i], mem);
+		if (!ret)
+			gdev_shm_mark_dirty(mem, mem->addr + offset, size);
+	}
+	else
+		ret = gdev_shm_evict_conflict(&ctxs[i], mem, mem->addr + offset, size);
+	if (ret) {
+		printf("vas %d: swap failed (%d)\n", i, ret);
+		return -1;
+	}
+
+	p = dev_ptr(mem->addr + offset, size);
+	fill_data(p, size, rand() % ZSWAP_KINDS);
+	memcpy(expected[i] + offset, p, size);
+
+	return 0;
+}
+
+/* read the whole buffer of @mem back and see if @i sees its own data. */
+static int read_all(int i, struct gdev_mem *mem)
+{
+	char *p;
+	uint64_t k;
+
+	if (gdev_shm_retrieve_swap(&ctxs[i], mem)) {
+		printf("vas %d: swap failed\n", i);
+		return -1;
+	}
+
+	p = dev_ptr(mem->addr, mem->size);
+	if (memcmp(p, expected[i], mem->size)) {
+		for (k = 0; p[k] == expected[i][k]; k++)
+			;
+		printf("vas %d: data corrupted at 0x%llx\n", i, (unsigned long long)k);
+		return -1;
+	}
+
+	return 0;
+}
+
+static void init_device(struct gdev_device *gdev)
+{
+	int i;
+
+	memset(gdev, 0, sizeof(*gdev));
+	gdev_list_init(&gdev->vas_list, NULL);
+	gdev_list_init(&gdev->shm_list, NULL);
+	for (i = 0; i < GDEV_EVICT_CLASSES; i++)
+		gdev_queue_init(&gdev->evict_index[i]);
+}
+
+static void init_vas(struct gdev_vas *vas, struct gdev_device *gdev, int vid, int prio)
+{
+	vas->vid = vid;
+	vas->gdev = gdev;
+	vas->prio = prio;
+	gdev_list_init(&vas->mem_list, NULL);
+	gdev_list_init(&vas->list_entry, vas);
+	gdev_list_add(&vas->list_entry, &gdev->vas_list);
+}
+
+static struct gdev_mem *alloc_mem(struct gdev_vas *vas, uint64_t size)
+{
+	struct gdev_mem *mem = gdev_raw_mem_alloc(vas, size);
+
+	gdev_nvidia_mem_setup(mem, vas, GDEV_MEM_DEVICE);
+	gdev_nvidia_mem_list_add(mem);
+
+	return mem;
+}
+
+static int prio_of(struct gdev_mem *mem)
+{
+	return mem->shm ? mem->shm->prio : mem->vas->prio;
+}
+
+/* select a victim by scanning all the objects, as without the index. */
+static struct gdev_mem *scan_victim(struct gdev_device *gdev, struct gdev_vas *vas, uint64_t size)
+{
+	struct gdev_vas *v;
+	struct gdev_mem *m, *victim = NULL;
+
+	gdev_list_for_each (v, &gdev->vas_list, list_entry) {
+		gdev_list_for_each (m, &v->mem_list, list_entry_heap) {
+			if (m->size >= size && m->vas != vas &&
+				(!victim || prio_of(victim) > prio_of(m)))
+				victim = m;
+		}
+	}
+
+	return victim;
+}
+
+/* the victim must have the lowest priority, and be in the smallest size 
+   class at that priority. */
+static int check_victim(struct gdev_device *gdev, struct gdev_vas *vas, uint64_t size, struct gdev_mem *victim)
+{
+	struct gdev_vas *v;
+	struct gdev_mem *m;
+
+	gdev_list_for_each (v, &gdev->vas_list, list_entry) {
+		gdev_list_for_each (m, &v->mem_list, list_entry_heap) {
+			if (m->size < size || m->vas == vas)
+				continue;
+			if (prio_of(m) < prio_of(victim) ||
+				(prio_of(m) == prio_of(victim) && m->size * 2 <= victim->size &&
+				 m->size > (1ULL << GDEV_EVICT_SHIFT))) {
+				printf("0x%llx bytes at prio %d selected over 0x%llx bytes at prio %d\n",
+					   (unsigned long long)victim->size, prio_of(victim),
+					   (unsigned long long)m->size, prio_of(m));
+				return -1;
+			}
+		}
+	}
+
+	return 0;
+}
+
+static int index_test(void)
+{
+	static struct gdev_device idev;
+	static struct gdev_vas ivases[INDEX_VAS_COUNT];
+	struct gdev_mem *m[3], *new, *victim;
+	struct gdev_time start, end, t;
+	uint64_t size;
+	unsigned long index_us = 0, scan_us = 0;
+	int i, j, n;
+
+	init_device(&idev);
+
+	/* the least recently used is selected at the same priority. */
+	init_vas(&ivases[0], &idev, 0, GDEV_PRIO_DEFAULT);
+	init_vas(&ivases[1], &idev, 1, GDEV_PRIO_DEFAULT);
+	for (i = 0; i < 3; i++)
+		m[i] = alloc_mem(&ivases[0], 0x100000);
+	gdev_shm_index_touch(m[0]);
+	gdev_shm_index_touch(m[2]);
+	new = gdev_shm_attach(&ivases[1], NULL, 0x100000);
+	if (!new || new->shm != m[1]->shm) {
+		printf("the least recently used is not selected\n");
+		return -1;
+	}
+	gdev_shm_detach(new);
+	for (i = 0; i < 3; i++) {
+		if (m[i]->shm)
+			gdev_shm_detach(m[i]);
+		else {
+			gdev_nvidia_mem_list_del(m[i]);
+			gdev_raw_mem_free(m[i]);
+		}
+	}
+
+	/* the requester's own objects ahead in the list are not all walked. */
+	init_device(&idev);
+	init_vas(&ivases[0], &idev, 0, GDEV_PRIO_MIN);
+	init_vas(&ivases[1], &idev, 1, GDEV_PRIO_MIN);
+	for (i = 0; i < GDEV_EVICT_SCAN * 4; i++)
+		alloc_mem(&ivases[0], 0x1000);
+	m[0] = alloc_mem(&ivases[1], 0x1000); /* behind them in the class */
+	m[1] = alloc_mem(&ivases[1], 0x100000); /* alone in a larger class */
+	new = gdev_shm_attach(&ivases[0], NULL, 0x1000);
+	if (!new || new->shm != m[1]->shm) {
+		printf("the lookup is not bounded\n");
+		return -1;
+	}
+	gdev_shm_detach(new);
+
+	/* thousands of objects of various sizes and priorities. */
+	init_device(&idev);
+	for (i = 0; i < INDEX_VAS_COUNT; i++) {
+		init_vas(&ivases[i], &idev, i, (i * 7) % (GDEV_PRIO_MAX + 1));
+		for (j = 0; j < INDEX_MEM_PER_VAS; j++)
+			alloc_mem(&ivases[i], 0x1000ULL << (rand() % 9));
+	}
+
+	for (n = 0; n < INDEX_OP_COUNT; n++) {
+		struct gdev_vas *vas = &ivases[rand() % INDEX_VAS_COUNT];
+		size = 0x1000ULL << (rand() % 9);
+
+		gdev_time_stamp(&start);
+		victim = scan_victim(&idev, vas, size);
+		gdev_time_stamp(&end);
+		gdev_time_sub(&t, &end, &start);
+		scan_us += gdev_time_to_us(&t);
+
+		gdev_time_stamp(&start);
+		new = gdev_shm_attach(vas, NULL, size);
+		gdev_time_stamp(&end);
+		gdev_time_sub(&t, &end, &start);
+		index_us += gdev_time_to_us(&t);
+
+		if (!new || !victim) {
+			printf("no victim for 0x%llx bytes\n", (unsigned long long)size);
+			return -1;
+		}
+		gdev_list_for_each (victim, &new->shm->mem_list, list_entry_shm) {
+			if (victim != new)
+				break;
+		}
+		/* the victim is back to its own priority when left alone. */
+		gdev_shm_detach(new);
+		if (check_victim(&idev, vas, size, victim))
+			return -1;
+
+		/* some objects are accessed in between. */
+		for (i = 0; i < 8; i++) {
+			vas = &ivases[rand() % INDEX_VAS_COUNT];
+			victim = gdev_list_container(gdev_list_head(&vas->mem_list));
+			gdev_shm_index_touch(victim);
+		}
+	}
+
+	printf("index: %d objects, %lu ns to share a victim, %lu ns only to scan them\n",
+		   INDEX_VAS_COUNT * INDEX_MEM_PER_VAS, index_us * 1000 / INDEX_OP_COUNT,
+		   scan_us * 1000 / INDEX_OP_COUNT);
+
+	return 0;
+}
+
+/* oversubscribe the device, with the host swap compressed if @compress. */
+static int run_swap(int compress)
+{
+	struct gdev_mem *bufs[VAS_COUNT];
+	uint64_t offset, size;
+	uint64_t whole = 0, host = 0;
+	int last = -1;
+	int i, n;
+
+	srand(1);
+	saved_host = saved_dev = loaded_host = loaded_dev = 0;
+	zstored = zkept = zstore_us = zfetch_us = 0;
+
+	init_device(&dev);
+	dev.swap_compress = compress;
+	if (gdev_swap_create(&dev, SWAP_SIZE))
+		return -1;
+
+	for (i = 0; i < VAS_COUNT; i++) {
+		init_vas(&vases[i], &dev, i, i);
+		ctxs[i].cid = i;
+		ctxs[i].vas = &vases[i];
+		expected[i] = calloc(1, BUF_SIZE);
+	}
+
+	/* the first address space fills up the device memory, and the others
+	   borrow it from the first. */
+	bufs[0] = alloc_mem(&vases[0], BUF_SIZE);
+	for (i = 1; i < VAS_COUNT; i++) {
+		bufs[i] = gdev_shm_attach(&vases[i], NULL, BUF_SIZE);
+		if (!bufs[i] || bufs[i]->shm != bufs[0]->shm) {
+			printf("vas %d: failed to share memory\n", i);
+			return -1;
+		}
+	}
+
+	/* the data written before sharing must survive. */
+	write_range(0, bufs[0], 0, BUF_SIZE, 0);
+	if (swap_bytes()) {
+		printf("the holder is saved without conflicts\n");
+		return -1;
+	}
+	/* new memory is undefined until written. */
+	for (i = 1; i < VAS_COUNT; i++) {
+		if (write_range(i, bufs[i], 0, BUF_SIZE, 0))
+			return -1;
+	}
+
+	for (n = 0; n < OP_COUNT; n++) {
+		i = rand() % VAS_COUNT;
+		offset = rand() % BUF_SIZE;
+		size = rand() % WRITE_MAX + 1;
+		if (offset + size > BUF_SIZE)
+			size = BUF_SIZE - offset;
+		if (last >= 0 && last != i && !gdev_shm_swapped_out(&vases[i])) {
+			printf("vas %d: not swapped out after others\n", i);
+			return -1;
+		}
+		if (write_range(i, bufs[i], offset, size, rand() % 3))
+			return -1;
+		if (rand() % 8 == 0) {
+			if (read_all(i, bufs[i]))
+				return -1;
+			if (gdev_shm_swapped_out(&vases[i])) {
+				printf("vas %d: swapped out after retrieval\n", i);
+				return -1;
+			}
+		}
+		/* swapping whole buffers saves and loads everything. */
+		if (last >= 0 && last != i)
+			whole += BUF_SIZE * 2;
+		last = i;
+	}
+
+	for (i = 0; i < VAS_COUNT; i++) {
+		if (read_all(i, bufs[i]))
+			return -1;
+	}
+
+	printf("swap%s: %llu bytes saved (%llu to device), %llu bytes loaded (%llu from device)\n",
+		   compress ? " compressed" : "",
+		   (unsigned long long)(saved_host + saved_dev), (unsigned long long)saved_dev,
+		   (unsigned long long)(loaded_host + loaded_dev), (unsigned long long)loaded_dev);
+	printf("swap%s: %llu bytes moved, %llu bytes if swapping whole buffers\n",
+		   compress ? " compressed" : "",
+		   (unsigned long long)swap_bytes(), (unsigned long long)whole);
+
+	if (!saved_dev || !loaded_dev) {
+		printf("the device swap is not used\n");
+		return -1;
+	}
+	/* only dirty pages are saved, while some launches still load everything. */
+	if ((saved_host + saved_dev) * 8 > whole / 2 || swap_bytes() * 2 > whole) {
+		printf("too many bytes moved\n");
+		return -1;
+	}
+
+	/* the others keep their data after one of them leaves. */
+	gdev_shm_detach(bufs[1]);
+	for (n = 0; n < OP_COUNT / 10; n++) {
+		i = (rand() % 2) ? 0 : 2;
+		offset = rand() % BUF_SIZE;
+		size = rand() % WRITE_MAX + 1;
+		if (offset + size > BUF_SIZE)
+			size = BUF_SIZE - offset;
+		if (write_range(i, bufs[i], offset, size, rand() % 3))
+			return -1;
+	}
+	if (read_all(0, bufs[0]) || read_all(2, bufs[2]))
+		return -1;
+
+	if (compress) {
+		host = gdev_zswap_bytes(bufs[0]->swap_zbuf) + gdev_zswap_bytes(bufs[2]->swap_zbuf);
+		printf("swap compressed: %llu bytes to %llu (%.1fx), %llu MB/s to store, %llu MB/s to fetch, "
+			   "%llu bytes of host swap for %u\n",
+			   (unsigned long long)zstored, (unsigned long long)zkept,
+			   zkept ? (double)zstored / zkept : 0.0,
+			   (unsigned long long)(zstore_us ? zstored / zstore_us : 0),
+			   (unsigned long long)(zfetch_us ? loaded_host / zfetch_us : 0),
+			   (unsigned long long)host, BUF_SIZE * 2);
+		/* two fifths of the data are zero or a pattern. */
+		if (zkept * 2 > zstored || host * 2 > BUF_SIZE * 2) {
+			printf("the host swap is not compressed\n");
+			return -1;
+		}
+	}
+
+	gdev_shm_detach(bufs[2]);
+	gdev_shm_detach(bufs[0]);
+	gdev_swap_destroy(&dev);
+	for (i = 0; i < VAS_COUNT; i++)
+		free(expected[i]);
+
+	return 0;
+}
+
+/**
+ * compression of the host swap alone: each kind of data must come back as
+ * it was, and shrink as much as it can.
+ */
+static int zswap_bench(void)
+{
+	/* the least ratio, in tenths, of each kind. */
+	static const int ratio_min[ZSWAP_KINDS] = {1000, 1000, 40, 20, 9};
+	struct gdev_zswap *z;
+	struct gdev_time start;
+	unsigned long store_us, fetch_us, us;
+	uint64_t bytes;
+	char *data, *out, *work;
+	int kind, r, n, ret = 0;
+
+	data = malloc(ZSWAP_SIZE);
+	out = malloc(ZSWAP_SIZE);
+	work = malloc(GDEV_ZSWAP_WORK_SIZE + GDEV_SWAP_PAGE_SIZE);
+	z = gdev_zswap_alloc(ZSWAP_SIZE, GDEV_SWAP_PAGE_SIZE);
+	if (!data || !out || !work || !z)
+		return -1;
+
+	srand(1);
+	for (kind = 0; kind < ZSWAP_KINDS; kind++) {
+		fill_data(data, ZSWAP_SIZE, kind);
+		store_us = fetch_us = ~0UL;
+		for (r = 0; r < ZSWAP_ROUNDS; r++) {
+			gdev_time_stamp(&start);
+			if (gdev_zswap_store(z, 0, data, ZSWAP_SIZE))
+				return -1;
+			us = elapsed_us(&start);
+			if (us < store_us)
+				store_us = us;
+			memset(out, 0xff, ZSWAP_SIZE);
+			gdev_time_stamp(&start);
+			if (gdev_zswap_fetch(z, 0, out, ZSWAP_SIZE))
+				return -1;
+			us = elapsed_us(&start);
+			if (us < fetch_us)
+				fetch_us = us;
+			if (memcmp(data, out, ZSWAP_SIZE)) {
+				printf("zswap: %s data corrupted\n", kind_names[kind]);
+				return -1;
+			}
+		}
+		bytes = gdev_zswap_bytes(z);
+		printf("zswap: %-7s %5.1fx, %5lu MB/s to store, %5lu MB/s to fetch\n",
+			   kind_names[kind], (double)ZSWAP_SIZE / bytes,
+			   store_us ? ZSWAP_SIZE / store_us : 0, fetch_us ? ZSWAP_SIZE / fetch_us : 0);
+		if (ZSWAP_SIZE * 10 < bytes * ratio_min[kind]) {
+			printf("zswap: %s data is not compressed enough\n", kind_names[kind]);
+			ret = -1;
+		}
+	}
+
+	/* broken data must be detected, not overrun. */
+	fill_data(data, GDEV_SWAP_PAGE_SIZE, 3);
+	n = gdev_zswap_compress(data, GDEV_SWAP_PAGE_SIZE, out, GDEV_SWAP_PAGE_SIZE, work);
+	if (n <= 0 ||
+		gdev_zswap_decompress(out, n, data, GDEV_SWAP_PAGE_SIZE) != GDEV_SWAP_PAGE_SIZE ||
+		gdev_zswap_decompress(out, n, data, GDEV_SWAP_PAGE_SIZE / 2) >= 0 ||
+		gdev_zswap_decompress(out, n / 2, data, GDEV_SWAP_PAGE_SIZE) == GDEV_SWAP_PAGE_SIZE) {
+		printf("zswap: broken data is not detected\n");
+		ret = -1;
+	}
+
+	gdev_zswap_free(z);
+	free(work);
+	free(out);
+	free(data);
+
+	return ret;
+}
+
+int gdev_test_swap(void)
+{
+	if (run_swap(0) || run_swap(1))
+		return -1;
+
+	if (zswap_bench())
+		return -1;
+
+	return index_test();
+}
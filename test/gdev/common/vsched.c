@@ -0,0 +1,1987 @@
+/*
+ * synthetic contexts on the virtual device scheduler.
+ * gdev_sched.c is linked directly with this file, which stands in for the
+ * OS and user-space private functions, so that every policy can be tested
+ * without GPUs.
+ */
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include "gdev_device.h"
+#include "gdev_sched.h"
+#include "gdev_slice.h"
+#include "gdev_system.h"
+
+#define VDEV_COUNT 2
+#define VDEV_MAX (VDEV_COUNT + 1) /* an extra one for interactive contexts. */
+#define CTX_PER_VDEV 2
+#define CTX_COUNT (VDEV_COUNT * CTX_PER_VDEV)
+#define EXEC_US 1000 /* execution time of one synthetic launch. */
+#define PERIOD_US 10000
+#define RUN_US 500000
+
+static struct gdev_device devs[1 + VDEV_MAX]; /* devs[0] is physical. */
+
+/* tasks sleep and lock in the same way as the user-space scheduler. */
+struct task {
+	int wakeups;
+	int prio;
+	int sleeps;
+};
+
+static __thread struct task *current = NULL;
+
+/* the number of contexts running on each device, devs[0] for all. */
+static int running[1 + VDEV_MAX];
+static int running_mem[1 + VDEV_MAX]; /* on the copy engine under MRQ. */
+static int violations = 0;
+static int exclusive = 0; /* the physical device is given to one virtual device at a time. */
+static pthread_mutex_t running_lock = PTHREAD_MUTEX_INITIALIZER;
+static volatile int stop = 0;
+
+int gdev_sched_create_scheduler(struct gdev_device *gdev)
+{
+	return 0;
+}
+
+void gdev_sched_destroy_scheduler(struct gdev_device *gdev)
+{
+}
+
+void *gdev_sched_get_current_task(void)
+{
+	return current;
+}
+
+int gdev_sched_get_static_prio(void *task)
+{
+	return ((struct task *)task)->prio;
+}
+
+void gdev_sched_sleep(void)
+{
+	current->sleeps++;
+	gdev_futex_sleep(&current->wakeups);
+}
+
+int gdev_sched_wakeup(void *task)
+{
+	gdev_futex_wakeup(&((struct task *)task)->wakeups);
+	return 0;
+}
+
+void gdev_lock_init(gdev_lock_t *p)
+{
+	gdev_futex_lock_init(&p->futex);
+}
+
+void gdev_lock(gdev_lock_t *p)
+{
+	gdev_futex_lock(&p->futex);
+}
+
+void gdev_unlock(gdev_lock_t *p)
+{
+	gdev_futex_unlock(&p->futex);
+}
+
+void gdev_lock_nested(gdev_lock_t *p)
+{
+	gdev_futex_lock_nested(&p->futex);
+}
+
+void gdev_unlock_nested(gdev_lock_t *p)
+{
+	gdev_futex_unlock_nested(&p->futex);
+}
+
+void gdev_event_init(gdev_event_t *p)
+{
+	gdev_futex_event_init(&p->futex);
+}
+
+unsigned int gdev_event_seq(gdev_event_t *p)
+{
+	return *(volatile int *)&p->futex.seq;
+}
+
+void gdev_event_wait(gdev_event_t *p, unsigned int seq, unsigned long timeout_us)
+{
+	gdev_futex_event_wait(&p->futex, seq, timeout_us);
+}
+
+void gdev_event_signal(gdev_event_t *p)
+{
+	gdev_futex_event_signal(&p->futex);
+}
+
+void *gdev_current_com_get(struct gdev_device *gdev)
+{
+	return gdev->current_com;
+}
+
+void gdev_current_com_set(struct gdev_device *gdev, void *com)
+{
+	gdev->current_com = com;
+}
+
+struct gdev_device *gdev_phys_get(struct gdev_device *gdev)
+{
+	return !gdev ? NULL : gdev->parent;
+}
+
+struct gdev_sched_entity *gdev_sched_entity_alloc(int size)
+{
+	return calloc(1, size);
+}
+
+int gdev_ctx_get_cid(gdev_ctx_t *ctx)
+{
+	return ctx->cid;
+}
+
+void gdev_access_start(struct gdev_device *gdev)
+{
+	struct gdev_device *phys = gdev_phys_get(gdev);
+
+retry:
+	gdev_lock(&phys->global_lock);
+	if (phys->blocked) {
+		gdev_unlock(&phys->global_lock);
+		sched_yield();
+		goto retry;
+	}
+	phys->accessed++;
+	gdev_unlock(&phys->global_lock);
+}
+
+void gdev_access_end(struct gdev_device *gdev)
+{
+	struct gdev_device *phys = gdev_phys_get(gdev);
+
+	gdev_lock(&phys->global_lock);
+	phys->accessed--;
+	gdev_unlock(&phys->global_lock);
+}
+
+static void init_devices(int policy)
+{
+	struct gdev_device *gdev;
+	int i;
+
+	memset(devs, 0, sizeof(devs));
+	for (i = 0; i < 1 + VDEV_MAX; i++) {
+		gdev = &devs[i];
+		gdev->id = i;
+		gdev->com_bw = i ? 100 / VDEV_COUNT : 100;
+		gdev->mem_bw = gdev->com_bw;
+		gdev->period = PERIOD_US;
+		gdev->vsched_policy = policy;
+		gdev->sched_queueing = GDEV_SCHED_QUEUEING_DEFAULT;
+		gdev->parent = i ? &devs[0] : NULL;
+		gdev_list_init(&gdev->sched_com_list, NULL);
+		gdev_list_init(&gdev->sched_mem_list, NULL);
+		gdev_queue_init(&gdev->sched_com_queue);
+		gdev_queue_init(&gdev->sched_mem_queue);
+		gdev_lock_init(&gdev->sched_com_lock);
+		gdev_lock_init(&gdev->sched_mem_lock);
+		gdev_lock_init(&gdev->global_lock);
+		gdev_event_init(&gdev->sched_com_event);
+		gdev_event_init(&gdev->sched_mem_event);
+		gdev_event_init(&gdev->throttle_mem_event);
+		gdev_trace_init(&gdev->trace);
+	}
+	for (i = 1; i < 1 + VDEV_MAX; i++)
+		gdev_init_scheduler(&devs[i]);
+}
+
+/* replenish credits and update utilization as the monitor does. */
+static void *replenish_thread(void *arg)
+{
+	struct gdev_time now, last, elapse;
+	int i;
+
+	gdev_time_stamp(&last);
+	while (!stop) {
+		usleep(PERIOD_US);
+		gdev_time_stamp(&now);
+		gdev_time_sub(&elapse, &now, &last);
+		for (i = 1; i < 1 + VDEV_MAX; i++) {
+			struct gdev_device *gdev = &devs[i];
+			gdev_lock(&gdev->sched_com_lock);
+			gdev_replenish_credit_compute(gdev);
+			gdev->com_bw_used = gdev->com_time * 100 / gdev_time_to_us(&elapse);
+			if (gdev->com_bw_used > 100)
+				gdev->com_bw_used = 100;
+			gdev_unlock(&gdev->sched_com_lock);
+			gdev_lock(&gdev->sched_mem_lock);
+			gdev_replenish_credit_memory(gdev);
+			gdev->mem_bw_used = gdev->mem_time * 100 / gdev_time_to_us(&elapse);
+			if (gdev->mem_bw_used > 100)
+				gdev->mem_bw_used = 100;
+			gdev_unlock(&gdev->sched_mem_lock);
+		}
+		if (gdev_time_to_us(&elapse) >= GDEV_UPDATE_INTERVAL) {
+			for (i = 1; i < 1 + VDEV_MAX; i++)
+				devs[i].com_time = devs[i].mem_time = 0;
+			gdev_time_stamp(&last);
+		}
+	}
+
+	return NULL;
+}
+
+struct context {
+	pthread_t thread;
+	struct task task;
+	gdev_ctx_t ctx;
+	struct gdev_device *gdev;
+	struct gdev_sched_entity *se;
+	int launches;
+	int yields; /* slices that let others in. */
+	unsigned long exec;
+	uint32_t period; /* periodic workloads only. */
+	uint32_t wcet;
+	uint32_t budget;
+};
+
+static void __enter(int *running, struct gdev_device *gdev)
+{
+	pthread_mutex_lock(&running_lock);
+	/* the local scheduler serializes contexts. */
+	if ((exclusive && running[0] > 0) || running[gdev->id] > 0)
+		violations++;
+	running[0]++;
+	running[gdev->id]++;
+	pthread_mutex_unlock(&running_lock);
+}
+
+static void __leave(int *running, struct gdev_device *gdev)
+{
+	pthread_mutex_lock(&running_lock);
+	running[0]--;
+	running[gdev->id]--;
+	pthread_mutex_unlock(&running_lock);
+}
+
+static void enter(struct gdev_device *gdev)
+{
+	__enter(running, gdev);
+}
+
+static void leave(struct gdev_device *gdev)
+{
+	__leave(running, gdev);
+}
+
+/* copies share the compute engine under SDQ. */
+static int *copy_engine(struct gdev_device *gdev)
+{
+	return gdev_sched_queueing_get(gdev) == GDEV_SCHED_SDQ ? running : running_mem;
+}
+
+static void *context_thread(void *arg)
+{
+	struct context *c = arg;
+	struct gdev_time start, end, exec;
+
+	current = &c->task;
+	c->se = gdev_sched_entity_create(c->gdev, &c->ctx);
+
+	while (!stop) {
+		gdev_schedule_compute(c->se);
+		enter(c->gdev);
+		gdev_time_stamp(&start);
+		usleep(EXEC_US);
+		gdev_time_stamp(&end);
+		leave(c->gdev);
+		gdev_select_next_compute(c->gdev);
+
+		gdev_time_sub(&exec, &end, &start);
+		c->exec += gdev_time_to_us(&exec);
+		c->launches++;
+	}
+
+	return NULL;
+}
+
+static int run_policy(int policy)
+{
+	struct context c[CTX_COUNT];
+	pthread_t replenish;
+	unsigned long total = 0, vexec[1 + VDEV_COUNT] = {0};
+	int i;
+
+	init_devices(policy);
+	memset(c, 0, sizeof(c));
+	memset(running, 0, sizeof(running));
+	violations = 0;
+	exclusive = (policy != GDEV_VSCHED_NULL);
+	stop = 0;
+
+	for (i = 0; i < CTX_COUNT; i++) {
+		c[i].gdev = &devs[1 + i % VDEV_COUNT];
+		c[i].gdev->users++;
+		devs[0].users++;
+		c[i].ctx.cid = i;
+		c[i].task.wakeups = 0;
+	}
+	pthread_create(&replenish, NULL, replenish_thread, NULL);
+	for (i = 0; i < CTX_COUNT; i++)
+		pthread_create(&c[i].thread, NULL, context_thread, &c[i]);
+
+	usleep(RUN_US);
+	stop = 1;
+
+	/* waiting contexts are woken up by completions of others. */
+	for (i = 0; i < CTX_COUNT; i++)
+		pthread_join(c[i].thread, NULL);
+	pthread_join(replenish, NULL);
+
+	for (i = 0; i < CTX_COUNT; i++) {
+		vexec[c[i].gdev->id] += c[i].exec;
+		total += c[i].exec;
+	}
+	printf("%s:", gdev_vsched_policies[policy]->name);
+	for (i = 1; i < 1 + VDEV_COUNT; i++)
+		printf(" vd%d %lu%%", i - 1, total ? vexec[i] * 100 / total : 0);
+	printf(" (%d violations)\n", violations);
+
+	for (i = 0; i < CTX_COUNT; i++) {
+		if (!c[i].launches) {
+			printf("%s: context %d made no progress\n",
+				   gdev_vsched_policies[policy]->name, i);
+			return -1;
+		}
+		gdev_sched_entity_destroy(c[i].se);
+		free(c[i].se);
+	}
+	for (i = 1; i < 1 + VDEV_MAX; i++)
+		gdev_exit_scheduler(&devs[i]);
+
+	return violations ? -1 : 0;
+}
+
+/* policies are switched only while idle. */
+static int switch_policy(void)
+{
+	struct context c;
+	int ret;
+
+	init_devices(GDEV_VSCHED_BAND);
+	memset(&c, 0, sizeof(c));
+	c.task.wakeups = 0;
+	current = &c.task;
+	c.gdev = &devs[1];
+	c.se = gdev_sched_entity_create(c.gdev, &c.ctx);
+
+	if (gdev_vsched_set(&devs[1], GDEV_VSCHED_POLICY_COUNT) != -EINVAL ||
+		gdev_vsched_lookup("none") != -EINVAL) {
+		printf("invalid policy accepted\n");
+		goto fail;
+	}
+
+	/* busy. */
+	gdev_schedule_compute(c.se);
+	ret = gdev_vsched_set(&devs[2], GDEV_VSCHED_FIFO);
+	gdev_select_next_compute(c.gdev);
+	if (ret != -EBUSY || gdev_vsched_get(&devs[2]) != gdev_vsched_policies[GDEV_VSCHED_BAND]) {
+		printf("policy switched while busy\n");
+		goto fail;
+	}
+
+	/* idle. the policy is shared by all virtual devices. */
+	ret = gdev_vsched_set(&devs[2], gdev_vsched_lookup("fifo"));
+	if (ret || devs[0].vsched_policy != GDEV_VSCHED_FIFO ||
+		gdev_vsched_get(&devs[1]) != gdev_vsched_policies[GDEV_VSCHED_FIFO]) {
+		printf("policy not switched while idle\n");
+		goto fail;
+	}
+
+	/* the new policy takes effect. */
+	gdev_schedule_compute(c.se);
+	if (gdev_current_com_get(&devs[0]) != &devs[1]) {
+		printf("switched policy not effective\n");
+		gdev_select_next_compute(c.gdev);
+		goto fail;
+	}
+	gdev_select_next_compute(c.gdev);
+
+	/* so is the queueing method. a copy scheduled by MRQ must complete
+	   by MRQ. */
+	gdev_schedule_memory(c.se);
+	ret = gdev_sched_queueing_set(&devs[2], gdev_sched_queueing_lookup("sdq"));
+	gdev_select_next_memory(c.gdev);
+	if (ret != -EBUSY || gdev_sched_queueing_get(&devs[1]) != GDEV_SCHED_MRQ) {
+		printf("queueing switched while busy\n");
+		goto fail;
+	}
+	ret = gdev_sched_queueing_set(&devs[2], gdev_sched_queueing_lookup("sdq"));
+	if (ret || gdev_sched_queueing_get(&devs[1]) != GDEV_SCHED_SDQ) {
+		printf("queueing not switched while idle\n");
+		goto fail;
+	}
+	gdev_schedule_memory(c.se);
+	if (gdev_current_com_get(&devs[0]) != &devs[1] || devs[0].current_mem) {
+		printf("copies not scheduled as compute under SDQ\n");
+		gdev_select_next_memory(c.gdev);
+		goto fail;
+	}
+	gdev_select_next_memory(c.gdev);
+
+	gdev_sched_entity_destroy(c.se);
+	free(c.se);
+	return 0;
+
+fail:
+	gdev_sched_entity_destroy(c.se);
+	free(c.se);
+	return -1;
+}
+
+/**
+ * synthetic periodic workloads: a launch of wcet us is released every
+ * period us with the relative deadline of the period. the first context
+ * has a short deadline, which cannot be met behind the long launches
+ * released along with it. the last context overruns its budget, and must
+ * not make the others miss deadlines. the others have no budgets, so that
+ * the noise of the host cannot postpone their deadlines.
+ */
+static struct {
+	int vdev;
+	uint32_t period;
+	uint32_t wcet;
+	uint32_t budget;
+} workload[] = {
+	{1, 10000, 1000, 0},
+	{2, 40000, 6000, 0},
+	{1, 40000, 6000, 0},
+	{2, 40000, 6000, 0},
+	{1, 20000, 4000, 1000}, /* overrun. */
+};
+
+#define WORKLOAD_COUNT (sizeof(workload) / sizeof(workload[0]))
+#define WORKLOAD_US 1000000
+
+static void *periodic_thread(void *arg)
+{
+	struct context *c = arg;
+	struct gdev_time release, period, now, wait;
+
+	current = &c->task;
+	gdev_time_us(&period, c->period);
+	gdev_time_stamp(&release);
+
+	while (!stop) {
+		gdev_schedule_compute(c->se);
+		enter(c->gdev);
+		usleep(c->wcet);
+		leave(c->gdev);
+		gdev_select_next_compute(c->gdev);
+		c->launches++;
+
+		/* sleep until the next release, if not released yet. */
+		gdev_time_add(&release, &release, &period);
+		gdev_time_stamp(&now);
+		if (gdev_time_lt(&now, &release)) {
+			gdev_time_sub(&wait, &release, &now);
+			usleep(gdev_time_to_us(&wait));
+		}
+	}
+
+	return NULL;
+}
+
+/* @misses returns the deadline misses of the contexts without budgets. */
+static int run_periodic(int policy, uint32_t *misses)
+{
+	struct context c[WORKLOAD_COUNT];
+	pthread_t replenish;
+	int i;
+
+	init_devices(policy);
+	memset(c, 0, sizeof(c));
+	memset(running, 0, sizeof(running));
+	violations = 0;
+	/* band hands the physical device over for a yield chance even while
+	   contexts of the yielding device are still running. */
+	exclusive = (policy != GDEV_VSCHED_NULL && policy != GDEV_VSCHED_BAND);
+	stop = 0;
+
+	for (i = 0; i < WORKLOAD_COUNT; i++) {
+		c[i].gdev = &devs[workload[i].vdev];
+		c[i].gdev->users++;
+		devs[0].users++;
+		c[i].ctx.cid = i;
+		c[i].period = workload[i].period;
+		c[i].wcet = workload[i].wcet;
+		c[i].budget = workload[i].budget;
+		c[i].task.wakeups = 0;
+		current = &c[i].task;
+		c[i].se = gdev_sched_entity_create(c[i].gdev, &c[i].ctx);
+		if (gdev_sched_entity_set_deadline(c[i].se, c[i].period, c[i].budget)) {
+			printf("context %d not admitted\n", i);
+			return -1;
+		}
+	}
+	pthread_create(&replenish, NULL, replenish_thread, NULL);
+	for (i = 0; i < WORKLOAD_COUNT; i++)
+		pthread_create(&c[i].thread, NULL, periodic_thread, &c[i]);
+
+	usleep(WORKLOAD_US);
+	stop = 1;
+
+	for (i = 0; i < WORKLOAD_COUNT; i++)
+		pthread_join(c[i].thread, NULL);
+	pthread_join(replenish, NULL);
+
+	printf("%s: deadline misses", gdev_vsched_policies[policy]->name);
+	*misses = 0;
+	for (i = 0; i < WORKLOAD_COUNT; i++) {
+		struct gdev_sched_entity *se = c[i].se;
+		printf(" %u/%u", se->deadline_misses, se->deadline_jobs);
+		if (!c[i].budget)
+			*misses += se->deadline_misses;
+	}
+	printf("\n");
+
+	for (i = 0; i < WORKLOAD_COUNT; i++) {
+		gdev_sched_entity_destroy(c[i].se);
+		free(c[i].se);
+	}
+	for (i = 1; i < 1 + VDEV_MAX; i++)
+		gdev_exit_scheduler(&devs[i]);
+
+	return violations ? -1 : 0;
+}
+
+/* reservations are admitted up to the utilization bound. */
+static int admit_deadline(void)
+{
+	struct context c[3];
+	int i, ret = -1;
+
+	init_devices(GDEV_VSCHED_EDF);
+	memset(c, 0, sizeof(c));
+	for (i = 0; i < 3; i++) {
+		c[i].gdev = &devs[1 + i % VDEV_COUNT];
+		c[i].ctx.cid = i;
+		current = &c[i].task;
+		c[i].se = gdev_sched_entity_create(c[i].gdev, &c[i].ctx);
+	}
+
+	if (gdev_sched_entity_set_deadline(c[0].se, 1000, 2000) != -EINVAL) {
+		printf("budget exceeding deadline accepted\n");
+		goto end;
+	}
+	if (gdev_sched_entity_set_deadline(c[0].se, 10000, 6000) ||
+		gdev_sched_entity_set_deadline(c[1].se, 10000, 4000)) {
+		printf("reservations within the bound rejected\n");
+		goto end;
+	}
+	if (gdev_sched_entity_set_deadline(c[2].se, 10000, 1) != -EBUSY) {
+		printf("reservation over the bound accepted\n");
+		goto end;
+	}
+	/* deadlines without budgets reserve nothing. */
+	if (gdev_sched_entity_set_deadline(c[2].se, 10000, 0)) {
+		printf("deadline without budget rejected\n");
+		goto end;
+	}
+	/* shrinking and releasing reservations. */
+	if (gdev_sched_entity_set_deadline(c[0].se, 10000, 5000) ||
+		gdev_sched_entity_set_deadline(c[2].se, 10000, 1000) ||
+		gdev_sched_entity_set_deadline(c[1].se, 0, 0) ||
+		devs[0].deadline_util != 600) {
+		printf("reservations not updated\n");
+		goto end;
+	}
+	ret = 0;
+
+end:
+	for (i = 0; i < 3; i++) {
+		gdev_sched_entity_destroy(c[i].se);
+		free(c[i].se);
+	}
+	if (!ret && devs[0].deadline_util != 0) {
+		printf("reservations not released\n");
+		ret = -1;
+	}
+
+	return ret;
+}
+
+/* weighted shares. two virtual devices are backlogged, and a short
+   interactive context on the third records its scheduling latency. */
+static const uint32_t weights[1 + VDEV_MAX] = {100, 60, 30, 10};
+
+#define WEIGHTED_CTX_COUNT (CTX_COUNT + 1)
+#define WEIGHTED_US 1000000
+#define SHORT_US 100
+#define THINK_US 2000
+#define LATENCY_SAMPLES 4096
+#define SHARE_ERROR_BOUND 10 /* percent */
+
+static unsigned long latency[LATENCY_SAMPLES];
+
+static void *interactive_thread(void *arg)
+{
+	struct context *c = arg;
+	struct gdev_time start, end, wait;
+
+	current = &c->task;
+	c->se = gdev_sched_entity_create(c->gdev, &c->ctx);
+
+	while (!stop) {
+		gdev_time_stamp(&start);
+		gdev_schedule_compute(c->se);
+		gdev_time_stamp(&end);
+		enter(c->gdev);
+		usleep(SHORT_US);
+		leave(c->gdev);
+		gdev_select_next_compute(c->gdev);
+		c->exec += SHORT_US;
+
+		gdev_time_sub(&wait, &end, &start);
+		if (c->launches < LATENCY_SAMPLES)
+			latency[c->launches++] = gdev_time_to_us(&wait);
+		usleep(THINK_US);
+	}
+
+	return NULL;
+}
+
+/* CPU time (us) spent by all the threads. */
+static unsigned long cpu_time(void)
+{
+	struct rusage ru;
+
+	getrusage(RUSAGE_SELF, &ru);
+	return (ru.ru_utime.tv_sec + ru.ru_stime.tv_sec) * 1000000UL +
+		ru.ru_utime.tv_usec + ru.ru_stime.tv_usec;
+}
+
+static int compare_ulong(const void *x, const void *y)
+{
+	unsigned long a = *(const unsigned long *)x, b = *(const unsigned long *)y;
+
+	return (a > b) - (a < b);
+}
+
+static int run_weighted(int policy)
+{
+	struct context c[WEIGHTED_CTX_COUNT];
+	pthread_t replenish;
+	unsigned long total = 0, backlogged, vexec[1 + VDEV_MAX] = {0};
+	unsigned long cpu;
+	struct context *interactive = &c[CTX_COUNT];
+	int i, n, ret = 0;
+
+	init_devices(policy);
+	for (i = 1; i < 1 + VDEV_MAX; i++)
+		devs[i].com_bw = devs[i].mem_bw = weights[i];
+	memset(c, 0, sizeof(c));
+	memset(running, 0, sizeof(running));
+	violations = 0;
+	exclusive = (policy != GDEV_VSCHED_NULL && policy != GDEV_VSCHED_BAND);
+	stop = 0;
+
+	for (i = 0; i < WEIGHTED_CTX_COUNT; i++) {
+		c[i].gdev = &devs[i < CTX_COUNT ? 1 + i % VDEV_COUNT : VDEV_MAX];
+		c[i].gdev->users++;
+		devs[0].users++;
+		c[i].ctx.cid = i;
+		c[i].task.wakeups = 0;
+	}
+	cpu = cpu_time();
+	pthread_create(&replenish, NULL, replenish_thread, NULL);
+	for (i = 0; i < CTX_COUNT; i++)
+		pthread_create(&c[i].thread, NULL, context_thread, &c[i]);
+	pthread_create(&interactive->thread, NULL, interactive_thread, interactive);
+
+	usleep(WEIGHTED_US);
+	stop = 1;
+
+	for (i = 0; i < WEIGHTED_CTX_COUNT; i++)
+		pthread_join(c[i].thread, NULL);
+	pthread_join(replenish, NULL);
+	/* contexts sleep while running, so this is the scheduler overhead. */
+	cpu = cpu_time() - cpu;
+
+	for (i = 0; i < WEIGHTED_CTX_COUNT; i++) {
+		vexec[c[i].gdev->id] += c[i].exec;
+		total += c[i].exec;
+	}
+	backlogged = total - vexec[VDEV_MAX];
+	n = interactive->launches;
+	qsort(latency, n, sizeof(latency[0]), compare_ulong);
+
+	printf("%s: weighted", gdev_vsched_policies[policy]->name);
+	for (i = 1; i < 1 + VDEV_MAX; i++)
+		printf(" vd%d %lu%% (%u%%)", i - 1,
+			   total ? vexec[i] * 100 / total : 0, weights[i]);
+	printf(", short launch latency p50 %luus p99 %luus max %luus, cpu %lu%%\n",
+		   n ? latency[n / 2] : 0, n ? latency[n * 99 / 100] : 0,
+		   n ? latency[n - 1] : 0, cpu * 100 / WEIGHTED_US);
+
+	/* the fair queueing policy must split the device between the
+	   backlogged virtual devices in proportion to their weights. */
+	for (i = 1; i < 1 + VDEV_COUNT && policy == GDEV_VSCHED_SFQ; i++) {
+		unsigned long share = backlogged ? vexec[i] * 100 / backlogged : 0;
+		unsigned long fair = weights[i] * 100 / (weights[1] + weights[2]);
+		if (share + SHARE_ERROR_BOUND < fair || share > fair + SHARE_ERROR_BOUND) {
+			printf("vd%d is given %lu%% rather than %lu%%\n", i - 1, share, fair);
+			ret = -1;
+		}
+	}
+
+	for (i = 0; i < WEIGHTED_CTX_COUNT; i++) {
+		gdev_sched_entity_destroy(c[i].se);
+		free(c[i].se);
+	}
+	for (i = 1; i < 1 + VDEV_MAX; i++)
+		gdev_exit_scheduler(&devs[i]);
+
+	return violations ? -1 : ret;
+}
+
+/**
+ * launches and copies from different tenants. each virtual device runs a
+ * context of each, and the engines are modeled by sleeping. they overlap
+ * only when copies are queued separately.
+ */
+#define OVERLAP_US 500000
+#define OVERLAP_GAIN 130 /* percent of the SDQ throughput at least. */
+
+static void *copy_thread(void *arg)
+{
+	struct context *c = arg;
+	struct gdev_time start, end, exec;
+	int *engine;
+
+	current = &c->task;
+	c->se = gdev_sched_entity_create(c->gdev, &c->ctx);
+
+	while (!stop) {
+		gdev_schedule_memory(c->se);
+		engine = copy_engine(c->gdev);
+		__enter(engine, c->gdev);
+		gdev_time_stamp(&start);
+		usleep(EXEC_US);
+		gdev_time_stamp(&end);
+		__leave(engine, c->gdev);
+		gdev_select_next_memory(c->gdev);
+
+		gdev_time_sub(&exec, &end, &start);
+		c->exec += gdev_time_to_us(&exec);
+		c->launches++;
+	}
+
+	return NULL;
+}
+
+/* return the engine time (us) done per second, or -1 on violations. */
+static long run_overlap(int policy, int queueing)
+{
+	struct context c[CTX_COUNT];
+	pthread_t replenish;
+	unsigned long total = 0;
+	int i;
+
+	init_devices(policy);
+	gdev_sched_queueing_set(&devs[1], queueing);
+	memset(c, 0, sizeof(c));
+	memset(running, 0, sizeof(running));
+	memset(running_mem, 0, sizeof(running_mem));
+	violations = 0;
+	exclusive = (policy != GDEV_VSCHED_NULL);
+	stop = 0;
+
+	for (i = 0; i < CTX_COUNT; i++) {
+		c[i].gdev = &devs[1 + i % VDEV_COUNT];
+		c[i].gdev->users++;
+		devs[0].users++;
+		c[i].ctx.cid = i;
+		c[i].task.wakeups = 0;
+	}
+	pthread_create(&replenish, NULL, replenish_thread, NULL);
+	for (i = 0; i < CTX_COUNT; i++)
+		pthread_create(&c[i].thread, NULL,
+					   i < VDEV_COUNT ? context_thread : copy_thread, &c[i]);
+
+	usleep(OVERLAP_US);
+	stop = 1;
+
+	for (i = 0; i < CTX_COUNT; i++)
+		pthread_join(c[i].thread, NULL);
+	pthread_join(replenish, NULL);
+
+	for (i = 0; i < CTX_COUNT; i++) {
+		if (!c[i].launches) {
+			printf("%s/%s: context %d made no progress\n",
+				   gdev_vsched_policies[policy]->name,
+				   gdev_sched_queueing_names[queueing], i);
+			violations++;
+		}
+		total += c[i].exec;
+		gdev_sched_entity_destroy(c[i].se);
+		free(c[i].se);
+	}
+	for (i = 1; i < 1 + VDEV_MAX; i++)
+		gdev_exit_scheduler(&devs[i]);
+
+	if (violations) {
+		printf("%s/%s: %d violations\n", gdev_vsched_policies[policy]->name,
+			   gdev_sched_queueing_names[queueing], violations);
+		return -1;
+	}
+
+	return total * 1000000UL / OVERLAP_US;
+}
+
+static int compare_queueing(int policy)
+{
+	long sdq, mrq;
+
+	sdq = run_overlap(policy, GDEV_SCHED_SDQ);
+	mrq = run_overlap(policy, GDEV_SCHED_MRQ);
+	if (sdq <= 0 || mrq <= 0)
+		return -1;
+
+	printf("%s: engine time per second sdq %ldus mrq %ldus (%ld%%)\n",
+		   gdev_vsched_policies[policy]->name, sdq, mrq, mrq * 100 / sdq);
+	if (mrq * 100 < sdq * OVERLAP_GAIN) {
+		printf("%s: copies do not overlap launches\n",
+			   gdev_vsched_policies[policy]->name);
+		return -1;
+	}
+
+	return 0;
+}
+
+/**
+ * memcpy throttling. several handles on each virtual device copy chunks
+ * which take no time, so the shares are decided by the throttling alone.
+ * sleeping for the chunks would make the copies slower than the rate
+ * whenever the host oversleeps.
+ */
+#define THROTTLE_RATE (256UL << 20) /* bytes/s */
+#define THROTTLE_CHUNK (256UL << 10)
+#define THROTTLE_HANDLES 3 /* per virtual device */
+#define THROTTLE_US 1000000
+#define RATE_ERROR_BOUND 10 /* percent of the rate */
+
+struct handle {
+	struct gdev_device *gdev;
+	pthread_t thread;
+	unsigned long bytes;
+};
+
+static void *memcpy_thread(void *arg)
+{
+	struct handle *h = arg;
+
+	while (!stop) {
+		gdev_throttle_memory(h->gdev, THROTTLE_CHUNK);
+		h->bytes += THROTTLE_CHUNK;
+	}
+
+	return NULL;
+}
+
+/* @share[i] is mem_bw of virtual device i + 1, or -1 if it is idle.
+   @expect[i] is the percent of the rate that it should get.
+   the host may run the handles late, which takes bytes from everyone,
+   so the shares are checked against the bytes copied in total, and only
+   a quarter of the capacity left by the shares must be lent. */
+static int run_throttle(const int *share, const int *expect)
+{
+	struct handle h[VDEV_COUNT * THROTTLE_HANDLES];
+	struct gdev_time start, end, elapse;
+	unsigned long bytes[VDEV_COUNT] = {0};
+	unsigned long total = 0, us;
+	int n = 0, ret = 0, shared = 0;
+	int i, j, pct;
+
+	init_devices(GDEV_VSCHED_BAND);
+	gdev_throttle_rate_set(&devs[1], THROTTLE_RATE);
+	stop = 0;
+
+	gdev_time_stamp(&start);
+	for (i = 0; i < VDEV_COUNT; i++) {
+		if (share[i] < 0)
+			continue;
+		devs[1 + i].mem_bw = share[i];
+		shared += share[i];
+		for (j = 0; j < THROTTLE_HANDLES; j++, n++) {
+			h[n].gdev = &devs[1 + i];
+			h[n].bytes = 0;
+			pthread_create(&h[n].thread, NULL, memcpy_thread, &h[n]);
+		}
+	}
+
+	usleep(THROTTLE_US);
+	stop = 1;
+	gdev_time_stamp(&end);
+
+	for (i = 0; i < n; i++) {
+		pthread_join(h[i].thread, NULL);
+		bytes[h[i].gdev->id - 1] += h[i].bytes;
+	}
+	for (i = 1; i < 1 + VDEV_MAX; i++)
+		gdev_exit_scheduler(&devs[i]);
+
+	gdev_time_sub(&elapse, &end, &start);
+	us = gdev_time_to_us(&elapse);
+	for (i = 0; i < VDEV_COUNT; i++)
+		total += bytes[i];
+	printf("throttle:");
+	for (i = 0; i < VDEV_COUNT; i++) {
+		pct = bytes[i] * 100 * 1000000UL / us / THROTTLE_RATE;
+		printf(" vd%d %d%% (%d%%)", i + 1, pct, expect[i]);
+		if (expect[i] > RATE_ERROR_BOUND &&
+			bytes[i] * 100 < total * (expect[i] - RATE_ERROR_BOUND)) {
+			printf("\nvd%d is not given its share\n", i + 1);
+			ret = -1;
+		}
+	}
+	pct = total * 100 * 1000000UL / us / THROTTLE_RATE;
+	printf(", total %d%%\n", pct);
+	if (pct > 100 + RATE_ERROR_BOUND) {
+		printf("copies are not throttled\n");
+		ret = -1;
+	}
+	if (shared < 100 && pct < shared + (100 - shared) / 4) {
+		printf("idle capacity is not lent\n");
+		ret = -1;
+	}
+
+	return ret;
+}
+
+/**
+ * tiny chunks at a low rate come back for the tokens well within a
+ * microsecond of each other. the time between them must still add up to
+ * the rate. the burst is spent first, so that it is not counted in.
+ */
+#define REFILL_RATE (4UL << 20) /* bytes/s */
+#define REFILL_CHUNK 16
+#define REFILL_US 300000
+#define REFILL_ERROR_BOUND 3 /* percent of the rate */
+
+static int throttle_refill(void)
+{
+	struct gdev_time start, now, elapse;
+	unsigned long bytes = 0, us;
+	int i, pct;
+
+	init_devices(GDEV_VSCHED_BAND);
+	gdev_throttle_rate_set(&devs[1], REFILL_RATE);
+	gdev_throttle_memory(&devs[1], REFILL_RATE * GDEV_THROTTLE_BURST / USEC_1SEC);
+
+	gdev_time_stamp(&start);
+	do {
+		gdev_throttle_memory(&devs[1], REFILL_CHUNK);
+		bytes += REFILL_CHUNK;
+		gdev_time_stamp(&now);
+		gdev_time_sub(&elapse, &now, &start);
+	} while (gdev_time_to_us(&elapse) < REFILL_US);
+	us = gdev_time_to_us(&elapse);
+
+	for (i = 1; i < 1 + VDEV_MAX; i++)
+		gdev_exit_scheduler(&devs[i]);
+
+	pct = bytes * 100 * 1000000UL / us / REFILL_RATE;
+	printf("throttle: %d-byte chunks at %d%% of the rate\n", REFILL_CHUNK, pct);
+	if (pct < 100 - REFILL_ERROR_BOUND) {
+		printf("refills in quick succession are lost\n");
+		return -1;
+	}
+
+	return 0;
+}
+
+static int throttle_memory(void)
+{
+	/* the first leaves 20% of the rate unused, which is lent to either.
+	   the last has vd1 idle, whose share goes to vd2 as well. */
+	static const int share[][VDEV_COUNT] = {{60, 20}, {80, 20}, {-1, 20}};
+	static const int expect[][VDEV_COUNT] = {{60, 20}, {80, 20}, {0, 100}};
+	int i;
+
+	for (i = 0; i < sizeof(share) / sizeof(share[0]); i++) {
+		if (run_throttle(share[i], expect[i]))
+			return -1;
+	}
+
+	return throttle_refill();
+}
+
+/**
+ * throttled copies on the copy engine. a context on vd1 copies chunks as
+ * gmemcpy() does, holding the engine from gdev_schedule_memory() on and
+ * throttled at a rate that keeps it waiting most of the time, while a
+ * context on vd2 copies unthrottled. vd2 must be given the engine while
+ * vd1 waits for the tokens.
+ */
+#define YIELD_RATE (THROTTLE_CHUNK * 50) /* bytes/s, 20ms per chunk. */
+#define YIELD_COPY_US 200 /* engine time of one chunk. */
+#define YIELD_US 500000
+#define YIELD_SHARE 75 /* percent of the time that vd2 copies at least. */
+
+static void yield_release(void *arg)
+{
+	struct context *c = arg;
+
+	gdev_select_next_memory(c->gdev);
+}
+
+static void yield_acquire(void *arg)
+{
+	struct context *c = arg;
+
+	gdev_schedule_memory(c->se);
+}
+
+static void *throttled_copy_thread(void *arg)
+{
+	struct context *c = arg;
+	struct gdev_time start, end, exec;
+
+	current = &c->task;
+	c->se = gdev_sched_entity_create(c->gdev, &c->ctx);
+
+	while (!stop) {
+		gdev_schedule_memory(c->se);
+		gdev_throttle_memory_wait(c->gdev, THROTTLE_CHUNK, yield_release, yield_acquire, c);
+		__enter(running_mem, c->gdev);
+		gdev_time_stamp(&start);
+		usleep(YIELD_COPY_US);
+		gdev_time_stamp(&end);
+		__leave(running_mem, c->gdev);
+		gdev_select_next_memory(c->gdev);
+
+		gdev_time_sub(&exec, &end, &start);
+		c->exec += gdev_time_to_us(&exec);
+		c->launches++;
+	}
+
+	return NULL;
+}
+
+static int throttle_engine(void)
+{
+	struct context c[VDEV_COUNT];
+	pthread_t replenish;
+	int i, ret = 0;
+	long pct;
+
+	init_devices(GDEV_VSCHED_BAND);
+	memset(c, 0, sizeof(c));
+	memset(running_mem, 0, sizeof(running_mem));
+	violations = 0;
+	exclusive = 1;
+	stop = 0;
+
+	for (i = 0; i < VDEV_COUNT; i++) {
+		gdev_sched_queueing_set(&devs[1 + i], GDEV_SCHED_MRQ);
+		c[i].gdev = &devs[1 + i];
+		c[i].gdev->users++;
+		devs[0].users++;
+		c[i].ctx.cid = i;
+	}
+	gdev_throttle_rate_set(&devs[1], YIELD_RATE);
+
+	pthread_create(&replenish, NULL, replenish_thread, NULL);
+	pthread_create(&c[0].thread, NULL, throttled_copy_thread, &c[0]);
+	pthread_create(&c[1].thread, NULL, copy_thread, &c[1]);
+
+	usleep(YIELD_US);
+	stop = 1;
+	/* vd1 may be waiting for the tokens. */
+	gdev_throttle_rate_set(&devs[1], 0);
+
+	for (i = 0; i < VDEV_COUNT; i++)
+		pthread_join(c[i].thread, NULL);
+	pthread_join(replenish, NULL);
+
+	pct = c[1].exec * 100 / YIELD_US;
+	printf("throttle: vd1 %d chunks, vd2 copies %ld%% of the time (%d violations)\n",
+		   c[0].launches, pct, violations);
+	if (!c[0].launches) {
+		printf("the throttled context made no progress\n");
+		ret = -1;
+	}
+	if (pct < YIELD_SHARE) {
+		printf("the copy engine is held while throttled\n");
+		ret = -1;
+	}
+	if (violations)
+		ret = -1;
+
+	for (i = 0; i < VDEV_COUNT; i++) {
+		gdev_sched_entity_destroy(c[i].se);
+		free(c[i].se);
+	}
+	for (i = 1; i < 1 + VDEV_MAX; i++)
+		gdev_exit_scheduler(&devs[i]);
+
+	return ret;
+}
+
+/**
+ * grid slicing. a long launch of SLICE_GRID CTAs, each of which takes
+ * CTA_US on the software backend, is made against short launches of a
+ * higher-priority context on the same virtual device. the slices are
+ * scheduled one by one as glaunch() does, so short launches get in.
+ */
+#define SLICE_GRID 64
+#define SLICE_SIZE 4
+#define SLICE_PARAM GDEV_SLICE_PARAM_MIN
+#define SLICE_PARAM_END (SLICE_PARAM + GDEV_SLICE_PARAM_COUNT)
+#define CTA_US 500
+#define SLICE_US 1000000
+
+static int sliced = 0;
+
+/* check that the slices of a grid cover every CTA exactly once. */
+static int check_slices(uint32_t x, uint32_t y, uint32_t z, uint32_t blocks)
+{
+	static unsigned char hits[SLICE_GRID * SLICE_GRID];
+	uint32_t param_buf[SLICE_PARAM_END], copy[SLICE_PARAM_END];
+	struct gdev_kernel k, slice;
+	struct gdev_slice s;
+	uint32_t i, bx, by;
+
+	memset(&k, 0, sizeof(k));
+	memset(hits, 0, sizeof(hits));
+	memset(param_buf, 0, sizeof(param_buf));
+	k.grid_x = x;
+	k.grid_y = y;
+	k.grid_z = z;
+	k.param_buf = param_buf;
+	k.param_size = sizeof(param_buf);
+	k.slice_param = SLICE_PARAM;
+	if (!gdev_slice_enabled(&k, blocks)) {
+		printf("%ux%ux%u grid is not sliced by %u\n", x, y, z, blocks);
+		return -1;
+	}
+
+	gdev_slice_init(&s);
+	while (gdev_slice_next(&k, &slice, blocks, &s)) {
+		gdev_slice_param(&k, &s, copy);
+		if (slice.grid_z != z ||
+			slice.grid_x * slice.grid_y * slice.grid_z > blocks) {
+			printf("%ux%ux%u grid: %ux%ux%u slice is too large\n",
+				   x, y, z, slice.grid_x, slice.grid_y, slice.grid_z);
+			return -1;
+		}
+		if (copy[SLICE_PARAM + 2] != x || copy[SLICE_PARAM + 3] != y) {
+			printf("%ux%ux%u grid: the kernel is given a %ux%u grid\n",
+				   x, y, z, copy[SLICE_PARAM + 2], copy[SLICE_PARAM + 3]);
+			return -1;
+		}
+		for (by = 0; by < slice.grid_y; by++) {
+			for (bx = 0; bx < slice.grid_x; bx++) {
+				/* what the kernel sees as its block index. */
+				uint32_t gx = bx + copy[SLICE_PARAM];
+				uint32_t gy = by + copy[SLICE_PARAM + 1];
+				if (gx >= x || gy >= y) {
+					printf("%ux%ux%u grid: block (%u, %u) is out of range\n",
+						   x, y, z, gx, gy);
+					return -1;
+				}
+				hits[gy * x + gx]++;
+			}
+		}
+	}
+
+	for (i = 0; i < x * y; i++) {
+		if (hits[i] != 1) {
+			printf("%ux%ux%u grid: block %u is launched %u times\n",
+				   x, y, z, i, hits[i]);
+			return -1;
+		}
+	}
+
+	/* the parameters of the caller are left untouched. */
+	for (i = 0; i < SLICE_PARAM_END; i++) {
+		if (param_buf[i]) {
+			printf("%ux%ux%u grid: parameter %u is overwritten\n", x, y, z, i);
+			return -1;
+		}
+	}
+
+	/* the grid fits in a slice, or the kernel does not take the offset. */
+	if (gdev_slice_enabled(&k, x * y * z)) {
+		printf("%ux%ux%u grid is sliced by itself\n", x, y, z);
+		return -1;
+	}
+	k.slice_param = 0;
+	if (gdev_slice_enabled(&k, blocks)) {
+		printf("%ux%ux%u grid is sliced without the offset\n", x, y, z);
+		return -1;
+	}
+
+	return 0;
+}
+
+/* check that a grid deeper than @blocks is not sliced, since a slice
+   cannot be thinner than the grid is deep. */
+static int check_unsliced(uint32_t x, uint32_t y, uint32_t z, uint32_t blocks)
+{
+	struct gdev_kernel k;
+
+	memset(&k, 0, sizeof(k));
+	k.grid_x = x;
+	k.grid_y = y;
+	k.grid_z = z;
+	k.param_size = SLICE_PARAM_END * 4;
+	k.slice_param = SLICE_PARAM;
+	if (gdev_slice_enabled(&k, blocks)) {
+		printf("%ux%ux%u grid is sliced by %u\n", x, y, z, blocks);
+		return -1;
+	}
+
+	return 0;
+}
+
+static void *long_thread(void *arg)
+{
+	struct context *c = arg;
+	uint32_t param_buf[SLICE_PARAM_END];
+	struct gdev_kernel k, slice;
+	struct gdev_slice s;
+	int sleeps;
+
+	current = &c->task;
+	c->se = gdev_sched_entity_create(c->gdev, &c->ctx);
+
+	memset(&k, 0, sizeof(k));
+	k.grid_x = SLICE_GRID;
+	k.grid_y = k.grid_z = 1;
+	k.param_buf = param_buf;
+	k.param_size = sizeof(param_buf);
+	k.slice_param = sliced ? SLICE_PARAM : 0;
+
+	while (!stop) {
+		if (!gdev_slice_enabled(&k, SLICE_SIZE)) {
+			gdev_schedule_compute(c->se);
+			enter(c->gdev);
+			usleep(CTA_US * SLICE_GRID);
+			leave(c->gdev);
+			gdev_select_next_compute(c->gdev);
+		}
+		else {
+			gdev_slice_init(&s);
+			while (gdev_slice_next(&k, &slice, SLICE_SIZE, &s)) {
+				/* count the slices that have waited for others. */
+				sleeps = c->task.sleeps;
+				gdev_schedule_compute(c->se);
+				if (s.x && c->task.sleeps != sleeps)
+					c->yields++;
+				enter(c->gdev);
+				usleep(CTA_US * slice.grid_x * slice.grid_y);
+				leave(c->gdev);
+				gdev_select_next_compute(c->gdev);
+			}
+		}
+		c->exec += CTA_US * SLICE_GRID;
+		c->launches++;
+	}
+
+	return NULL;
+}
+
+/* return the number of times that the long launch let short launches in
+   between its slices, or -1 on violations. the p99 latency (us) of short
+   launches is given by @p99. */
+static long run_sliced(int slicing, long *p99)
+{
+	struct context c[2];
+	struct context *interactive = &c[1];
+	pthread_t replenish;
+	long yields;
+	int i, n;
+
+	init_devices(GDEV_VSCHED_BAND);
+	memset(c, 0, sizeof(c));
+	memset(running, 0, sizeof(running));
+	violations = 0;
+	exclusive = 1;
+	sliced = slicing;
+	stop = 0;
+
+	for (i = 0; i < 2; i++) {
+		c[i].gdev = &devs[1];
+		c[i].gdev->users++;
+		devs[0].users++;
+		c[i].ctx.cid = i;
+		c[i].task.wakeups = 0;
+		c[i].task.prio = i ? GDEV_PRIO_MAX : GDEV_PRIO_DEFAULT;
+	}
+	pthread_create(&replenish, NULL, replenish_thread, NULL);
+	pthread_create(&c[0].thread, NULL, long_thread, &c[0]);
+	pthread_create(&interactive->thread, NULL, interactive_thread, interactive);
+
+	usleep(SLICE_US);
+	stop = 1;
+
+	for (i = 0; i < 2; i++)
+		pthread_join(c[i].thread, NULL);
+	pthread_join(replenish, NULL);
+
+	n = interactive->launches;
+	qsort(latency, n, sizeof(latency[0]), compare_ulong);
+	*p99 = n ? latency[n * 99 / 100] : 0;
+	yields = c[0].yields;
+	if (!c[0].launches || !n) {
+		printf("slice: a context made no progress\n");
+		violations++;
+	}
+
+	for (i = 0; i < 2; i++) {
+		gdev_sched_entity_destroy(c[i].se);
+		free(c[i].se);
+	}
+	for (i = 1; i < 1 + VDEV_MAX; i++)
+		gdev_exit_scheduler(&devs[i]);
+
+	return violations ? -1 : yields;
+}
+
+static int slice_grid(void)
+{
+	long whole, sliced, whole_p99, sliced_p99;
+
+	if (check_slices(SLICE_GRID, 1, 1, SLICE_SIZE) ||
+		check_slices(SLICE_GRID - 1, 1, 1, SLICE_SIZE) ||
+		check_slices(7, 5, 1, 16) ||
+		check_slices(7, 5, 1, 3) ||
+		check_slices(9, 3, 2, 4) ||
+		check_slices(5, 1, 2, 4) ||
+		check_unsliced(4, 1, 8, 4))
+		return -1;
+
+	whole = run_sliced(0, &whole_p99);
+	sliced = run_sliced(1, &sliced_p99);
+	if (whole < 0 || sliced < 0)
+		return -1;
+
+	/* the latency is reported, but not checked, as the host may oversleep. */
+	printf("slice: short launches in between slices %ld, "
+		   "p99 latency whole %ldus sliced %ldus\n",
+		   sliced, whole_p99, sliced_p99);
+	if (whole || !sliced) {
+		printf("slices do not let short launches in\n");
+		return -1;
+	}
+
+	return 0;
+}
+
+/**
+ * the trace ring: events of concurrent writers must all be read back in
+ * order, and recording must add little to the scheduling cost.
+ */
+#define TRACE_WRITERS 4
+#define TRACE_EVENTS 200 /* per writer, TRACE_WRITERS * TRACE_EVENTS fit the ring */
+#define TRACE_LOOPS 200000
+#define TRACE_ROUNDS 5
+#define TRACE_OVERHEAD 20 /* percent of a launch, i.e. dispatch and completion */
+
+static void *trace_thread(void *arg)
+{
+	long id = (long)arg;
+	int i;
+
+	for (i = 0; i < TRACE_EVENTS; i++)
+		gdev_trace(&devs[1 + id % VDEV_COUNT], GDEV_TRACE_ENQUEUE, GDEV_TRACE_COMPUTE, id, i);
+
+	return NULL;
+}
+
+static int check_trace_writers(void)
+{
+	pthread_t thread[TRACE_WRITERS];
+	struct gdev_trace_event ev;
+	int64_t last[TRACE_WRITERS];
+	uint32_t pos = 0;
+	long i;
+	int n = 0;
+
+	init_devices(GDEV_VSCHED_BAND);
+	devs[0].trace.enabled = 1;
+	for (i = 0; i < TRACE_WRITERS; i++) {
+		last[i] = -1;
+		pthread_create(&thread[i], NULL, trace_thread, (void *)i);
+	}
+	for (i = 0; i < TRACE_WRITERS; i++)
+		pthread_join(thread[i], NULL);
+
+	while (gdev_trace_read(&devs[0].trace, &pos, &ev)) {
+		if (ev.cid < 0 || ev.cid >= TRACE_WRITERS ||
+			ev.vid != 1 + ev.cid % VDEV_COUNT || ev.val != last[ev.cid] + 1) {
+			printf("trace: broken event %d: vid %d cid %d val %lld\n",
+				   n, ev.vid, ev.cid, (long long)ev.val);
+			return -1;
+		}
+		last[ev.cid] = ev.val;
+		n++;
+	}
+	if (n != TRACE_WRITERS * TRACE_EVENTS) {
+		printf("trace: %d events read, %d recorded\n", n, TRACE_WRITERS * TRACE_EVENTS);
+		return -1;
+	}
+
+	return 0;
+}
+
+/* nanoseconds per launch of a context alone on the device, untraced in
+   @off and traced in @on. the rounds alternate, so that the host slows
+   down both alike, and the best of them is taken. */
+static void trace_launch_cost(unsigned long *off, unsigned long *on)
+{
+	struct context c;
+	struct gdev_time start, end, elapse;
+	unsigned long cost, *best;
+	int i, r;
+
+	init_devices(GDEV_VSCHED_BAND);
+	memset(&c, 0, sizeof(c));
+	current = &c.task;
+	c.gdev = &devs[1];
+	c.gdev->users++;
+	devs[0].users++;
+	c.se = gdev_sched_entity_create(c.gdev, &c.ctx);
+	*off = *on = ~0UL;
+
+	for (r = 0; r < TRACE_ROUNDS * 2; r++) {
+		devs[0].trace.enabled = r % 2;
+		best = r % 2 ? on : off;
+		gdev_time_stamp(&start);
+		for (i = 0; i < TRACE_LOOPS; i++) {
+			gdev_schedule_compute(c.se);
+			gdev_select_next_compute(c.gdev);
+		}
+		gdev_time_stamp(&end);
+		gdev_time_sub(&elapse, &end, &start);
+		cost = gdev_time_to_ns(&elapse) / TRACE_LOOPS;
+		if (cost < *best)
+			*best = cost;
+	}
+
+	gdev_sched_entity_destroy(c.se);
+	current = NULL;
+}
+
+/* the ring keeps the latest launches, dispatches and completions in turn. */
+static int check_trace_launches(void)
+{
+	struct gdev_trace_event ev;
+	uint64_t ts = 0;
+	uint32_t pos = 0;
+	int n = 0;
+
+	while (gdev_trace_read(&devs[0].trace, &pos, &ev)) {
+		if (ev.type != (n % 2 ? GDEV_TRACE_COMPLETE : GDEV_TRACE_DISPATCH) ||
+			ev.vid != 1 || ev.ts < ts) {
+			printf("trace: unexpected %s of vd%d at %d\n",
+				   gdev_trace_type_name(ev.type), ev.vid, n);
+			return -1;
+		}
+		ts = ev.ts;
+		n++;
+	}
+	if (n != GDEV_TRACE_COUNT || pos != TRACE_LOOPS * TRACE_ROUNDS * 2) {
+		printf("trace: %d events up to %u\n", n, pos);
+		return -1;
+	}
+
+	return 0;
+}
+
+static int trace_events(void)
+{
+	unsigned long off, on;
+
+	if (check_trace_writers())
+		return -1;
+
+	trace_launch_cost(&off, &on);
+	if (check_trace_launches())
+		return -1;
+
+	printf("trace: launch cost %luns untraced %luns traced\n", off, on);
+	if (on * 100 > off * (100 + TRACE_OVERHEAD)) {
+		printf("tracing costs too much\n");
+		return -1;
+	}
+
+	return 0;
+}
+
+/**
+ * swap-in prefetch: a context whose data has been swapped out gets it back
+ * on the copy engine while another context occupies the compute engine, so
+ * that the swap-in no longer adds up to the latency of its launches.
+ */
+#define BUSY_US 5000 /* execution time of one launch of the busy context. */
+#define SWAPIN_US 3000 /* copy engine time to swap the data back. */
+#define PREFETCH_US 1000000
+#define PREFETCH_GAIN 80 /* percent of the latency without prefetch at most. */
+
+static int prefetching = 0;
+
+static void *busy_thread(void *arg)
+{
+	struct context *c = arg;
+
+	current = &c->task;
+	c->se = gdev_sched_entity_create(c->gdev, &c->ctx);
+
+	while (!stop) {
+		gdev_schedule_compute(c->se);
+		enter(c->gdev);
+		usleep(BUSY_US);
+		leave(c->gdev);
+		gdev_select_next_compute(c->gdev);
+		c->exec += BUSY_US;
+		c->launches++;
+	}
+
+	return NULL;
+}
+
+static int swapped;
+
+/* swap the data back on the copy engine, as __prefetch() in gdev_api.c. */
+static void swap_in(void *arg)
+{
+	struct context *c = arg;
+	int *engine;
+
+	gdev_schedule_memory(c->se);
+	engine = copy_engine(c->gdev);
+	__enter(engine, c->gdev);
+	usleep(SWAPIN_US);
+	__leave(engine, c->gdev);
+	gdev_select_next_memory(c->gdev);
+	swapped = 0;
+	c->budget++; /* # of prefetches */
+}
+
+/* mirror glaunch(): the data is swapped out again by others every time. */
+static void *swapped_thread(void *arg)
+{
+	struct context *c = arg;
+	struct gdev_time start, end, elapse;
+
+	current = &c->task;
+	c->se = gdev_sched_entity_create(c->gdev, &c->ctx);
+
+	while (!stop) {
+		swapped = 1;
+		gdev_time_stamp(&start);
+		gdev_schedule_compute_wait(c->se, prefetching ? swap_in : NULL, c);
+		enter(c->gdev);
+		if (swapped)
+			usleep(SWAPIN_US);
+		usleep(SHORT_US);
+		leave(c->gdev);
+		gdev_select_next_compute(c->gdev);
+		gdev_time_stamp(&end);
+		c->exec += SHORT_US;
+
+		gdev_time_sub(&elapse, &end, &start);
+		if (c->launches < LATENCY_SAMPLES)
+			latency[c->launches++] = gdev_time_to_us(&elapse);
+		usleep(THINK_US);
+	}
+
+	return NULL;
+}
+
+/* return the mean latency (us) of swapped launches, or -1 on violations. */
+static long run_prefetch(int prefetch)
+{
+	struct context c[2];
+	struct context *swapped = &c[1];
+	pthread_t replenish;
+	unsigned long sum = 0;
+	int i, n;
+
+	init_devices(GDEV_VSCHED_BAND);
+	gdev_sched_queueing_set(&devs[1], GDEV_SCHED_MRQ);
+	memset(c, 0, sizeof(c));
+	memset(running, 0, sizeof(running));
+	memset(running_mem, 0, sizeof(running_mem));
+	violations = 0;
+	exclusive = 1;
+	prefetching = prefetch;
+	stop = 0;
+
+	for (i = 0; i < 2; i++) {
+		c[i].gdev = &devs[1];
+		c[i].gdev->users++;
+		devs[0].users++;
+		c[i].ctx.cid = i;
+		c[i].task.wakeups = 0;
+	}
+	pthread_create(&replenish, NULL, replenish_thread, NULL);
+	pthread_create(&c[0].thread, NULL, busy_thread, &c[0]);
+	pthread_create(&swapped->thread, NULL, swapped_thread, swapped);
+
+	usleep(PREFETCH_US);
+	stop = 1;
+
+	for (i = 0; i < 2; i++)
+		pthread_join(c[i].thread, NULL);
+	pthread_join(replenish, NULL);
+
+	n = swapped->launches;
+	for (i = 0; i < n; i++)
+		sum += latency[i];
+	if (!c[0].launches || !n) {
+		printf("prefetch: a context made no progress\n");
+		violations++;
+	}
+	if (prefetch && !swapped->budget) {
+		printf("prefetch: the swapped context never waits\n");
+		violations++;
+	}
+
+	for (i = 0; i < 2; i++) {
+		gdev_sched_entity_destroy(c[i].se);
+		free(c[i].se);
+	}
+	for (i = 1; i < 1 + VDEV_MAX; i++)
+		gdev_exit_scheduler(&devs[i]);
+
+	return violations ? -1 : (long)(n ? sum / n : 0);
+}
+
+static int prefetch_swap(void)
+{
+	long demand, prefetch;
+
+	demand = run_prefetch(0);
+	prefetch = run_prefetch(1);
+	if (demand < 0 || prefetch < 0)
+		return -1;
+
+	printf("prefetch: swapped launch latency mean on demand %ldus prefetched %ldus\n",
+		   demand, prefetch);
+	if (prefetch * 100 > demand * PREFETCH_GAIN) {
+		printf("swap-in does not overlap other launches\n");
+		return -1;
+	}
+
+	return 0;
+}
+
+/**
+ * the swap-in waits for the copy engine while its launch is queued for the
+ * compute engine, so that the compute wakeup may come first. it must not
+ * end the memory wait, in which the entity is still queued.
+ */
+#define WAKEUP_WAIT_US 1000000
+
+/* wait until @c sleeps @n times, or return -1. */
+static int wait_sleeps(struct context *c, int n)
+{
+	int us;
+
+	for (us = 0; c->task.sleeps < n; us += 1000) {
+		if (us >= WAKEUP_WAIT_US)
+			return -1;
+		usleep(1000);
+	}
+	usleep(10000); /* into the futex. */
+
+	return 0;
+}
+
+static void copy_in(void *arg)
+{
+	struct context *c = arg;
+
+	gdev_schedule_memory(c->se);
+	c->budget++; /* # of copies */
+	gdev_select_next_memory(c->gdev);
+}
+
+static void *prefetching_thread(void *arg)
+{
+	struct context *c = arg;
+
+	current = &c->task;
+	gdev_schedule_compute_wait(c->se, copy_in, c);
+	c->launches++;
+	gdev_select_next_compute(c->gdev);
+
+	return NULL;
+}
+
+static void *copying_thread(void *arg)
+{
+	struct context *c = arg;
+
+	current = &c->task;
+	copy_in(c);
+
+	return NULL;
+}
+
+static int prefetch_wakeup(void)
+{
+	struct context c[4]; /* copy, launch, prefetch, copy behind it. */
+	struct gdev_device *gdev = &devs[1];
+	struct gdev_sched_entity *se;
+	struct gdev_time later;
+	int i, n;
+
+	init_devices(GDEV_VSCHED_FIFO);
+	gdev_sched_queueing_set(gdev, GDEV_SCHED_MRQ);
+	memset(c, 0, sizeof(c));
+	for (i = 0; i < 4; i++) {
+		c[i].gdev = gdev;
+		c[i].ctx.cid = i;
+		current = &c[i].task;
+		c[i].se = gdev_sched_entity_create(gdev, &c[i].ctx);
+	}
+	/* the entities with deadlines are queued in order of the deadlines. */
+	if (gdev_sched_entity_set_deadline(c[2].se, 10000, 0) ||
+		gdev_sched_entity_set_deadline(c[3].se, 10000, 0)) {
+		printf("prefetch: deadlines are not admitted\n");
+		return -1;
+	}
+
+	/* the copy engine and the compute engine are both taken. */
+	current = &c[0].task;
+	gdev_schedule_memory(c[0].se);
+	gdev_schedule_compute(c[1].se);
+
+	pthread_create(&c[2].thread, NULL, prefetching_thread, &c[2]);
+	if (wait_sleeps(&c[2], 1))
+		goto fail_sleep;
+	gdev_time_stamp(&later);
+	gdev_time_us(&c[3].se->abs_deadline, 1000000);
+	gdev_time_add(&c[3].se->abs_deadline, &c[3].se->abs_deadline, &later);
+	pthread_create(&c[3].thread, NULL, copying_thread, &c[3]);
+	if (wait_sleeps(&c[3], 1))
+		goto fail_sleep;
+
+	/* the compute engine is handed over to the prefetching entity. */
+	gdev_select_next_compute(gdev);
+	usleep(10000);
+
+	n = 0;
+	gdev_list_for_each (se, gdev_queue_level(&gdev->sched_mem_queue, GDEV_QUEUE_LEVELS - 1), list_entry_mem) {
+		if (++n > 2 || se != c[n + 1].se)
+			break;
+	}
+	if (n != 2) {
+		printf("prefetch: the memory queue is broken by a compute wakeup\n");
+		return -1;
+	}
+
+	gdev_select_next_memory(gdev);
+	for (i = 2; i < 4; i++)
+		pthread_join(c[i].thread, NULL);
+	if (c[2].budget != 1 || c[2].launches != 1 || c[3].budget != 1) {
+		printf("prefetch: the waiting entities are not served\n");
+		return -1;
+	}
+
+	for (i = 0; i < 4; i++) {
+		gdev_sched_entity_destroy(c[i].se);
+		free(c[i].se);
+	}
+	for (i = 1; i < 1 + VDEV_MAX; i++)
+		gdev_exit_scheduler(&devs[i]);
+
+	return 0;
+
+fail_sleep:
+	printf("prefetch: the entities do not wait\n");
+	return -1;
+}
+
+#define SHORT_LAUNCHES 5000
+#define SHORT_MIN_NS 20000 /* launches of 20us to 80us. */
+#define SHORT_MAX_NS 80000
+#define TRUNCATE_MIN_NS 250 /* lost per launch by truncation at least, in mean. */
+
+/* spin for @ns nanoseconds as a short kernel does on the compute engine. */
+static void spin(int64_t ns)
+{
+	struct gdev_time start, now, elapse;
+
+	gdev_time_stamp(&start);
+	do {
+		gdev_time_stamp(&now);
+		gdev_time_sub(&elapse, &now, &start);
+	} while (gdev_time_to_ns(&elapse) < ns);
+}
+
+static int64_t abs_ns(int64_t ns)
+{
+	return ns < 0 ? -ns : ns;
+}
+
+/**
+ * the time of short launches accumulated by the scheduler. the credit is
+ * charged the nanoseconds each launch takes, and com_time carries what is
+ * below a microsecond over, so it must add up to the charged time, while
+ * truncating the same spans to microseconds per launch loses half a
+ * microsecond each in mean. the charge is compared with the span measured
+ * here around the launch, and with microsecond stamps over the very same
+ * span, as the time base used to be, so that the scheduler overhead is in
+ * neither. the medians are checked, since the host may preempt a launch
+ * in between the stamps of the scheduler and ours.
+ */
+static int account_short(void)
+{
+	struct context c;
+	struct gdev_device *gdev = &devs[1];
+	struct gdev_time start, end, exec, credit;
+	static unsigned long err[SHORT_LAUNCHES], us_err[SHORT_LAUNCHES];
+	int64_t busy = 0, charged = 0, truncated = 0, stamped = 0;
+	int64_t err_sum = 0, us_err_sum = 0, ns, us;
+	int i;
+
+	init_devices(GDEV_VSCHED_NULL);
+	memset(&c, 0, sizeof(c));
+	c.task.wakeups = 0;
+	current = &c.task;
+	c.gdev = gdev;
+	c.se = gdev_sched_entity_create(c.gdev, &c.ctx);
+	srand(0);
+
+	for (i = 0; i < SHORT_LAUNCHES; i++) {
+		ns = SHORT_MIN_NS + rand() % (SHORT_MAX_NS - SHORT_MIN_NS);
+		credit = gdev->credit_com;
+		gdev_schedule_compute(c.se);
+		gdev_time_stamp(&start);
+		spin(ns);
+		gdev_time_stamp(&end);
+		gdev_select_next_compute(c.gdev);
+
+		gdev_time_sub(&exec, &end, &start);
+		busy += gdev_time_to_ns(&exec);
+		/* the nanoseconds the scheduler charged for this launch. */
+		gdev_time_sub(&credit, &credit, &gdev->credit_com);
+		charged += gdev_time_to_ns(&credit);
+		truncated += gdev_time_to_us(&credit);
+		err[i] = abs_ns(gdev_time_to_ns(&credit) - gdev_time_to_ns(&exec));
+		err_sum += err[i];
+		/* the same span between stamps of a microsecond clock. */
+		us = gdev_time_to_us(&end) - gdev_time_to_us(&start);
+		stamped += us;
+		us_err[i] = abs_ns(us * 1000 - gdev_time_to_ns(&exec));
+		us_err_sum += us_err[i];
+	}
+
+	gdev_sched_entity_destroy(c.se);
+	free(c.se);
+	gdev_exit_scheduler(gdev);
+
+	qsort(err, SHORT_LAUNCHES, sizeof(err[0]), compare_ulong);
+	qsort(us_err, SHORT_LAUNCHES, sizeof(us_err[0]), compare_ulong);
+	printf("accounting %d launches of %d-%dus: busy %lldus, charged %lldus (%+.2f%%)\n",
+		   SHORT_LAUNCHES, SHORT_MIN_NS / 1000, SHORT_MAX_NS / 1000,
+		   (long long)(busy / 1000), (long long)(charged / 1000),
+		   (charged - busy) * 100.0 / busy);
+	printf("  com_time %luus (%+.2f%%), truncated per launch %lldus (%+.2f%%)\n",
+		   (unsigned long)gdev->com_time, (gdev->com_time * 1000.0 - charged) * 100 / charged,
+		   (long long)truncated, (truncated * 1000.0 - charged) * 100 / charged);
+	printf("  error per launch mean %lldns median %luns, by microsecond stamps mean %lldns median %luns (%lldus in total)\n",
+		   (long long)(err_sum / SHORT_LAUNCHES), err[SHORT_LAUNCHES / 2],
+		   (long long)(us_err_sum / SHORT_LAUNCHES), us_err[SHORT_LAUNCHES / 2],
+		   (long long)stamped);
+
+	if (gdev->com_time != (unsigned long)(charged / 1000)) {
+		printf("com_time does not add up to the time charged\n");
+		return -1;
+	}
+	if (charged - truncated * 1000 < (int64_t)SHORT_LAUNCHES * TRUNCATE_MIN_NS) {
+		printf("truncation loses less than the accounting carries over\n");
+		return -1;
+	}
+	if (err[SHORT_LAUNCHES / 2] >= us_err[SHORT_LAUNCHES / 2]) {
+		printf("the charge is no closer than microsecond stamps\n");
+		return -1;
+	}
+
+	return 0;
+}
+
+int gdev_test_vsched(void)
+{
+	uint32_t misses[GDEV_VSCHED_POLICY_COUNT];
+	int i;
+
+	for (i = 0; i < GDEV_VSCHED_POLICY_COUNT; i++) {
+		if (run_policy(i))
+			return -1;
+	}
+
+	if (switch_policy())
+		return -1;
+
+	if (admit_deadline())
+		return -1;
+
+	for (i = 0; i < GDEV_VSCHED_POLICY_COUNT; i++) {
+		/* no virtual device scheduling at all. */
+		if (i == GDEV_VSCHED_NULL)
+			continue;
+		if (run_periodic(i, &misses[i]))
+			return -1;
+	}
+	/* the short deadlines are met under EDF, but not in the order of
+	   arrivals. */
+	if (misses[GDEV_VSCHED_EDF] >= misses[GDEV_VSCHED_FIFO]) {
+		printf("edf missed %u deadlines, fifo %u\n", misses[GDEV_VSCHED_EDF], misses[GDEV_VSCHED_FIFO]);
+		return -1;
+	}
+
+	/* fair queueing against the credit-based policies. */
+	if (run_weighted(GDEV_VSCHED_BAND) ||
+		run_weighted(GDEV_VSCHED_CREDIT) ||
+		run_weighted(GDEV_VSCHED_SFQ))
+		return -1;
+
+	for (i = 0; i < GDEV_VSCHED_POLICY_COUNT; i++) {
+		if (compare_queueing(i))
+			return -1;
+	}
+
+	if (throttle_memory())
+		return -1;
+
+	if (throttle_engine())
+		return -1;
+
+	if (slice_grid())
+		return -1;
+
+	if (trace_events())
+		return -1;
+
+	if (prefetch_swap())
+		return -1;
+
+	if (prefetch_wakeup())
+		return -1;
+
+	if (account_short())
+		return -1;
+
+	return 0;
+}
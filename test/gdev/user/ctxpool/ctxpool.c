@@ -0,0 +1 @@
+#include "../../common/ctxpool.c"
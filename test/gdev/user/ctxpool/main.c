@@ -0,0 +1,13 @@
+#include <stdio.h>
+
+int gdev_test_ctxpool(void);
+
+int main(int argc, char *argv[])
+{
+	if (gdev_test_ctxpool() < 0)
+		printf("Test failed\n");
+	else
+		printf("Test passed\n");
+
+	return 0;
+}
@@ -0,0 +1 @@
+../../common/futex.c
\ No newline at end of file
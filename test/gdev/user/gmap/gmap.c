@@ -0,0 +1 @@
+../../common/gmap.c
\ No newline at end of file
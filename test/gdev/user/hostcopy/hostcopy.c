@@ -0,0 +1 @@
+../../common/hostcopy.c
\ No newline at end of file
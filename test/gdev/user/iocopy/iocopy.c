@@ -0,0 +1 @@
+../../common/iocopy.c
\ No newline at end of file
@@ -0,0 +1 @@
+#include "../../common/mthread.c"
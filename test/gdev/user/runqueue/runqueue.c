@@ -0,0 +1 @@
+../../common/runqueue.c
\ No newline at end of file
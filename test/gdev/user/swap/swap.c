@@ -0,0 +1 @@
+../../common/swap.c
\ No newline at end of file
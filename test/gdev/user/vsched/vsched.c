@@ -0,0 +1 @@
+../../common/vsched.c
\ No newline at end of file
@@ -0,0 +1,85 @@
+/*
+ * convert the scheduler event trace of Gdev into Chrome trace JSON, which
+ * can be loaded by chrome://tracing or Perfetto.
+ *
+ * usage: gtrace [trace file] > trace.json
+ * the trace file is /proc/gdev/pd0/trace by default. it can also be the
+ * file written by gdev_usched_monitor when GDEV_TRACE is set.
+ *
+ * each virtual device is shown as a process, and each context as a thread
+ * of it. completions are shown as slices of their execution time, credits
+ * as counters, and the others as instant events.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define VDEV_MAX 256
+
+int main(int argc, char *argv[])
+{
+	const char *fname = "/proc/gdev/pd0/trace";
+	char line[256], type[32], res[32];
+	unsigned long long ts, base = 0;
+	long long val;
+	int vid, cid, n = 0, i;
+	int seen[VDEV_MAX] = {0};
+	FILE *fp;
+
+	if (argc > 1)
+		fname = argv[1];
+	if (!strcmp(fname, "-"))
+		fp = stdin;
+	else if (!(fp = fopen(fname, "r"))) {
+		perror(fname);
+		return 1;
+	}
+
+	printf("{\"traceEvents\":[\n");
+	while (fgets(line, sizeof(line), fp)) {
+		if (sscanf(line, "%llu %31s %31s %d %d %lld",
+				   &ts, type, res, &vid, &cid, &val) != 6)
+			continue;
+		if (!n)
+			base = ts;
+		ts = ts > base ? ts - base : 0;
+		if (vid >= 0 && vid < VDEV_MAX)
+			seen[vid] = 1;
+		if (n++)
+			printf(",\n");
+
+		if (!strcmp(type, "complete")) {
+			/* val is the execution time. */
+			if (val > (long long)ts)
+				val = ts;
+			printf("{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"ts\":%llu,"
+				   "\"dur\":%lld,\"pid\":%d,\"tid\":%d}",
+				   res, type, ts - val, val, vid, cid);
+		}
+		else if (!strcmp(type, "replenish")) {
+			printf("{\"name\":\"credit %s\",\"ph\":\"C\",\"ts\":%llu,"
+				   "\"pid\":%d,\"args\":{\"us\":%lld}}",
+				   res, ts, vid, val);
+		}
+		else {
+			printf("{\"name\":\"%s %s\",\"cat\":\"%s\",\"ph\":\"i\",\"s\":\"t\","
+				   "\"ts\":%llu,\"pid\":%d,\"tid\":%d,\"args\":{\"val\":%lld}}",
+				   type, res, type, ts, vid, cid, val);
+		}
+	}
+
+	for (i = 0; i < VDEV_MAX; i++) {
+		if (!seen[i])
+			continue;
+		if (n++)
+			printf(",\n");
+		printf("{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,"
+			   "\"args\":{\"name\":\"vd%d\"}}", i, i);
+	}
+	printf("\n]}\n");
+
+	if (fp != stdin)
+		fclose(fp);
+
+	return 0;
+}
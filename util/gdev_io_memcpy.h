@@ -29,14 +29,168 @@
 #ifndef __GDEV_IO_MEMCPY_H__
 #define __GDEV_IO_MEMCPY_H__
 
-/* this ensures that SSE is not applied to memcpy. */
+#define GDEV_IO_MEMCPY_STREAM_MIN 512 /* bytes worth streaming to I/O memory */
+
+#ifndef __KERNEL__
+#include <stdint.h>
+#include <string.h>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#if defined(__SSE4_1__)
+#include <smmintrin.h>
+#endif
+#endif
+
+/* words on the host side may be unaligned. */
+static inline uint32_t __gdev_io_load32(const void *p)
+{
+	uint32_t v;
+	memcpy(&v, p, 4);
+	return v;
+}
+
+static inline uint64_t __gdev_io_load64(const void *p)
+{
+	uint64_t v;
+	memcpy(&v, p, 8);
+	return v;
+}
+
+static inline void __gdev_io_store64(void *p, uint64_t v)
+{
+	memcpy(p, &v, 8);
+}
+
+/**
+ * this ensures that SSE is not applied to memcpy: every byte is accessed 
+ * once by a volatile access, by 64-bit words at the aligned destination, 
+ * and then a 32-bit word and bytes at the end.
+ */
 static inline void* gdev_io_memcpy(void* s1, const void* s2, size_t n)
 {
-    volatile char* out = (volatile char*)s1;
-    const volatile char* in = (const volatile char*)s2;
-    size_t i;
-    for (i = 0; i < n; ++i) out[i] = in[i];
-    return s1;
+	volatile char* out = (volatile char*)s1;
+	const volatile char* in = (const volatile char*)s2;
+
+	for (; n && ((unsigned long)out & 7); n--)
+		*out++ = *in++;
+
+	if (((unsigned long)in & 7) == 0) {
+		for (; n >= 8; n -= 8, out += 8, in += 8)
+			*(volatile uint64_t*)out = *(const volatile uint64_t*)in;
+	}
+	else {
+		for (; n >= 8; n -= 8, out += 8, in += 8)
+			*(volatile uint64_t*)out = __gdev_io_load64((const void*)in);
+	}
+	if (n >= 4) {
+		if ((unsigned long)in & 3)
+			*(volatile uint32_t*)out = __gdev_io_load32((const void*)in);
+		else
+			*(volatile uint32_t*)out = *(const volatile uint32_t*)in;
+		out += 4;
+		in += 4;
+		n -= 4;
+	}
+
+	for (; n; n--)
+		*out++ = *in++;
+
+	return s1;
+}
+
+/**
+ * copy host memory to I/O memory, e.g., the write-combined BAR. the I/O 
+ * side is written by aligned words, 16 bytes at a time by non-temporal 
+ * stores if SSE2 is available and the copy is long enough, which are 
+ * fenced so that they reach the device before any following doorbell.
+ */
+static inline void* gdev_io_memcpy_toio(void* io, const void* src, size_t n)
+{
+	volatile char* out = (volatile char*)io;
+	const char* in = (const char*)src;
+
+	for (; n && ((unsigned long)out & 7); n--)
+		*out++ = *in++;
+
+#if !defined(__KERNEL__) && defined(__SSE2__)
+	/* the fence costs more than a short copy gains. */
+	if (n < GDEV_IO_MEMCPY_STREAM_MIN)
+		goto words;
+	if ((unsigned long)out & 15) {
+		*(volatile uint64_t*)out = __gdev_io_load64(in);
+		out += 8;
+		in += 8;
+		n -= 8;
+	}
+	for (; n >= 64; n -= 64, out += 64, in += 64) {
+		__m128i x0 = _mm_loadu_si128((const __m128i*)in);
+		__m128i x1 = _mm_loadu_si128((const __m128i*)(in + 16));
+		__m128i x2 = _mm_loadu_si128((const __m128i*)(in + 32));
+		__m128i x3 = _mm_loadu_si128((const __m128i*)(in + 48));
+		_mm_stream_si128((__m128i*)out, x0);
+		_mm_stream_si128((__m128i*)(out + 16), x1);
+		_mm_stream_si128((__m128i*)(out + 32), x2);
+		_mm_stream_si128((__m128i*)(out + 48), x3);
+	}
+	_mm_sfence();
+words:
+#endif
+
+	for (; n >= 8; n -= 8, out += 8, in += 8)
+		*(volatile uint64_t*)out = __gdev_io_load64(in);
+	for (; n; n--)
+		*out++ = *in++;
+
+	return io;
+}
+
+/**
+ * copy I/O memory to host memory. every read of the BAR is a round trip 
+ * to the device, so the I/O side is read by aligned words as wide as 
+ * possible, by streaming loads that fetch write-combined memory by lines 
+ * if SSE4.1 is available, or 16 bytes at a time if SSE2 is.
+ */
+static inline void* gdev_io_memcpy_fromio(void* dst, const void* io, size_t n)
+{
+	char* out = (char*)dst;
+	const volatile char* in = (const volatile char*)io;
+
+	for (; n && ((unsigned long)in & 7); n--)
+		*out++ = *in++;
+
+#if !defined(__KERNEL__) && defined(__SSE2__)
+	if (n >= 8 && ((unsigned long)in & 15)) {
+		__gdev_io_store64(out, *(const volatile uint64_t*)in);
+		out += 8;
+		in += 8;
+		n -= 8;
+	}
+	for (; n >= 64; n -= 64, out += 64, in += 64) {
+#if defined(__SSE4_1__)
+		__m128i x0 = _mm_stream_load_si128((__m128i*)in);
+		__m128i x1 = _mm_stream_load_si128((__m128i*)(in + 16));
+		__m128i x2 = _mm_stream_load_si128((__m128i*)(in + 32));
+		__m128i x3 = _mm_stream_load_si128((__m128i*)(in + 48));
+#else
+		__m128i x0 = _mm_load_si128((const __m128i*)in);
+		__m128i x1 = _mm_load_si128((const __m128i*)(in + 16));
+		__m128i x2 = _mm_load_si128((const __m128i*)(in + 32));
+		__m128i x3 = _mm_load_si128((const __m128i*)(in + 48));
+#endif
+		_mm_storeu_si128((__m128i*)out, x0);
+		_mm_storeu_si128((__m128i*)(out + 16), x1);
+		_mm_storeu_si128((__m128i*)(out + 32), x2);
+		_mm_storeu_si128((__m128i*)(out + 48), x3);
+	}
+#endif
+
+	for (; n >= 8; n -= 8, out += 8, in += 8)
+		__gdev_io_store64(out, *(const volatile uint64_t*)in);
+	for (; n; n--)
+		*out++ = *in++;
+
+	return dst;
 }
 
 #endif  /* __GDEV_IO_MEMCPY_H__ */